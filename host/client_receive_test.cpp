@@ -0,0 +1,204 @@
+// Drives the receive path of scripts/udp_client.cpp with scripted packet orders and clocks: the
+// JitterBuffer (jitter_buffer.h) has to put reordered packets back in place without concealing
+// anything, conceal a packet that never comes once the window is full, count it as late when it
+// shows up after all and widen the window, and unwrap sequence and sample counters across 2^32.
+// The LossDetector (loss_detector.h) has to NACK a hole when a later packet shows it, ask again
+// only after twice the minimum retry until a round trip is measured and after the smoothed round
+// trip plus four deviations from then on, leave retried holes out of the round trip (Karn), stop
+// after three attempts and give a hole up once as many packets are in behind it as the deadline.
+//
+// Build: see CMakeLists.txt
+// Run:   client_receive_test
+//        the exit code says whether every check passed
+#include "jitter_buffer.h"
+#include "loss_detector.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+namespace {
+
+using namespace std::chrono_literals;
+using Clock = LossDetector::Clock;
+
+constexpr size_t PACKET_SAMPLES = 160;
+
+int failed = 0;
+
+void Check(bool ok, const char* what) {
+    if (!ok) {
+        printf("FAILED: %s\n", what);
+        failed++;
+    }
+}
+
+/* sample values that say where on the timeline they belong */
+int16_t SampleAt(uint32_t index) {
+    return static_cast<int16_t>(index * 7);
+}
+
+struct Stream {
+    std::vector<int16_t> out;
+    JitterBuffer buffer{[this](const int16_t* samples, size_t count) { out.insert(out.end(), samples, samples + count); }};
+    uint32_t first_sequence;
+    uint32_t first_index;
+
+    Stream(uint32_t first_sequence, uint32_t first_index)
+        : first_sequence(first_sequence), first_index(first_index) {}
+
+    void Push(uint32_t packet) {
+        uint32_t index = first_index + packet * PACKET_SAMPLES;
+        int16_t samples[PACKET_SAMPLES];
+        for (size_t i = 0; i < PACKET_SAMPLES; i++) {
+            samples[i] = SampleAt(index + static_cast<uint32_t>(i));
+        }
+        buffer.push(first_sequence + packet, index, samples, PACKET_SAMPLES);
+    }
+
+    /* the output matches the timeline from packet first on, concealed samples excepted */
+    bool Matches(size_t first_sample, size_t count) const {
+        if (first_sample + count > out.size()) {
+            return false;
+        }
+        for (size_t i = first_sample; i < first_sample + count; i++) {
+            if (out[i] != SampleAt(first_index + static_cast<uint32_t>(i))) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+void TestReordering() {
+    // counters about to wrap, as on a device that has been up for a while
+    Stream stream(0xFFFFFFF0u, 0xFFFFF000u);
+    stream.buffer.set_min_depth(4);
+    const uint32_t order[] = {0, 1, 2, 4, 3, 5, 6, 9, 7, 8, 10, 12, 13, 11, 14, 15, 16, 17, 18, 19};
+    for (uint32_t packet : order) {
+        stream.Push(packet);
+    }
+    stream.buffer.flush();
+    JitterBuffer::Stats stats = stream.buffer.get_stats();
+    printf("reordering: %" PRIu64 " received, %" PRIu64 " reordered, %" PRIu64 " late, %" PRIu64
+           " lost, %" PRIu64 " samples concealed\n",
+           stats.received_packets, stats.reordered_packets, stats.late_packets, stats.lost_packets,
+           stats.concealed_samples);
+    Check(stream.out.size() == 20 * PACKET_SAMPLES, "reordering: the timeline has a gap or an overlap");
+    Check(stream.Matches(0, 20 * PACKET_SAMPLES), "reordering: the samples are out of place");
+    Check(stats.reordered_packets == 4, "reordering: four packets arrived after a later one");
+    Check(stats.concealed_samples == 0, "reordering: a packet within the window was concealed");
+    Check(stats.late_packets == 0 && stats.lost_packets == 0, "reordering: a packet counted late or lost");
+}
+
+void TestLatePacket() {
+    Stream stream(100, 48000);
+    stream.buffer.set_min_depth(4);
+    // packet 5 is missing until the window has moved past it
+    for (uint32_t packet = 0; packet < 12; packet++) {
+        if (packet != 5) {
+            stream.Push(packet);
+        }
+    }
+    size_t target_before = stream.buffer.get_stats().target_depth_samples;
+    Check(stream.buffer.get_stats().concealed_samples == PACKET_SAMPLES,
+          "late packet: the hole was not concealed once the window was full");
+    stream.Push(5);
+    for (uint32_t packet = 12; packet < 16; packet++) {
+        stream.Push(packet);
+    }
+    stream.buffer.flush();
+    JitterBuffer::Stats stats = stream.buffer.get_stats();
+    printf("late packet: %" PRIu64 " late, %" PRIu64 " lost, %" PRIu64 " samples concealed, window %zu -> %zu samples\n",
+           stats.late_packets, stats.lost_packets, stats.concealed_samples, target_before,
+           stats.target_depth_samples);
+    Check(stream.out.size() == 16 * PACKET_SAMPLES, "late packet: the late audio was played out a second time");
+    Check(stream.Matches(0, 5 * PACKET_SAMPLES) && stream.Matches(6 * PACKET_SAMPLES, 10 * PACKET_SAMPLES),
+          "late packet: the audio around the hole is out of place");
+    // the concealment fades the last packet out, it does not repeat it at full level
+    Check(stream.out[6 * PACKET_SAMPLES - 1] == 0, "late packet: the concealment does not fade to silence");
+    Check(stats.late_packets == 1 && stats.lost_packets == 1, "late packet: not counted as one late and lost packet");
+    Check(stats.target_depth_samples == target_before + PACKET_SAMPLES,
+          "late packet: the window did not widen by a packet");
+}
+
+struct Nack {
+    size_t bytes = 0;
+    std::vector<NackRange> ranges;
+};
+
+Nack BuildNack(LossDetector& detector, Clock::time_point now, size_t deadline_packets) {
+    char datagram[LossDetector::DATAGRAM_CAPACITY];
+    Nack nack;
+    nack.bytes = detector.build(now, deadline_packets, 10ms, datagram);
+    if (nack.bytes > sizeof(MessageHeader)) {
+        nack.ranges.resize((nack.bytes - sizeof(MessageHeader)) / sizeof(NackRange));
+        memcpy(nack.ranges.data(), datagram + sizeof(MessageHeader), nack.ranges.size() * sizeof(NackRange));
+    }
+    return nack;
+}
+
+bool Asks(const Nack& nack, uint32_t first_sequence, uint16_t count) {
+    return nack.ranges.size() == 1 && nack.ranges[0].first_sequence == first_sequence && nack.ranges[0].count == count;
+}
+
+void TestLossDetector() {
+    const Clock::time_point t0 = Clock::time_point() + 1h;
+    constexpr size_t DEADLINE = 8;
+
+    // 5 and 6 missing: one range, again after twice the minimum retry, three attempts at most
+    LossDetector detector;
+    for (uint32_t sequence : {1u, 2u, 3u, 4u, 7u}) {
+        detector.on_packet(sequence, t0);
+    }
+    Check(Asks(BuildNack(detector, t0, DEADLINE), 5, 2), "loss detector: the hole is not asked for at once");
+    Check(BuildNack(detector, t0 + 19ms, DEADLINE).bytes == 0, "loss detector: asked again before twice min_retry");
+    Check(Asks(BuildNack(detector, t0 + 20ms, DEADLINE), 5, 2), "loss detector: no retry after twice min_retry");
+    Check(Asks(BuildNack(detector, t0 + 40ms, DEADLINE), 5, 2), "loss detector: no third attempt");
+    Check(BuildNack(detector, t0 + 60ms, DEADLINE).bytes == 0, "loss detector: more than three attempts");
+    // retried, so its arrival says nothing about the round trip
+    detector.on_packet(5, t0 + 65ms);
+    Check(detector.get_stats().rtt_samples == 0, "loss detector: a retried hole gave a round trip sample");
+
+    // the deadline: given up once DEADLINE packets are in behind it, 6 of them still missing
+    for (uint32_t sequence = 8; sequence <= 12; sequence++) {
+        detector.on_packet(sequence, t0 + 70ms);
+    }
+    BuildNack(detector, t0 + 70ms, DEADLINE);
+    Check(detector.get_stats().expired == 0, "loss detector: a hole given up before its deadline");
+    detector.on_packet(13, t0 + 75ms);
+    Check(BuildNack(detector, t0 + 75ms, DEADLINE).bytes == 0, "loss detector: asked for a hole past its deadline");
+    Check(detector.get_stats().expired == 1, "loss detector: the hole past its deadline was not given up");
+
+    // a hole answered after its first request is a round trip sample, the retry follows it
+    detector.on_packet(15, t0 + 100ms);
+    Check(Asks(BuildNack(detector, t0 + 100ms, DEADLINE), 14, 1), "loss detector: the second hole is not asked for");
+    detector.on_packet(14, t0 + 130ms);
+    LossDetector::Stats stats = detector.get_stats();
+    Check(stats.rtt_samples == 1 && stats.rtt_ms > 29.9 && stats.rtt_ms < 30.1,
+          "loss detector: the round trip was not measured as 30 ms");
+
+    // now srtt + 4 rttvar = 30 + 4 * 15 ms rather than twice min_retry
+    detector.on_packet(17, t0 + 200ms);
+    Check(Asks(BuildNack(detector, t0 + 200ms, DEADLINE), 16, 1), "loss detector: the third hole is not asked for");
+    Check(BuildNack(detector, t0 + 289ms, DEADLINE).bytes == 0, "loss detector: asked again before the round trip");
+    Check(Asks(BuildNack(detector, t0 + 290ms, DEADLINE), 16, 1), "loss detector: no retry after the round trip");
+
+    stats = detector.get_stats();
+    printf("loss detector: %" PRIu64 " asked for in %" PRIu64 " NACKs, %" PRIu64 " recovered, %" PRIu64
+           " given up, round trip %.1f ms\n",
+           stats.requested, stats.nacks, stats.recovered, stats.expired, stats.rtt_ms);
+    Check(stats.requested == 4 && stats.recovered == 2, "loss detector: requested or recovered miscounted");
+}
+
+}  // namespace
+
+int main() {
+    TestReordering();
+    TestLatePacket();
+    TestLossDetector();
+    printf("%s\n", failed == 0 ? "ok" : "FAILED");
+    return failed == 0 ? 0 : 1;
+}
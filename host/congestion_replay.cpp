@@ -0,0 +1,352 @@
+// Replays scripted link traces through the firmware's CongestionController
+// (main/network/congestion_controller.h) and checks the level it settles on after each step. The
+// controller takes its time from the caller, so a minute of link behaviour replays in
+// microseconds and the same trace always gives the same answer.
+//
+// A trace is one step per line, each step lasting a number of controller windows:
+//
+//   windows=n      how many windows the step lasts (1)
+//   send=n         sendto attempts per window (33, a 30 ms packet period)
+//   fail=n         of those, how many failed
+//   expected=n     packets a receiver report expected per window, and how many were
+//   lost=n         lost (no report when expected is 0)
+//   backlog=a[-b]  ring buffer backlog in ms, ramping from a to b over each window
+//   below=n        the failures, loss and backlog only apply while the level is below n, a link
+//                  that carries level n and up (the default applies them at any level)
+//   max=n          SetMaxLevel before the step
+//
+// and the checks after its last window: level=n, hold=ms (the clean time a step up needs) and
+// retries=n. # starts a comment.
+//
+// Build: see CMakeLists.txt
+// Run:   congestion_replay [--verbose] [trace...]
+//        without a trace file it replays the built-in scenarios, the exit code says whether every
+//        check passed
+#include "congestion_controller.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t TICKS_PER_WINDOW = 100;
+
+struct Scenario {
+    const char* name;
+    const char* trace;
+};
+
+const Scenario SCENARIOS[] = {
+    {"clean link", R"(
+        windows=30 level=0 retries=2
+    )"},
+    {"one second of burst loss", R"(
+        windows=5 level=0
+        fail=10 level=1 retries=0
+        windows=4 level=1 retries=2
+        level=0                         # 5 s clean
+        windows=20 level=0 hold=5000
+    )"},
+    {"sustained congestion walks down the ladder and back", R"(
+        fail=20 level=1
+        fail=20 level=2
+        fail=20 level=3
+        fail=20 windows=5 level=3       # the bottom holds
+        windows=4 level=3
+        level=2
+        windows=4 level=2
+        level=1
+        windows=4 level=1
+        level=0 hold=5000
+    )"},
+    {"marginal windows restart the clean run", R"(
+        fail=10 level=1
+        windows=4 level=1
+        fail=1 level=1 retries=1        # 3% failed, neither clean nor congested
+        windows=4 level=1
+        level=0
+    )"},
+    {"a link at the edge backs off instead of flapping", R"(
+        below=1 fail=20 level=1         # level 0 does not fit
+        below=1 fail=20 windows=4 level=1
+        below=1 fail=20 level=0         # the first probe
+        below=1 fail=20 level=1 hold=10000
+        below=1 fail=20 windows=9 level=1
+        below=1 fail=20 level=0
+        below=1 fail=20 level=1 hold=20000
+        below=1 fail=20 windows=19 level=1
+        below=1 fail=20 level=0
+        below=1 fail=20 level=1 hold=40000
+        windows=39 level=1              # the link recovers
+        level=0
+        windows=9 level=0 hold=40000
+        level=0 hold=20000              # the step up outlived its probe
+    )"},
+    {"receiver reports of loss the sender never saw", R"(
+        expected=33 lost=3 level=1
+        expected=33 windows=4 level=1
+        expected=100 lost=1 level=0     # 1% is still clean
+    )"},
+    {"backlog growth", R"(
+        backlog=20-200 level=1          # grows 180 ms in one window
+        backlog=200-120 level=1         # draining, above the low mark
+        backlog=120-40 level=1
+        backlog=40 windows=4 level=1
+        backlog=40 level=0
+    )"},
+    {"high backlog", R"(
+        backlog=320 level=1
+        backlog=320 level=2
+    )"},
+    {"silence is no evidence", R"(
+        fail=20 level=1
+        send=0 windows=20 level=1       # no clients, nothing sent
+        windows=4 level=1
+        level=0
+    )"},
+    {"the configured rate cannot be halved", R"(
+        max=2 fail=20 windows=5 level=2
+        max=2 windows=5 level=1
+    )"},
+};
+
+struct Step {
+    uint32_t windows = 1;
+    uint32_t send = 33;
+    uint32_t fail = 0;
+    uint32_t expected = 0;
+    uint32_t lost = 0;
+    uint32_t backlog_from_ms = 0;
+    uint32_t backlog_to_ms = 0;
+    uint32_t below = CongestionController::LEVEL_COUNT;
+    int max_level = -1;
+    int expect_level = -1;
+    int64_t expect_hold_ms = -1;
+    int expect_retries = -1;
+    int line = 0;
+};
+
+bool ParseStep(const std::string& text, int line, Step& step, std::string& error) {
+    std::istringstream tokens(text.substr(0, text.find('#')));
+    std::string token;
+    bool any = false;
+    step.line = line;
+    while (tokens >> token) {
+        size_t equals = token.find('=');
+        if (equals == std::string::npos) {
+            error = "expected key=value, got '" + token + "'";
+            return false;
+        }
+        std::string key = token.substr(0, equals);
+        std::string value = token.substr(equals + 1);
+        char* end = nullptr;
+        unsigned long number = strtoul(value.c_str(), &end, 10);
+        if (key == "backlog" && *end == '-') {
+            step.backlog_from_ms = static_cast<uint32_t>(number);
+            number = strtoul(end + 1, &end, 10);
+            step.backlog_to_ms = static_cast<uint32_t>(number);
+        } else if (key == "backlog") {
+            step.backlog_from_ms = step.backlog_to_ms = static_cast<uint32_t>(number);
+        }
+        if (value.empty() || *end != '\0') {
+            error = "bad value in '" + token + "'";
+            return false;
+        }
+
+        if (key == "windows") {
+            step.windows = static_cast<uint32_t>(number);
+        } else if (key == "send") {
+            step.send = static_cast<uint32_t>(number);
+        } else if (key == "fail") {
+            step.fail = static_cast<uint32_t>(number);
+        } else if (key == "expected") {
+            step.expected = static_cast<uint32_t>(number);
+        } else if (key == "lost") {
+            step.lost = static_cast<uint32_t>(number);
+        } else if (key == "below") {
+            step.below = static_cast<uint32_t>(number);
+        } else if (key == "max") {
+            step.max_level = static_cast<int>(number);
+        } else if (key == "level") {
+            step.expect_level = static_cast<int>(number);
+        } else if (key == "hold") {
+            step.expect_hold_ms = static_cast<int64_t>(number);
+        } else if (key == "retries") {
+            step.expect_retries = static_cast<int>(number);
+        } else if (key != "backlog") {
+            error = "unknown key '" + key + "'";
+            return false;
+        }
+        any = true;
+    }
+    if (any && step.fail > step.send) {
+        error = "more failures than sends";
+        return false;
+    }
+    step.line = any ? line : 0;
+    return true;
+}
+
+bool ParseTrace(const std::string& trace, std::vector<Step>& steps) {
+    std::istringstream lines(trace);
+    std::string text;
+    int line = 0;
+    while (std::getline(lines, text)) {
+        line++;
+        Step step;
+        std::string error;
+        if (!ParseStep(text, line, step, error)) {
+            fprintf(stderr, "line %d: %s\n", line, error.c_str());
+            return false;
+        }
+        if (step.line != 0) {
+            steps.push_back(step);
+        }
+    }
+    return true;
+}
+
+const char* VerdictName(CongestionController::Verdict verdict) {
+    switch (verdict) {
+        case CongestionController::Verdict::IDLE:
+            return "idle";
+        case CongestionController::Verdict::CLEAN:
+            return "clean";
+        case CongestionController::Verdict::MARGINAL:
+            return "marginal";
+        case CongestionController::Verdict::CONGESTED:
+            return "congested";
+    }
+    return "?";
+}
+
+/* drives the controller tick by tick like the send path does, spreading each window's sends,
+   failures and backlog evenly over it. returns the number of failed checks */
+int Replay(const std::vector<Step>& steps, bool verbose) {
+    CongestionController controller;
+    uint32_t window_ms = controller.config().window_ms;
+    uint32_t tick_ms = window_ms / TICKS_PER_WINDOW;
+    uint32_t now_ms = 0;
+    uint32_t window = 0;
+    int failed = 0;
+
+    for (const Step& step : steps) {
+        if (step.max_level >= 0) {
+            controller.SetMaxLevel(static_cast<uint8_t>(step.max_level));
+        }
+
+        for (uint32_t w = 0; w < step.windows; w++) {
+            // whether the link carries the stream is decided by the level the window starts at
+            bool impaired = controller.level() < step.below;
+            uint32_t attempt = 0;
+            for (uint32_t tick = 0; tick < TICKS_PER_WINDOW; tick++) {
+                uint32_t sends = step.send * (tick + 1) / TICKS_PER_WINDOW - step.send * tick / TICKS_PER_WINDOW;
+                for (uint32_t i = 0; i < sends; i++, attempt++) {
+                    bool fails = step.fail * (attempt + 1) / step.send > step.fail * attempt / step.send;
+                    controller.OnSendAttempt(!impaired || !fails);
+                }
+                if (impaired && (step.backlog_from_ms > 0 || step.backlog_to_ms > 0)) {
+                    int64_t span = static_cast<int64_t>(step.backlog_to_ms) - step.backlog_from_ms;
+                    controller.OnBacklog(static_cast<uint32_t>(step.backlog_from_ms +
+                                                               span * static_cast<int64_t>(tick) / (TICKS_PER_WINDOW - 1)));
+                } else if (sends > 0) {
+                    controller.OnBacklog(0);
+                }
+                if (tick == TICKS_PER_WINDOW - 1 && step.expected > 0) {
+                    controller.OnReceiverReport(step.expected, impaired ? step.lost : 0);
+                }
+
+                now_ms += tick_ms;
+                uint8_t previous = controller.level();
+                bool changed = controller.Update(now_ms);
+                if (verbose && tick == TICKS_PER_WINDOW - 1) {
+                    const CongestionController::Window& last = controller.last_window();
+                    printf("  %4" PRIu32 " s  %-9s  %3" PRIu32 "/%-3" PRIu32 " failed  %3" PRIu32 "/%-3" PRIu32
+                           " lost  backlog %3" PRIu32 " ms (%+4" PRId32 ")  level %u%s  hold %" PRIu32 " ms\n",
+                           now_ms / 1000, VerdictName(last.verdict), last.failures, last.attempts, last.lost,
+                           last.expected, last.backlog_max_ms, last.backlog_growth_ms, controller.level(),
+                           changed ? (controller.level() > previous ? " down" : " up") : "",
+                           controller.up_hold_ms());
+                }
+            }
+            window++;
+        }
+
+        auto check = [&](const char* what, int64_t actual, int64_t expected) {
+            if (expected >= 0 && actual != expected) {
+                printf("  line %d, after window %" PRIu32 ": %s %" PRId64 ", expected %" PRId64 "\n", step.line,
+                       window, what, actual, expected);
+                failed++;
+            }
+        };
+        check("level", controller.level(), step.expect_level);
+        check("hold", controller.up_hold_ms(), step.expect_hold_ms);
+        check("retries", controller.send_retries(), step.expect_retries);
+    }
+    return failed;
+}
+
+bool ReadFile(const char* path, std::string& contents) {
+    std::ifstream file(path);
+    if (!file) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return false;
+    }
+    std::ostringstream buffer;
+    buffer << file.rdbuf();
+    contents = buffer.str();
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    bool verbose = false;
+    std::vector<const char*> paths;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--verbose") {
+            verbose = true;
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            fprintf(stderr, "usage: %s [--verbose] [trace...]\n", argv[0]);
+            return 1;
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+
+    int failed_runs = 0;
+    auto run = [&](const char* name, const std::string& trace) {
+        std::vector<Step> steps;
+        if (!ParseTrace(trace, steps)) {
+            printf("%-55s  invalid trace\n", name);
+            failed_runs++;
+            return;
+        }
+        if (verbose) {
+            printf("%s\n", name);
+        }
+        int failed = Replay(steps, verbose);
+        printf("%-55s  %s\n", name, failed == 0 ? "ok" : "FAILED");
+        failed_runs += failed > 0;
+    };
+
+    if (paths.empty()) {
+        for (const Scenario& scenario : SCENARIOS) {
+            run(scenario.name, scenario.trace);
+        }
+    }
+    for (const char* path : paths) {
+        std::string trace;
+        if (!ReadFile(path, trace)) {
+            return 1;
+        }
+        run(path, trace);
+    }
+    return failed_runs == 0 ? 0 : 1;
+}
@@ -0,0 +1,306 @@
+// Runs a stream of DATA packets through the firmware's FecEncoder (main/network/fec_encoder.h)
+// and the client's FecDecoder (scripts/fec_decoder.h) over a lossy link, for every group size
+// the send path uses. The stream mixes PCM16 and IMA-ADPCM packets of different lengths with
+// SILENCE and GAP descriptors, as ProtectPacket sees them, and starts just short of the 32-bit
+// sequence wrap. The link drops datagrams, parity included, one at every position of a group in
+// turn, then at random and in bursts at several loss rates. Every group that lost exactly one
+// DATA packet and kept its parity has to get that packet back byte for byte, with its
+// sample_index and codec; no other packet may come out of the decoder. Prints the fraction of
+// the lost packets recovered and the bandwidth the parity costs per group size.
+//
+// Build: see CMakeLists.txt
+// Run:   fec_test [--packets n]
+//        the exit code says whether every recovery came out right
+#include "fec_encoder.h"
+#include "ima_adpcm.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+// the client declares the wire structs the firmware's udp_protocol.h does, so its decoder goes
+// in a namespace of its own. the standard headers it includes are already in above
+namespace client {
+#include "fec_decoder.h"
+}
+
+namespace {
+
+constexpr uint8_t GROUP_SIZES[] = {2, 4, 8, 16};
+constexpr uint32_t FIRST_SEQUENCE = 0xFFFFFF00u;
+constexpr uint32_t SAMPLE_RATE = 16000;
+
+struct Datagram {
+    std::vector<uint8_t> bytes;
+    bool parity;
+    uint32_t sequence;   /* DATA only */
+};
+
+struct Shape {
+    AudioCodec codec;
+    size_t samples;
+};
+
+/* what ProtectPacket gets to see: both codecs at 5, 10, 15, 30 and 45 ms and odd lengths, and
+   the two descriptors */
+constexpr Shape SHAPES[] = {
+    {AudioCodec::PCM16, 480},     {AudioCodec::IMA_ADPCM, 480}, {AudioCodec::PCM16, 80},
+    {AudioCodec::IMA_ADPCM, 720}, {AudioCodec::SILENCE, 4800},  {AudioCodec::PCM16, 720},
+    {AudioCodec::IMA_ADPCM, 79},  {AudioCodec::PCM16, 241},     {AudioCodec::GAP, 960},
+    {AudioCodec::IMA_ADPCM, 160}, {AudioCodec::PCM16, 160},     {AudioCodec::IMA_ADPCM, 240},
+};
+
+/* the DATA packets of the stream and the parity the encoder puts out after them, in send order */
+std::vector<Datagram> BuildStream(uint8_t group_size, size_t packets) {
+    std::mt19937 generator(group_size);
+    std::normal_distribution<double> noise(0.0, 2000.0);
+    FecEncoder encoder;
+    encoder.Configure(group_size);
+    ImaAdpcmEncoder adpcm;
+    PacketBuffer data;
+    PacketBuffer parity;
+    std::vector<Datagram> stream;
+    uint32_t sample_index = 0x7FFFF000u;
+    std::vector<int16_t> samples;
+
+    for (size_t i = 0; i < packets; i++) {
+        const Shape& shape = SHAPES[i % std::size(SHAPES)];
+        uint32_t sequence = FIRST_SEQUENCE + static_cast<uint32_t>(i);
+        *data.header() = MessageHeader{
+            .type = MessageType::DATA,
+            .version = PROTOCOL_VERSION,
+            .codec = shape.codec,
+            .sample_rate_khz = SAMPLE_RATE / 1000,
+        };
+        *data.data_header() = DataHeader{.sequence = sequence, .sample_index = sample_index};
+
+        samples.resize(shape.samples);
+        for (size_t s = 0; s < samples.size(); s++) {
+            double t = static_cast<double>(sample_index + s) / SAMPLE_RATE;
+            samples[s] = static_cast<int16_t>(std::lround(8000.0 * std::sin(2.0 * M_PI * 300.0 * t) + noise(generator)));
+        }
+        switch (shape.codec) {
+            case AudioCodec::PCM16:
+                data.payload_len = samples.size() * sizeof(int16_t);
+                memcpy(data.payload(), samples.data(), data.payload_len);
+                break;
+            case AudioCodec::IMA_ADPCM:
+                adpcm.BeginBlock(data.payload());
+                adpcm.Encode(std::span<const int16_t>(samples));
+                data.payload_len = adpcm.EndBlock();
+                break;
+            case AudioCodec::SILENCE: {
+                SilenceDescriptor descriptor = {.samples = static_cast<uint32_t>(shape.samples), .noise_rms = 40};
+                data.payload_len = sizeof(descriptor);
+                memcpy(data.payload(), &descriptor, sizeof(descriptor));
+                break;
+            }
+            case AudioCodec::GAP: {
+                GapDescriptor descriptor = {.samples = static_cast<uint32_t>(shape.samples),
+                                            .reason = GapReason::SHED};
+                data.payload_len = sizeof(descriptor);
+                memcpy(data.payload(), &descriptor, sizeof(descriptor));
+                break;
+            }
+        }
+        sample_index += static_cast<uint32_t>(shape.samples);
+
+        stream.push_back({std::vector<uint8_t>(data.data(), data.data() + data.size()), false, sequence});
+        if (encoder.Protect(data, parity)) {
+            stream.push_back({std::vector<uint8_t>(parity.data(), parity.data() + parity.size()), true, 0});
+        }
+    }
+    return stream;
+}
+
+struct Outcome {
+    uint64_t data_lost = 0;
+    uint64_t recovered = 0;
+    uint64_t errors = 0;
+};
+
+/* sends the stream over a link that drops the datagrams marked in lost, checks what the decoder
+   rebuilds against what the groups make possible */
+Outcome RunLink(const std::vector<Datagram>& stream, uint8_t group_size, const std::vector<bool>& lost,
+                const char* pattern) {
+    Outcome outcome;
+    client::FecDecoder decoder;
+    std::vector<client::FecDecoder::Packet> recovered;
+    std::map<uint32_t, const Datagram*> sent;
+    // per group: the DATA packets lost, whether its parity arrived
+    std::map<uint32_t, std::vector<uint32_t>> group_losses;
+    std::set<uint32_t> parity_arrived;
+
+    for (size_t i = 0; i < stream.size(); i++) {
+        const Datagram& datagram = stream[i];
+        const uint8_t* bytes = datagram.bytes.data();
+        if (datagram.parity) {
+            ParityHeader header;
+            memcpy(&header, bytes + sizeof(MessageHeader), sizeof(header));
+            if (!lost[i]) {
+                parity_arrived.insert(header.first_sequence);
+                decoder.add_parity(bytes + sizeof(MessageHeader), datagram.bytes.size() - sizeof(MessageHeader),
+                                   recovered);
+            }
+            continue;
+        }
+        sent[datagram.sequence] = &datagram;
+        uint32_t first = FIRST_SEQUENCE + (datagram.sequence - FIRST_SEQUENCE) / group_size * group_size;
+        group_losses[first];
+        if (lost[i]) {
+            outcome.data_lost++;
+            group_losses[first].push_back(datagram.sequence);
+            continue;
+        }
+        MessageHeader message;
+        DataHeader header;
+        memcpy(&message, bytes, sizeof(message));
+        memcpy(&header, bytes + sizeof(MessageHeader), sizeof(header));
+        decoder.add_data(header.sequence, header.sample_index, static_cast<uint8_t>(message.codec),
+                         bytes + DATA_HEADERS_SIZE, datagram.bytes.size() - DATA_HEADERS_SIZE, recovered);
+    }
+
+    std::set<uint32_t> expected;
+    for (const auto& [first, losses] : group_losses) {
+        if (losses.size() == 1 && parity_arrived.count(first)) {
+            expected.insert(losses.front());
+        }
+    }
+
+    for (const client::FecDecoder::Packet& packet : recovered) {
+        outcome.recovered++;
+        auto it = sent.find(packet.sequence);
+        if (!expected.erase(packet.sequence) || it == sent.end()) {
+            if (outcome.errors++ < 5) {
+                printf("FAILED: group size %u, %s: rebuilt %" PRIu32 ", which was not recoverable\n", group_size,
+                       pattern, packet.sequence);
+            }
+            continue;
+        }
+        const std::vector<uint8_t>& original = it->second->bytes;
+        MessageHeader message;
+        DataHeader header;
+        memcpy(&message, original.data(), sizeof(message));
+        memcpy(&header, original.data() + sizeof(MessageHeader), sizeof(header));
+        bool same = packet.sample_index == header.sample_index &&
+                    packet.codec == static_cast<uint8_t>(message.codec) &&
+                    packet.payload.size() == original.size() - DATA_HEADERS_SIZE &&
+                    memcmp(packet.payload.data(), original.data() + DATA_HEADERS_SIZE, packet.payload.size()) == 0;
+        if (!same && outcome.errors++ < 5) {
+            printf("FAILED: group size %u, %s: %" PRIu32 " rebuilt with different bytes\n", group_size, pattern,
+                   packet.sequence);
+        }
+    }
+    for (uint32_t sequence : expected) {
+        if (outcome.errors++ < 5) {
+            printf("FAILED: group size %u, %s: %" PRIu32 " was the group's only loss and not rebuilt\n", group_size,
+                   pattern, sequence);
+        }
+    }
+    return outcome;
+}
+
+std::vector<bool> RandomLoss(size_t count, double rate, uint32_t seed) {
+    std::mt19937 generator(seed);
+    std::bernoulli_distribution drop(rate);
+    std::vector<bool> lost(count);
+    for (size_t i = 0; i < count; i++) {
+        lost[i] = drop(generator);
+    }
+    return lost;
+}
+
+/* gilbert-elliott: every datagram in the bad state is lost, bursts average burst datagrams */
+std::vector<bool> BurstLoss(size_t count, double rate, double burst, uint32_t seed) {
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    double leave_bad = 1.0 / burst;
+    double enter_bad = rate * leave_bad / (1.0 - rate);
+    std::vector<bool> lost(count);
+    bool bad = false;
+    for (size_t i = 0; i < count; i++) {
+        bad = uniform(generator) < (bad ? 1.0 - leave_bad : enter_bad);
+        lost[i] = bad;
+    }
+    return lost;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    size_t packets = 20000;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--packets" && i + 1 < argc) {
+            packets = strtoull(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--packets n]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    struct Pattern {
+        const char* name;
+        double rate;
+        double burst;   /* 0: independent losses */
+    };
+    const Pattern patterns[] = {
+        {"random 1%", 0.01, 0},  {"random 5%", 0.05, 0},  {"random 10%", 0.10, 0},
+        {"random 20%", 0.20, 0}, {"bursts 5%", 0.05, 3},  {"bursts 10%", 0.10, 3},
+    };
+
+    uint64_t errors = 0;
+    for (uint8_t group_size : GROUP_SIZES) {
+        std::vector<Datagram> stream = BuildStream(group_size, packets);
+        uint64_t data_bytes = 0;
+        uint64_t parity_bytes = 0;
+        for (const Datagram& datagram : stream) {
+            (datagram.parity ? parity_bytes : data_bytes) += datagram.bytes.size();
+        }
+        printf("group size %2u: parity adds %.1f%% to the datagram bytes\n", group_size,
+               100.0 * parity_bytes / data_bytes);
+
+        // one loss at every position of a group in turn, parity included: the packet comes back
+        // unless it was the parity, and a second loss in the same group leaves it alone
+        for (size_t position = 0; position <= group_size; position++) {
+            std::vector<bool> lost(stream.size());
+            size_t group = 0;
+            size_t index = 0;
+            for (size_t i = 0; i < stream.size(); i++) {
+                lost[i] = index == position || (group % 3 == 2 && index == (position + 1) % (group_size + 1));
+                if (++index == static_cast<size_t>(group_size) + 1) {
+                    index = 0;
+                    group++;
+                }
+            }
+            char name[48];
+            snprintf(name, sizeof(name), "position %zu", position);
+            errors += RunLink(stream, group_size, lost, name).errors;
+        }
+
+        for (const Pattern& pattern : patterns) {
+            std::vector<bool> lost = pattern.burst > 0 ? BurstLoss(stream.size(), pattern.rate, pattern.burst, group_size)
+                                                       : RandomLoss(stream.size(), pattern.rate, group_size);
+            Outcome outcome = RunLink(stream, group_size, lost, pattern.name);
+            errors += outcome.errors;
+            printf("  %-11s %5" PRIu64 " data packets lost, %5.1f%% recovered, %.2f%% left lost\n", pattern.name,
+                   outcome.data_lost, outcome.data_lost ? 100.0 * outcome.recovered / outcome.data_lost : 0.0,
+                   100.0 * (outcome.data_lost - outcome.recovered) / packets);
+        }
+    }
+
+    printf("%s\n", errors == 0 ? "ok" : "FAILED");
+    return errors == 0 ? 0 : 1;
+}
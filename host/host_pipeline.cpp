@@ -0,0 +1,486 @@
+// End-to-end benchmark of the firmware pipeline on Linux: the real I2SCodec, AudioProcessor and
+// UDPServer run on the host shims (shim/), the simulated i2s channel captures a synthetic talker
+// or a looped WAV file in real time, and built-in receivers speaking the udp_client protocol
+// (KEEPALIVE, DATA, PARITY, DISCONNECT) listen on the loopback interface. At the end it reports
+// packets/s, the CPU the firmware code spent per read period and two latency distributions:
+// capture to receive, from the completion of the dma buffer holding a packet's newest sample to
+// the packet arriving at a receiver (the pipeline's own work), and microphone to receive, from
+// the moment the packet's oldest sample was at the microphone (what a listener hears, the frame
+// length included). The per-packet header overhead is reported next to them, to compare latency
+// profiles (--profile).
+//
+// scripts/udp_client can listen in at the same time (udp_client 127.0.0.1), it counts as one more
+// unicast client. Priorities and core pinning are not modelled, so absolute numbers are the host's;
+// the use is comparing builds and settings against each other.
+//
+// Build: see CMakeLists.txt
+// Run:   host_pipeline [--seconds n] [--rate hz] [--profile ms] [--adpcm] [--fec n] [--vad]
+//                      [--timer] [--raw] [--no-congestion] [--overrun policy] [--clients n]
+//                      [--port n] [--wav file] [--verbose]
+#include "audio_processor.h"
+#include "host_i2s.h"
+#include "i2s_codec.h"
+#include "ima_adpcm.h"
+#include "latency_trace.h"
+#include "udp_server.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const char* TAG = "host_pipeline";
+
+namespace {
+
+std::atomic<bool> stop_requested{false};
+
+void OnSignal(int) {
+    stop_requested = true;
+}
+
+uint64_t CpuUs(clockid_t clock) {
+    timespec ts;
+    clock_gettime(clock, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint64_t ProcessCpuUs() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<uint64_t>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+           usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+/* one listener on its own socket, like a udp_client instance */
+class Receiver {
+public:
+    bool Start(uint16_t server_port) {
+        socket_fd_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (socket_fd_ < 0) {
+            return false;
+        }
+        timeval timeout = {.tv_sec = 0, .tv_usec = 100 * 1000};
+        setsockopt(socket_fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        server_addr_.sin_family = AF_INET;
+        server_addr_.sin_port = htons(server_port);
+        server_addr_.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        latencies_us_.reserve(1 << 16);
+        sample_latencies_us_.reserve(1 << 16);
+
+        Send(MessageType::KEEPALIVE);
+        thread_ = std::thread(&Receiver::Run, this);
+        return true;
+    }
+
+    void Stop() {
+        running_ = false;
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        if (socket_fd_ >= 0) {
+            Send(MessageType::DISCONNECT);
+            close(socket_fd_);
+            socket_fd_ = -1;
+        }
+    }
+
+    const std::vector<uint32_t>& latencies_us() const { return latencies_us_; }
+    const std::vector<uint32_t>& sample_latencies_us() const { return sample_latencies_us_; }
+    uint64_t packets() const { return packets_; }
+    uint64_t data_packets() const { return data_packets_; }
+    uint64_t parity_packets() const { return parity_packets_; }
+    uint64_t silence_packets() const { return silence_packets_; }
+    uint64_t gap_packets() const { return gap_packets_; }
+    uint64_t lost_packets() const { return lost_packets_; }
+    uint64_t cpu_us() const { return cpu_us_; }
+
+private:
+    void Send(MessageType type) {
+        MessageHeader header = {
+            .type = type,
+            .version = PROTOCOL_VERSION,
+            .codec = AudioCodec::PCM16,
+            .sample_rate_khz = 0,
+        };
+        sendto(socket_fd_, &header, sizeof(header), 0, reinterpret_cast<const sockaddr*>(&server_addr_),
+               sizeof(server_addr_));
+    }
+
+    void Run() {
+        pthread_setname_np(pthread_self(), "receiver");
+        uint8_t buffer[MAX_DATAGRAM_SIZE];
+        int64_t last_keepalive_us = esp_timer_get_time();
+
+        while (running_) {
+            ssize_t len = recv(socket_fd_, buffer, sizeof(buffer), 0);
+            int64_t now_us = esp_timer_get_time();
+            if (now_us - last_keepalive_us >= static_cast<int64_t>(KEEPALIVE_INTERVAL_MS) * 1000) {
+                Send(MessageType::KEEPALIVE);
+                last_keepalive_us = now_us;
+            }
+            if (len >= static_cast<ssize_t>(sizeof(MessageHeader))) {
+                Handle(buffer, static_cast<size_t>(len), now_us);
+            }
+        }
+        cpu_us_ = CpuUs(CLOCK_THREAD_CPUTIME_ID);
+    }
+
+    void Handle(const uint8_t* data, size_t len, int64_t now_us) {
+        MessageHeader header;
+        memcpy(&header, data, sizeof(header));
+        packets_++;
+        if (header.type == MessageType::PARITY) {
+            parity_packets_++;
+            return;
+        }
+        if (header.type != MessageType::DATA || len < DATA_HEADERS_SIZE) {
+            return;
+        }
+
+        DataHeader data_header;
+        memcpy(&data_header, data + sizeof(MessageHeader), sizeof(data_header));
+        if (data_packets_ > 0 && data_header.sequence != next_sequence_) {
+            lost_packets_ += data_header.sequence - next_sequence_;
+        }
+        next_sequence_ = data_header.sequence + 1;
+        data_packets_++;
+
+        const uint8_t* payload = data + DATA_HEADERS_SIZE;
+        size_t payload_len = len - DATA_HEADERS_SIZE;
+        size_t samples = 0;
+        switch (header.codec) {
+            case AudioCodec::PCM16:
+                samples = payload_len / sizeof(int16_t);
+                break;
+            case AudioCodec::IMA_ADPCM:
+                if (payload_len > IMA_ADPCM_BLOCK_HEADER_SIZE) {
+                    samples = (payload_len - IMA_ADPCM_BLOCK_HEADER_SIZE) * 2 -
+                              ((payload[3] & IMA_ADPCM_FLAG_ODD) ? 1 : 0);
+                }
+                break;
+            case AudioCodec::SILENCE:
+                silence_packets_++;   /* stands in for samples sent nowhere, no latency to speak of */
+                return;
+            case AudioCodec::GAP:
+                gap_packets_++;
+                return;
+        }
+        if (samples == 0) {
+            return;
+        }
+
+        int64_t captured_us = HostI2sCaptureTimeUs(data_header.sample_index + static_cast<uint32_t>(samples) - 1);
+        if (captured_us >= 0 && now_us >= captured_us) {
+            latencies_us_.push_back(static_cast<uint32_t>(now_us - captured_us));
+        }
+        int64_t sampled_us = HostI2sSampleTimeUs(data_header.sample_index);
+        if (sampled_us >= 0 && now_us >= sampled_us) {
+            sample_latencies_us_.push_back(static_cast<uint32_t>(now_us - sampled_us));
+        }
+    }
+
+    int socket_fd_ = -1;
+    sockaddr_in server_addr_ = {};
+    std::thread thread_;
+    std::atomic<bool> running_{true};
+
+    uint32_t next_sequence_ = 0;
+    uint64_t packets_ = 0;
+    uint64_t data_packets_ = 0;
+    uint64_t parity_packets_ = 0;
+    uint64_t silence_packets_ = 0;
+    uint64_t gap_packets_ = 0;
+    uint64_t lost_packets_ = 0;
+    uint64_t cpu_us_ = 0;
+    std::vector<uint32_t> latencies_us_;
+    std::vector<uint32_t> sample_latencies_us_;
+};
+
+struct Options {
+    uint32_t seconds = 10;
+    uint32_t sample_rate = AUDIO_SAMPLE_RATE;
+    uint32_t frame_ms = AUDIO_LATENCY_PROFILE_MS;
+    bool adpcm = false;
+    uint8_t fec_group_size = AUDIO_FEC_GROUP_SIZE;
+    bool vad = false;
+    bool timer_mode = false;
+    bool raw = false;
+    bool congestion_control = true;
+    AudioProcessor::OverrunPolicy overrun_policy = static_cast<AudioProcessor::OverrunPolicy>(AUDIO_RING_OVERRUN_POLICY);
+    uint32_t clients = 1;
+    uint16_t port = 5001;
+    const char* wav = nullptr;
+    bool verbose = false;
+};
+
+void Usage(const char* program) {
+    fprintf(stderr,
+            "usage: %s [--seconds n] [--rate hz] [--profile ms] [--adpcm] [--fec n] [--vad]\n"
+            "          [--timer] [--raw] [--no-congestion] [--overrun policy] [--clients n]\n"
+            "          [--port n] [--wav file] [--verbose]\n"
+            "  --profile        latency profile, the frame length: 5, 10, 20 or 30 ms\n"
+            "  --timer          poll with esp_timers instead of the dma event driven capture task\n"
+            "  --raw            dc blocker and agc off, the plain narrowing kernel\n"
+            "  --no-congestion  keep the configured stream whatever the link does\n"
+            "  --overrun        drop-newest, drop-oldest or catch-up, when the send path falls behind\n"
+            "  --clients        built-in receivers, 0 to leave the stream to external udp_clients\n",
+            program);
+}
+
+bool ParseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--seconds" && has_value) {
+            options.seconds = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--rate" && has_value) {
+            options.sample_rate = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--profile" && has_value) {
+            options.frame_ms = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--adpcm") {
+            options.adpcm = true;
+        } else if (arg == "--fec" && has_value) {
+            options.fec_group_size = static_cast<uint8_t>(strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--vad") {
+            options.vad = true;
+        } else if (arg == "--timer") {
+            options.timer_mode = true;
+        } else if (arg == "--raw") {
+            options.raw = true;
+        } else if (arg == "--no-congestion") {
+            options.congestion_control = false;
+        } else if (arg == "--overrun" && has_value) {
+            std::string policy = argv[++i];
+            if (policy == "drop-newest") {
+                options.overrun_policy = AudioProcessor::OverrunPolicy::DROP_NEWEST;
+            } else if (policy == "drop-oldest") {
+                options.overrun_policy = AudioProcessor::OverrunPolicy::DROP_OLDEST;
+            } else if (policy == "catch-up") {
+                options.overrun_policy = AudioProcessor::OverrunPolicy::CATCH_UP;
+            } else {
+                return false;
+            }
+        } else if (arg == "--clients" && has_value) {
+            options.clients = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--port" && has_value) {
+            options.port = static_cast<uint16_t>(strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--wav" && has_value) {
+            options.wav = argv[++i];
+        } else if (arg == "--verbose") {
+            options.verbose = true;
+        } else {
+            return false;
+        }
+    }
+    return AudioProcessor::IsSupportedSampleRate(options.sample_rate) && FindLatencyProfile(options.frame_ms) &&
+           options.seconds > 0;
+}
+
+uint32_t Percentile(const std::vector<uint32_t>& sorted, double fraction) {
+    size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        Usage(argv[0]);
+        return 1;
+    }
+    esp_log_level_set("*", options.verbose ? ESP_LOG_INFO : ESP_LOG_WARN);
+    signal(SIGINT, OnSignal);
+    signal(SIGTERM, OnSignal);
+
+    if (options.wav && !HostI2sLoadWav(options.wav)) {
+        return 1;
+    }
+
+    // STATS requests are answered like on the device, without the heap figures the shim has no
+    // watermarks for (scripts/udp_client --stats 127.0.0.1)
+    auto& udp_server = UDPServer::GetInstance();
+    udp_server.SetStatsCallback([](StatsSnapshot& snapshot) {
+        AudioProcessor::GetInstance().FillStatsSnapshot(snapshot);
+    });
+    udp_server.SetReportCallback([](const ReceiverReport& report, const sockaddr_in&) {
+        AudioProcessor::GetInstance().OnReceiverReport(report);
+    });
+    udp_server.SetNackCallback([](const NackRange* ranges, size_t count, const sockaddr_in& client_addr) {
+        AudioProcessor::GetInstance().OnNack(ranges, count, client_addr);
+    });
+    if (!udp_server.Initialize(options.port)) {
+        ESP_LOGE(TAG, "Failed to initialize UDP server on port %u", options.port);
+        return 1;
+    }
+
+    std::vector<std::unique_ptr<Receiver>> receivers;
+    for (uint32_t i = 0; i < options.clients; i++) {
+        receivers.push_back(std::make_unique<Receiver>());
+        if (!receivers.back()->Start(options.port)) {
+            ESP_LOGE(TAG, "Failed to start receiver %" PRIu32, i);
+            return 1;
+        }
+    }
+    // let the server register the receivers before the first packet
+    vTaskDelay(pdMS_TO_TICKS(200));
+
+    I2SCodec codec(options.sample_rate, AUDIO_I2S_MIC_GPIO_SCK, AUDIO_I2S_MIC_GPIO_WS, AUDIO_I2S_MIC_GPIO_DIN);
+    if (options.timer_mode) {
+        codec.SetCaptureMode(I2SCodec::CaptureMode::TIMER);
+    }
+    codec.SetLatencyProfile(options.frame_ms);
+    if (options.raw) {
+        codec.SetCaptureConditioning(false, false);
+    }
+
+    auto& audio_processor = AudioProcessor::GetInstance();
+    audio_processor.SetStreamCodec(options.adpcm ? AudioCodec::IMA_ADPCM : AudioCodec::PCM16);
+    audio_processor.SetFecGroupSize(options.fec_group_size);
+    audio_processor.SetVadEnabled(options.vad);
+    audio_processor.SetCongestionControl(options.congestion_control);
+    audio_processor.SetOverrunPolicy(options.overrun_policy);
+
+    uint64_t start_cpu_us = ProcessCpuUs();
+    int64_t start_us = esp_timer_get_time();
+
+    // unlike app_main, the processor goes first: its microphone callback is then in place before
+    // the channel is enabled, so the ring buffer positions match the capture clock's sample count
+    if (!audio_processor.Initialize(&codec)) {
+        ESP_LOGE(TAG, "Failed to initialize audio processor");
+        return 1;
+    }
+    if (!codec.Initialize()) {
+        ESP_LOGE(TAG, "Failed to initialize audio codec");
+        return 1;
+    }
+
+    printf("streaming %" PRIu32 " Hz %s, %" PRIu32 " ms frames, %s capture, %s conversion, fec %u, vad %s, %s, %" PRIu32 " receiver(s), %" PRIu32 " s\n",
+           options.sample_rate, options.adpcm ? "IMA-ADPCM" : "PCM16", codec.get_audio_read_duration_ms(),
+           options.timer_mode ? "timer" : "dma event", options.raw ? "plain" : "conditioned",
+           options.fec_group_size, options.vad ? "on" : "off", options.wav ? options.wav : "synthetic talker",
+           options.clients, options.seconds);
+    fflush(stdout);
+
+    while (!stop_requested && esp_timer_get_time() - start_us < static_cast<int64_t>(options.seconds) * 1000000) {
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+
+    AudioProcessor::SendPathStats send_stats = audio_processor.GetSendPathStats();
+    AudioProcessor::CaptureLatencyStats send_latency = audio_processor.GetCaptureLatencyStats();
+    HostI2sStats i2s_stats = HostI2sGetStats();
+    double elapsed_s = (esp_timer_get_time() - start_us) / 1e6;
+    uint64_t process_cpu_us = ProcessCpuUs() - start_cpu_us;
+
+    audio_processor.Deinitialize();
+    codec.Deinitialize();
+
+    uint64_t receiver_cpu_us = 0;
+    std::vector<uint32_t> latencies;
+    std::vector<uint32_t> sample_latencies;
+    for (auto& receiver : receivers) {
+        receiver->Stop();
+        receiver_cpu_us += receiver->cpu_us();
+        latencies.insert(latencies.end(), receiver->latencies_us().begin(), receiver->latencies_us().end());
+        sample_latencies.insert(sample_latencies.end(), receiver->sample_latencies_us().begin(),
+                                receiver->sample_latencies_us().end());
+    }
+    udp_server.Deinitialize();
+
+    // what is left is the firmware's own work: capture task or timers, network task, udp task
+    uint64_t firmware_cpu_us = process_cpu_us - std::min(process_cpu_us, receiver_cpu_us + i2s_stats.dma_cpu_us);
+    uint64_t read_periods = i2s_stats.samples_captured / (options.sample_rate / 1000 * codec.get_audio_read_duration_ms());
+
+    printf("\n%.1f s, %" PRIu64 " samples captured, %" PRIu32 " dma overflows\n", elapsed_s, i2s_stats.samples_captured,
+           i2s_stats.dma_overflows);
+    printf("sent      %" PRIu32 " datagrams (%.1f/s), %" PRIu32 " failed, %" PRIu64 " bytes (%.1f kbit/s)\n",
+           send_stats.udp.packets_sent, send_stats.udp.packets_sent / elapsed_s, send_stats.udp.send_failures,
+           send_stats.udp.bytes_sent, send_stats.udp.bytes_sent * 8 / elapsed_s / 1000);
+    if (send_stats.udp.packets_sent > 0) {
+        // what each datagram carries besides audio: the protocol headers and udp/ipv4
+        double datagram_bytes = static_cast<double>(send_stats.udp.bytes_sent) / send_stats.udp.packets_sent;
+        size_t overhead_bytes = DATA_HEADERS_SIZE + UDP_IPV4_HEADERS_SIZE;
+        printf("overhead  %zu header bytes per %.0f byte datagram (%.1f%% of the %.1f kbit/s on air)\n",
+               overhead_bytes, datagram_bytes, 100.0 * overhead_bytes / (datagram_bytes + UDP_IPV4_HEADERS_SIZE),
+               (send_stats.udp.bytes_sent + send_stats.udp.packets_sent * UDP_IPV4_HEADERS_SIZE) * 8 / elapsed_s / 1000);
+    }
+    if (options.vad) {
+        printf("vad       %" PRIu32 " packets suppressed, %" PRIu32 " silence descriptors, %" PRIu64 " bytes saved\n",
+               send_stats.vad_suppressed_packets, send_stats.vad_silence_descriptors, send_stats.vad_saved_bytes);
+    }
+    if (send_stats.congestion_changes > 0) {
+        printf("congestion %" PRIu32 " level changes, level %u at the end\n", send_stats.congestion_changes,
+               send_stats.congestion_level);
+    }
+    if (send_stats.ring_full_samples > 0 || send_stats.shed_samples > 0 || send_stats.idle_samples > 0) {
+        printf("overrun   %" PRIu32 " samples found the ring full, %" PRIu32 " shed, %" PRIu32
+               " discarded without clients, %" PRIu32 " gap markers\n",
+               send_stats.ring_full_samples, send_stats.shed_samples, send_stats.idle_samples,
+               send_stats.gap_markers);
+    }
+    if (send_stats.nack_requested > 0) {
+        printf("nack      %" PRIu32 " packets asked for again, %" PRIu32 " retransmitted, %" PRIu32
+               " no longer held, %" PRIu32 " failed to send\n", send_stats.nack_requested,
+               send_stats.retransmissions, send_stats.nack_expired, send_stats.nack_send_failed);
+    }
+    for (size_t i = 0; i < receivers.size(); i++) {
+        const Receiver& receiver = *receivers[i];
+        printf("receiver  %zu: %" PRIu64 " packets (%.1f/s), %" PRIu64 " data, %" PRIu64 " parity, %" PRIu64
+               " silence, %" PRIu64 " gap, %" PRIu64 " lost\n",
+               i, receiver.packets(), receiver.packets() / elapsed_s, receiver.data_packets(),
+               receiver.parity_packets(), receiver.silence_packets(), receiver.gap_packets(),
+               receiver.lost_packets());
+    }
+    printf("cpu       %.1f ms firmware (%.2f%% of a core), %.1f us per %" PRIu32 " ms read period;"
+           " receivers %.1f ms, dma simulation %.1f ms\n",
+           firmware_cpu_us / 1000.0, 100.0 * firmware_cpu_us / (elapsed_s * 1e6),
+           read_periods > 0 ? static_cast<double>(firmware_cpu_us) / read_periods : 0.0,
+           codec.get_audio_read_duration_ms(), receiver_cpu_us / 1000.0, i2s_stats.dma_cpu_us / 1000.0);
+    if (send_latency.samples > 0) {
+        printf("ring      write to send %.2f ms avg, %.2f ms max\n",
+               send_latency.total_us / 1000.0 / send_latency.samples, send_latency.max_us / 1000.0);
+    }
+#ifdef AUDIO_LATENCY_TRACE
+    for (size_t i = 0; i < static_cast<size_t>(LatencyStage::COUNT); i++) {
+        LatencyStage stage = static_cast<LatencyStage>(i);
+        LatencyHistogram::Snapshot snapshot = LatencyTrace::GetInstance().Read(stage);
+        if (snapshot.count > 0) {
+            printf("stage     %-13s %7" PRIu32 " x  p50 <= %.3f  p90 <= %.3f  p99 <= %.3f  max %.3f ms\n",
+                   LatencyTrace::StageName(stage), snapshot.count, snapshot.Percentile(0.5f) / 1000.0,
+                   snapshot.Percentile(0.9f) / 1000.0, snapshot.Percentile(0.99f) / 1000.0, snapshot.max_us / 1000.0);
+        }
+    }
+#endif
+
+    if (latencies.empty()) {
+        printf("latency   no data packets received\n");
+        return 0;
+    }
+    auto print_latencies = [](const char* what, std::vector<uint32_t>& values) {
+        std::sort(values.begin(), values.end());
+        printf("latency   %-19s over %zu packets: min %.2f  p50 %.2f  p90 %.2f  p99 %.2f  p99.9 %.2f  max %.2f ms\n",
+               what, values.size(), values.front() / 1000.0, Percentile(values, 0.50) / 1000.0,
+               Percentile(values, 0.90) / 1000.0, Percentile(values, 0.99) / 1000.0,
+               Percentile(values, 0.999) / 1000.0, values.back() / 1000.0);
+    };
+    print_latencies("capture to receive", latencies);
+    print_latencies("mic to receive", sample_latencies);
+    if (i2s_stats.dma_overflows > 0) {
+        printf("          (dma buffers were overwritten, later packets map to the wrong capture time)\n");
+    }
+    return 0;
+}
@@ -0,0 +1,232 @@
+// Round trips a tone and speech-like noise through the firmware's IMA ADPCM encoder
+// (main/audio/ima_adpcm.h) and ImaAdpcmDecodeBlock in packet sized blocks, and checks the
+// signal to noise ratio of what comes back. Each block is decoded on its own, as the client does
+// after a loss. Also checks that a block fed in two spans (a wrapped ring buffer region) and a
+// block re-encoded from its saved state (a retransmission) give the same bytes, then times the
+// encoder per packet.
+//
+// Build: see CMakeLists.txt
+// Run:   ima_adpcm_test [--iterations n]
+//        the exit code says whether every signal reached its minimum SNR
+#include "ima_adpcm.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t SAMPLE_RATE = 16000;
+constexpr size_t SIGNAL_SAMPLES = 2 * SAMPLE_RATE;
+constexpr double PI = 3.14159265358979323846;
+
+struct Signal {
+    const char* name;
+    std::vector<int16_t> samples;
+    double min_snr_db;
+};
+
+int16_t Clamp(double value) {
+    return static_cast<int16_t>(std::lround(std::fmax(-32767.0, std::fmin(32767.0, value))));
+}
+
+std::vector<int16_t> Tone(double hz, double dbfs) {
+    std::vector<int16_t> samples(SIGNAL_SAMPLES);
+    double amplitude = 32767.0 * std::pow(10.0, dbfs / 20.0);
+    for (size_t i = 0; i < samples.size(); i++) {
+        samples[i] = Clamp(amplitude * std::sin(2.0 * PI * hz * i / SAMPLE_RATE));
+    }
+    return samples;
+}
+
+/* low-passed noise with a voiced harmonic series, both under a 4 Hz syllable envelope, peaking
+   around -12 dBFS: the spectral tilt and level swings the step adaptation has to follow */
+std::vector<int16_t> SpeechLike() {
+    std::vector<int16_t> samples(SIGNAL_SAMPLES);
+    std::mt19937 generator(7);
+    std::normal_distribution<double> noise(0.0, 1.0);
+    double lowpass = 0.0;
+    for (size_t i = 0; i < samples.size(); i++) {
+        double t = static_cast<double>(i) / SAMPLE_RATE;
+        double envelope = 0.1 + 0.9 * 0.5 * (1.0 - std::cos(2.0 * PI * 4.0 * t));
+        lowpass += 0.3 * (noise(generator) - lowpass);
+        double voice = 0.0;
+        for (int h = 1; h <= 10; h++) {
+            voice += std::sin(2.0 * PI * 150.0 * h * t) / h;
+        }
+        samples[i] = Clamp(envelope * (2500.0 * voice + 6000.0 * lowpass));
+    }
+    return samples;
+}
+
+/* encodes the signal in blocks of packet_samples, decodes every block on its own */
+std::vector<int16_t> RoundTrip(const std::vector<int16_t>& input, size_t packet_samples) {
+    ImaAdpcmEncoder encoder;
+    std::vector<uint8_t> block(ImaAdpcmBlockSize(packet_samples));
+    std::vector<int16_t> output;
+    output.reserve(input.size());
+    int16_t decoded[2 * 1024];
+    for (size_t offset = 0; offset < input.size(); offset += packet_samples) {
+        size_t count = std::min(packet_samples, input.size() - offset);
+        encoder.BeginBlock(block.data());
+        encoder.Encode(std::span<const int16_t>(input.data() + offset, count));
+        size_t bytes = encoder.EndBlock();
+        size_t samples = ImaAdpcmDecodeBlock(block.data(), bytes, decoded);
+        output.insert(output.end(), decoded, decoded + samples);
+    }
+    return output;
+}
+
+double SnrDb(const std::vector<int16_t>& reference, const std::vector<int16_t>& decoded) {
+    double signal = 0.0;
+    double noise = 0.0;
+    for (size_t i = 0; i < reference.size(); i++) {
+        double error = static_cast<double>(reference[i]) - (i < decoded.size() ? decoded[i] : 0);
+        signal += static_cast<double>(reference[i]) * reference[i];
+        noise += error * error;
+    }
+    return noise > 0.0 ? 10.0 * std::log10(signal / noise) : INFINITY;
+}
+
+/* one block from two spans split at split, against the same block from one span */
+bool SplitMatches(const std::vector<int16_t>& input, size_t packet_samples, size_t split) {
+    std::vector<uint8_t> whole(ImaAdpcmBlockSize(packet_samples));
+    std::vector<uint8_t> parts(whole.size());
+    ImaAdpcmEncoder a;
+    ImaAdpcmEncoder b;
+    // start both from a state mid-stream rather than the reset one
+    a.BeginBlock(whole.data());
+    a.Encode(std::span<const int16_t>(input.data(), packet_samples));
+    a.EndBlock();
+    b.SetState(a.state());
+
+    std::span<const int16_t> block(input.data() + packet_samples, packet_samples);
+    a.BeginBlock(whole.data());
+    a.Encode(block);
+    size_t whole_bytes = a.EndBlock();
+    b.BeginBlock(parts.data());
+    b.Encode(block.first(split));
+    b.Encode(block.subspan(split));
+    size_t parts_bytes = b.EndBlock();
+    return whole_bytes == parts_bytes && memcmp(whole.data(), parts.data(), whole_bytes) == 0;
+}
+
+/* a block re-encoded from the state saved before it, as AudioProcessor::Retransmit does */
+bool RetransmissionMatches(const std::vector<int16_t>& input, size_t packet_samples) {
+    ImaAdpcmEncoder encoder;
+    std::vector<uint8_t> first(ImaAdpcmBlockSize(packet_samples));
+    std::vector<uint8_t> again(first.size());
+    for (size_t offset = 0; offset + packet_samples <= input.size(); offset += packet_samples) {
+        std::span<const int16_t> block(input.data() + offset, packet_samples);
+        ImaAdpcmState saved = encoder.state();
+        encoder.BeginBlock(first.data());
+        encoder.Encode(block);
+        size_t bytes = encoder.EndBlock();
+
+        ImaAdpcmEncoder retransmit;
+        retransmit.SetState(saved);
+        retransmit.BeginBlock(again.data());
+        retransmit.Encode(block);
+        if (retransmit.EndBlock() != bytes || memcmp(first.data(), again.data(), bytes) != 0 ||
+            retransmit.state().predictor != encoder.state().predictor ||
+            retransmit.state().step_index != encoder.state().step_index) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* best per packet time of a few runs, in us */
+template <typename Body>
+double TimePerPacket(size_t packets, uint32_t iterations, Body body) {
+    double best = 1e30;
+    for (int run = 0; run < 5; run++) {
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < iterations; i++) {
+            body();
+        }
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        best = std::min(best, us / (static_cast<double>(iterations) * packets));
+    }
+    return best;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    uint32_t iterations = 20;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--iterations" && i + 1 < argc) {
+            iterations = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        } else {
+            fprintf(stderr, "usage: %s [--iterations n]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<Signal> signals = {
+        {"1 kHz tone, -6 dBFS", Tone(1000.0, -6.0), 24.0},
+        {"300 Hz tone, -30 dBFS", Tone(300.0, -30.0), 35.0},
+        {"speech-like noise", SpeechLike(), 18.0},
+    };
+    // 5 and 30 ms packets at 16 kHz, an odd length that pads the last nibble, and 48 kHz's 720
+    const size_t packet_sizes[] = {80, 480, 479, 720};
+
+    int failed = 0;
+    for (const Signal& signal : signals) {
+        for (size_t packet_samples : packet_sizes) {
+            std::vector<int16_t> decoded = RoundTrip(signal.samples, packet_samples);
+            double snr = SnrDb(signal.samples, decoded);
+            bool ok = decoded.size() == signal.samples.size() && snr >= signal.min_snr_db;
+            printf("%-24s %4zu sample packets  SNR %5.1f dB (min %.0f)  %s\n", signal.name, packet_samples, snr,
+                   signal.min_snr_db, ok ? "ok" : "FAILED");
+            failed += !ok;
+        }
+        for (size_t split : {size_t{1}, size_t{239}, size_t{240}, size_t{479}}) {
+            if (!SplitMatches(signal.samples, 480, split)) {
+                printf("FAILED: %s, a block fed in two spans split at %zu differs\n", signal.name, split);
+                failed++;
+            }
+        }
+        if (!RetransmissionMatches(signal.samples, 480)) {
+            printf("FAILED: %s, a block re-encoded from its saved state differs\n", signal.name);
+            failed++;
+        }
+    }
+
+    // per packet cost of the speech-like signal, the decoder for comparison
+    const std::vector<int16_t>& speech = signals.back().samples;
+    for (size_t packet_samples : {size_t{80}, size_t{480}, size_t{720}}) {
+        size_t packets = speech.size() / packet_samples;
+        std::vector<uint8_t> blocks(packets * ImaAdpcmBlockSize(packet_samples));
+        std::vector<size_t> sizes(packets);
+        ImaAdpcmEncoder encoder;
+        double encode_us = TimePerPacket(packets, iterations, [&] {
+            for (size_t p = 0; p < packets; p++) {
+                encoder.BeginBlock(blocks.data() + p * ImaAdpcmBlockSize(packet_samples));
+                encoder.Encode(std::span<const int16_t>(speech.data() + p * packet_samples, packet_samples));
+                sizes[p] = encoder.EndBlock();
+            }
+        });
+        std::vector<int16_t> decoded(packet_samples + 1);
+        double decode_us = TimePerPacket(packets, iterations, [&] {
+            for (size_t p = 0; p < packets; p++) {
+                ImaAdpcmDecodeBlock(blocks.data() + p * ImaAdpcmBlockSize(packet_samples), sizes[p], decoded.data());
+            }
+            asm volatile("" : : "r"(decoded.data()) : "memory");
+        });
+        printf("%4zu sample packets  encode %6.2f us/packet (%5.2f ns/sample)  decode %6.2f us/packet\n",
+               packet_samples, encode_us, encode_us * 1000.0 / packet_samples, decode_us);
+    }
+
+    printf("%s\n", failed == 0 ? "ok" : "FAILED");
+    return failed == 0 ? 0 : 1;
+}
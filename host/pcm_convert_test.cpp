@@ -0,0 +1,194 @@
+// Checks the 32 -> 16 bit narrowing kernels in main/audio/pcm_convert.cpp against the scalar
+// reference, then times them. PcmConvertS32ToS16 is the kernel the capture path calls: the PIE
+// assembly on the esp32-s3, the blocked loop the compiler vectorizes (sse/avx/neon) elsewhere.
+// Every variant has to be bit-exact with PcmConvertS32ToS16Scalar for random words and the edges
+// (INT32_MIN, INT32_MAX, the clamp limits either side of each shift), both saturation modes,
+// every length up to a few blocks, unaligned heads and tails, and in place.
+//
+// Build: see CMakeLists.txt
+// Run:   pcm_convert_test [--iterations n]
+//        the exit code says whether every case matched
+#include "audio_config.h"
+#include "pcm_convert.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Kernel = void (*)(const int32_t*, int16_t*, size_t, uint32_t, PcmSaturation);
+
+struct Variant {
+    const char* name;
+    Kernel kernel;
+};
+
+constexpr Variant VARIANTS[] = {
+    {"PcmConvertS32ToS16", PcmConvertS32ToS16},
+    {"PcmConvertS32ToS16Portable", PcmConvertS32ToS16Portable},
+};
+
+constexpr uint32_t SHIFTS[] = {0, 1, 8, 14, 15, 16, 31};
+constexpr PcmSaturation SATURATIONS[] = {PcmSaturation::SYMMETRIC, PcmSaturation::FULL};
+constexpr size_t MAX_LENGTH = 200;   /* a few 8 sample simd blocks and 64 sample portable blocks */
+constexpr size_t MAX_OFFSET = 8;     /* element offsets from a 64 byte boundary, in and out */
+
+/* words that land on or next to the clamp limits and the int32 edges for this shift */
+std::vector<int32_t> EdgeWords(uint32_t shift) {
+    std::vector<int32_t> words = {INT32_MIN, INT32_MIN + 1, INT32_MAX, INT32_MAX - 1, 0, 1, -1};
+    for (int64_t limit : {int64_t{INT16_MAX}, int64_t{INT16_MIN}, int64_t{-INT16_MAX}}) {
+        for (int64_t delta = -1; delta <= 1; delta++) {
+            int64_t word = (limit + delta) * (int64_t{1} << shift);
+            if (word >= INT32_MIN && word <= INT32_MAX) {
+                words.push_back(static_cast<int32_t>(word));
+                words.push_back(static_cast<int32_t>(std::min<int64_t>(word + (int64_t{1} << shift) - 1, INT32_MAX)));
+            }
+        }
+    }
+    return words;
+}
+
+struct Checker {
+    uint64_t cases = 0;
+    uint64_t failures = 0;
+
+    void Compare(const Variant& variant, const int32_t* input, size_t length, size_t in_offset, size_t out_offset,
+                 uint32_t shift, PcmSaturation saturation) {
+        // 64 byte aligned scratch so the offsets decide the alignment
+        alignas(64) int32_t in[MAX_LENGTH + MAX_OFFSET];
+        alignas(64) int16_t out[MAX_LENGTH + 2 * MAX_OFFSET + 16];
+        alignas(64) int16_t expected[MAX_LENGTH];
+        memcpy(in + in_offset, input, length * sizeof(int32_t));
+        memset(out, 0x5A, sizeof(out));
+        PcmConvertS32ToS16Scalar(input, expected, length, shift, saturation);
+        variant.kernel(in + in_offset, out + out_offset, length, shift, saturation);
+
+        cases++;
+        bool ok = memcmp(out + out_offset, expected, length * sizeof(int16_t)) == 0;
+        // nothing past the end may be touched
+        for (size_t i = out_offset + length; i < std::size(out); i++) {
+            ok = ok && out[i] == 0x5A5A;
+        }
+        Report(ok, variant, "out of place", length, in_offset, out_offset, shift, saturation);
+    }
+
+    void CompareInPlace(const Variant& variant, const int32_t* input, size_t length, size_t offset, uint32_t shift,
+                        PcmSaturation saturation) {
+        alignas(64) int32_t buffer[MAX_LENGTH + MAX_OFFSET];
+        alignas(64) int16_t expected[MAX_LENGTH];
+        memcpy(buffer + offset, input, length * sizeof(int32_t));
+        PcmConvertS32ToS16Scalar(input, expected, length, shift, saturation);
+        variant.kernel(buffer + offset, reinterpret_cast<int16_t*>(buffer + offset), length, shift, saturation);
+
+        cases++;
+        bool ok = memcmp(buffer + offset, expected, length * sizeof(int16_t)) == 0;
+        Report(ok, variant, "in place", length, offset, offset, shift, saturation);
+    }
+
+    void Report(bool ok, const Variant& variant, const char* mode, size_t length, size_t in_offset,
+                size_t out_offset, uint32_t shift, PcmSaturation saturation) {
+        if (!ok && failures++ < 10) {
+            printf("FAILED: %s %s, %zu samples, in +%zu out +%zu, >> %" PRIu32 ", %s saturation\n", variant.name,
+                   mode, length, in_offset, out_offset, shift,
+                   saturation == PcmSaturation::FULL ? "full" : "symmetric");
+        }
+    }
+};
+
+/* ns per sample of one read period, best of a few runs so a preempted run does not count */
+double TimeKernel(Kernel kernel, const std::vector<int32_t>& input, uint32_t iterations) {
+    std::vector<int32_t> in(input.size());
+    double best = 1e30;
+    for (int run = 0; run < 5; run++) {
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < iterations; i++) {
+            // in place like the capture path, the words are restored for the next call
+            memcpy(in.data(), input.data(), input.size() * sizeof(int32_t));
+            kernel(in.data(), reinterpret_cast<int16_t*>(in.data()), in.size(), AUDIO_I2S_SAMPLE_SHIFT,
+                   PcmSaturation::SYMMETRIC);
+            asm volatile("" : : "r"(in.data()) : "memory");
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        best = std::min(best, ns / (static_cast<double>(iterations) * input.size()));
+    }
+    return best;
+}
+
+double TimeCopy(const std::vector<int32_t>& input, uint32_t iterations) {
+    auto copy_only = [](const int32_t*, int16_t*, size_t, uint32_t, PcmSaturation) {};
+    return TimeKernel(copy_only, input, iterations);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    uint32_t iterations = 20000;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--iterations" && i + 1 < argc) {
+            iterations = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        } else {
+            fprintf(stderr, "usage: %s [--iterations n]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::mt19937 generator(1);
+    std::uniform_int_distribution<int32_t> any_word(INT32_MIN, INT32_MAX);
+    Checker checker;
+
+    for (uint32_t shift : SHIFTS) {
+        // random words with the edges sprinkled in at every position in turn
+        std::vector<int32_t> edges = EdgeWords(shift);
+        std::vector<int32_t> input(MAX_LENGTH);
+        for (size_t i = 0; i < input.size(); i++) {
+            input[i] = i % 3 == 0 ? edges[(i / 3) % edges.size()] : any_word(generator);
+        }
+
+        for (PcmSaturation saturation : SATURATIONS) {
+            for (const Variant& variant : VARIANTS) {
+                for (size_t length = 0; length <= MAX_LENGTH; length++) {
+                    for (size_t offset = 0; offset < MAX_OFFSET; offset++) {
+                        checker.Compare(variant, input.data(), length, offset, offset, shift, saturation);
+                        checker.Compare(variant, input.data(), length, offset, (offset + 3) % MAX_OFFSET, shift,
+                                        saturation);
+                        checker.CompareInPlace(variant, input.data(), length, offset, shift, saturation);
+                    }
+                }
+            }
+        }
+    }
+    printf("%" PRIu64 " cases, %" PRIu64 " mismatches, simd kernel on this target: %s\n", checker.cases,
+           checker.failures, PcmConvertHasSimd() ? "PIE" : "none, the vectorized portable loop");
+
+    // one read period at 16 and 48 kHz with 30 ms frames: 24-bit samples around -30 dBFS in the
+    // top of the word, narrowed with the capture path's shift
+    for (size_t samples : {480, 1440}) {
+        std::vector<int32_t> input(samples);
+        std::normal_distribution<double> speech(0.0, 265000.0);
+        for (int32_t& word : input) {
+            word = static_cast<int32_t>(std::clamp(speech(generator), -8388608.0, 8388607.0)) * 256;
+        }
+        double copy = TimeCopy(input, iterations);
+        double scalar = TimeKernel(PcmConvertS32ToS16Scalar, input, iterations) - copy;
+        printf("%4zu samples  %-28s %6.3f ns/sample\n", samples, "PcmConvertS32ToS16Scalar", scalar);
+        for (const Variant& variant : VARIANTS) {
+            double ns = TimeKernel(variant.kernel, input, iterations) - copy;
+            printf("%4zu samples  %-28s %6.3f ns/sample  %5.1fx\n", samples, variant.name, ns, scalar / ns);
+        }
+    }
+
+    if (checker.failures > 0) {
+        printf("FAILED\n");
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,266 @@
+// Checks the files scripts/udp_client.cpp records into (recording_segment.h). WavHeader has to keep
+// the plain RIFF layout up to the last data size whose RIFF size still fits 32 bits and switch to
+// RF64 one byte later: "RF64" and "ds64" in place of "RIFF" and "JUNK", 0xFFFFFFFF in the 32-bit
+// sizes and the real ones in the ds64 chunk, the samples still at byte 80. A WavSegment written
+// in odd sized chunks has to read back as a valid file after every write, not just after close.
+//
+// FlacSegment files are decoded with the reference decoder of flac_decoder.h, and with `flac -t`
+// as well where flac is installed: the samples have to come back bit-exact, with total_frames and
+// the MD5 in STREAMINFO matching them, for writes that split frames, a short final block, several
+// channels and a file read while it is still being written. A DiskWriter recording rotated every
+// second has to give segments that each decode on their own and join up to the input.
+//
+// Build: see CMakeLists.txt
+// Run:   recording_segment_test
+//        the exit code says whether every check passed
+#include "disk_writer.h"
+#include "flac_decoder.h"
+#include "recording_segment.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+int failed = 0;
+
+void Check(bool ok, const char* what) {
+    if (!ok) {
+        printf("FAILED: %s\n", what);
+        failed++;
+    }
+}
+
+bool HasTag(const WavHeader& header, size_t offset, const char* tag) {
+    return memcmp(reinterpret_cast<const char*>(&header) + offset, tag, 4) == 0;
+}
+
+void TestRf64Switch() {
+    // the chunk tags where a reader looks for them, whichever layout
+    WavHeader header(48000, 2);
+    Check(HasTag(header, 0, "RIFF") && HasTag(header, 8, "WAVE") && HasTag(header, 12, "JUNK") &&
+              HasTag(header, 48, "fmt ") && HasTag(header, 72, "data"),
+          "rf64: the chunks are not where a RIFF reader looks for them");
+    Check(header.block_align == 4 && header.byte_rate == 192000, "rf64: the stereo block size is wrong");
+
+    constexpr uint64_t LAST_RIFF = UINT32_MAX - (sizeof(WavHeader) - 8);
+    header.set_data_size(LAST_RIFF);
+    printf("rf64: %" PRIu64 " data bytes in a %.4s file, riff size %" PRIu32 "\n", LAST_RIFF, header.riff_header,
+           header.wav_size);
+    Check(HasTag(header, 0, "RIFF") && HasTag(header, 12, "JUNK") && header.wav_size == UINT32_MAX &&
+              header.data_chunk_size == LAST_RIFF && header.riff_size_64 == 0,
+          "rf64: switched while the sizes still fit 32 bits");
+
+    header.set_data_size(LAST_RIFF + 1);
+    printf("rf64: %" PRIu64 " data bytes in a %.4s file, ds64 riff size %" PRIu64 ", %" PRIu64 " frames\n",
+           LAST_RIFF + 1, header.riff_header, header.riff_size_64, header.sample_count_64);
+    Check(HasTag(header, 0, "RF64") && HasTag(header, 8, "WAVE") && HasTag(header, 12, "ds64") &&
+              HasTag(header, 48, "fmt ") && HasTag(header, 72, "data"),
+          "rf64: the RF64 chunk tags are wrong");
+    Check(header.wav_size == UINT32_MAX && header.data_chunk_size == UINT32_MAX,
+          "rf64: the 32-bit sizes are not 0xFFFFFFFF");
+    Check(header.ds64_chunk_size == 28 && header.riff_size_64 == LAST_RIFF + 1 + sizeof(WavHeader) - 8 &&
+              header.data_size_64 == LAST_RIFF + 1 && header.sample_count_64 == (LAST_RIFF + 1) / 4,
+          "rf64: the ds64 sizes are wrong");
+
+    // far past 4 GiB, a day of 48 kHz stereo
+    constexpr uint64_t DAY = 24ull * 3600 * 192000;
+    header.set_data_size(DAY);
+    Check(header.data_size_64 == DAY && header.sample_count_64 == 24ull * 3600 * 48000,
+          "rf64: a day of audio is not counted right");
+}
+
+bool ReadFile(const std::string& path, std::vector<uint8_t>& bytes) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    bytes.clear();
+    uint8_t buffer[4096];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        bytes.insert(bytes.end(), buffer, buffer + count);
+    }
+    fclose(file);
+    return true;
+}
+
+/* the file on disk is a complete WAV of exactly the samples written so far */
+bool ValidWav(const std::string& path, const std::vector<int16_t>& samples, uint32_t rate) {
+    std::vector<uint8_t> bytes;
+    if (!ReadFile(path, bytes) || bytes.size() != sizeof(WavHeader) + samples.size() * sizeof(int16_t)) {
+        return false;
+    }
+    WavHeader header(0);
+    memcpy(&header, bytes.data(), sizeof(header));
+    return HasTag(header, 0, "RIFF") && header.sample_rate == rate && header.num_channels == 1 &&
+           header.wav_size == bytes.size() - 8 && header.data_chunk_size == samples.size() * sizeof(int16_t) &&
+           memcmp(bytes.data() + sizeof(WavHeader), samples.data(), samples.size() * sizeof(int16_t)) == 0;
+}
+
+void TestWavSegment() {
+    std::string path = "/tmp/recording_segment_test_" + std::to_string(getpid()) + ".wav";
+    std::vector<int16_t> written;
+    WavSegment segment;
+    Check(segment.open(path, 16000, 1, 0), "wav segment: open failed");
+    Check(ValidWav(path, written, 16000), "wav segment: not a valid empty file after open");
+
+    bool valid = true;
+    for (size_t chunk : {1, 479, 480, 4097, 3}) {
+        std::vector<int16_t> samples(chunk);
+        for (size_t i = 0; i < chunk; i++) {
+            samples[i] = static_cast<int16_t>((written.size() + i) * 31);
+        }
+        valid = valid && segment.write(reinterpret_cast<const char*>(samples.data()), chunk * sizeof(int16_t));
+        written.insert(written.end(), samples.begin(), samples.end());
+        valid = valid && ValidWav(path, written, 16000);
+    }
+    Check(valid, "wav segment: the file is not valid between writes");
+    Check(segment.data_bytes() == written.size() * sizeof(int16_t) &&
+              segment.file_bytes() == sizeof(WavHeader) + segment.data_bytes(),
+          "wav segment: the byte counts are wrong");
+    segment.close();
+    Check(ValidWav(path, written, 16000), "wav segment: not valid after close");
+    printf("wav segment: %zu samples in 5 writes, valid after each\n", written.size());
+    unlink(path.c_str());
+}
+
+/* a tone over noise with stretches of digital silence, which become CONSTANT subframes */
+std::vector<int16_t> TestSignal(size_t frames, uint16_t channels) {
+    std::vector<int16_t> samples(frames * channels);
+    std::mt19937 generator(3);
+    std::normal_distribution<double> noise(0.0, 800.0);
+    for (size_t frame = 0; frame < frames; frame++) {
+        bool quiet = (frame / 3000) % 4 == 3;
+        for (uint16_t c = 0; c < channels; c++) {
+            double value = 8000.0 * std::sin(0.02 * (c + 1) * frame) + noise(generator);
+            samples[frame * channels + c] = quiet ? 0 : static_cast<int16_t>(std::lround(value));
+        }
+    }
+    return samples;
+}
+
+bool HaveFlac() {
+    static const bool have = system("flac --version > /dev/null 2>&1") == 0;
+    return have;
+}
+
+/* decodes the file and holds it against the samples, complete: whether the MD5 must be set */
+bool FlacMatches(const std::string& path, const std::vector<int16_t>& samples, uint32_t rate, uint16_t channels,
+                 bool complete, const char* what) {
+    std::vector<uint8_t> bytes;
+    if (!ReadFile(path, bytes)) {
+        printf("FAILED: %s, %s cannot be read\n", what, path.c_str());
+        return false;
+    }
+    flac_decoder::Decoded decoded = flac_decoder::decode(bytes);
+    size_t frames = decoded.samples.size() / std::max<uint16_t>(decoded.channels, 1);
+    bool prefix = decoded.samples.size() <= samples.size() &&
+                  std::equal(decoded.samples.begin(), decoded.samples.end(), samples.begin());
+    const char* problem = !decoded.error.empty()                       ? decoded.error.c_str()
+                          : decoded.sample_rate != rate                ? "wrong sample rate"
+                          : decoded.channels != channels               ? "wrong channel count"
+                          : !prefix                                    ? "samples differ"
+                          : decoded.declared_frames != frames          ? "total_frames differs"
+                          : complete && decoded.samples != samples     ? "samples missing"
+                          : complete != decoded.md5_set                ? "MD5 set too early or not at all"
+                                                                       : nullptr;
+    if (!problem && complete && HaveFlac()) {
+        std::string command = "flac -t -s '" + path + "' 2>&1";
+        problem = system(command.c_str()) == 0 ? nullptr : "flac -t rejects it";
+    }
+    if (problem) {
+        printf("FAILED: %s, %s\n", what, problem);
+        return false;
+    }
+    return true;
+}
+
+void TestFlacSegment(uint16_t channels) {
+    // three whole blocks and a short one
+    const size_t frames = 3 * FlacSegment::BLOCK_FRAMES + 1001;
+    std::vector<int16_t> samples = TestSignal(frames, channels);
+    std::string path = "/tmp/recording_segment_test_" + std::to_string(getpid()) + ".flac";
+    EncoderPool pool(2);
+    FlacSegment segment(pool);
+    Check(segment.open(path, 16000, channels, 0), "flac segment: open failed");
+
+    // byte counts that split frames and samples, as the disk writer's chunks do
+    const char* data = reinterpret_cast<const char*>(samples.data());
+    size_t bytes = samples.size() * sizeof(int16_t);
+    bool valid = true;
+    size_t step = 1;
+    for (size_t offset = 0; offset < bytes; step = step * 7 + 3) {
+        size_t count = std::min(step % 20011, bytes - offset);
+        valid = valid && segment.write(data + offset, count);
+        offset += count;
+        valid = valid && FlacMatches(path, samples, 16000, channels, false, "flac segment while written");
+    }
+    Check(valid, "flac segment: not valid between writes");
+    segment.close();
+
+    std::string what = "flac segment, " + std::to_string(channels) + " channels";
+    Check(FlacMatches(path, samples, 16000, channels, true, what.c_str()), "flac segment: not valid after close");
+    printf("flac segment: %zu frames of %u channels in %" PRIu64 " bytes, %.1f%% of the PCM\n", frames, channels,
+           segment.file_bytes(), 100.0 * segment.file_bytes() / bytes);
+    unlink(path.c_str());
+}
+
+void TestFlacRotation() {
+    // 3.3 s at 16 kHz rotated every second: four segments, each with a short last block
+    constexpr uint32_t RATE = 16000;
+    constexpr size_t PACKET = 480;
+    std::vector<int16_t> samples = TestSignal(RATE * 33 / 10, 1);
+    std::string base = "/tmp/recording_segment_test_" + std::to_string(getpid());
+    {
+        DiskWriter writer;
+        writer.set_format(RecordingFormat::FLAC, 2);
+        writer.set_rotation(1, 0);
+        writer.start(base, RATE);
+        for (size_t offset = 0; offset < samples.size(); offset += PACKET) {
+            writer.append(samples.data() + offset, std::min(PACKET, samples.size() - offset) * sizeof(int16_t));
+        }
+        writer.stop();
+        Check(writer.get_stats().segments == 4, "flac rotation: not four segments");
+    }
+
+    std::vector<int16_t> joined;
+    for (int index = 0; index < 4; index++) {
+        char suffix[16] = "";
+        if (index > 0) {
+            snprintf(suffix, sizeof(suffix), "_%03d", index);
+        }
+        std::string path = base + suffix + ".flac";
+        size_t first = index * RATE;
+        size_t count = std::min<size_t>(RATE, samples.size() - first);
+        std::vector<int16_t> expected(samples.begin() + first, samples.begin() + first + count);
+        std::string what = "flac rotation, segment " + std::to_string(index);
+        if (FlacMatches(path, expected, RATE, 1, true, what.c_str())) {
+            joined.insert(joined.end(), expected.begin(), expected.end());
+        }
+        unlink(path.c_str());
+    }
+    Check(joined == samples, "flac rotation: the segments do not join up to the recording");
+    printf("flac rotation: %zu frames in 4 segments, %s\n", samples.size(),
+           HaveFlac() ? "flac -t too" : "flac not installed, reference decoder only");
+}
+
+}  // namespace
+
+int main() {
+    TestRf64Switch();
+    TestWavSegment();
+    TestFlacSegment(1);
+    TestFlacSegment(2);
+    TestFlacSegment(3);
+    TestFlacRotation();
+    printf("%s\n", failed == 0 ? "ok" : "FAILED");
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,148 @@
+// Switches latency profile and sample rate back and forth while the stream runs, the way a
+// control message or the congestion controller does at runtime, and checks that packets of the
+// new shape come out after every switch. Each switch stops the send path and detaches the ring
+// under a send tick that may still be running; build with -DHOST_SANITIZE=ON to have a use
+// after free reported rather than just risked.
+//
+// Build: see CMakeLists.txt
+// Run:   runtime_switch_test [--timer] [--port n] [--rounds n]
+//        the exit code says whether every switch came through
+#include "audio_processor.h"
+#include "i2s_codec.h"
+#include "latency_profile.h"
+#include "udp_server.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+namespace {
+
+constexpr uint32_t SWITCH_TIMEOUT_MS = 1000;
+constexpr uint32_t RATES[] = {16000, 8000, 48000, 16000, 24000};
+
+void Send(int socket_fd, const sockaddr_in& server_addr, MessageType type) {
+    MessageHeader header = {
+        .type = type,
+        .version = PROTOCOL_VERSION,
+        .codec = AudioCodec::PCM16,
+        .sample_rate_khz = 0,
+    };
+    sendto(socket_fd, &header, sizeof(header), 0, reinterpret_cast<const sockaddr*>(&server_addr),
+           sizeof(server_addr));
+}
+
+/* reads until a PCM16 packet at rate_khz with samples samples arrives, false on timeout */
+bool AwaitPacket(int socket_fd, const sockaddr_in& server_addr, uint8_t rate_khz, size_t samples) {
+    uint8_t buffer[MAX_DATAGRAM_SIZE];
+    int64_t start_us = esp_timer_get_time();
+    while (esp_timer_get_time() - start_us < static_cast<int64_t>(SWITCH_TIMEOUT_MS) * 1000) {
+        Send(socket_fd, server_addr, MessageType::KEEPALIVE);
+        ssize_t len = recv(socket_fd, buffer, sizeof(buffer), 0);
+        if (len < static_cast<ssize_t>(DATA_HEADERS_SIZE)) {
+            continue;
+        }
+        MessageHeader header;
+        memcpy(&header, buffer, sizeof(header));
+        if (header.type == MessageType::DATA && header.codec == AudioCodec::PCM16 &&
+            header.sample_rate_khz == rate_khz &&
+            static_cast<size_t>(len) - DATA_HEADERS_SIZE == samples * sizeof(int16_t)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    bool timer_mode = false;
+    uint16_t port = 6302;
+    uint32_t rounds = 3;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--timer") {
+            timer_mode = true;
+        } else if (arg == "--port" && i + 1 < argc) {
+            port = static_cast<uint16_t>(strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--rounds" && i + 1 < argc) {
+            rounds = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        } else {
+            fprintf(stderr, "usage: %s [--timer] [--port n] [--rounds n]\n", argv[0]);
+            return 1;
+        }
+    }
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    auto& udp_server = UDPServer::GetInstance();
+    if (!udp_server.Initialize(port)) {
+        fprintf(stderr, "failed to initialize the UDP server on port %u\n", port);
+        return 1;
+    }
+
+    int socket_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    timeval timeout = {.tv_sec = 0, .tv_usec = 20 * 1000};
+    setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    sockaddr_in server_addr = {};
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(port);
+    server_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    Send(socket_fd, server_addr, MessageType::KEEPALIVE);
+    vTaskDelay(pdMS_TO_TICKS(200));
+
+    I2SCodec codec(RATES[0], AUDIO_I2S_MIC_GPIO_SCK, AUDIO_I2S_MIC_GPIO_WS, AUDIO_I2S_MIC_GPIO_DIN);
+    codec.SetCaptureMode(timer_mode ? I2SCodec::CaptureMode::TIMER : I2SCodec::CaptureMode::DMA_EVENT);
+    auto& audio_processor = AudioProcessor::GetInstance();
+    audio_processor.SetStreamCodec(AudioCodec::PCM16);
+    audio_processor.SetFecGroupSize(0);
+    audio_processor.SetVadEnabled(false);
+    audio_processor.SetCongestionControl(false);
+    if (!audio_processor.Initialize(&codec) || !codec.Initialize()) {
+        fprintf(stderr, "failed to start the capture path\n");
+        return 1;
+    }
+    printf("%s capture, %" PRIu32 " rounds\n", timer_mode ? "timer" : "dma event", rounds);
+
+    int failed = 0;
+    uint32_t switches = 0;
+    auto check = [&](const char* what) {
+        switches++;
+        uint32_t rate = audio_processor.GetSampleRate();
+        size_t samples = audio_processor.GetSamplesPerPacket();
+        if (!AwaitPacket(socket_fd, server_addr, static_cast<uint8_t>(rate / 1000), samples)) {
+            printf("FAILED: no %zu sample packets at %" PRIu32 " Hz after %s\n", samples, rate, what);
+            failed++;
+        }
+    };
+
+    for (uint32_t round = 0; round < rounds; round++) {
+        for (const LatencyProfile& profile : LATENCY_PROFILES) {
+            if (!audio_processor.SetLatencyProfile(profile.frame_ms)) {
+                printf("FAILED: SetLatencyProfile(%" PRIu32 ")\n", profile.frame_ms);
+                failed++;
+                continue;
+            }
+            check("a profile switch");
+            for (uint32_t rate : RATES) {
+                if (!audio_processor.SetSampleRate(rate)) {
+                    printf("FAILED: SetSampleRate(%" PRIu32 ")\n", rate);
+                    failed++;
+                    continue;
+                }
+                check("a rate switch");
+            }
+        }
+    }
+
+    audio_processor.Deinitialize();
+    codec.Deinitialize();
+    Send(socket_fd, server_addr, MessageType::DISCONNECT);
+    close(socket_fd);
+
+    printf("%" PRIu32 " switches, %s\n", switches, failed == 0 ? "ok" : "FAILED");
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+/* host build: no iram or dram placement */
+#define IRAM_ATTR
+#define DRAM_ATTR
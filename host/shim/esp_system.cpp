@@ -0,0 +1,86 @@
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+/* esp_err, esp_log and heap_caps for the host build */
+
+const char* esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+        default: return "UNKNOWN ERROR";
+    }
+}
+
+void _esp_error_check_failed(esp_err_t rc, const char* file, int line, const char* function, const char* expression) {
+    fprintf(stderr, "ESP_ERROR_CHECK failed: esp_err_t 0x%x (%s) at %s:%d\nfile: \"%s\" line %d\nfunc: %s\nexpression: %s\n",
+            rc, esp_err_to_name(rc), file, line, file, line, function, expression);
+    abort();
+}
+
+static std::atomic<esp_log_level_t> log_level{ESP_LOG_INFO};
+static std::mutex log_mutex;
+
+void esp_log_level_set(const char* tag, esp_log_level_t level) {
+    if (tag && strcmp(tag, "*") == 0) {
+        log_level = level;
+    }
+}
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...) {
+    if (level > log_level.load(std::memory_order_relaxed) || level == ESP_LOG_NONE) {
+        return;
+    }
+
+    static const char LETTERS[] = "NEWIDV";
+    char message[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+
+    // one line per call even with several tasks logging at once
+    std::lock_guard<std::mutex> lock(log_mutex);
+    printf("%c (%lld) %s: %s\n", LETTERS[level], static_cast<long long>(esp_timer_get_time() / 1000), tag, message);
+    fflush(stdout);
+}
+
+void* heap_caps_malloc(size_t size, uint32_t caps) {
+    return malloc(size);
+}
+
+void* heap_caps_calloc(size_t n, size_t size, uint32_t caps) {
+    return calloc(n, size);
+}
+
+void* heap_caps_aligned_alloc(size_t alignment, size_t size, uint32_t caps) {
+    void* ptr = nullptr;
+    return posix_memalign(&ptr, alignment, size) == 0 ? ptr : nullptr;
+}
+
+void* heap_caps_aligned_calloc(size_t alignment, size_t n, size_t size, uint32_t caps) {
+    if (size != 0 && n > SIZE_MAX / size) {
+        return nullptr;
+    }
+    void* ptr = heap_caps_aligned_alloc(alignment, n * size, caps);
+    if (ptr) {
+        memset(ptr, 0, n * size);
+    }
+    return ptr;
+}
+
+void heap_caps_free(void* ptr) {
+    free(ptr);
+}
@@ -0,0 +1,147 @@
+#include "esp_timer.h"
+#include <pthread.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void* arg;
+    bool skip_unhandled_events;
+    bool armed = false;
+    uint64_t period_us = 0;   /* 0 for one-shot */
+    int64_t alarm_us = 0;
+};
+
+namespace {
+
+const auto process_start = std::chrono::steady_clock::now();
+
+/* the dispatch thread is started with the first timer and lives as long as the process, so its
+   state is never destroyed: exit would otherwise tear the condition variable down under it */
+struct TimerService {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<esp_timer*> timers;
+    std::thread::id dispatch_thread_id;
+};
+TimerService& service = *new TimerService;
+
+void DispatchTask() {
+    pthread_setname_np(pthread_self(), "esp_timer");
+    std::unique_lock<std::mutex> lock(service.mutex);
+    while (true) {
+        esp_timer* next = nullptr;
+        for (esp_timer* timer : service.timers) {
+            if (timer->armed && (!next || timer->alarm_us < next->alarm_us)) {
+                next = timer;
+            }
+        }
+        if (!next) {
+            service.changed.wait(lock);
+            continue;
+        }
+
+        int64_t now_us = esp_timer_get_time();
+        if (next->alarm_us > now_us) {
+            service.changed.wait_for(lock, std::chrono::microseconds(next->alarm_us - now_us));
+            continue;   /* the timer may have been stopped or a nearer one started */
+        }
+
+        if (next->period_us == 0) {
+            next->armed = false;
+        } else if (next->skip_unhandled_events && next->alarm_us + static_cast<int64_t>(next->period_us) <= now_us) {
+            // late by more than a period: run once, then stay on the original phase
+            int64_t missed = (now_us - next->alarm_us) / static_cast<int64_t>(next->period_us);
+            next->alarm_us += (missed + 1) * static_cast<int64_t>(next->period_us);
+        } else {
+            next->alarm_us += static_cast<int64_t>(next->period_us);
+        }
+
+        esp_timer_cb_t callback = next->callback;
+        void* arg = next->arg;
+        lock.unlock();
+        callback(arg);
+        lock.lock();
+    }
+}
+
+esp_err_t Arm(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us) {
+    if (!timer) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(service.mutex);
+    if (timer->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->armed = true;
+    timer->period_us = period_us;
+    timer->alarm_us = esp_timer_get_time() + static_cast<int64_t>(timeout_us);
+    service.changed.notify_all();
+    return ESP_OK;
+}
+
+}  // namespace
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle) {
+    if (!create_args || !create_args->callback || !out_handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    std::lock_guard<std::mutex> lock(service.mutex);
+    if (service.dispatch_thread_id == std::thread::id()) {
+        std::thread dispatcher(DispatchTask);
+        service.dispatch_thread_id = dispatcher.get_id();
+        dispatcher.detach();
+    }
+    esp_timer* timer = new esp_timer{
+        .callback = create_args->callback,
+        .arg = create_args->arg,
+        .skip_unhandled_events = create_args->skip_unhandled_events,
+    };
+    service.timers.push_back(timer);
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    return Arm(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+    return Arm(timer, period, period);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (!timer) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(service.mutex);
+    if (!timer->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->armed = false;
+    service.changed.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    if (!timer) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(service.mutex);
+    if (timer->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    service.timers.erase(std::remove(service.timers.begin(), service.timers.end(), timer), service.timers.end());
+    delete timer;
+    return ESP_OK;
+}
+
+int64_t esp_timer_get_time() {
+    auto elapsed = std::chrono::steady_clock::now() - process_start;
+    return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
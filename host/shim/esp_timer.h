@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include "esp_err.h"
+
+/* host build: one dispatch thread runs every timer callback, like the esp_timer task, so
+   callbacks of different timers never overlap. esp_timer_get_time is CLOCK_MONOTONIC in
+   microseconds since the process started */
+
+typedef struct esp_timer* esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void* arg);
+
+typedef enum {
+    ESP_TIMER_TASK,
+    ESP_TIMER_ISR,   /* dispatched from the same thread as ESP_TIMER_TASK */
+} esp_timer_dispatch_t;
+
+typedef struct {
+    esp_timer_cb_t callback;
+    void* arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char* name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+/* like esp-idf, does not wait for a callback of this timer that is still running: the caller
+   has to keep what the callback uses alive until it has returned */
+esp_err_t esp_timer_delete(esp_timer_handle_t timer);
+int64_t esp_timer_get_time();
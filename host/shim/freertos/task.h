@@ -0,0 +1,29 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+/* host build: every task is a std::thread named after it. priorities and core affinity are
+   ignored, the linux scheduler decides. the direct to task notification is a counting
+   semaphore, which is all the firmware uses it as.
+
+   vTaskDelete(nullptr) cannot end a thread from the middle of a function: it only marks the
+   task, which ends when its function returns. the firmware calls it as the last statement of
+   every task. vTaskDelete on another task waits for that task to return, the callers stop it
+   through a flag first */
+
+typedef struct tskTaskControlBlock* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_depth,
+                       void* parameters, UBaseType_t priority, TaskHandle_t* created_task);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth,
+                                   void* parameters, UBaseType_t priority, TaskHandle_t* created_task,
+                                   BaseType_t core_id);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+TaskHandle_t xTaskGetCurrentTaskHandle();
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit, TickType_t ticks_to_wait);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higher_priority_task_woken);
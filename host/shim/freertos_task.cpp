@@ -0,0 +1,140 @@
+#include "freertos/task.h"
+#include <pthread.h>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+struct tskTaskControlBlock {
+    std::string name;
+    std::mutex mutex;
+    std::condition_variable notified;
+    std::condition_variable finished_cv;
+    uint32_t notification_count = 0;
+    bool finished = false;
+};
+
+namespace {
+
+/* a task is kept alive by its own thread and by this table until it returns, so vTaskDelete
+   on a handle whose task already ended finds nothing and returns. the table outlives exit, tasks
+   that are still running then must not find it destroyed */
+struct TaskTable {
+    std::mutex mutex;
+    std::unordered_map<TaskHandle_t, std::shared_ptr<tskTaskControlBlock>> tasks;
+};
+TaskTable& task_table = *new TaskTable;
+thread_local TaskHandle_t current_task = nullptr;
+
+std::shared_ptr<tskTaskControlBlock> FindTask(TaskHandle_t task) {
+    std::lock_guard<std::mutex> lock(task_table.mutex);
+    auto it = task_table.tasks.find(task);
+    return it == task_table.tasks.end() ? nullptr : it->second;
+}
+
+void RunTask(std::shared_ptr<tskTaskControlBlock> task, TaskFunction_t function, void* parameters) {
+    current_task = task.get();
+    pthread_setname_np(pthread_self(), task->name.substr(0, 15).c_str());
+    function(parameters);
+
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->finished = true;
+    }
+    task->finished_cv.notify_all();
+    std::lock_guard<std::mutex> lock(task_table.mutex);
+    task_table.tasks.erase(task.get());
+}
+
+}  // namespace
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_depth,
+                       void* parameters, UBaseType_t priority, TaskHandle_t* created_task) {
+    auto task = std::make_shared<tskTaskControlBlock>();
+    task->name = name ? name : "task";
+    {
+        std::lock_guard<std::mutex> lock(task_table.mutex);
+        task_table.tasks[task.get()] = task;
+    }
+    if (created_task) {
+        *created_task = task.get();
+    }
+    std::thread(RunTask, task, function, parameters).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth,
+                                   void* parameters, UBaseType_t priority, TaskHandle_t* created_task,
+                                   BaseType_t core_id) {
+    return xTaskCreate(function, name, stack_depth, parameters, priority, created_task);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (!task || task == current_task) {
+        return;   /* ends when the task function returns */
+    }
+    std::shared_ptr<tskTaskControlBlock> block = FindTask(task);
+    if (!block) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(block->mutex);
+    block->finished_cv.wait(lock, [&] { return block->finished; });
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+}
+
+TickType_t xTaskGetTickCount() {
+    static const auto start = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return static_cast<TickType_t>(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() /
+                                   portTICK_PERIOD_MS);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    return current_task;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit, TickType_t ticks_to_wait) {
+    TaskHandle_t task = current_task;
+    if (!task) {
+        return 0;   /* the main thread is not a task */
+    }
+
+    std::unique_lock<std::mutex> lock(task->mutex);
+    auto pending = [task] { return task->notification_count > 0; };
+    if (ticks_to_wait == portMAX_DELAY) {
+        task->notified.wait(lock, pending);
+    } else {
+        task->notified.wait_for(lock, std::chrono::milliseconds(ticks_to_wait * portTICK_PERIOD_MS), pending);
+    }
+
+    uint32_t count = task->notification_count;
+    if (count > 0) {
+        task->notification_count = clear_count_on_exit ? 0 : count - 1;
+    }
+    return count;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    std::shared_ptr<tskTaskControlBlock> block = FindTask(task);
+    if (block) {
+        {
+            std::lock_guard<std::mutex> lock(block->mutex);
+            block->notification_count++;
+        }
+        block->notified.notify_one();
+    }
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higher_priority_task_woken) {
+    xTaskNotifyGive(task);
+    if (higher_priority_task_woken) {
+        *higher_priority_task_woken = pdFALSE;
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/* host build only: what the simulated i2s rx channel (driver/i2s_std.h) captures.
+
+   the source is 16-bit pcm, placed in the 32-bit slot as sample << AUDIO_I2S_SAMPLE_SHIFT so the
+   firmware's plain narrowing gives back the source samples. by default it is a synthetic talker:
+   1.2 s of a voiced, syllable modulated harmonic tone, then 0.8 s of background noise at about
+   -60 dBFS, over a small dc offset, so the vad, dc blocker and agc all have work to do. a wav file
+   (16-bit pcm, first channel) replaces it and loops, it is played at the channel's rate whatever
+   rate it was recorded at.
+
+   the capture clock starts when the channel is enabled and counts samples from there: sample n
+   is captured at HostI2sCaptureTimeUs(n), when the dma buffer holding it completes. with the
+   microphone callbacks registered before the codec is initialized (AudioProcessor::Initialize
+   only needs the codec's configuration), n is also the ring buffer position AudioProcessor stamps
+   into DataHeader.sample_index, as long as no dma buffer is overwritten, no sample is dropped at
+   the ring buffer and the rate does not change. one rx channel at a time */
+
+bool HostI2sLoadWav(const char* path);
+/* the same from memory, for tests that synthesize their own signal */
+bool HostI2sLoadSamples(const int16_t* samples, size_t count);
+
+/* esp_timer_get_time() at which the dma buffer holding sample sample_index completed, the index
+   wraps at 32 bits like DataHeader.sample_index. -1 before the channel was enabled */
+int64_t HostI2sCaptureTimeUs(uint32_t sample_index);
+/* esp_timer_get_time() at which sample sample_index was at the microphone, a dma buffer earlier
+   for its first sample. the latency a listener hears is measured from here */
+int64_t HostI2sSampleTimeUs(uint32_t sample_index);
+
+struct HostI2sStats {
+    uint64_t samples_captured;
+    uint32_t dma_overflows;     /* filled buffers overwritten before they were read */
+    uint64_t dma_cpu_us;        /* thread cpu time of the simulated dma engine, not firmware work */
+};
+HostI2sStats HostI2sGetStats();
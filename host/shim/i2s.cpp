@@ -0,0 +1,399 @@
+#include "driver/i2s_std.h"
+#include "host_i2s.h"
+#include "audio_config.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <pthread.h>
+#include <time.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static const char* TAG = "HostI2S";
+
+struct i2s_channel_obj_t {
+    uint32_t dma_desc_num;
+    uint32_t dma_frame_num;
+    uint32_t sample_rate = 0;
+    i2s_event_callbacks_t callbacks = {};
+    void* user_ctx = nullptr;
+
+    /* filled dma buffers, oldest first from head */
+    std::mutex mutex;
+    std::condition_variable filled;
+    std::condition_variable stopped;
+    std::vector<std::vector<int32_t>> buffers;
+    size_t head = 0;
+    size_t count = 0;
+    size_t read_offset = 0;   /* words of the head buffer already read */
+    bool enabled = false;
+    std::thread dma;
+};
+
+namespace {
+
+/* the source and the capture clock of the enabled channel */
+std::mutex source_mutex;
+std::vector<int16_t> wav_samples;
+size_t wav_position = 0;
+uint32_t noise_state = 1;
+
+std::atomic<int64_t> clock_start_us{-1};
+std::atomic<uint64_t> buffer_period_us{0};
+std::atomic<uint32_t> buffer_frames{0};
+std::atomic<uint64_t> samples_captured{0};
+std::atomic<uint32_t> dma_overflows{0};
+std::atomic<uint64_t> dma_cpu_us{0};
+
+constexpr double PI = 3.14159265358979323846;
+
+/* voiced for 1.2 s of every 2 s: a 140 Hz harmonic series under a 4 Hz syllable envelope, peaking
+   around -12 dBFS, then background noise only */
+int16_t SyntheticSample(uint64_t n, uint32_t sample_rate) {
+    constexpr double CYCLE_S = 2.0;
+    constexpr double VOICED_S = 1.2;
+    constexpr double F0_HZ = 140.0;
+    constexpr int DC_OFFSET = 200;
+
+    noise_state = noise_state * 1664525u + 1013904223u;
+    double value = DC_OFFSET + static_cast<int32_t>(noise_state >> 25) - 64;   /* ~ -60 dBFS rms */
+
+    double t = static_cast<double>(n) / sample_rate;
+    double cycle_t = std::fmod(t, CYCLE_S);
+    if (cycle_t < VOICED_S) {
+        double envelope = 0.5 * (1.0 - std::cos(2.0 * PI * 4.0 * cycle_t));
+        double voice = 0.0;
+        for (int h = 1; h <= 8 && F0_HZ * h < sample_rate / 2; h++) {
+            voice += std::sin(2.0 * PI * F0_HZ * h * t) / h;
+        }
+        value += 3000.0 * envelope * voice;
+    }
+    return static_cast<int16_t>(std::lround(std::fmax(-32767.0, std::fmin(32767.0, value))));
+}
+
+void FillBuffer(std::vector<int32_t>& buffer, uint64_t first_sample, uint32_t sample_rate) {
+    std::lock_guard<std::mutex> lock(source_mutex);
+    for (size_t i = 0; i < buffer.size(); i++) {
+        int32_t sample;
+        if (!wav_samples.empty()) {
+            sample = wav_samples[wav_position];
+            wav_position = (wav_position + 1) % wav_samples.size();
+        } else {
+            sample = SyntheticSample(first_sample + i, sample_rate);
+        }
+        buffer[i] = static_cast<int32_t>(static_cast<uint32_t>(sample) << AUDIO_I2S_SAMPLE_SHIFT);
+    }
+}
+
+uint64_t ThreadCpuUs() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+void DmaTask(i2s_chan_handle_t handle) {
+    pthread_setname_np(pthread_self(), "i2s_dma");
+    const uint64_t period_us = static_cast<uint64_t>(handle->dma_frame_num) * 1000000 / handle->sample_rate;
+    const int64_t start_us = esp_timer_get_time();
+    buffer_period_us = period_us;
+    buffer_frames = handle->dma_frame_num;
+    samples_captured = 0;
+    clock_start_us = start_us;
+
+    std::vector<int32_t> block(handle->dma_frame_num);
+    uint64_t cpu_us = ThreadCpuUs();
+    for (uint64_t index = 0;; index++) {
+        // buffer index completes at the end of its period, paced against the start so it never drifts
+        int64_t due_us = start_us + static_cast<int64_t>((index + 1) * period_us);
+        {
+            std::unique_lock<std::mutex> lock(handle->mutex);
+            int64_t wait_us = due_us - esp_timer_get_time();
+            if (wait_us > 0) {
+                handle->stopped.wait_for(lock, std::chrono::microseconds(wait_us), [handle] { return !handle->enabled; });
+            }
+            if (!handle->enabled) {
+                break;
+            }
+        }
+
+        FillBuffer(block, index * handle->dma_frame_num, handle->sample_rate);
+
+        i2s_event_data_t event;
+        bool overflow = false;
+        {
+            std::lock_guard<std::mutex> lock(handle->mutex);
+            if (handle->count == handle->dma_desc_num) {
+                // the reader fell behind, the oldest filled buffer is reused
+                handle->head = (handle->head + 1) % handle->dma_desc_num;
+                handle->count--;
+                handle->read_offset = 0;
+                overflow = true;
+            }
+            std::vector<int32_t>& buffer = handle->buffers[(handle->head + handle->count) % handle->dma_desc_num];
+            buffer = block;
+            handle->count++;
+            event.data = buffer.data();
+            event.size = buffer.size() * sizeof(int32_t);
+        }
+        handle->filled.notify_all();
+        samples_captured += handle->dma_frame_num;
+
+        if (overflow) {
+            dma_overflows++;
+            if (handle->callbacks.on_recv_q_ovf) {
+                handle->callbacks.on_recv_q_ovf(handle, &event, handle->user_ctx);
+            }
+        }
+        if (handle->callbacks.on_recv) {
+            handle->callbacks.on_recv(handle, &event, handle->user_ctx);
+        }
+        uint64_t now_cpu_us = ThreadCpuUs();
+        dma_cpu_us += now_cpu_us - cpu_us;
+        cpu_us = now_cpu_us;
+    }
+}
+
+}  // namespace
+
+esp_err_t i2s_new_channel(const i2s_chan_config_t* chan_cfg, i2s_chan_handle_t* ret_tx_handle,
+                          i2s_chan_handle_t* ret_rx_handle) {
+    if (!chan_cfg || ret_tx_handle || !ret_rx_handle || chan_cfg->dma_desc_num < 2 || chan_cfg->dma_frame_num == 0) {
+        return ESP_ERR_INVALID_ARG;   /* rx only */
+    }
+    i2s_channel_obj_t* channel = new i2s_channel_obj_t;
+    channel->dma_desc_num = chan_cfg->dma_desc_num;
+    channel->dma_frame_num = chan_cfg->dma_frame_num;
+    channel->buffers.resize(chan_cfg->dma_desc_num);
+    *ret_rx_handle = channel;
+    return ESP_OK;
+}
+
+esp_err_t i2s_del_channel(i2s_chan_handle_t handle) {
+    if (!handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    i2s_channel_disable(handle);
+    delete handle;
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_init_std_mode(i2s_chan_handle_t handle, const i2s_std_config_t* std_cfg) {
+    if (!handle || !std_cfg || std_cfg->clk_cfg.sample_rate_hz == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (std_cfg->slot_cfg.data_bit_width != I2S_DATA_BIT_WIDTH_32BIT ||
+        std_cfg->slot_cfg.slot_mode != I2S_SLOT_MODE_MONO) {
+        ESP_LOGE(TAG, "Only mono 32-bit slots are simulated");
+        return ESP_ERR_INVALID_ARG;
+    }
+    handle->sample_rate = std_cfg->clk_cfg.sample_rate_hz;
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_reconfig_std_clock(i2s_chan_handle_t handle, const i2s_std_clk_config_t* clk_cfg) {
+    if (!handle || !clk_cfg || clk_cfg->sample_rate_hz == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(handle->mutex);
+    if (handle->enabled) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    handle->sample_rate = clk_cfg->sample_rate_hz;
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_register_event_callback(i2s_chan_handle_t handle, const i2s_event_callbacks_t* callbacks,
+                                              void* user_data) {
+    if (!handle || !callbacks) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (handle->enabled) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    handle->callbacks = *callbacks;
+    handle->user_ctx = user_data;
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_enable(i2s_chan_handle_t handle) {
+    if (!handle || handle->sample_rate == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    std::lock_guard<std::mutex> lock(handle->mutex);
+    if (handle->enabled) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    handle->enabled = true;
+    handle->head = 0;
+    handle->count = 0;
+    handle->read_offset = 0;
+    handle->dma = std::thread(DmaTask, handle);
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_disable(i2s_chan_handle_t handle) {
+    if (!handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    {
+        std::lock_guard<std::mutex> lock(handle->mutex);
+        if (!handle->enabled) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        handle->enabled = false;
+    }
+    handle->stopped.notify_all();
+    handle->filled.notify_all();
+    handle->dma.join();
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_read(i2s_chan_handle_t handle, void* dest, size_t size, size_t* bytes_read,
+                           uint32_t timeout_ms) {
+    if (!handle || !dest) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint8_t* out = static_cast<uint8_t*>(dest);
+    size_t copied = 0;
+    esp_err_t result = ESP_OK;
+    std::unique_lock<std::mutex> lock(handle->mutex);
+    while (copied < size) {
+        auto ready = [handle] { return handle->count > 0 || !handle->enabled; };
+        if (timeout_ms == portMAX_DELAY) {
+            handle->filled.wait(lock, ready);
+        } else {
+            handle->filled.wait_for(lock, std::chrono::milliseconds(timeout_ms), ready);
+        }
+        if (!handle->enabled) {
+            result = ESP_ERR_INVALID_STATE;
+            break;
+        }
+        if (handle->count == 0) {
+            result = ESP_ERR_TIMEOUT;
+            break;
+        }
+
+        const std::vector<int32_t>& buffer = handle->buffers[handle->head];
+        size_t available = (buffer.size() - handle->read_offset) * sizeof(int32_t);
+        size_t chunk = std::min(available, size - copied);
+        memcpy(out + copied, reinterpret_cast<const uint8_t*>(buffer.data()) + handle->read_offset * sizeof(int32_t),
+               chunk);
+        copied += chunk;
+        handle->read_offset += chunk / sizeof(int32_t);
+        if (handle->read_offset == buffer.size()) {
+            handle->head = (handle->head + 1) % handle->dma_desc_num;
+            handle->count--;
+            handle->read_offset = 0;
+        }
+    }
+
+    if (bytes_read) {
+        *bytes_read = copied;
+    }
+    return result;
+}
+
+bool HostI2sLoadWav(const char* path) {
+    std::ifstream file(path, std::ios::binary);
+    std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (data.size() < 12 || memcmp(data.data(), "RIFF", 4) != 0 || memcmp(data.data() + 8, "WAVE", 4) != 0) {
+        ESP_LOGE(TAG, "%s is not a WAV file", path);
+        return false;
+    }
+
+    auto read_u16 = [&](size_t pos) { uint16_t v; memcpy(&v, data.data() + pos, sizeof(v)); return v; };
+    auto read_u32 = [&](size_t pos) { uint32_t v; memcpy(&v, data.data() + pos, sizeof(v)); return v; };
+    uint16_t format = 0, channels = 0, bits = 0;
+    uint32_t rate = 0;
+    size_t pos = 12;
+    while (pos + 8 <= data.size()) {
+        size_t size = read_u32(pos + 4);
+        size_t body = pos + 8;
+        // udp_client leaves the data size at 0 when it is killed mid-recording
+        size_t available = std::min(size == 0 ? data.size() - body : size, data.size() - body);
+        if (memcmp(data.data() + pos, "fmt ", 4) == 0 && available >= 16) {
+            format = read_u16(body);
+            channels = read_u16(body + 2);
+            rate = read_u32(body + 4);
+            bits = read_u16(body + 14);
+        } else if (memcmp(data.data() + pos, "data", 4) == 0) {
+            if (format != 1 || bits != 16 || channels == 0) {
+                ESP_LOGE(TAG, "%s: only 16-bit PCM is supported", path);
+                return false;
+            }
+            size_t frames = available / (2 * channels);
+            if (frames == 0) {
+                break;
+            }
+            std::lock_guard<std::mutex> lock(source_mutex);
+            wav_samples.resize(frames);
+            for (size_t i = 0; i < frames; i++) {
+                memcpy(&wav_samples[i], data.data() + body + i * 2 * channels, sizeof(int16_t));
+            }
+            wav_position = 0;
+            ESP_LOGI(TAG, "Capturing %s: %zu samples recorded at %u Hz, looped", path, frames, rate);
+            return true;
+        }
+        pos = body + size + (size & 1);
+    }
+    ESP_LOGE(TAG, "%s has no samples", path);
+    return false;
+}
+
+bool HostI2sLoadSamples(const int16_t* samples, size_t count) {
+    if (count == 0) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(source_mutex);
+    wav_samples.assign(samples, samples + count);
+    wav_position = 0;
+    return true;
+}
+
+namespace {
+
+/* the latest 64-bit capture position with these low 32 bits, at most one wrap behind the capture */
+uint64_t UnwrapSampleIndex(uint32_t sample_index) {
+    uint64_t captured = samples_captured.load();
+    uint64_t position = (captured & ~0xFFFFFFFFull) | sample_index;
+    if (position >= captured && position >= (1ull << 32)) {
+        position -= 1ull << 32;
+    }
+    return position;
+}
+
+}  // namespace
+
+int64_t HostI2sCaptureTimeUs(uint32_t sample_index) {
+    int64_t start_us = clock_start_us.load();
+    uint32_t frames = buffer_frames.load();
+    if (start_us < 0 || frames == 0) {
+        return -1;
+    }
+    return start_us + static_cast<int64_t>((UnwrapSampleIndex(sample_index) / frames + 1) * buffer_period_us.load());
+}
+
+int64_t HostI2sSampleTimeUs(uint32_t sample_index) {
+    int64_t start_us = clock_start_us.load();
+    uint32_t frames = buffer_frames.load();
+    if (start_us < 0 || frames == 0) {
+        return -1;
+    }
+    return start_us + static_cast<int64_t>(UnwrapSampleIndex(sample_index) * buffer_period_us.load() / frames);
+}
+
+HostI2sStats HostI2sGetStats() {
+    return {
+        .samples_captured = samples_captured.load(),
+        .dma_overflows = dma_overflows.load(),
+        .dma_cpu_us = dma_cpu_us.load(),
+    };
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+/* host build: lwip's bsd socket api is the linux one */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+static inline char* inet_ntoa_r(struct in_addr addr, char* buf, int buflen) {
+    return inet_ntop(AF_INET, &addr, buf, buflen) ? buf : nullptr;
+}
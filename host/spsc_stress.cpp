@@ -0,0 +1,174 @@
+// One producer thread and one consumer thread push a running sequence number through
+// SpscRingBuffer (main/audio/spsc_ring_buffer.h) and check that it comes out unbroken. Both sides
+// move odd sized chunks (never a divisor of the capacity) so the copies and the spans split at
+// the wrap in every possible place, and alternate between the copying calls (Write, Read) and
+// the zero-copy ones (WriteSpan/CommitWrite, ReadSpan/CommitRead, ReadSpanAt). A retention keeps
+// the newest consumed elements, which the consumer reads back with RetainedSpanAt.
+//
+// Build: see CMakeLists.txt
+// Run:   spsc_stress [--elements n]
+//        the exit code says whether the sequence arrived complete and in order
+#include "spsc_ring_buffer.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr size_t CAPACITY = 1024;
+constexpr size_t RETENTION = 97;
+constexpr size_t PRODUCER_CHUNKS[] = {7, 13, 480, 1, 37, 250, 1000};
+constexpr size_t CONSUMER_CHUNKS[] = {11, 333, 3, 720, 29, 160};
+
+struct Result {
+    uint64_t errors = 0;
+    uint64_t first_error_at = 0;
+    uint64_t retained_checks = 0;
+    uint64_t empty_polls = 0;
+};
+
+void Produce(SpscRingBuffer<uint32_t>& ring, uint64_t elements, uint64_t& full_polls) {
+    std::vector<uint32_t> chunk(*std::max_element(std::begin(PRODUCER_CHUNKS), std::end(PRODUCER_CHUNKS)));
+    uint64_t next = 0;
+    for (size_t round = 0; next < elements; round++) {
+        size_t want = std::min<uint64_t>(PRODUCER_CHUNKS[round % std::size(PRODUCER_CHUNKS)], elements - next);
+        size_t written = 0;
+        if (round % 2 == 0) {
+            for (size_t i = 0; i < want; i++) {
+                chunk[i] = static_cast<uint32_t>(next + i);
+            }
+            written = ring.Write(chunk.data(), want);
+        } else {
+            std::span<uint32_t> span = ring.WriteSpan();
+            written = std::min(span.size(), want);
+            for (size_t i = 0; i < written; i++) {
+                span[i] = static_cast<uint32_t>(next + i);
+            }
+            ring.CommitWrite(written);
+        }
+        next += written;
+        if (written == 0) {
+            full_polls++;
+            std::this_thread::yield();
+        }
+    }
+}
+
+void Consume(SpscRingBuffer<uint32_t>& ring, uint64_t elements, Result& result) {
+    std::vector<uint32_t> chunk(*std::max_element(std::begin(CONSUMER_CHUNKS), std::end(CONSUMER_CHUNKS)));
+    uint64_t expected = 0;
+    auto check = [&](uint32_t value) {
+        if (value != static_cast<uint32_t>(expected) && result.errors++ == 0) {
+            result.first_error_at = expected;
+        }
+        expected++;
+    };
+
+    for (size_t round = 0; expected < elements; round++) {
+        size_t want = CONSUMER_CHUNKS[round % std::size(CONSUMER_CHUNKS)];
+        size_t read = 0;
+        switch (round % 3) {
+            case 0:
+                read = ring.Read(chunk.data(), want);
+                for (size_t i = 0; i < read; i++) {
+                    check(chunk[i]);
+                }
+                break;
+            case 1: {
+                std::span<const uint32_t> span = ring.ReadSpan();
+                read = std::min(span.size(), want);
+                for (size_t i = 0; i < read; i++) {
+                    check(span[i]);
+                }
+                ring.CommitRead(read);
+                break;
+            }
+            default:
+                // look ahead across the wrap, then consume what was looked at
+                for (size_t offset = 0; read < want;) {
+                    std::span<const uint32_t> span = ring.ReadSpanAt(offset);
+                    if (span.empty()) {
+                        break;
+                    }
+                    size_t count = std::min(span.size(), want - read);
+                    for (size_t i = 0; i < count; i++) {
+                        check(span[i]);
+                    }
+                    read += count;
+                    offset += count;
+                }
+                ring.CommitRead(read);
+                break;
+        }
+
+        // the retained elements behind the read position still hold their sequence numbers
+        size_t position = ring.ReadPosition();
+        size_t back = std::min<size_t>(position, RETENTION);
+        for (size_t start = position - back; start < position;) {
+            std::span<const uint32_t> span = ring.RetainedSpanAt(start);
+            if (span.empty()) {
+                if (result.errors++ == 0) {
+                    result.first_error_at = start;
+                }
+                break;
+            }
+            for (size_t i = 0; i < span.size(); i++) {
+                if (span[i] != static_cast<uint32_t>(start + i) && result.errors++ == 0) {
+                    result.first_error_at = start + i;
+                }
+            }
+            start += span.size();
+            result.retained_checks++;
+        }
+
+        if (read == 0) {
+            result.empty_polls++;
+            std::this_thread::yield();
+        }
+    }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    uint64_t elements = 20000000;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--elements" && i + 1 < argc) {
+            elements = strtoull(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--elements n]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<uint32_t> storage(CAPACITY);
+    SpscRingBuffer<uint32_t> ring;
+    ring.Attach(storage.data(), CAPACITY);
+    ring.SetRetention(RETENTION);
+
+    Result result;
+    uint64_t full_polls = 0;
+    std::thread consumer(Consume, std::ref(ring), elements, std::ref(result));
+    std::thread producer(Produce, std::ref(ring), elements, std::ref(full_polls));
+    producer.join();
+    consumer.join();
+
+    printf("%" PRIu64 " elements through a %zu slot ring (%zu retained), %" PRIu64 " wraps, %" PRIu64
+           " retained reads, %" PRIu64 " full and %" PRIu64 " empty polls\n",
+           elements, CAPACITY, RETENTION, elements / CAPACITY, result.retained_checks, full_polls,
+           result.empty_polls);
+    if (result.errors > 0 || ring.Size() != 0 || ring.ReadPosition() != elements) {
+        printf("FAILED: %" PRIu64 " errors, the first at element %" PRIu64 ", %zu left in the ring\n",
+               result.errors, result.first_error_at, ring.Size());
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
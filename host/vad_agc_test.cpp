@@ -0,0 +1,173 @@
+// Streams room noise at about -60 dBFS, with a short tone burst every few seconds, through the
+// firmware's capture path with the AGC on and voice activity detection on, and checks that the
+// noise goes out as SILENCE descriptors instead of audio. The AGC lifts that noise by up to
+// AUDIO_AGC_MAX_GAIN_DB ahead of the VAD, so this fails if the VAD compares the amplified level
+// against thresholds meant for the microphone's.
+//
+// Build: see CMakeLists.txt
+// Run:   vad_agc_test [--port n]
+//        the exit code says whether the checks passed
+#include "audio_processor.h"
+#include "host_i2s.h"
+#include "i2s_codec.h"
+#include "udp_server.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t SAMPLE_RATE = 16000;
+constexpr uint32_t NOISE_MS = 3000;
+constexpr uint32_t TONE_MS = 500;
+constexpr double NOISE_DBFS = -60.0;
+constexpr double TONE_DBFS = -30.0;
+constexpr uint32_t RUN_MS = 2 * (NOISE_MS + TONE_MS);
+
+/* gaussian noise throughout, the tone on top of it at the end of each loop */
+std::vector<int16_t> MakeSource() {
+    std::vector<int16_t> samples((NOISE_MS + TONE_MS) * SAMPLE_RATE / 1000);
+    std::mt19937 generator(1);
+    std::normal_distribution<double> noise(0.0, 32768.0 * std::pow(10.0, NOISE_DBFS / 20.0));
+    double tone_amplitude = 32768.0 * std::sqrt(2.0) * std::pow(10.0, TONE_DBFS / 20.0);
+    size_t tone_start = NOISE_MS * SAMPLE_RATE / 1000;
+    for (size_t i = 0; i < samples.size(); i++) {
+        double value = noise(generator);
+        if (i >= tone_start) {
+            value += tone_amplitude * std::sin(2.0 * M_PI * 440.0 * i / SAMPLE_RATE);
+        }
+        samples[i] = static_cast<int16_t>(std::lround(std::fmax(-32767.0, std::fmin(32767.0, value))));
+    }
+    return samples;
+}
+
+struct Received {
+    uint64_t audio_packets = 0;
+    uint64_t audio_samples = 0;
+    uint64_t silence_descriptors = 0;
+};
+
+void Send(int socket_fd, const sockaddr_in& server_addr, MessageType type) {
+    MessageHeader header = {
+        .type = type,
+        .version = PROTOCOL_VERSION,
+        .codec = AudioCodec::PCM16,
+        .sample_rate_khz = 0,
+    };
+    sendto(socket_fd, &header, sizeof(header), 0, reinterpret_cast<const sockaddr*>(&server_addr),
+           sizeof(server_addr));
+}
+
+void Handle(const uint8_t* data, size_t len, Received& received) {
+    MessageHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (header.type != MessageType::DATA || len < DATA_HEADERS_SIZE) {
+        return;
+    }
+    if (header.codec == AudioCodec::SILENCE) {
+        received.silence_descriptors++;
+    } else if (header.codec == AudioCodec::PCM16) {
+        received.audio_packets++;
+        received.audio_samples += (len - DATA_HEADERS_SIZE) / sizeof(int16_t);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    uint16_t port = 6301;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--port" && i + 1 < argc) {
+            port = static_cast<uint16_t>(strtoul(argv[++i], nullptr, 10));
+        } else {
+            fprintf(stderr, "usage: %s [--port n]\n", argv[0]);
+            return 1;
+        }
+    }
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    std::vector<int16_t> source = MakeSource();
+    HostI2sLoadSamples(source.data(), source.size());
+
+    auto& udp_server = UDPServer::GetInstance();
+    if (!udp_server.Initialize(port)) {
+        fprintf(stderr, "failed to initialize the UDP server on port %u\n", port);
+        return 1;
+    }
+
+    int socket_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    timeval timeout = {.tv_sec = 0, .tv_usec = 100 * 1000};
+    setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    sockaddr_in server_addr = {};
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(port);
+    server_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    Send(socket_fd, server_addr, MessageType::KEEPALIVE);
+    vTaskDelay(pdMS_TO_TICKS(200));
+
+    I2SCodec codec(SAMPLE_RATE, AUDIO_I2S_MIC_GPIO_SCK, AUDIO_I2S_MIC_GPIO_WS, AUDIO_I2S_MIC_GPIO_DIN);
+    codec.SetCaptureConditioning(true, true);
+    auto& audio_processor = AudioProcessor::GetInstance();
+    audio_processor.SetStreamCodec(AudioCodec::PCM16);
+    audio_processor.SetVadEnabled(true);
+    audio_processor.SetCongestionControl(false);
+    if (!audio_processor.Initialize(&codec) || !codec.Initialize()) {
+        fprintf(stderr, "failed to start the capture path\n");
+        return 1;
+    }
+
+    Received received;
+    uint8_t buffer[MAX_DATAGRAM_SIZE];
+    int64_t start_us = esp_timer_get_time();
+    int64_t last_keepalive_us = start_us;
+    while (esp_timer_get_time() - start_us < static_cast<int64_t>(RUN_MS) * 1000) {
+        ssize_t len = recv(socket_fd, buffer, sizeof(buffer), 0);
+        int64_t now_us = esp_timer_get_time();
+        if (now_us - last_keepalive_us >= static_cast<int64_t>(KEEPALIVE_INTERVAL_MS) * 1000) {
+            Send(socket_fd, server_addr, MessageType::KEEPALIVE);
+            last_keepalive_us = now_us;
+        }
+        if (len >= static_cast<ssize_t>(sizeof(MessageHeader))) {
+            Handle(buffer, static_cast<size_t>(len), received);
+        }
+    }
+    float agc_gain_db = codec.GetAgcGainDb();
+
+    audio_processor.Deinitialize();
+    codec.Deinitialize();
+    Send(socket_fd, server_addr, MessageType::DISCONNECT);
+    close(socket_fd);
+
+    // the tone and the hangover after it are sent, the noise between the bursts is not. the
+    // first frames go out while the noise floor is still unknown
+    uint64_t sent_ms = received.audio_samples * 1000 / SAMPLE_RATE;
+    uint64_t max_sent_ms = 2 * (TONE_MS + AUDIO_VAD_HANGOVER_MS) + NOISE_MS / 2;
+    printf("noise %.0f dBFS, tone %.0f dBFS, agc gain %.1f dB at the end\n", NOISE_DBFS, TONE_DBFS, agc_gain_db);
+    printf("received %" PRIu64 " audio packets (%" PRIu64 " ms of %" PRIu32 " ms), %" PRIu64 " silence descriptors\n",
+           received.audio_packets, sent_ms, RUN_MS, received.silence_descriptors);
+
+    int failed = 0;
+    if (received.silence_descriptors == 0) {
+        printf("FAILED: no silence descriptors, the noise was classified as voice\n");
+        failed++;
+    }
+    if (sent_ms > max_sent_ms) {
+        printf("FAILED: more than %" PRIu64 " ms of audio sent\n", max_sent_ms);
+        failed++;
+    }
+    if (sent_ms < TONE_MS) {
+        printf("FAILED: the tone bursts were suppressed\n");
+        failed++;
+    }
+    printf("%s\n", failed == 0 ? "ok" : "FAILED");
+    return failed == 0 ? 0 : 1;
+}
@@ -3,14 +3,100 @@
 #include <driver/gpio.h>
 #include <driver/i2s_std.h>
 
-// Audio sample rate
+// Audio sample rate at boot, AudioProcessor::SetSampleRate switches between 8, 16, 24, 32 and
+// 48 kHz at runtime
 #define AUDIO_SAMPLE_RATE 16000
 
 #define I2S_PORT_NUM     I2S_NUM_0
 #define CHANNEL_NUM      1                          // mono
 
+// 32-bit i2s words are narrowed to 16-bit pcm as clamp(word >> shift)
+#define AUDIO_I2S_SAMPLE_SHIFT  12
+
+// capture conditioning, fused into the same pass as the narrowing (capture_conditioner.h):
+// a dc blocking high-pass for the mic's offset and an agc with limiter around the fixed shift.
+// with both off the plain pcm_convert kernels run. I2SCodec::SetCaptureConditioning switches
+// them at runtime
+#define AUDIO_CAPTURE_DC_BLOCK
+#define AUDIO_CAPTURE_AGC
+#define AUDIO_DC_BLOCK_CUTOFF_HZ    10
+#define AUDIO_AGC_TARGET_DBFS       -18     // peak level the gain steers to
+#define AUDIO_AGC_MAX_GAIN_DB       30      // relative to the plain shift
+#define AUDIO_AGC_MIN_GAIN_DB       -12
+#define AUDIO_AGC_GATE_DBFS         -55     // quieter input holds the gain instead of raising it
+#define AUDIO_AGC_LIMITER_DBFS      -1
+#define AUDIO_AGC_ATTACK_MS         5
+#define AUDIO_AGC_RELEASE_MS        400
+
 #define AUDIO_I2S_METHOD_SIMPLEX
 
+// latency profile: the frame length in ms, 5, 10, 20 or 30. read period, packet length, dma
+// descriptors and the client's buffer all follow from it (latency_profile.h). shorter frames cut
+// the delay and cost more datagrams per second. AudioProcessor::SetLatencyProfile switches at runtime
+#define AUDIO_LATENCY_PROFILE_MS    30
+
+// capture scheduling: when defined, the i2s on_recv dma callback wakes a capture task pinned to
+// AUDIO_CAPTURE_TASK_CORE which converts the block and wakes the network task on the other core.
+// otherwise two esp_timers poll the dma buffers and the ring buffer every read period
+#define AUDIO_CAPTURE_EVENT_DRIVEN
+
+#define AUDIO_CAPTURE_TASK_CORE         1
+#define AUDIO_CAPTURE_TASK_PRIORITY     20
+#define AUDIO_CAPTURE_TASK_STACK_SIZE   4096
+#define AUDIO_NETWORK_TASK_CORE         0
+#define AUDIO_NETWORK_TASK_PRIORITY     15      // below the lwip tcpip task (18)
+#define AUDIO_NETWORK_TASK_STACK_SIZE   4096
+
+// per-stage latency histograms (dma, conversion, ring buffer dwell, sendto) and esp_timer
+// lateness, dumped with the send path stats and read through LatencyTrace (latency_trace.h).
+// a debug option: it timestamps every stage and registers the i2s on_recv callback in timer
+// capture mode too. left undefined the instrumentation compiles away entirely
+// #define AUDIO_LATENCY_TRACE
+
+// stream ima-adpcm (4:1) instead of raw 16-bit pcm by default,
+// AudioProcessor::SetStreamCodec switches at runtime
+// #define AUDIO_STREAM_CODEC_ADPCM
+
+// forward error correction: one xor parity packet after every N data packets (N:1),
+// 0 disables it. AudioProcessor::SetFecGroupSize changes it at runtime
+#define AUDIO_FEC_GROUP_SIZE    0
+
+// ring buffer overrun policy, for when the send path falls behind the capture (a stalled link, a
+// sendto that blocks): 0 keeps the oldest audio and drops the capture that no longer fits the
+// ring, 1 drops the oldest audio beyond AUDIO_RING_MAX_BACKLOG_MS, 2 does the same and drains the
+// rest at most AUDIO_RING_CATCH_UP_PACKETS packets per tick ahead of the capture instead of in one
+// burst. clients get a gap marker for whatever is dropped. while no client listens the ring is
+// simply emptied. AudioProcessor::SetOverrunPolicy switches at runtime
+#define AUDIO_RING_OVERRUN_POLICY       2
+#define AUDIO_RING_MAX_BACKLOG_MS       1000
+#define AUDIO_RING_CATCH_UP_PACKETS     2
+
+// selective retransmission: the ring keeps the last AUDIO_NACK_RETENTION_MS of sent audio out of
+// the producer's reach, so a DATA packet a client NACKs can be rebuilt and sent again to that
+// client alone. the send path answers at most AUDIO_NACK_MAX_RETRANSMITS packets per tick, the
+// rest of a request waits for the next one. 0 retention ignores NACKs
+#define AUDIO_NACK_RETENTION_MS         1000
+#define AUDIO_NACK_MAX_RETRANSMITS      8
+
+// congestion control: send failures, ring buffer backlog and the clients' receiver reports step
+// the stream down to adpcm, longer packets and half the rate when the link cannot carry it, and
+// back up once it has been clean for a while (network/congestion_controller.h). it changes the
+// codec and the rate of the stream, so like the codec option it is opt-in: every client has to
+// decode adpcm and gap markers first (udp_client.py does not).
+// AudioProcessor::SetCongestionControl switches it at runtime
+// #define AUDIO_CONGESTION_CONTROL
+
+// voice activity detection: frames the vad classifies as silence are not sent, a small
+// SilenceDescriptor tells the client how much silence to play out instead.
+// AudioProcessor::SetVadEnabled switches it at runtime, SetVadConfig tunes the thresholds
+// #define AUDIO_VAD_ENABLED
+#define AUDIO_VAD_ENERGY_THRESHOLD_DBFS     -50     // never voiced below this level
+#define AUDIO_VAD_NOISE_MARGIN_DB           9       // voiced needs this much above the noise floor
+#define AUDIO_VAD_WEAK_SPEECH_MARGIN_DB     6       // how far below that a high zcr frame may be
+#define AUDIO_VAD_ZCR_THRESHOLD_HZ          3000    // zero crossings/s that keep quiet fricatives
+#define AUDIO_VAD_HANGOVER_MS               300     // keep sending this long after speech ends
+#define AUDIO_VAD_SILENCE_RUN_MS            300     // longest silence covered by one descriptor
+
 #ifdef AUDIO_I2S_METHOD_SIMPLEX
 #define AUDIO_I2S_MIC_GPIO_WS   GPIO_NUM_4    // L/R clock
 #define AUDIO_I2S_MIC_GPIO_SCK  GPIO_NUM_5    // Serial clock
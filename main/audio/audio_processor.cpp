@@ -26,159 +26,1035 @@ bool AudioProcessor::Initialize(I2SCodec* codec) {
         return false;
     }
 
-    // allocate memory in PSRAM (each sample is 2 bytes)
-    ring_buffer_ = (int16_t*)heap_caps_malloc(ring_buffer_size_ * sizeof(int16_t), MALLOC_CAP_SPIRAM);
-    if (!ring_buffer_) {
-        ESP_LOGE(TAG, "Failed to allocate PSRAM for audio buffer");
+    std::lock_guard<std::mutex> lock(rate_mutex_);
+    codec_ = codec;
+    configured_sample_rate_ = codec->microphone_sample_rate();
+    ResetCongestion();
+    congestion_changes_ = 0;
+    latency_stats_ = {};
+    last_send_us_ = 0;
+    next_sequence_ = 0;
+    parity_packets_sent_ = 0;
+    vad_suppressed_packets_ = 0;
+    vad_silence_descriptors_ = 0;
+    vad_saved_bytes_ = 0;
+    shed_samples_ = 0;
+    idle_samples_ = 0;
+    gap_markers_ = 0;
+    nack_requested_ = 0;
+    retransmissions_ = 0;
+    nack_expired_ = 0;
+    nack_send_failed_ = 0;
+
+    if (!Start()) {
+        Stop();
+        codec_ = nullptr;
         return false;
     }
 
-    codec_ = codec;
-    write_pos_ = 0;
-    last_send_pos_ = 0;
-    
-    // create timer for periodic data reading
-    const esp_timer_create_args_t timer_args = {
-        .callback = ReadTimerCallback,
-        .arg = this,
-        .dispatch_method = ESP_TIMER_TASK,
-        .name = "audio_read_timer",
-        .skip_unhandled_events = true,
-    };
-    
-    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &read_timer_));
-    ESP_ERROR_CHECK(esp_timer_start_periodic(read_timer_, codec_->get_audio_read_duration_ms() * 1000));
+    ESP_LOGI(TAG, "Audio processor initialized with PSRAM buffer");
+    return true;
+}
+
+void AudioProcessor::Deinitialize() {
+    std::lock_guard<std::mutex> lock(rate_mutex_);
+    Stop();
+    FreeRing();
+    codec_ = nullptr;
+}
+
+bool AudioProcessor::IsSupportedSampleRate(uint32_t sample_rate) {
+    switch (sample_rate) {
+        case 8000:
+        case 16000:
+        case 24000:
+        case 32000:
+        case 48000:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool AudioProcessor::SetSampleRate(uint32_t sample_rate) {
+    if (!IsSupportedSampleRate(sample_rate)) {
+        ESP_LOGE(TAG, "Unsupported sample rate %" PRIu32 " Hz", sample_rate);
+        return false;
+    }
+    if (!codec_) {
+        ESP_LOGE(TAG, "Audio processor not initialized");
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(rate_mutex_);
+    if (sample_rate == configured_sample_rate_ && sample_rate == codec_->microphone_sample_rate()) {
+        return true;
+    }
+    return SwitchSampleRate(sample_rate, true);
+}
+
+bool AudioProcessor::SetLatencyProfile(uint32_t frame_ms) {
+    if (!FindLatencyProfile(frame_ms)) {
+        ESP_LOGE(TAG, "No latency profile for %" PRIu32 " ms frames", frame_ms);
+        return false;
+    }
+    if (!codec_) {
+        ESP_LOGE(TAG, "Audio processor not initialized");
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(rate_mutex_);
+    if (frame_ms == codec_->get_audio_read_duration_ms()) {
+        return true;
+    }
+    Stop();
+    if (!codec_->SetLatencyProfile(frame_ms)) {
+        ESP_LOGE(TAG, "Failed to switch the codec to %" PRIu32 " ms frames", frame_ms);
+        return false;
+    }
+    return Start();
+}
+
+bool AudioProcessor::SwitchSampleRate(uint32_t sample_rate, bool configure) {
+    Stop();
+    if (configure) {
+        configured_sample_rate_ = sample_rate;
+        ResetCongestion();
+    }
+    if (sample_rate != codec_->microphone_sample_rate() && !codec_->SetSampleRate(sample_rate)) {
+        ESP_LOGE(TAG, "Failed to switch the codec to %" PRIu32 " Hz", sample_rate);
+        return false;
+    }
+    return Start();
+}
+
+void AudioProcessor::RateSwitchTask(void* arg) {
+    AudioProcessor* processor = static_cast<AudioProcessor*>(arg);
+
+    {
+        std::lock_guard<std::mutex> lock(processor->rate_mutex_);
+        // the stream may have been stopped or reconfigured since the send path asked
+        uint32_t sample_rate = processor->configured_sample_rate_ / processor->rate_switch_divider_;
+        if (processor->codec_ && processor->ring_buffer_.IsAttached() && sample_rate != processor->GetSampleRate()) {
+            ESP_LOGW(TAG, "Congestion control switches the stream to %" PRIu32 " Hz", sample_rate);
+            if (!processor->SwitchSampleRate(sample_rate, false)) {
+                processor->Stop();
+            }
+        }
+    }
+
+    processor->rate_switch_pending_ = false;
+    vTaskDelete(nullptr);
+}
+
+bool AudioProcessor::Start() {
+    uint32_t sample_rate = codec_->microphone_sample_rate();
+    if (!IsSupportedSampleRate(sample_rate)) {
+        ESP_LOGE(TAG, "Unsupported sample rate %" PRIu32 " Hz", sample_rate);
+        return false;
+    }
+
+    // split each read period into the fewest equal packets that fit
+    size_t period_samples = sample_rate / 1000 * codec_->get_audio_read_duration_ms();
+    size_t packets = (period_samples + MAX_SAMPLES_PER_PACKET - 1) / MAX_SAMPLES_PER_PACKET;
+    samples_per_packet_ = (period_samples + packets - 1) / packets;
+    period_packets_ = packets;
+    stats_log_interval_ticks_ = STATS_LOG_INTERVAL_MS / codec_->get_audio_read_duration_ms();
+    sample_rate_khz_ = static_cast<uint8_t>(sample_rate / 1000);
+
+    // the retained audio is out of the producer's reach, so it comes on top of the writable part
+    size_t retention_samples = static_cast<size_t>(sample_rate) / 1000 * AUDIO_NACK_RETENTION_MS;
+    size_t min_ring_samples = static_cast<size_t>(sample_rate) / 1000 * RING_BUFFER_DURATION_MS + retention_samples;
+    ring_buffer_size_ = 1;
+    while (ring_buffer_size_ < min_ring_samples) {
+        ring_buffer_size_ <<= 1;
+    }
+
+    // a rate or profile switch keeps the storage, the congestion controller's steps only ever go
+    // down from the configured rate and back, so they fit the first allocation
+    if (ring_storage_samples_ < ring_buffer_size_) {
+        FreeRing();
+        // allocate memory in PSRAM (each sample is 2 bytes)
+        ring_storage_ = (int16_t*)heap_caps_malloc(ring_buffer_size_ * sizeof(int16_t), MALLOC_CAP_SPIRAM);
+        if (!ring_storage_) {
+            ESP_LOGE(TAG, "Failed to allocate PSRAM for audio buffer");
+            return false;
+        }
+        ring_storage_samples_ = ring_buffer_size_;
+    }
+    ring_buffer_.Attach(ring_storage_, ring_buffer_size_);
+    ring_buffer_.SetRetention(retention_samples);
+    gap_queue_.Attach(gap_queue_storage_, GAP_QUEUE_SIZE);
+
+    // the old packets' audio went with the old ring, requests for them are dropped
+    for (SentPacket& packet : sent_history_) {
+        packet.samples = 0;
+    }
+    nack_in_progress_.count = 0;
+    NackRequest stale;
+    while (nack_queue_.Read(&stale, 1) == 1) {
+    }
+
+    dropped_samples_.store(0, std::memory_order_relaxed);
+    ring_gap_ = {};
+    stream_offset_ = 0;
+    gap_samples_ = 0;
+    active_codec_ = AudioCodec::PCM16;
+    adpcm_encoder_.Reset();
+    fec_encoder_.Configure(0);
+    vad_active_ = false;
+    vad_.Configure(vad_config_, sample_rate);
+    silence_run_samples_ = 0;
+    silence_run_max_samples_ = sample_rate / 1000 * AUDIO_VAD_SILENCE_RUN_MS;
+
+    if (codec_->capture_mode() == I2SCodec::CaptureMode::DMA_EVENT) {
+        // sends are paced by the capture task, on the core opposite to it
+        TaskHandle_t task = nullptr;
+        network_task_running_ = true;
+        if (xTaskCreatePinnedToCore(NetworkTask, "audio_network", AUDIO_NETWORK_TASK_STACK_SIZE, this,
+                                    AUDIO_NETWORK_TASK_PRIORITY, &task, AUDIO_NETWORK_TASK_CORE) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create network task");
+            network_task_running_ = false;
+            return false;
+        }
+        network_task_ = task;
+    } else {
+        // create timer for periodic data reading
+        const esp_timer_create_args_t timer_args = {
+            .callback = ReadTimerCallback,
+            .arg = this,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "audio_read_timer",
+            .skip_unhandled_events = true,
+        };
+
+        read_timer_running_ = true;
+        ESP_ERROR_CHECK(esp_timer_create(&timer_args, &read_timer_));
+        ESP_ERROR_CHECK(esp_timer_start_periodic(read_timer_, codec_->get_audio_read_duration_ms() * 1000));
+#ifdef AUDIO_LATENCY_TRACE
+        read_timer_due_us_ = esp_timer_get_time() + codec_->get_audio_read_duration_ms() * 1000;
+#endif
+    }
 
     ESP_LOGI(TAG, "Setting microphone callback");
-    codec_->SetMicrophoneCallback(MicrophoneCallback);
+    codec_->SetMicrophoneSpanCallback(MicrophoneCallback);
 
-    ESP_LOGI(TAG, "Audio processor initialized with PSRAM buffer");
+    ESP_LOGI(TAG, "Streaming at %" PRIu32 " Hz, %" PRIu32 " ms frames: %zu samples per packet, %zu sample ring buffer",
+             sample_rate, codec_->get_audio_read_duration_ms(), samples_per_packet_, ring_buffer_size_);
     return true;
 }
 
-void AudioProcessor::Deinitialize() {
+void AudioProcessor::Stop() {
+    // stop the producer first so nothing notifies the network task while it winds down
+    if (codec_) {
+        codec_->SetMicrophoneSpanCallback(nullptr);
+    }
+
     if (read_timer_) {
+        read_timer_running_ = false;
         esp_timer_stop(read_timer_);
+        // a send tick may still be running in the esp_timer task, it must not outlive the ring
+        while (read_timer_callbacks_.load() > 0) {
+            vTaskDelay(1);
+        }
         esp_timer_delete(read_timer_);
         read_timer_ = nullptr;
     }
 
-    if (codec_) {
-        codec_->SetMicrophoneCallback(nullptr);
-        codec_ = nullptr;
+    if (TaskHandle_t task = network_task_.load()) {
+        // the task clears network_task_ on its way out
+        network_task_running_ = false;
+        xTaskNotifyGive(task);
+        while (network_task_.load()) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
     }
 
-    if (ring_buffer_) {
-        heap_caps_free(ring_buffer_);
-        ring_buffer_ = nullptr;
+    ReleaseParity();
+    silence_run_samples_ = 0;   /* the client conceals the unsent run */
+    gap_samples_ = 0;           /* and the unsent gap */
+
+    ring_buffer_.Detach();
+    gap_queue_.Detach();
+    ring_buffer_size_ = 0;
+    published_ring_fill_.store(0, std::memory_order_relaxed);
+    published_ring_capacity_.store(0, std::memory_order_relaxed);
+
+    dropped_samples_.store(0, std::memory_order_relaxed);
+}
+
+void AudioProcessor::FreeRing() {
+    if (ring_storage_) {
+        heap_caps_free(ring_storage_);
+        ring_storage_ = nullptr;
     }
-    
-    write_pos_ = 0;
-    last_send_pos_ = 0;
+    ring_storage_samples_ = 0;
 }
 
 void AudioProcessor::WriteData(const int16_t* data, size_t samples) {
-    if (!data || samples == 0 || !ring_buffer_) {
+    if (!data || samples == 0 || !ring_buffer_.IsAttached()) {
         return;
     }
 
-    // aggressively write data to the ring buffer
-    if (write_pos_ + samples <= ring_buffer_size_) {
-        memcpy(&ring_buffer_[write_pos_], data, samples * sizeof(int16_t));
+    // a drop is published before the first sample behind it, so the send path meets it exactly
+    // where the audio breaks. while the ring is still full, or the send path has yet to take the
+    // drops before it, the open one just grows
+    if (ring_gap_.samples > 0 && ring_buffer_.Free() > 0 && gap_queue_.Write(&ring_gap_, 1) == 1) {
+        ring_gap_.samples = 0;
+    }
+
+    if (ring_gap_.samples > 0) {
+        ring_gap_.samples += static_cast<uint32_t>(samples);
+        CountDropped(samples);
     } else {
-        size_t first_part = ring_buffer_size_ - write_pos_;
-        memcpy(&ring_buffer_[write_pos_], data, first_part * sizeof(int16_t));
-        memcpy(&ring_buffer_[0], data + first_part, (samples - first_part) * sizeof(int16_t));
+        // the producer never overwrites unsent samples, whatever does not fit is dropped
+        size_t written = ring_buffer_.Write(data, samples);
+        if (written < samples) {
+            ring_gap_ = {ring_buffer_.WritePosition(), static_cast<uint32_t>(samples - written)};
+            CountDropped(samples - written);
+        }
+        last_write_us_.store(static_cast<uint32_t>(esp_timer_get_time()), std::memory_order_relaxed);
     }
 
-    write_pos_ = (write_pos_ + samples) % ring_buffer_size_;
+    // wake the network task once a whole packet is waiting
+    TaskHandle_t network_task = network_task_.load(std::memory_order_acquire);
+    if (network_task && ring_buffer_.Size() >= samples_per_packet_) {
+        xTaskNotifyGive(network_task);
+    }
 }
 
+void AudioProcessor::CountDropped(size_t samples) {
+    uint32_t dropped = dropped_samples_.load(std::memory_order_relaxed);
+    if (dropped == 0) {
+        ESP_LOGW(TAG, "Ring buffer full, dropping new samples");
+    }
+    dropped_samples_.store(dropped + static_cast<uint32_t>(samples), std::memory_order_relaxed);
+}
 
-void AudioProcessor::MicrophoneCallback(const int16_t* data, size_t len) {
+void AudioProcessor::MicrophoneCallback(std::span<const int16_t> block) {
     if (instance_) {
-        instance_->WriteData(data, len);
+        instance_->WriteData(block.data(), block.size());
     }
 }
 
 void AudioProcessor::ReadTimerCallback(void* arg) {
-    static_cast<AudioProcessor*>(arg)->SendData();
+    AudioProcessor* processor = static_cast<AudioProcessor*>(arg);
+    processor->read_timer_callbacks_++;
+    if (processor->read_timer_running_) {
+        LATENCY_TRACE_TIMER(SEND_TIMER, processor->read_timer_due_us_,
+                            processor->codec_->get_audio_read_duration_ms() * 1000);
+        processor->SendData();
+    }
+    processor->read_timer_callbacks_--;
+}
+
+void AudioProcessor::NetworkTask(void* arg) {
+    AudioProcessor* processor = static_cast<AudioProcessor*>(arg);
+
+    while (processor->network_task_running_) {
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(NETWORK_TASK_IDLE_TIMEOUT_MS)) == 0) {
+            continue;
+        }
+        if (processor->network_task_running_) {
+            processor->SendData();
+        }
+    }
+
+    processor->network_task_ = nullptr;
+    vTaskDelete(nullptr);
 }
 
 void AudioProcessor::SendData() {
-    if (!ring_buffer_) {
+    if (!ring_buffer_.IsAttached()) {
         return;
     }
+    published_ring_fill_.store(static_cast<uint32_t>(ring_buffer_.Size()), std::memory_order_relaxed);
+    published_ring_capacity_.store(static_cast<uint32_t>(ring_buffer_.Capacity() - ring_buffer_.Retention()),
+                                   std::memory_order_relaxed);
 
-    /* calculate the available data (from the send position to the write position) */
-    size_t valid_data_samples = 0;
-    if (write_pos_ >= last_send_pos_) {
-        valid_data_samples = write_pos_ - last_send_pos_;
-    } else {
-        valid_data_samples = ring_buffer_size_ - last_send_pos_ + write_pos_;
+    if (++send_ticks_ % stats_log_interval_ticks_ == 0) {
+        LogSendPathStats();
+    }
+
+    UpdateCongestion();
+    const CongestionController::Rung& rung = congestion_.rung();
+
+    AudioCodec codec = rung.compress ? AudioCodec::IMA_ADPCM : requested_codec_.load(std::memory_order_relaxed);
+    if (codec != active_codec_) {
+        ESP_LOGI(TAG, "Switching stream codec to %s", codec == AudioCodec::IMA_ADPCM ? "IMA-ADPCM" : "PCM16");
+        adpcm_encoder_.Reset();
+        active_codec_ = codec;
+    }
+
+    uint8_t fec_group_size = requested_fec_group_size_.load(std::memory_order_relaxed);
+    if (fec_group_size != fec_encoder_.group_size()) {
+        ESP_LOGI(TAG, "FEC group size %u -> %u", fec_encoder_.group_size(), fec_group_size);
+        ReleaseParity();
+        fec_encoder_.Configure(fec_group_size);
+    }
+
+    bool vad_enabled = requested_vad_enabled_.load(std::memory_order_relaxed);
+    if (vad_enabled != vad_active_) {
+        ESP_LOGI(TAG, "Voice activity detection %s", vad_enabled ? "on" : "off");
+        SendSilenceRun();
+        vad_.Reset();
+        vad_active_ = vad_enabled;
+    }
+
+    bool has_clients = udp_server_.HasClients();
+    if (!has_clients) {
+        // nobody would hear the backlog, a client that connects gets live audio instead of the
+        // last seconds in a burst. the stream position moves on, no marker goes out
+        size_t idle = ring_buffer_.Size();
+        Skip(idle, false, GapReason::SHED);
+        idle_samples_.fetch_add(static_cast<uint32_t>(idle), std::memory_order_relaxed);
+        silence_run_samples_ = 0;
+        gap_samples_ = 0;
+        return;
+    }
+
+    // a retransmission is due before the audio that follows it, it goes out first
+    ServeNacks();
+
+    /* snapshot the available data, anything written after this is sent on the next tick */
+    size_t valid_data_samples = ring_buffer_.Size();
+    size_t packet_samples = samples_per_packet_ * rung.packet_scale;
+    OverrunPolicy policy = requested_overrun_policy_.load(std::memory_order_relaxed);
+    if (policy != OverrunPolicy::DROP_NEWEST) {
+        size_t max_backlog = std::max<size_t>(requested_max_backlog_ms_.load(std::memory_order_relaxed) * sample_rate_khz_,
+                                              (period_packets_ + 1) * packet_samples);
+        if (valid_data_samples > max_backlog) {
+            size_t shed = valid_data_samples - max_backlog;
+            ESP_LOGW(TAG, "Send path %zums behind, dropping the oldest %zums",
+                     valid_data_samples / sample_rate_khz_, shed / sample_rate_khz_);
+            Skip(shed, true, GapReason::SHED);
+            shed_samples_.fetch_add(static_cast<uint32_t>(shed), std::memory_order_relaxed);
+            valid_data_samples = max_backlog;
+        }
+    }
+    if (policy == OverrunPolicy::CATCH_UP) {
+        // a backlog drains a few packets per tick faster than the capture fills it, not in one burst
+        valid_data_samples = std::min(valid_data_samples,
+                                      (period_packets_ + AUDIO_RING_CATCH_UP_PACKETS) * packet_samples);
+    }
+    if (network_task_.load(std::memory_order_relaxed)) {
+        // event driven sends only ship whole packets, the remainder rides with the next block
+        valid_data_samples -= valid_data_samples % packet_samples;
     }
 
     /* send data to the server via udp */
-    if (valid_data_samples > 0 && udp_server_.HasClients()) {
-        const size_t MAX_SAMPLES_PER_PACKET = 480; // 480 samples = 1920 bytes = 30ms
+    if (valid_data_samples > 0) {
         size_t samples_sent = 0;
-        size_t current_send_pos = last_send_pos_;  // track the current send position
-        size_t failed_packets = 0;
-        const size_t MAX_FAILED_PACKETS = 3;       // allow max consecutive failures
         size_t total_packets_sent = 0;             // for calculating delay
+        size_t skipped_samples = 0;
+        uint8_t send_retries = congestion_.send_retries();
 
-        ESP_LOGI(TAG, "Sending %zu samples from pos %zu", valid_data_samples, current_send_pos);
+        ESP_LOGI(TAG, "Sending %zu samples", valid_data_samples);
+        RecordLatency(static_cast<uint32_t>(esp_timer_get_time()));
 
         while (samples_sent < valid_data_samples) {
-            size_t samples_to_send = std::min(MAX_SAMPLES_PER_PACKET, valid_data_samples - samples_sent);
-            std::vector<int16_t> send_buffer(samples_to_send);
-
-            // read new data from the ring buffer
-            size_t read_pos = (current_send_pos + samples_sent) % ring_buffer_size_;
-            if (read_pos + samples_to_send <= ring_buffer_size_) {
-                memcpy(send_buffer.data(), &ring_buffer_[read_pos], 
-                       samples_to_send * sizeof(int16_t));
-            } else {
-                size_t first_part = ring_buffer_size_ - read_pos;
-                memcpy(send_buffer.data(), &ring_buffer_[read_pos], 
-                       first_part * sizeof(int16_t));
-                memcpy(send_buffer.data() + first_part, &ring_buffer_[0], 
-                       (samples_to_send - first_part) * sizeof(int16_t));
-            }
-
-            // send
-            if (!udp_server_.SendToAllClients(reinterpret_cast<const uint8_t*>(send_buffer.data()), 
-                                            samples_to_send * sizeof(int16_t))) {
-                ESP_LOGW(TAG, "Failed to send packet at offset %zu", samples_sent);
-                failed_packets++;
-                
-                if (failed_packets >= MAX_FAILED_PACKETS) {
-                    ESP_LOGE(TAG, "Too many consecutive send failures (%zu), skipping this batch", 
-                            failed_packets);
-                    samples_sent += samples_to_send;  // skip this batch
+            // a packet never spans a capture side drop, the gap goes out between the two
+            TakeRingGaps(true);
+            size_t samples_to_send = SamplesBeforeGap(std::min(packet_samples, valid_data_samples - samples_sent));
+            if (vad_active_) {
+                if (!IsVoiceFrame(samples_to_send)) {
+                    AddToSilenceRun(samples_to_send);
+                    samples_sent += samples_to_send;
                     continue;
                 }
-                
-                continue;
+                // the run ends here, its descriptor goes out ahead of the voiced packet
+                SendSilenceRun();
+            }
+            SendGap();
+
+            PacketBuffer* packet = udp_server_.AcquirePacket();
+            if (!packet) {
+                ESP_LOGW(TAG, "Packet pool exhausted, leaving %zu samples for the next tick",
+                         valid_data_samples - samples_sent);
+                break;
+            }
+
+            // move new data from the ring buffer straight into the packet payload, this is the
+            // only pass over it before lwip; the samples are consumed whether or not the send succeeds
+            DataHeader* data_header = packet->data_header();
+            data_header->sequence = next_sequence_++;
+            data_header->sample_index = static_cast<uint32_t>(StreamPosition());
+            SentPacket sent_packet = {
+                .sequence = data_header->sequence,
+                .sample_index = data_header->sample_index,
+                .ring_position = ring_buffer_.ReadPosition(),
+                .samples = 0,
+                .adpcm_state = adpcm_encoder_.state(),
+                .codec = active_codec_,
+                .gap_reason = GapReason::RING_FULL,
+                .noise_rms = 0,
+            };
+            samples_to_send = FillPacket(packet, samples_to_send);
+            sent_packet.samples = static_cast<uint32_t>(samples_to_send);
+            RememberPacket(sent_packet);
+            payload_bytes_copied_ += packet->payload_len;
+
+            // packets that fail to send are protected too, the parity may still rebuild them
+            PacketBuffer* parity = ProtectPacket(packet);
+
+            // send, retrying the same packet as often as the congestion controller allows
+            bool sent = false;
+            LATENCY_TRACE_NOW(send_start_us);
+            for (uint8_t attempt = 0; !sent && attempt <= send_retries; attempt++) {
+                sent = udp_server_.SendToAllClients(packet);
+                congestion_.OnSendAttempt(sent);
             }
+            LATENCY_TRACE_RECORD(SEND, esp_timer_get_time() - send_start_us);
+            udp_server_.ReleasePacket(packet);
+            SendParity(parity);
 
-            failed_packets = 0;  // reset the failure count
             samples_sent += samples_to_send;
+            if (!sent) {
+                // the rest waits in the ring buffer, the backlog it builds up is what tells the
+                // controller that the link no longer keeps up
+                ESP_LOGW(TAG, "Failed to send packet at offset %zu, leaving %zu samples for the next tick",
+                         samples_sent - samples_to_send, valid_data_samples - samples_sent);
+                skipped_samples += samples_to_send;
+                break;
+            }
+
             total_packets_sent++;
         }
 
-        // update the send position
-        if (samples_sent > 0) {
-            last_send_pos_ = (current_send_pos + samples_sent) % ring_buffer_size_;
-            if (samples_sent < valid_data_samples) {
-                ESP_LOGW(TAG, "Only sent %zu samples out of %zu valid samples (%zu packets)", 
-                         samples_sent, valid_data_samples, total_packets_sent);
-            } else {
-                ESP_LOGI(TAG, "Successfully sent %zu samples in %zu packets", 
-                         samples_sent, total_packets_sent);
-            }
+        if (skipped_samples > 0) {
+            ESP_LOGW(TAG, "Only sent %zu samples out of %zu valid samples (%zu packets)",
+                     samples_sent - skipped_samples, valid_data_samples, total_packets_sent);
         } else {
-            ESP_LOGW(TAG, "No data sent, will retry from position %zu next time", last_send_pos_);
+            ESP_LOGI(TAG, "Successfully sent %zu samples in %zu packets",
+                     samples_sent, total_packets_sent);
+        }
+    }
+
+    // a drop at the end of what was sent still goes out this tick
+    TakeRingGaps(true);
+    SendGap();
+
+    congestion_.OnBacklog(static_cast<uint32_t>(ring_buffer_.Size()) / sample_rate_khz_);
+}
+
+void AudioProcessor::TakeRingGaps(bool mark) {
+    RingGap gap;
+    while (gap_queue_.Peek(&gap, 1) == 1 && gap.position == ring_buffer_.ReadPosition()) {
+        gap_queue_.CommitRead(1);
+        if (mark) {
+            AddGap(gap.samples, GapReason::RING_FULL);
         }
+        stream_offset_ += gap.samples;
+    }
+}
+
+size_t AudioProcessor::SamplesBeforeGap(size_t limit) const {
+    RingGap gap;
+    if (gap_queue_.Peek(&gap, 1) == 1) {
+        return std::min(limit, gap.position - ring_buffer_.ReadPosition());
     }
-} 
\ No newline at end of file
+    return limit;
+}
+
+void AudioProcessor::Skip(size_t samples, bool mark, GapReason reason) {
+    while (samples > 0) {
+        TakeRingGaps(mark);
+        size_t count = SamplesBeforeGap(samples);
+        if (mark) {
+            AddGap(static_cast<uint32_t>(count), reason);
+        }
+        ring_buffer_.CommitRead(count);
+        samples -= count;
+    }
+    TakeRingGaps(mark);
+}
+
+void AudioProcessor::AddGap(uint32_t samples, GapReason reason) {
+    if (gap_samples_ == 0) {
+        // the silence run ends where the gap starts
+        SendSilenceRun();
+        gap_start_ = static_cast<uint32_t>(StreamPosition());
+        gap_reason_ = reason;
+    }
+    gap_samples_ += samples;
+}
+
+void AudioProcessor::SendGap() {
+    if (gap_samples_ == 0) {
+        return;
+    }
+
+    // without a buffer the marker is dropped, the client conceals the jump in the sample index
+    PacketBuffer* packet = udp_server_.AcquirePacket();
+    if (packet) {
+        packet->header()->codec = AudioCodec::GAP;
+        packet->header()->sample_rate_khz = sample_rate_khz_;
+        DataHeader* data_header = packet->data_header();
+        data_header->sequence = next_sequence_++;
+        data_header->sample_index = gap_start_;
+
+        GapDescriptor* descriptor = reinterpret_cast<GapDescriptor*>(packet->payload());
+        *descriptor = GapDescriptor{.samples = gap_samples_, .reason = gap_reason_, .reserved = {}};
+        packet->payload_len = sizeof(GapDescriptor);
+        RememberPacket(SentPacket{
+            .sequence = data_header->sequence,
+            .sample_index = gap_start_,
+            .ring_position = 0,
+            .samples = gap_samples_,
+            .adpcm_state = {},
+            .codec = AudioCodec::GAP,
+            .gap_reason = gap_reason_,
+            .noise_rms = 0,
+        });
+
+        PacketBuffer* parity = ProtectPacket(packet);
+        if (udp_server_.SendToAllClients(packet)) {
+            gap_markers_.fetch_add(1, std::memory_order_relaxed);
+        }
+        udp_server_.ReleasePacket(packet);
+        SendParity(parity);
+    }
+
+    gap_samples_ = 0;
+}
+
+void AudioProcessor::ResetCongestion() {
+    congestion_.Reset(static_cast<uint32_t>(esp_timer_get_time() / 1000));
+    uint8_t max_level = 0;
+    while (max_level + 1 < CongestionController::LEVEL_COUNT &&
+           IsSupportedSampleRate(configured_sample_rate_ /
+                                 CongestionController::LADDER[max_level + 1].rate_divider)) {
+        max_level++;
+    }
+    congestion_.SetMaxLevel(max_level);
+    rate_switch_divider_ = 1;
+    reported_expected_ = 0;
+    reported_lost_ = 0;
+}
+
+void AudioProcessor::OnReceiverReport(const ReceiverReport& report) {
+    reported_expected_.fetch_add(report.expected_packets, std::memory_order_relaxed);
+    reported_lost_.fetch_add(std::min(report.lost_packets, report.expected_packets), std::memory_order_relaxed);
+}
+
+void AudioProcessor::OnNack(const NackRange* ranges, size_t count, const sockaddr_in& client_addr) {
+    if (AUDIO_NACK_RETENTION_MS == 0) {
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        NackRequest request = {
+            .client_addr = client_addr,
+            .first_sequence = ranges[i].first_sequence,
+            .count = std::min(ranges[i].count, MAX_NACK_RANGE_PACKETS),
+        };
+        if (request.count == 0) {
+            continue;
+        }
+        // a request that finds the queue full is lost, the client asks again while it can wait
+        if (nack_queue_.Write(&request, 1) == 1) {
+            nack_requested_.fetch_add(request.count, std::memory_order_relaxed);
+        }
+    }
+}
+
+void AudioProcessor::ServeNacks() {
+    uint32_t budget = AUDIO_NACK_MAX_RETRANSMITS;
+    while (budget > 0) {
+        if (nack_in_progress_.count == 0 && nack_queue_.Read(&nack_in_progress_, 1) == 0) {
+            break;
+        }
+        RetransmitResult result = Retransmit(nack_in_progress_.first_sequence, nack_in_progress_.client_addr);
+        if (result == RetransmitResult::NO_BUFFER) {
+            // every pool buffer is in flight, the sequence stays first in line for the next tick
+            break;
+        }
+        nack_in_progress_.first_sequence++;
+        nack_in_progress_.count--;
+        switch (result) {
+            case RetransmitResult::SENT:
+                retransmissions_.fetch_add(1, std::memory_order_relaxed);
+                budget--;
+                break;
+            case RetransmitResult::SEND_FAILED:
+                nack_send_failed_.fetch_add(1, std::memory_order_relaxed);
+                budget--;
+                break;
+            default:
+                nack_expired_.fetch_add(1, std::memory_order_relaxed);
+                break;
+        }
+    }
+}
+
+AudioProcessor::RetransmitResult AudioProcessor::Retransmit(uint32_t sequence, const sockaddr_in& client_addr) {
+    const SentPacket& sent_packet = sent_history_[sequence % SENT_HISTORY_SIZE];
+    bool held = sent_packet.sequence == sequence && sent_packet.samples > 0;
+    bool from_ring = sent_packet.codec == AudioCodec::PCM16 || sent_packet.codec == AudioCodec::IMA_ADPCM;
+    if (held && from_ring) {
+        // the ring keeps everything from the oldest retained sample up to the read position
+        held = !ring_buffer_.RetainedSpanAt(sent_packet.ring_position).empty();
+    }
+    if (!held) {
+        return RetransmitResult::EXPIRED;
+    }
+
+    PacketBuffer* packet = udp_server_.AcquirePacket();
+    if (!packet) {
+        return RetransmitResult::NO_BUFFER;
+    }
+    packet->header()->codec = sent_packet.codec;
+    packet->header()->sample_rate_khz = sample_rate_khz_;
+    DataHeader* data_header = packet->data_header();
+    data_header->sequence = sent_packet.sequence;
+    data_header->sample_index = sent_packet.sample_index;
+
+    switch (sent_packet.codec) {
+        case AudioCodec::PCM16:
+        case AudioCodec::IMA_ADPCM: {
+            // the adpcm block is encoded again from the state it started with, the same bytes
+            int16_t* pcm = reinterpret_cast<int16_t*>(packet->payload());
+            if (sent_packet.codec == AudioCodec::IMA_ADPCM) {
+                retransmit_encoder_.SetState(sent_packet.adpcm_state);
+                retransmit_encoder_.BeginBlock(packet->payload());
+            }
+            size_t offset = 0;
+            while (offset < sent_packet.samples) {
+                std::span<const int16_t> span = ring_buffer_.RetainedSpanAt(sent_packet.ring_position + offset);
+                if (span.empty()) {
+                    break;
+                }
+                size_t count = std::min<size_t>(span.size(), sent_packet.samples - offset);
+                if (sent_packet.codec == AudioCodec::IMA_ADPCM) {
+                    retransmit_encoder_.Encode(span.first(count));
+                } else {
+                    memcpy(pcm + offset, span.data(), count * sizeof(int16_t));
+                }
+                offset += count;
+            }
+            packet->payload_len = sent_packet.codec == AudioCodec::IMA_ADPCM ? retransmit_encoder_.EndBlock()
+                                                                             : offset * sizeof(int16_t);
+            break;
+        }
+        case AudioCodec::SILENCE:
+            *reinterpret_cast<SilenceDescriptor*>(packet->payload()) = SilenceDescriptor{
+                .samples = sent_packet.samples, .noise_rms = sent_packet.noise_rms, .reserved = 0};
+            packet->payload_len = sizeof(SilenceDescriptor);
+            break;
+        case AudioCodec::GAP:
+            *reinterpret_cast<GapDescriptor*>(packet->payload()) = GapDescriptor{
+                .samples = sent_packet.samples, .reason = sent_packet.gap_reason, .reserved = {}};
+            packet->payload_len = sizeof(GapDescriptor);
+            break;
+    }
+
+    bool sent = udp_server_.SendToClient(packet, client_addr);
+    udp_server_.ReleasePacket(packet);
+    return sent ? RetransmitResult::SENT : RetransmitResult::SEND_FAILED;
+}
+
+void AudioProcessor::UpdateCongestion() {
+    uint32_t now_ms = static_cast<uint32_t>(esp_timer_get_time() / 1000);
+    bool enabled = requested_congestion_control_.load(std::memory_order_relaxed);
+    if (enabled != congestion_active_) {
+        ESP_LOGI(TAG, "Congestion control %s", enabled ? "on" : "off");
+        congestion_.Reset(now_ms);
+        congestion_active_ = enabled;
+    }
+
+    uint32_t expected = reported_expected_.exchange(0, std::memory_order_relaxed);
+    uint32_t lost = reported_lost_.exchange(0, std::memory_order_relaxed);
+    if (congestion_active_) {
+        if (expected > 0) {
+            congestion_.OnReceiverReport(expected, lost);
+        }
+        uint8_t previous = congestion_.level();
+        if (congestion_.Update(now_ms)) {
+            const CongestionController::Window& window = congestion_.last_window();
+            ESP_LOGW(TAG, "Congestion level %u -> %u: %" PRIu32 "/%" PRIu32 " sends failed, %" PRIu32 "/%" PRIu32
+                     " packets lost, backlog up to %" PRIu32 "ms, next step up after %" PRIu32 "ms clean",
+                     previous, congestion_.level(), window.failures, window.attempts, window.lost,
+                     window.expected, window.backlog_max_ms, congestion_.up_hold_ms());
+            congestion_changes_++;
+        }
+    }
+
+    // the rate follows the level, and returns to the configured rate once control is switched off
+    uint8_t divider = congestion_.rung().rate_divider;
+    if (configured_sample_rate_ / divider != GetSampleRate() && !rate_switch_pending_.exchange(true)) {
+        rate_switch_divider_ = divider;
+        if (xTaskCreate(RateSwitchTask, "audio_rate", AUDIO_NETWORK_TASK_STACK_SIZE, this,
+                        AUDIO_NETWORK_TASK_PRIORITY - 1, nullptr) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create rate switch task");
+            rate_switch_pending_ = false;
+        }
+    }
+}
+
+size_t AudioProcessor::FillPacket(PacketBuffer* packet, size_t samples) {
+    packet->header()->codec = active_codec_;
+    packet->header()->sample_rate_khz = sample_rate_khz_;
+
+    if (active_codec_ == AudioCodec::PCM16) {
+        samples = ring_buffer_.Read(reinterpret_cast<int16_t*>(packet->payload()), samples);
+        packet->payload_len = samples * sizeof(int16_t);
+        return samples;
+    }
+
+    // encode straight out of the ring buffer, in two spans when the region wraps
+    size_t remaining = std::min(samples, ring_buffer_.Size());
+    samples = remaining;
+    adpcm_encoder_.BeginBlock(packet->payload());
+    while (remaining > 0) {
+        std::span<const int16_t> span = ring_buffer_.ReadSpan();
+        size_t count = std::min(span.size(), remaining);
+        adpcm_encoder_.Encode(span.first(count));
+        ring_buffer_.CommitRead(count);
+        remaining -= count;
+    }
+    packet->payload_len = adpcm_encoder_.EndBlock();
+    return samples;
+}
+
+PacketBuffer* AudioProcessor::ProtectPacket(PacketBuffer* packet) {
+    if (fec_encoder_.group_size() == 0) {
+        return nullptr;
+    }
+
+    if (!fec_parity_) {
+        // a group only starts with a parity buffer in hand, otherwise this packet goes unprotected
+        fec_parity_ = udp_server_.AcquirePacket();
+        if (!fec_parity_) {
+            return nullptr;
+        }
+    }
+
+    if (!fec_encoder_.Protect(*packet, *fec_parity_)) {
+        return nullptr;
+    }
+    PacketBuffer* parity = fec_parity_;
+    fec_parity_ = nullptr;
+    return parity;
+}
+
+void AudioProcessor::SendParity(PacketBuffer* parity) {
+    if (!parity) {
+        return;
+    }
+    if (udp_server_.SendToAllClients(parity)) {
+        parity_packets_sent_.fetch_add(1, std::memory_order_relaxed);
+    }
+    udp_server_.ReleasePacket(parity);
+}
+
+void AudioProcessor::ReleaseParity() {
+    if (fec_parity_) {
+        udp_server_.ReleasePacket(fec_parity_);
+        fec_parity_ = nullptr;
+    }
+    fec_encoder_.Reset();
+}
+
+bool AudioProcessor::IsVoiceFrame(size_t samples) {
+    // a second pass over the frame in psram, cheap next to sending it
+    vad_.BeginFrame();
+    size_t offset = 0;
+    while (offset < samples) {
+        std::span<const int16_t> span = ring_buffer_.ReadSpanAt(offset);
+        if (span.empty()) {
+            break;
+        }
+        size_t count = std::min(span.size(), samples - offset);
+        vad_.Accumulate(span.first(count));
+        offset += count;
+    }
+    // the ring holds samples after the agc, the thresholds are in microphone levels. the gain
+    // is that of the newest capture block, the agc moves little within a frame or two
+    vad_.SetInputGainDb(codec_->GetAgcGainDb());
+    return vad_.EndFrame();
+}
+
+void AudioProcessor::AddToSilenceRun(size_t samples) {
+    if (silence_run_samples_ == 0) {
+        // the gap ends where the run starts
+        SendGap();
+        silence_run_start_ = static_cast<uint32_t>(StreamPosition());
+        silence_run_rms_total_ = 0;
+    }
+    silence_run_samples_ += samples;
+    silence_run_rms_total_ += static_cast<uint64_t>(vad_.frame_rms()) * samples;
+    ring_buffer_.CommitRead(samples);
+
+    size_t payload_len = active_codec_ == AudioCodec::IMA_ADPCM ? ImaAdpcmBlockSize(samples)
+                                                                : samples * sizeof(int16_t);
+    vad_saved_bytes_ += DATA_HEADERS_SIZE + payload_len;
+    vad_suppressed_packets_.fetch_add(1, std::memory_order_relaxed);
+
+    if (silence_run_samples_ >= silence_run_max_samples_) {
+        SendSilenceRun();
+    }
+}
+
+void AudioProcessor::SendSilenceRun() {
+    if (silence_run_samples_ == 0) {
+        return;
+    }
+
+    // without a buffer the run is dropped, the client conceals the gap in the sample index
+    PacketBuffer* packet = udp_server_.AcquirePacket();
+    if (packet) {
+        packet->header()->codec = AudioCodec::SILENCE;
+        packet->header()->sample_rate_khz = sample_rate_khz_;
+        DataHeader* data_header = packet->data_header();
+        data_header->sequence = next_sequence_++;
+        data_header->sample_index = silence_run_start_;
+
+        SilenceDescriptor* descriptor = reinterpret_cast<SilenceDescriptor*>(packet->payload());
+        descriptor->samples = silence_run_samples_;
+        descriptor->noise_rms = static_cast<uint16_t>(silence_run_rms_total_ / silence_run_samples_);
+        descriptor->reserved = 0;
+        packet->payload_len = sizeof(SilenceDescriptor);
+        RememberPacket(SentPacket{
+            .sequence = data_header->sequence,
+            .sample_index = silence_run_start_,
+            .ring_position = 0,
+            .samples = silence_run_samples_,
+            .adpcm_state = {},
+            .codec = AudioCodec::SILENCE,
+            .gap_reason = GapReason::RING_FULL,
+            .noise_rms = descriptor->noise_rms,
+        });
+
+        PacketBuffer* parity = ProtectPacket(packet);
+        if (udp_server_.SendToAllClients(packet)) {
+            vad_silence_descriptors_++;
+        }
+        udp_server_.ReleasePacket(packet);
+        SendParity(parity);
+        vad_saved_bytes_ -= DATA_HEADERS_SIZE + sizeof(SilenceDescriptor);
+    }
+
+    silence_run_samples_ = 0;
+}
+
+AudioProcessor::SendPathStats AudioProcessor::GetSendPathStats() const {
+    return SendPathStats{
+        .payload_bytes_copied = payload_bytes_copied_,
+        .parity_packets = parity_packets_sent_.load(std::memory_order_relaxed),
+        .vad_suppressed_packets = vad_suppressed_packets_.load(std::memory_order_relaxed),
+        .vad_silence_descriptors = vad_silence_descriptors_,
+        .vad_saved_bytes = vad_saved_bytes_,
+        .congestion_level = congestion_.level(),
+        .congestion_changes = congestion_changes_,
+        .ring_full_samples = dropped_samples_.load(std::memory_order_relaxed),
+        .shed_samples = shed_samples_.load(std::memory_order_relaxed),
+        .idle_samples = idle_samples_.load(std::memory_order_relaxed),
+        .gap_markers = gap_markers_.load(std::memory_order_relaxed),
+        .nack_requested = nack_requested_.load(std::memory_order_relaxed),
+        .retransmissions = retransmissions_.load(std::memory_order_relaxed),
+        .nack_expired = nack_expired_.load(std::memory_order_relaxed),
+        .nack_send_failed = nack_send_failed_.load(std::memory_order_relaxed),
+        .udp = udp_server_.GetStats(),
+        .pool = udp_server_.GetPacketPoolStats(),
+    };
+}
+
+void AudioProcessor::FillStatsSnapshot(StatsSnapshot& snapshot) const {
+    snapshot.sample_rate = GetSampleRate();
+    snapshot.parity_packets = parity_packets_sent_.load(std::memory_order_relaxed);
+    snapshot.vad_suppressed_packets = vad_suppressed_packets_.load(std::memory_order_relaxed);
+
+    snapshot.ring_fill_samples = published_ring_fill_.load(std::memory_order_relaxed);
+    snapshot.ring_capacity_samples = published_ring_capacity_.load(std::memory_order_relaxed);
+    snapshot.ring_dropped_samples = dropped_samples_.load(std::memory_order_relaxed);
+    snapshot.ring_shed_samples = shed_samples_.load(std::memory_order_relaxed);
+    snapshot.ring_idle_samples = idle_samples_.load(std::memory_order_relaxed);
+    snapshot.gap_markers = gap_markers_.load(std::memory_order_relaxed);
+    snapshot.overrun_policy = static_cast<uint8_t>(requested_overrun_policy_.load(std::memory_order_relaxed));
+    snapshot.retransmitted_packets = retransmissions_.load(std::memory_order_relaxed);
+    snapshot.nack_expired_packets = nack_expired_.load(std::memory_order_relaxed);
+
+#ifdef AUDIO_LATENCY_TRACE
+    static_assert(static_cast<size_t>(LatencyStage::COUNT) == STATS_STAGE_COUNT);
+    for (size_t i = 0; i < STATS_STAGE_COUNT; i++) {
+        LatencyHistogram::Snapshot histogram = LatencyTrace::GetInstance().Read(static_cast<LatencyStage>(i));
+        snapshot.stages[i] = StatsStageLatency{
+            .count = histogram.count,
+            .p50_us = histogram.Percentile(0.5f),
+            .p99_us = histogram.Percentile(0.99f),
+            .max_us = histogram.max_us,
+        };
+    }
+    snapshot.flags |= STATS_FLAG_LATENCY_TRACE;
+#endif
+}
+
+void AudioProcessor::RecordLatency(uint32_t now_us) {
+    uint32_t latency_us = now_us - last_write_us_.load(std::memory_order_relaxed);
+    LATENCY_TRACE_RECORD(RING, latency_us);
+    if (latency_stats_.samples == 0 || latency_us < latency_stats_.min_us) {
+        latency_stats_.min_us = latency_us;
+    }
+    if (latency_us > latency_stats_.max_us) {
+        latency_stats_.max_us = latency_us;
+    }
+    latency_stats_.total_us += latency_us;
+
+    if (latency_stats_.samples > 0) {
+        uint32_t interval_us = now_us - last_send_us_;
+        if (latency_stats_.samples == 1 || interval_us < latency_stats_.min_send_interval_us) {
+            latency_stats_.min_send_interval_us = interval_us;
+        }
+        if (interval_us > latency_stats_.max_send_interval_us) {
+            latency_stats_.max_send_interval_us = interval_us;
+        }
+    }
+    last_send_us_ = now_us;
+    latency_stats_.samples++;
+}
+
+void AudioProcessor::LogSendPathStats() const {
+    SendPathStats stats = GetSendPathStats();
+    ESP_LOGI(TAG, "Send path: %" PRIu32 " datagrams (%" PRIu32 " failed), %" PRIu64 " bytes sent, "
+             "%" PRIu64 " payload bytes copied, %" PRIu32 " parity packets, pool heap allocs=%" PRIu32
+             " acquired=%" PRIu32 " exhausted=%" PRIu32 " peak=%" PRIu32,
+             stats.udp.packets_sent, stats.udp.send_failures, stats.udp.bytes_sent,
+             stats.payload_bytes_copied, stats.parity_packets, stats.pool.heap_allocations, stats.pool.acquired,
+             stats.pool.exhausted, stats.pool.peak_in_use);
+
+    if (vad_active_ || stats.vad_suppressed_packets > 0) {
+        uint64_t sent = stats.udp.bytes_sent;
+        ESP_LOGI(TAG, "VAD: %" PRIu32 " packets suppressed, %" PRIu32 " silence descriptors, "
+                 "%" PRIu64 " bytes saved (%" PRIu64 "%%)",
+                 stats.vad_suppressed_packets, stats.vad_silence_descriptors, stats.vad_saved_bytes,
+                 sent + stats.vad_saved_bytes > 0 ? stats.vad_saved_bytes * 100 / (sent + stats.vad_saved_bytes) : 0);
+    }
+
+    if (congestion_active_) {
+        ESP_LOGI(TAG, "Congestion control: level %u of %u, %" PRIu32 " changes, %" PRIu32 "ms clean to step up",
+                 stats.congestion_level, congestion_.max_level(), stats.congestion_changes,
+                 congestion_.up_hold_ms());
+    }
+
+    if (stats.ring_full_samples > 0 || stats.shed_samples > 0) {
+        ESP_LOGI(TAG, "Overruns: %" PRIu32 " samples found the ring full, %" PRIu32 " shed, %" PRIu32
+                 " gap markers", stats.ring_full_samples, stats.shed_samples, stats.gap_markers);
+    }
+
+    if (stats.nack_requested > 0) {
+        ESP_LOGI(TAG, "Retransmission: %" PRIu32 " packets NACKed, %" PRIu32 " sent again, %" PRIu32
+                 " no longer held, %" PRIu32 " failed to send", stats.nack_requested, stats.retransmissions,
+                 stats.nack_expired, stats.nack_send_failed);
+    }
+
+    if (latency_stats_.samples > 0) {
+        ESP_LOGI(TAG, "Capture to send: min=%" PRIu32 "us avg=%" PRIu64 "us max=%" PRIu32 "us, "
+                 "send interval %" PRIu32 "..%" PRIu32 "us",
+                 latency_stats_.min_us, latency_stats_.total_us / latency_stats_.samples,
+                 latency_stats_.max_us, latency_stats_.min_send_interval_us,
+                 latency_stats_.max_send_interval_us);
+    }
+
+#ifdef AUDIO_LATENCY_TRACE
+    LatencyTrace::GetInstance().Log();
+#endif
+}
@@ -1,10 +1,17 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
+#include <mutex>
 #include <esp_timer.h>
 #include <esp_heap_caps.h>
 #include "i2s_codec.h"
+#include "spsc_ring_buffer.h"
+#include "ima_adpcm.h"
+#include "vad.h"
 #include "../network/udp_server.h"
+#include "../network/fec_encoder.h"
+#include "../network/congestion_controller.h"
 
 class AudioProcessor {
 public:
@@ -18,28 +25,337 @@ public:
 
     void SendData();
 
+    /* switches the whole pipeline to a new capture rate: the stream pauses while the i2s channel
+       is reclocked (or rebuilt for a higher rate) and the ring buffer, on the same storage where
+       it fits, and the packet size are set up again. buffered samples at the old rate are dropped.
+       waits for the send path to stop, so it must not be called from it. this is the configured
+       rate, congestion control may stream at half of it and starts over from level 0 */
+    static bool IsSupportedSampleRate(uint32_t sample_rate);
+    bool SetSampleRate(uint32_t sample_rate);
+    uint32_t GetSampleRate() const { return codec_ ? codec_->microphone_sample_rate() : 0; }
+    uint32_t GetConfiguredSampleRate() const { return configured_sample_rate_; }
+    size_t GetSamplesPerPacket() const { return samples_per_packet_; }
+
+    /* frame length, packet length and dma sizing in one, see latency_profile.h. restarts the
+       stream like SetSampleRate, buffered samples are dropped. like it, safe at runtime from any
+       task but the send path: Stop waits for a send tick in flight before the ring is touched */
+    bool SetLatencyProfile(uint32_t frame_ms);
+    uint32_t GetLatencyProfile() const { return codec_ ? codec_->get_audio_read_duration_ms() : 0; }
+
+    /* takes effect at the next packet boundary */
+    void SetStreamCodec(AudioCodec codec) { requested_codec_ = codec; }
+    AudioCodec GetStreamCodec() const { return requested_codec_; }
+
+    /* one parity packet per group_size data packets, 0 disables fec; takes effect at the next
+       packet and restarts the group in progress */
+    void SetFecGroupSize(uint8_t group_size) { requested_fec_group_size_ = group_size; }
+    uint8_t GetFecGroupSize() const { return requested_fec_group_size_; }
+
+    /* voice activity detection: silent frames are replaced by SilenceDescriptor packets. the
+       switch takes effect at the next packet, the config at the next Initialize or SetSampleRate */
+    void SetVadEnabled(bool enabled) { requested_vad_enabled_ = enabled; }
+    bool GetVadEnabled() const { return requested_vad_enabled_; }
+    void SetVadConfig(const VadConfig& config) { vad_config_ = config; }
+    const VadConfig& GetVadConfig() const { return vad_config_; }
+
+    /* adapts codec, packet length and rate to the link, see CongestionController. switching it
+       off returns the stream to the configured settings at the next packet */
+    void SetCongestionControl(bool enabled) { requested_congestion_control_ = enabled; }
+    bool GetCongestionControl() const { return requested_congestion_control_; }
+    /* udp task: a client's loss since its previous report, folded into the next send tick */
+    void OnReceiverReport(const ReceiverReport& report);
+
+    /* udp task: a client's NACK. the send path re-sends what it still holds of those packets to
+       that client alone, see AUDIO_NACK_RETENTION_MS */
+    void OnNack(const NackRange* ranges, size_t count, const sockaddr_in& client_addr);
+
+    /* what happens to audio the send path falls behind on, see AUDIO_RING_OVERRUN_POLICY. every
+       drop reaches the clients as a GAP packet; takes effect at the next send tick */
+    enum class OverrunPolicy : uint8_t {
+        DROP_NEWEST = 0,   /* keep the backlog, capture that does not fit the ring is lost */
+        DROP_OLDEST = 1,   /* keep at most max_backlog_ms, the oldest audio goes */
+        CATCH_UP = 2,      /* DROP_OLDEST, and drain the backlog a few packets per tick */
+    };
+    void SetOverrunPolicy(OverrunPolicy policy, uint32_t max_backlog_ms = AUDIO_RING_MAX_BACKLOG_MS) {
+        requested_max_backlog_ms_ = max_backlog_ms;
+        requested_overrun_policy_ = policy;
+    }
+    OverrunPolicy GetOverrunPolicy() const { return requested_overrun_policy_; }
+
+    /* send path counters: in steady state pool.heap_allocations stays at its startup value and
+       payload_bytes_copied grows by exactly one copy per payload byte handed to lwip. meant for
+       the send path's own log, only the counters FillStatsSnapshot shares are atomic */
+    struct SendPathStats {
+        uint64_t payload_bytes_copied;
+        uint32_t parity_packets;
+        uint32_t vad_suppressed_packets;   /* packets not sent because the vad found them silent */
+        uint32_t vad_silence_descriptors;
+        uint64_t vad_saved_bytes;          /* datagram bytes not sent, net of the descriptors */
+        uint8_t congestion_level;          /* CongestionController::LADDER index in use */
+        uint32_t congestion_changes;       /* level changes since Initialize */
+        uint32_t ring_full_samples;        /* capture the ring had no room for, since the last Start */
+        uint32_t shed_samples;             /* oldest audio dropped by the overrun policy */
+        uint32_t idle_samples;             /* discarded while no client listened */
+        uint32_t gap_markers;              /* GAP packets sent */
+        uint32_t nack_requested;           /* packets clients asked for again */
+        uint32_t retransmissions;          /* of those, sent again */
+        uint32_t nack_expired;             /* of those, no longer held */
+        uint32_t nack_send_failed;         /* of those, held but the sendto failed */
+        UDPServer::Stats udp;
+        PacketPool::Stats pool;
+    };
+    SendPathStats GetSendPathStats() const;
+
+    /* time from a captured block landing in the ring buffer to the first send that carries it,
+       and the spread of the intervals between sends */
+    struct CaptureLatencyStats {
+        uint32_t samples;
+        uint32_t min_us;
+        uint32_t max_us;
+        uint64_t total_us;
+        uint32_t min_send_interval_us;
+        uint32_t max_send_interval_us;
+    };
+    CaptureLatencyStats GetCaptureLatencyStats() const { return latency_stats_; }
+
+    /* the audio side of a STATS reply: rate, parity and vad counters, ring buffer and stage latencies */
+    void FillStatsSnapshot(StatsSnapshot& snapshot) const;
+
 private:
-    AudioProcessor() : ring_buffer_(nullptr) {}
+    AudioProcessor() : ring_storage_(nullptr) {
+        nack_queue_.Attach(nack_queue_storage_, NACK_QUEUE_SIZE);
+    }
     ~AudioProcessor();
 
     esp_timer_handle_t read_timer_ = nullptr;
+    /* esp_timer_stop and esp_timer_delete don't wait for a callback already running in the
+       esp_timer task, so Stop clears read_timer_running_ and then waits for
+       read_timer_callbacks_ to drain before it frees the ring. both seq_cst: a callback either
+       counts itself before Stop looks, or sees the flag cleared */
+    std::atomic<bool> read_timer_running_{false};
+    std::atomic<uint32_t> read_timer_callbacks_{0};
+#ifdef AUDIO_LATENCY_TRACE
+    int64_t read_timer_due_us_ = 0;
+#endif
     I2SCodec* codec_ = nullptr;
 
+    /* event driven mode: the capture task wakes this task once a full packet is buffered */
+    std::atomic<TaskHandle_t> network_task_{nullptr};
+    std::atomic<bool> network_task_running_{false};
+    static constexpr uint32_t NETWORK_TASK_IDLE_TIMEOUT_MS = 100;
+    static void NetworkTask(void* arg);
+
     /* udp server */
     UDPServer& udp_server_ = UDPServer::GetInstance();
 
-    /* ring buffer */
-    int16_t* ring_buffer_;
-    static constexpr size_t ring_buffer_size_ = 16000 * 4;   /* (16kHz * 0.4 seconds) */
-    size_t write_pos_ = 0;
-    size_t read_pos_ = 0;
-    size_t last_send_pos_ = 0;
+    /* attaches the ring buffer for the codec's current rate and starts the producer and consumer.
+       the storage of an earlier Start is reused when it is large enough */
+    bool Start();
+    /* stops both sides and detaches the ring buffer, its storage and codec_ stay for the next
+       Start. FreeRing gives the storage back */
+    void Stop();
+    void FreeRing();
+    /* Stop, codec rate, Start. configure makes sample_rate the configured rate and resets the
+       congestion controller, the controller's own switches keep both. the caller holds rate_mutex_,
+       which keeps them from interleaving */
+    bool SwitchSampleRate(uint32_t sample_rate, bool configure);
+    std::mutex rate_mutex_;
+    uint32_t configured_sample_rate_ = 0;
+
+    /* ring buffer, written by the capture side (producer) and drained by the send side (consumer) */
+    int16_t* ring_storage_;
+    size_t ring_storage_samples_ = 0;   /* allocated, the ring may use less of it at a lower rate */
+    /* power of two, at least RING_BUFFER_DURATION_MS writable plus the AUDIO_NACK_RETENTION_MS
+       retained for retransmissions, at the current rate */
+    size_t ring_buffer_size_ = 0;
+    static constexpr uint32_t RING_BUFFER_DURATION_MS = 4000;
+    SpscRingBuffer<int16_t> ring_buffer_;
+    std::atomic<uint32_t> dropped_samples_{0};   /* written by the producer only */
+    void CountDropped(size_t samples);
+    /* the ring's fill and writable capacity as of the last send tick, 0 while it is detached. the
+       stats snapshot reads these rather than the ring, which Stop may detach under it */
+    std::atomic<uint32_t> published_ring_fill_{0};
+    std::atomic<uint32_t> published_ring_capacity_{0};
+
+    /* the position stamped into packets: ring reads plus the capture the ring had no room for.
+       consumer side only */
+    size_t stream_offset_ = 0;
+    size_t StreamPosition() const { return ring_buffer_.ReadPosition() + stream_offset_; }
+
+    /* overrun handling. the producer notes where it dropped capture and publishes that on
+       gap_queue_ before it writes anything behind it, the send path merges those drops and its
+       own into one gap in progress and sends it as a GAP packet ahead of the next audio */
+    struct RingGap {
+        size_t position;   /* ring write position the drop happened at */
+        uint32_t samples;
+    };
+    RingGap ring_gap_ = {};   /* producer only, the drop not yet published */
+    static constexpr size_t GAP_QUEUE_SIZE = 8;
+    RingGap gap_queue_storage_[GAP_QUEUE_SIZE];
+    SpscRingBuffer<RingGap> gap_queue_;
+    std::atomic<OverrunPolicy> requested_overrun_policy_{static_cast<OverrunPolicy>(AUDIO_RING_OVERRUN_POLICY)};
+    std::atomic<uint32_t> requested_max_backlog_ms_{AUDIO_RING_MAX_BACKLOG_MS};
+    size_t period_packets_ = 1;   /* packets per read period */
+    uint32_t gap_start_ = 0;
+    uint32_t gap_samples_ = 0;
+    GapReason gap_reason_ = GapReason::RING_FULL;
+    /* counters below are written by the send path and read by the stats snapshot on the udp task */
+    std::atomic<uint32_t> shed_samples_{0};
+    std::atomic<uint32_t> idle_samples_{0};
+    std::atomic<uint32_t> gap_markers_{0};
+    /* takes the producer's drops at the read position, into the gap in progress if mark */
+    void TakeRingGaps(bool mark);
+    /* how many of the next samples can be read before the next producer drop, at most limit */
+    size_t SamplesBeforeGap(size_t limit) const;
+    /* consumes samples without sending them, into the gap in progress if mark */
+    void Skip(size_t samples, bool mark, GapReason reason);
+    void AddGap(uint32_t samples, GapReason reason);
+    void SendGap();
+
+    /* a read period is split into equal packets of at most MAX_SAMPLES_PER_PACKET,
+       e.g. 480 samples (30ms) at 16kHz and 2 x 720 samples (15ms) at 48kHz */
+    static constexpr size_t MAX_SAMPLES_PER_PACKET = 720;   /* 1440 bytes */
+    static_assert(MAX_SAMPLES_PER_PACKET * sizeof(int16_t) <= MAX_PAYLOAD_SIZE);
+    size_t samples_per_packet_ = 0;
+    uint8_t sample_rate_khz_ = 0;
+
+    /* low 32 bits of esp_timer_get_time() when the newest block was written, wraps every ~71 minutes */
+    std::atomic<uint32_t> last_write_us_{0};
+    uint32_t last_send_us_ = 0;
+    CaptureLatencyStats latency_stats_ = {};
+    void RecordLatency(uint32_t now_us);
+
+    /* stamped into every data packet, consumer side only */
+    uint32_t next_sequence_ = 0;
+
+    /* payload encoding */
+#ifdef AUDIO_STREAM_CODEC_ADPCM
+    std::atomic<AudioCodec> requested_codec_{AudioCodec::IMA_ADPCM};
+#else
+    std::atomic<AudioCodec> requested_codec_{AudioCodec::PCM16};
+#endif
+    AudioCodec active_codec_ = AudioCodec::PCM16;   /* consumer side only */
+    ImaAdpcmEncoder adpcm_encoder_;
+    static_assert(ImaAdpcmBlockSize(MAX_SAMPLES_PER_PACKET) <= MAX_PAYLOAD_SIZE);
+
+    /* moves samples from the ring buffer into the packet payload in the active codec */
+    size_t FillPacket(PacketBuffer* packet, size_t samples);
+
+    /* selective retransmission. every DATA packet sent is noted by sequence number with what it
+       takes to build it again: pcm and adpcm come back out of the ring's retention, the
+       descriptors from the note itself. cleared by Start, the ring starts over there */
+    struct SentPacket {
+        uint32_t sequence;
+        uint32_t sample_index;
+        size_t ring_position;        /* of the first sample, PCM16 and IMA_ADPCM */
+        uint32_t samples;            /* 0 in a slot that holds nothing */
+        ImaAdpcmState adpcm_state;   /* the encoder's state at the start of the block */
+        AudioCodec codec;
+        GapReason gap_reason;
+        uint16_t noise_rms;
+    };
+    static constexpr size_t SENT_HISTORY_SIZE = 256;   /* a second of 5 ms packets and the descriptors between */
+    SentPacket sent_history_[SENT_HISTORY_SIZE];
+    void RememberPacket(const SentPacket& packet) { sent_history_[packet.sequence % SENT_HISTORY_SIZE] = packet; }
+
+    /* requests are queued by the udp task and served by the send path a few packets per tick */
+    struct NackRequest {
+        sockaddr_in client_addr;
+        uint32_t first_sequence;
+        uint32_t count;
+    };
+    static constexpr size_t NACK_QUEUE_SIZE = 16;
+    NackRequest nack_queue_storage_[NACK_QUEUE_SIZE];
+    SpscRingBuffer<NackRequest> nack_queue_;
+    std::atomic<uint32_t> nack_requested_{0};   /* written by the udp task only */
+    NackRequest nack_in_progress_ = {};         /* consumer side from here on */
+    std::atomic<uint32_t> retransmissions_{0};
+    std::atomic<uint32_t> nack_expired_{0};
+    std::atomic<uint32_t> nack_send_failed_{0};
+    ImaAdpcmEncoder retransmit_encoder_;
+    void ServeNacks();
+    enum class RetransmitResult : uint8_t {
+        SENT,
+        EXPIRED,        /* no longer held */
+        NO_BUFFER,      /* the packet pool is empty, the sequence can be tried again next tick */
+        SEND_FAILED,
+    };
+    RetransmitResult Retransmit(uint32_t sequence, const sockaddr_in& client_addr);
+
+    /* forward error correction, the parity of the group in progress is held in a pool packet */
+    std::atomic<uint8_t> requested_fec_group_size_{AUDIO_FEC_GROUP_SIZE};
+    FecEncoder fec_encoder_;
+    PacketBuffer* fec_parity_ = nullptr;
+    std::atomic<uint32_t> parity_packets_sent_{0};
+    static_assert(MAX_SAMPLES_PER_PACKET * sizeof(int16_t) <= MAX_PARITY_PROTECTED_PAYLOAD);
+    /* returns a finished parity packet to send after this data packet, if any */
+    PacketBuffer* ProtectPacket(PacketBuffer* packet);
+    void ReleaseParity();
+    /* best effort, a lost parity packet only costs the group its protection */
+    void SendParity(PacketBuffer* parity);
+
+    /* congestion control, consumer side only apart from the request flag and the reports */
+#ifdef AUDIO_CONGESTION_CONTROL
+    std::atomic<bool> requested_congestion_control_{true};
+#else
+    std::atomic<bool> requested_congestion_control_{false};
+#endif
+    bool congestion_active_ = false;
+    CongestionController congestion_;
+    uint32_t congestion_changes_ = 0;
+    std::atomic<uint32_t> reported_expected_{0};   /* summed over clients until the next send tick */
+    std::atomic<uint32_t> reported_lost_{0};
+    static_assert(ImaAdpcmBlockSize(MAX_SAMPLES_PER_PACKET * 2) <= MAX_PARITY_PROTECTED_PAYLOAD,
+                  "the long packets of the congestion ladder are adpcm and must stay protectable");
+    /* level 0 and the deepest level whose rate the configured rate supports, pipeline stopped */
+    void ResetCongestion();
+    /* feeds the controller once per send tick and starts a rate switch the level asks for */
+    void UpdateCongestion();
+    /* rate changes cannot run on the send path, a one-shot task does them */
+    std::atomic<bool> rate_switch_pending_{false};
+    std::atomic<uint8_t> rate_switch_divider_{1};
+    static void RateSwitchTask(void* arg);
+
+    /* voice activity detection, consumer side only apart from the request flag */
+#ifdef AUDIO_VAD_ENABLED
+    std::atomic<bool> requested_vad_enabled_{true};
+#else
+    std::atomic<bool> requested_vad_enabled_{false};
+#endif
+    bool vad_active_ = false;
+    VadConfig vad_config_ = {
+        .energy_threshold_dbfs = AUDIO_VAD_ENERGY_THRESHOLD_DBFS,
+        .noise_margin_db = AUDIO_VAD_NOISE_MARGIN_DB,
+        .weak_speech_margin_db = AUDIO_VAD_WEAK_SPEECH_MARGIN_DB,
+        .zcr_threshold_hz = AUDIO_VAD_ZCR_THRESHOLD_HZ,
+        .hangover_ms = AUDIO_VAD_HANGOVER_MS,
+    };
+    VoiceActivityDetector vad_;
+    /* the silence run in progress, sent as one descriptor */
+    uint32_t silence_run_start_ = 0;
+    uint32_t silence_run_samples_ = 0;
+    uint64_t silence_run_rms_total_ = 0;    /* frame rms weighted by frame length */
+    uint32_t silence_run_max_samples_ = 0;
+    std::atomic<uint32_t> vad_suppressed_packets_{0};
+    uint32_t vad_silence_descriptors_ = 0;
+    uint64_t vad_saved_bytes_ = 0;
+    /* runs the vad over the next samples without consuming them */
+    bool IsVoiceFrame(size_t samples);
+    void AddToSilenceRun(size_t samples);
+    void SendSilenceRun();
+
+    /* send path counters, consumer side only */
+    uint64_t payload_bytes_copied_ = 0;
+    uint32_t send_ticks_ = 0;
+    static constexpr uint32_t STATS_LOG_INTERVAL_MS = 10000;
+    uint32_t stats_log_interval_ticks_ = 1;   /* STATS_LOG_INTERVAL_MS of read periods */
+    void LogSendPathStats() const;
 
     /* read timer callback */
     static void ReadTimerCallback(void* arg);
 
-    /* microphone callback */
-    static void MicrophoneCallback(const int16_t* data, size_t len);
+    /* microphone callback, borrows the codec's converted block for the duration of the call */
+    static void MicrophoneCallback(std::span<const int16_t> block);
     /* write data to the ring buffer */
     void WriteData(const int16_t* data, size_t samples);
 
@@ -0,0 +1,163 @@
+#include "capture_conditioner.h"
+#include <algorithm>
+#include <cmath>
+
+static int32_t DbToLinear(float db, float scale) {
+    return static_cast<int32_t>(std::lround(scale * std::pow(10.0f, db / 20.0f)));
+}
+
+/* largest k with 2^k <= the time constant in samples */
+uint32_t CaptureConditioner::TimeConstantShift(uint32_t sample_rate, uint32_t ms) {
+    uint32_t samples = static_cast<uint32_t>(static_cast<uint64_t>(sample_rate) * ms / 1000);
+    uint32_t shift = 0;
+    while ((2u << shift) <= samples && shift < 30) {
+        shift++;
+    }
+    return shift;
+}
+
+void CaptureConditioner::Configure(uint32_t sample_rate, uint32_t shift, bool dc_block, bool agc,
+                                   const AgcConfig& agc_config, uint32_t dc_cutoff_hz) {
+    dc_block_ = dc_block;
+    agc_ = agc;
+    if (sample_rate == 0) {
+        sample_rate = 16000;
+    }
+
+    pre_shift_ = std::min(shift, MAX_PRE_SHIFT);
+    uint32_t post_shift = shift - pre_shift_;
+    gain_shift_ = GAIN_FRAC_BITS + post_shift;
+
+    // corner of y = x - dc, dc += y / 2^k is about fs / (2 pi 2^k)
+    float dc_samples = sample_rate / (2.0f * static_cast<float>(M_PI) * std::max<uint32_t>(dc_cutoff_hz, 1));
+    dc_shift_ = static_cast<uint32_t>(std::clamp(std::lround(std::log2(dc_samples)), 1l, 20l));
+
+    attack_shift_ = TimeConstantShift(sample_rate, agc_config.attack_ms);
+    release_shift_ = TimeConstantShift(sample_rate, agc_config.release_ms);
+
+    // levels in 16-bit output units, moved into the envelope's scale (|y| << ENVELOPE_FRAC_BITS)
+    uint64_t target = static_cast<uint64_t>(DbToLinear(agc_config.target_dbfs, INT16_MAX));
+    target_numerator_ = target << (gain_shift_ + ENVELOPE_FRAC_BITS);
+    gate_envelope_ = static_cast<uint32_t>(
+        std::min<uint64_t>(static_cast<uint64_t>(DbToLinear(agc_config.gate_dbfs, INT16_MAX))
+                               << (post_shift + ENVELOPE_FRAC_BITS),
+                           UINT32_MAX));
+    min_gain_ = DbToLinear(agc_config.min_gain_db, 1 << GAIN_FRAC_BITS);
+    max_gain_ = DbToLinear(agc_config.max_gain_db, 1 << GAIN_FRAC_BITS);
+    limiter_knee_ = std::min<int32_t>(DbToLinear(agc_config.limiter_dbfs, INT16_MAX), INT16_MAX);
+
+    Reset();
+}
+
+void CaptureConditioner::Reset() {
+    dc_acc_ = 0;
+    envelope_ = 0;
+    gain_ = 1 << GAIN_FRAC_BITS;
+    block_position_ = 0;
+}
+
+template <bool DC_BLOCK, bool AGC>
+void CaptureConditioner::ProcessBlock(const int32_t* in, int16_t* out, size_t samples) {
+    // state in locals for the loop, out may alias in so nothing is kept in memory across it
+    const uint32_t pre_shift = pre_shift_;
+    const uint32_t dc_shift = dc_shift_;
+    const uint32_t gain_shift = gain_shift_;
+    const uint32_t post_shift = gain_shift_ - GAIN_FRAC_BITS;
+    const uint32_t attack_shift = attack_shift_;
+    const uint32_t release_shift = release_shift_;
+    const int32_t gain = gain_;
+    const int32_t knee = limiter_knee_;
+    int64_t dc_acc = dc_acc_;
+    uint32_t envelope = envelope_;
+
+    for (size_t i = 0; i < samples; i++) {
+        int32_t y = in[i] >> pre_shift;
+
+        if constexpr (DC_BLOCK) {
+            y -= static_cast<int32_t>(dc_acc >> dc_shift);
+            dc_acc += y;
+        }
+
+        int32_t value;
+        if constexpr (AGC) {
+            // |y| < 2^24, so the magnitude with its 7 fraction bits still fits 32 bits
+            uint32_t magnitude = static_cast<uint32_t>(y < 0 ? -y : y) << ENVELOPE_FRAC_BITS;
+            if (magnitude > envelope) {
+                envelope += (magnitude - envelope) >> attack_shift;
+            } else {
+                envelope -= envelope >> release_shift;
+            }
+
+            value = static_cast<int32_t>((static_cast<int64_t>(y) * gain) >> gain_shift);
+            if (value > knee) {
+                value = knee + ((value - knee) >> 3);
+            } else if (value < -knee) {
+                value = -knee + ((value + knee) >> 3);
+            }
+        } else {
+            value = y >> post_shift;
+        }
+
+        value = std::min(value, static_cast<int32_t>(INT16_MAX));
+        value = std::max(value, static_cast<int32_t>(-INT16_MAX));
+        out[i] = static_cast<int16_t>(value);
+    }
+
+    dc_acc_ = dc_acc;
+    envelope_ = envelope;
+}
+
+void CaptureConditioner::UpdateGain() {
+    if (envelope_ < gate_envelope_ || envelope_ == 0) {
+        return;   /* pause or background noise, hold the gain */
+    }
+
+    int64_t target = static_cast<int64_t>(target_numerator_ / envelope_);
+    target = std::clamp<int64_t>(target, min_gain_, max_gain_);
+
+    // the envelope attack already smooths the way down, the way up is eased further
+    if (target < gain_) {
+        gain_ = static_cast<int32_t>(target);
+    } else {
+        gain_ += static_cast<int32_t>((target - gain_) >> 3);
+    }
+}
+
+void CaptureConditioner::Process(const int32_t* in, int16_t* out, size_t samples) {
+    while (samples > 0) {
+        size_t count = samples;
+        if (agc_) {
+            count = std::min(samples, GAIN_BLOCK_SAMPLES - block_position_);
+        }
+
+        if (dc_block_ && agc_) {
+            ProcessBlock<true, true>(in, out, count);
+        } else if (agc_) {
+            ProcessBlock<false, true>(in, out, count);
+        } else if (dc_block_) {
+            ProcessBlock<true, false>(in, out, count);
+        } else {
+            ProcessBlock<false, false>(in, out, count);
+        }
+
+        in += count;
+        out += count;
+        samples -= count;
+
+        if (agc_) {
+            block_position_ += count;
+            if (block_position_ == GAIN_BLOCK_SAMPLES) {
+                UpdateGain();
+                block_position_ = 0;
+            }
+        }
+    }
+}
+
+float CaptureConditioner::gain_db() const {
+    return 20.0f * std::log10(static_cast<float>(gain_) / (1 << GAIN_FRAC_BITS));
+}
+
+int32_t CaptureConditioner::dc_offset() const {
+    return static_cast<int32_t>(dc_acc_ >> dc_shift_) >> (gain_shift_ - GAIN_FRAC_BITS);
+}
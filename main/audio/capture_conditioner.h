@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/* capture conditioning fused into the 32-bit i2s word -> 16-bit pcm conversion.
+
+   one forward pass per block does, per sample:
+     1. x = word >> min(shift, 8), the 24 significant bits of the mems microphone
+     2. dc blocker: y = x - dc, dc += y / 2^k (one pole high-pass, k picked from the rate so the
+        corner sits at about dc_cutoff_hz)
+     3. agc: out = y * gain, the gain steering a peak envelope of y towards target_dbfs.
+        the envelope rises with attack_ms and decays with release_ms, the gain is recomputed
+        every GAIN_BLOCK_SAMPLES and held while the envelope is below gate_dbfs so background
+        noise is not pumped up in pauses
+     4. limiter: everything above limiter_dbfs is compressed 8:1, then clamped to +-INT16_MAX
+
+   with the agc off the gain stays at unity, i.e. the same scaling as a plain >> shift. all
+   arithmetic is integer, the only division is once per gain block. like the pcm_convert kernels
+   out may alias in (in-place narrowing into the front of the same buffer).
+
+   plain c++ without esp-idf dependencies, scripts/capture_dsp_benchmark.cpp runs it on the host */
+
+struct AgcConfig {
+    float target_dbfs = -18.0f;     /* peak output level the gain steers to */
+    float max_gain_db = 30.0f;      /* relative to the plain >> shift scaling */
+    float min_gain_db = -12.0f;
+    float gate_dbfs = -55.0f;       /* envelope level (at unity gain) below which the gain holds */
+    float limiter_dbfs = -1.0f;
+    uint32_t attack_ms = 5;
+    uint32_t release_ms = 400;
+};
+
+class CaptureConditioner {
+public:
+    void Configure(uint32_t sample_rate, uint32_t shift, bool dc_block, bool agc,
+                   const AgcConfig& agc_config = AgcConfig(), uint32_t dc_cutoff_hz = 10);
+    /* clears the filter and envelope state, the gain goes back to unity */
+    void Reset();
+
+    bool enabled() const { return dc_block_ || agc_; }
+    bool dc_block() const { return dc_block_; }
+    bool agc() const { return agc_; }
+
+    void Process(const int32_t* in, int16_t* out, size_t samples);
+
+    float gain_db() const;
+    /* current dc estimate in 16-bit output units */
+    int32_t dc_offset() const;
+
+private:
+    static constexpr size_t GAIN_BLOCK_SAMPLES = 32;
+    static constexpr uint32_t MAX_PRE_SHIFT = 8;
+    static constexpr uint32_t GAIN_FRAC_BITS = 16;   /* unity gain is 1 << 16 */
+    static constexpr uint32_t ENVELOPE_FRAC_BITS = 7;
+
+    template <bool DC_BLOCK, bool AGC>
+    void ProcessBlock(const int32_t* in, int16_t* out, size_t samples);
+    void UpdateGain();
+
+    static uint32_t TimeConstantShift(uint32_t sample_rate, uint32_t ms);
+
+    bool dc_block_ = false;
+    bool agc_ = false;
+
+    /* scaling: x = word >> pre_shift_, out = (y * gain_) >> gain_shift_ */
+    uint32_t pre_shift_ = 0;
+    uint32_t gain_shift_ = GAIN_FRAC_BITS;
+
+    /* dc blocker, dc_acc_ holds the dc estimate scaled by 2^dc_shift_ */
+    uint32_t dc_shift_ = 10;
+    int64_t dc_acc_ = 0;
+
+    /* agc, envelope of |y| with ENVELOPE_FRAC_BITS extra precision */
+    uint32_t attack_shift_ = 0;
+    uint32_t release_shift_ = 0;
+    uint32_t envelope_ = 0;
+    uint32_t gate_envelope_ = 0;
+    uint64_t target_numerator_ = 0;   /* gain = target_numerator_ / envelope_ */
+    int32_t gain_ = 1 << GAIN_FRAC_BITS;
+    int32_t min_gain_ = 1 << GAIN_FRAC_BITS;
+    int32_t max_gain_ = 1 << GAIN_FRAC_BITS;
+    int32_t limiter_knee_ = INT16_MAX;
+    size_t block_position_ = 0;   /* samples into the current gain block */
+};
@@ -1,8 +1,10 @@
 #include "i2s_codec.h"
+#include "pcm_convert.h"
 #include <esp_log.h>
 #include <cstring>
 #include <inttypes.h>
-#include <vector>
+#include <esp_heap_caps.h>
+#include <esp_attr.h>
 
 static const char* TAG = "I2SCodec";
 
@@ -17,25 +19,221 @@ I2SCodec::~I2SCodec() {
 }
 
 bool I2SCodec::Initialize() {
+    if (!AllocateCaptureBuffer()) {
+        return false;
+    }
+    ConfigureConditioner();
+
+    if (capture_mode_ == CaptureMode::DMA_EVENT) {
+        // the task must exist before the first dma interrupt can notify it
+        if (!StartCaptureTask()) {
+            return false;
+        }
+    }
+
+    if (!CreateRxChannel()) {
+        return false;
+    }
+
+    if (capture_mode_ == CaptureMode::TIMER) {
+        const esp_timer_create_args_t timer_args = {
+            .callback = TimerCallback,
+            .arg = this,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "i2s_read_timer",
+            .skip_unhandled_events = true,
+        };
+
+        ESP_ERROR_CHECK(esp_timer_create(&timer_args, &timer_handle_));
+        ESP_ERROR_CHECK(esp_timer_start_periodic(timer_handle_, audio_read_duration_ms_ * 1000));
+#ifdef AUDIO_LATENCY_TRACE
+        timer_due_us_ = esp_timer_get_time() + audio_read_duration_ms_ * 1000;
+#endif
+    }
+
+    ESP_LOGI(TAG, "I2S Configuration:");
+    ESP_LOGI(TAG, "  Sample Rate: %lu Hz", sample_rate_);
+    ESP_LOGI(TAG, "  MCLK Multiple: 256");
+    ESP_LOGI(TAG, "  Data Bit Width: 32-bit");
+    ESP_LOGI(TAG, "  Slot Bit Width: AUTO");
+    ESP_LOGI(TAG, "  WS Width: 32-bit");
+    ESP_LOGI(TAG, "  GPIO: SCK=%d, WS=%d, DIN=%d", mic_sck_, mic_ws_, mic_din_);
+    ESP_LOGI(TAG, "  DMA: %" PRIu32 " x %" PRIu32 " frames, %" PRIu32 " ms frames", dma_desc_num_, dma_frame_num_,
+             audio_read_duration_ms_);
+    if (capture_mode_ == CaptureMode::DMA_EVENT) {
+        ESP_LOGI(TAG, "  Capture: DMA event driven, task on core %d, priority %d",
+                 AUDIO_CAPTURE_TASK_CORE, AUDIO_CAPTURE_TASK_PRIORITY);
+    } else {
+        ESP_LOGI(TAG, "  Capture: timer polled every %" PRIu32 " ms", audio_read_duration_ms_);
+    }
+    if (conditioner_.enabled()) {
+        ESP_LOGI(TAG, "  PCM conversion: >> %d, conditioned (DC block %s, AGC %s)", AUDIO_I2S_SAMPLE_SHIFT,
+                 dc_block_ ? "on" : "off", agc_ ? "on" : "off");
+    } else {
+        ESP_LOGI(TAG, "  PCM conversion: >> %d, %s kernel", AUDIO_I2S_SAMPLE_SHIFT,
+                 PcmConvertHasSimd() ? "PIE SIMD" : "portable");
+    }
+
+    ESP_LOGI(TAG, "I2S codec initialized successfully");
+    return true;
+}
+
+void I2SCodec::Deinitialize() {
+    if (timer_handle_) {
+        esp_timer_stop(timer_handle_);
+        esp_timer_delete(timer_handle_);
+        timer_handle_ = nullptr;
+    }
+
+    if (rx_handle_) {
+        i2s_channel_disable(rx_handle_);
+    }
+    StopCaptureTask();
+
+    {
+        std::lock_guard<std::mutex> lock(callback_mutex_);
+        audio_callback_ = nullptr;
+        audio_span_callback_ = nullptr;
+    }
+
+    if (rx_handle_) {
+        i2s_del_channel(rx_handle_);
+        rx_handle_ = nullptr;
+    }
+
+    FreeCaptureBuffer();
+}
+
+bool I2SCodec::AllocateCaptureBuffer() {
+    size_t samples = (sample_rate_ / 1000) * audio_read_duration_ms_ * input_channels_;
+    if (capture_buffer_ && capture_buffer_samples_ >= samples) {
+        read_period_samples_ = samples;
+        return true;
+    }
+
+    FreeCaptureBuffer();
+    capture_buffer_ = static_cast<int32_t*>(heap_caps_aligned_calloc(CAPTURE_BUFFER_ALIGNMENT, samples, sizeof(int32_t),
+                                                                     MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL));
+    if (!capture_buffer_) {
+        ESP_LOGE(TAG, "Failed to allocate %zu byte capture buffer", samples * sizeof(int32_t));
+        return false;
+    }
+    capture_buffer_samples_ = samples;
+    read_period_samples_ = samples;
+    return true;
+}
+
+void I2SCodec::FreeCaptureBuffer() {
+    if (capture_buffer_) {
+        heap_caps_free(capture_buffer_);
+        capture_buffer_ = nullptr;
+    }
+    capture_buffer_samples_ = 0;
+    read_period_samples_ = 0;
+}
+
+bool I2SCodec::SetSampleRate(uint32_t sample_rate) {
+    if (sample_rate == sample_rate_) return true;
+    if (!rx_handle_) {
+        sample_rate_ = sample_rate;
+        return true;
+    }
+
+    /* the timer callback and the capture task read under the callback lock */
+    std::lock_guard<std::mutex> lock(callback_mutex_);
+    if (sample_rate <= channel_sample_rate_) {
+        // e.g. the congestion controller's steps down from the configured rate and back: the dma
+        // buffers and the capture buffer are large enough, only the clock changes
+        i2s_channel_disable(rx_handle_);
+        sample_rate_ = sample_rate;
+        ConfigureConditioner();
+        i2s_std_clk_config_t clk_cfg = RxClockConfig();
+        if (i2s_channel_reconfig_std_clock(rx_handle_, &clk_cfg) != ESP_OK || !AllocateCaptureBuffer() ||
+            i2s_channel_enable(rx_handle_) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to reclock the I2S rx channel to %" PRIu32 " Hz", sample_rate_);
+            return false;
+        }
+        ESP_LOGI(TAG, "Sample rate %" PRIu32 " Hz, reclocked, DMA: %" PRIu32 " x %" PRIu32 " frames",
+                 sample_rate_, dma_desc_num_, dma_frame_num_);
+        return true;
+    }
+
+    // the dma buffers are too short for the read period at the new rate, the channel is rebuilt
+    DeleteRxChannel();
+    sample_rate_ = sample_rate;
+    ConfigureConditioner();
+    if (!AllocateCaptureBuffer() || !CreateRxChannel()) {
+        return false;
+    }
+    ESP_LOGI(TAG, "Sample rate %" PRIu32 " Hz, DMA: %" PRIu32 " x %" PRIu32 " frames",
+             sample_rate_, dma_desc_num_, dma_frame_num_);
+    return true;
+}
+
+bool I2SCodec::SetLatencyProfile(uint32_t frame_ms) {
+    const LatencyProfile* profile = FindLatencyProfile(frame_ms);
+    if (!profile) {
+        ESP_LOGE(TAG, "No latency profile for %" PRIu32 " ms frames", frame_ms);
+        return false;
+    }
+    if (!rx_handle_) {
+        latency_profile_ = *profile;
+        audio_read_duration_ms_ = profile->frame_ms;
+        return true;
+    }
+
+    // the same rebuild as a rate change, the capture buffer holds one read period
+    std::lock_guard<std::mutex> lock(callback_mutex_);
+    DeleteRxChannel();
+    latency_profile_ = *profile;
+    audio_read_duration_ms_ = profile->frame_ms;
+    if (!AllocateCaptureBuffer() || !CreateRxChannel()) {
+        return false;
+    }
+    if (timer_handle_) {
+        esp_timer_stop(timer_handle_);
+        ESP_ERROR_CHECK(esp_timer_start_periodic(timer_handle_, audio_read_duration_ms_ * 1000));
+#ifdef AUDIO_LATENCY_TRACE
+        timer_due_us_ = esp_timer_get_time() + audio_read_duration_ms_ * 1000;
+#endif
+    }
+    ESP_LOGI(TAG, "Latency profile %" PRIu32 " ms, DMA: %" PRIu32 " x %" PRIu32 " frames",
+             audio_read_duration_ms_, dma_desc_num_, dma_frame_num_);
+    return true;
+}
+
+i2s_std_clk_config_t I2SCodec::RxClockConfig() const {
+    return {
+        .sample_rate_hz = (uint32_t)sample_rate_,
+        .clk_src = I2S_CLK_SRC_DEFAULT,
+        .ext_clk_freq_hz = 0,  // always initialize this field
+        .mclk_multiple = I2S_MCLK_MULTIPLE_256
+    };
+}
+
+bool I2SCodec::CreateRxChannel() {
+    dma_desc_num_ = latency_profile_.dma_desc_num;
+    dma_frame_num_ = sample_rate_ / 1000 * latency_profile_.dma_buffer_ms;
+    channel_sample_rate_ = sample_rate_;
+
     i2s_chan_config_t rx_chan_cfg = {
         .id = (i2s_port_t)1,
         .role = I2S_ROLE_MASTER,
-        .dma_desc_num = 6,
-        .dma_frame_num = 240,
+        .dma_desc_num = dma_desc_num_,
+        .dma_frame_num = dma_frame_num_,
         .auto_clear_after_cb = true,
         .auto_clear_before_cb = false,
         .intr_priority = 0,
     };
     
-    ESP_ERROR_CHECK(i2s_new_channel(&rx_chan_cfg, nullptr, &rx_handle_));
+    if (i2s_new_channel(&rx_chan_cfg, nullptr, &rx_handle_) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create I2S rx channel");
+        rx_handle_ = nullptr;
+        return false;
+    }
 
     i2s_std_config_t rx_std_cfg = {
-        .clk_cfg = {
-            .sample_rate_hz = (uint32_t)sample_rate_,
-            .clk_src = I2S_CLK_SRC_DEFAULT,
-            .ext_clk_freq_hz = 0,  // always initialize this field
-            .mclk_multiple = I2S_MCLK_MULTIPLE_256
-        },
+        .clk_cfg = RxClockConfig(),
         .slot_cfg = {
             .data_bit_width = I2S_DATA_BIT_WIDTH_32BIT,
             .slot_bit_width = I2S_SLOT_BIT_WIDTH_AUTO,
@@ -63,65 +261,47 @@ bool I2SCodec::Initialize() {
     };
 
     ESP_ERROR_CHECK(i2s_channel_init_std_mode(rx_handle_, &rx_std_cfg));
-    ESP_ERROR_CHECK(i2s_channel_enable(rx_handle_));
 
-    const esp_timer_create_args_t timer_args = {
-        .callback = TimerCallback,
-        .arg = this,
-        .dispatch_method = ESP_TIMER_TASK,
-        .name = "i2s_read_timer",
-        .skip_unhandled_events = true,
-    };
-    
-    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &timer_handle_));
-    ESP_ERROR_CHECK(esp_timer_start_periodic(timer_handle_, audio_read_duration_ms_ * 1000));
-
-    ESP_LOGI(TAG, "I2S Configuration:");
-    ESP_LOGI(TAG, "  Sample Rate: %lu Hz", sample_rate_);
-    ESP_LOGI(TAG, "  MCLK Multiple: 256");
-    ESP_LOGI(TAG, "  Data Bit Width: 32-bit");
-    ESP_LOGI(TAG, "  Slot Bit Width: AUTO");
-    ESP_LOGI(TAG, "  WS Width: 32-bit");
-    ESP_LOGI(TAG, "  GPIO: SCK=%d, WS=%d, DIN=%d", mic_sck_, mic_ws_, mic_din_);
-
-    ESP_LOGI(TAG, "I2S codec initialized successfully");
+#ifdef AUDIO_LATENCY_TRACE
+    const bool dma_events = true;   /* the callback also timestamps every filled buffer */
+#else
+    const bool dma_events = capture_mode_ == CaptureMode::DMA_EVENT;
+#endif
+    if (dma_events) {
+        i2s_event_callbacks_t callbacks = {};
+        callbacks.on_recv = OnReceiveCallback;
+        ESP_ERROR_CHECK(i2s_channel_register_event_callback(rx_handle_, &callbacks, this));
+    }
+    ESP_ERROR_CHECK(i2s_channel_enable(rx_handle_));
     return true;
 }
 
-void I2SCodec::Deinitialize() {
-    if (timer_handle_) {
-        esp_timer_stop(timer_handle_);
-        esp_timer_delete(timer_handle_);
-        timer_handle_ = nullptr;
-    }
-
-    {
-        std::lock_guard<std::mutex> lock(callback_mutex_);
-        audio_callback_ = nullptr;
-    }
-
+void I2SCodec::DeleteRxChannel() {
     if (rx_handle_) {
         i2s_channel_disable(rx_handle_);
         i2s_del_channel(rx_handle_);
         rx_handle_ = nullptr;
     }
+    channel_sample_rate_ = 0;
 }
 
-void I2SCodec::SetSampleRate(uint32_t sample_rate) {
-    if (sample_rate == sample_rate_ || !rx_handle_) return;
-    
-    sample_rate_ = sample_rate;
-    
-    i2s_channel_disable(rx_handle_);
-    i2s_std_clk_config_t clk_cfg = {
-        .sample_rate_hz = sample_rate,
-        .clk_src = I2S_CLK_SRC_DEFAULT,
-        .ext_clk_freq_hz = 0,
-        .mclk_multiple = I2S_MCLK_MULTIPLE_256
-    };
-    
-    ESP_ERROR_CHECK(i2s_channel_reconfig_std_clock(rx_handle_, &clk_cfg));
-    ESP_ERROR_CHECK(i2s_channel_enable(rx_handle_));
+void I2SCodec::ConfigureConditioner() {
+    conditioner_.Configure(sample_rate_, AUDIO_I2S_SAMPLE_SHIFT, dc_block_, agc_, agc_config_,
+                           AUDIO_DC_BLOCK_CUTOFF_HZ);
+    agc_gain_db_.store(0.0f, std::memory_order_relaxed);
+}
+
+void I2SCodec::SetCaptureConditioning(bool dc_block, bool agc) {
+    std::lock_guard<std::mutex> lock(callback_mutex_);
+    dc_block_ = dc_block;
+    agc_ = agc;
+    ConfigureConditioner();
+}
+
+void I2SCodec::SetAgcConfig(const AgcConfig& config) {
+    std::lock_guard<std::mutex> lock(callback_mutex_);
+    agc_config_ = config;
+    ConfigureConditioner();
 }
 
 void I2SCodec::SetMicrophoneCallback(MicrophoneCallback callback) {
@@ -129,28 +309,34 @@ void I2SCodec::SetMicrophoneCallback(MicrophoneCallback callback) {
     audio_callback_ = callback;
 }
 
-bool I2SCodec::ReadAudioData() {
-    if (!rx_handle_) return false;
+void I2SCodec::SetMicrophoneSpanCallback(MicrophoneSpanCallback callback) {
+    std::lock_guard<std::mutex> lock(callback_mutex_);
+    audio_span_callback_ = callback;
+}
 
-    // calculate the expected frame size
-    size_t expected_samples = (sample_rate_ / 1000) * audio_read_duration_ms_ * 1;
-    size_t expected_bytes = expected_samples * sizeof(int32_t);
+bool I2SCodec::ReadAudioData(uint32_t timeout_ms) {
+    // SetSampleRate swaps the channel and the buffer under the same lock
+    std::lock_guard<std::mutex> lock(callback_mutex_);
+    if (!rx_handle_ || !capture_buffer_) return false;
 
-    std::vector<int32_t> audio_buffer(expected_samples);
+    // one read period of 32-bit words, the buffer was sized for it up front
+    size_t expected_bytes = read_period_samples_ * sizeof(int32_t);
     size_t total_bytes_read = 0;
 
     // read until get enough audio data
     while (total_bytes_read < expected_bytes) {
         size_t current_read = 0;
         esp_err_t err = i2s_channel_read(rx_handle_, 
-                                         audio_buffer.data() + (total_bytes_read / sizeof(int32_t)), 
+                                         capture_buffer_ + (total_bytes_read / sizeof(int32_t)), 
                                          expected_bytes - total_bytes_read, 
                                          &current_read, 
-                                         portMAX_DELAY);
+                                         timeout_ms);
+        if (err == ESP_ERR_TIMEOUT) {
+            total_bytes_read += current_read;  // keep whatever the filled dma buffers held
+            break;
+        }
         if (err != ESP_OK) {
-            if (err != ESP_ERR_TIMEOUT) {
-                ESP_LOGE(TAG, "Error reading I2S data: %s", esp_err_to_name(err));
-            }
+            ESP_LOGE(TAG, "Error reading I2S data: %s", esp_err_to_name(err));
             return false;
         }
 
@@ -164,28 +350,100 @@ bool I2SCodec::ReadAudioData() {
     if (total_bytes_read == 0) {
         return false;
     }
+    LATENCY_TRACE_NOW(read_us);
+    LATENCY_TRACE_RECORD(DMA, static_cast<uint32_t>(read_us) - last_dma_event_us_.load(std::memory_order_relaxed));
 
     size_t samples = total_bytes_read / sizeof(int32_t);
-    std::vector<int16_t> converted_data(samples);
 
-    // convert 32-bit pcm to 16-bit pcm
-    for (size_t i = 0; i < samples; i++) {
-        int32_t value = audio_buffer[i] >> 12;
-        converted_data[i] = (value > INT16_MAX) ? INT16_MAX : 
-                            (value < -INT16_MAX) ? -INT16_MAX : 
-                            static_cast<int16_t>(value);
+    // convert 32-bit pcm to 16-bit pcm in place: sample i lands at byte 2*i, which only
+    // overlaps 32-bit words that have already been read, so a forward pass is safe.
+    // the dc blocker and agc run inside that same pass
+    int16_t* converted_data = reinterpret_cast<int16_t*>(capture_buffer_);
+    if (conditioner_.enabled()) {
+        conditioner_.Process(capture_buffer_, converted_data, samples);
+        if (conditioner_.agc()) {
+            agc_gain_db_.store(conditioner_.gain_db(), std::memory_order_relaxed);
+        }
+    } else {
+        PcmConvertS32ToS16(capture_buffer_, converted_data, samples,
+                           AUDIO_I2S_SAMPLE_SHIFT, PcmSaturation::SYMMETRIC);
     }
 
-    std::lock_guard<std::mutex> lock(callback_mutex_);
+    bool delivered = false;
+    if (audio_span_callback_) {
+        audio_span_callback_(std::span<const int16_t>(converted_data, samples));
+        delivered = true;
+    }
     if (audio_callback_) {
-        audio_callback_(converted_data.data(), samples);
-        return true;
+        audio_callback_(converted_data, samples);
+        delivered = true;
     }
+    LATENCY_TRACE_RECORD(CONVERT, esp_timer_get_time() - read_us);
 
-    return false;
+    return delivered;
 }
 
 
 void I2SCodec::TimerCallback(void* arg) {
-    static_cast<I2SCodec*>(arg)->ReadAudioData();
+    I2SCodec* codec = static_cast<I2SCodec*>(arg);
+    LATENCY_TRACE_TIMER(CAPTURE_TIMER, codec->timer_due_us_, codec->audio_read_duration_ms_ * 1000);
+    codec->ReadAudioData();
+}
+
+bool IRAM_ATTR I2SCodec::OnReceiveCallback(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user_ctx) {
+    I2SCodec* codec = static_cast<I2SCodec*>(user_ctx);
+#ifdef AUDIO_LATENCY_TRACE
+    codec->last_dma_event_us_.store(static_cast<uint32_t>(esp_timer_get_time()), std::memory_order_relaxed);
+#endif
+    TaskHandle_t task = codec->capture_task_.load(std::memory_order_acquire);
+    if (!task) {
+        return false;
+    }
+
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    vTaskNotifyGiveFromISR(task, &higher_priority_task_woken);
+    return higher_priority_task_woken == pdTRUE;
+}
+
+bool I2SCodec::StartCaptureTask() {
+    TaskHandle_t task = nullptr;
+    capture_task_running_ = true;
+    if (xTaskCreatePinnedToCore(CaptureTask, "audio_capture", AUDIO_CAPTURE_TASK_STACK_SIZE, this,
+                                AUDIO_CAPTURE_TASK_PRIORITY, &task, AUDIO_CAPTURE_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create capture task");
+        capture_task_running_ = false;
+        return false;
+    }
+    capture_task_.store(task, std::memory_order_release);
+    return true;
+}
+
+void I2SCodec::StopCaptureTask() {
+    TaskHandle_t task = capture_task_.load(std::memory_order_acquire);
+    if (!task) {
+        return;
+    }
+
+    // the task clears capture_task_ on its way out
+    capture_task_running_ = false;
+    xTaskNotifyGive(task);
+    while (capture_task_.load(std::memory_order_acquire)) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+void I2SCodec::CaptureTask(void* arg) {
+    I2SCodec* codec = static_cast<I2SCodec*>(arg);
+
+    while (codec->capture_task_running_) {
+        // one notification per filled dma buffer, take them all and drain whatever is ready
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CAPTURE_TASK_IDLE_TIMEOUT_MS)) == 0) {
+            continue;
+        }
+        while (codec->capture_task_running_ && codec->ReadAudioData(0)) {
+        }
+    }
+
+    codec->capture_task_.store(nullptr, std::memory_order_release);
+    vTaskDelete(nullptr);
 }
\ No newline at end of file
@@ -1,12 +1,18 @@
 #pragma once
 
 #include "audio_config.h"
+#include "capture_conditioner.h"
+#include "latency_profile.h"
+#include "latency_trace.h"
 #include <driver/gpio.h>
 #include <driver/i2s_std.h>
 #include <esp_timer.h>
 #include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <atomic>
 #include <mutex>
 #include <functional>
+#include <span>
 
 // I2S port definitions for TX (speaker) and RX (microphone)
 #define I2S_PORT_TX I2S_NUM_0
@@ -14,7 +20,14 @@
 
 class I2SCodec {
 public:
+    enum class CaptureMode : uint8_t {
+        TIMER,       /* an esp_timer polls the dma buffers every read period */
+        DMA_EVENT,   /* the on_recv dma callback wakes a dedicated, pinned capture task */
+    };
+
     using MicrophoneCallback = std::function<void(const int16_t*, size_t)>;
+    /* the span borrows the codec's capture buffer, it is only valid for the duration of the call */
+    using MicrophoneSpanCallback = std::function<void(std::span<const int16_t>)>;
 
     I2SCodec(uint32_t sample_rate,
              gpio_num_t mic_sck, gpio_num_t mic_ws, gpio_num_t mic_din);
@@ -22,14 +35,46 @@ public:
 
     bool Initialize();
     void Deinitialize();
-    void SetSampleRate(uint32_t sample_rate);
+    /* a rate up to the one the rx channel was created at only reclocks it, keeping its dma
+       buffers (which then span proportionally longer); a higher rate re-creates the channel with
+       dma buffers sized for it. the microphone callbacks stay registered */
+    bool SetSampleRate(uint32_t sample_rate);
     void SetMicrophoneCallback(MicrophoneCallback callback);
-    bool ReadAudioData();
+    void SetMicrophoneSpanCallback(MicrophoneSpanCallback callback);
+    /* dc blocker and agc in the conversion pass, both off runs the plain narrowing kernel.
+       changing either resets the filter and gain state */
+    void SetCaptureConditioning(bool dc_block, bool agc);
+    void SetAgcConfig(const AgcConfig& config);
+    /* the gain applied to the last delivered block, lock-free so the send path's vad can take
+       it out of its level measurement */
+    float GetAgcGainDb() const { return agc_gain_db_.load(std::memory_order_relaxed); }
+    /* frame length and dma sizing, see latency_profile.h. like SetSampleRate it re-creates a
+       running rx channel, and retimes the read timer */
+    bool SetLatencyProfile(uint32_t frame_ms);
+    const LatencyProfile& latency_profile() const { return latency_profile_; }
+    /* must be called before Initialize */
+    void SetCaptureMode(CaptureMode mode) { capture_mode_ = mode; }
+    /* reads up to one read period, timeout_ms = 0 only drains the dma buffers already filled */
+    bool ReadAudioData(uint32_t timeout_ms = portMAX_DELAY);
 
     uint32_t microphone_sample_rate() const { return sample_rate_; }
     uint32_t get_audio_read_duration_ms() const { return audio_read_duration_ms_; }
+    CaptureMode capture_mode() const { return capture_mode_; }
 private:
     static void TimerCallback(void* arg);
+    static bool OnReceiveCallback(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user_ctx);
+    static void CaptureTask(void* arg);
+
+    bool StartCaptureTask();
+    void StopCaptureTask();
+
+    /* rx channel setup shared by Initialize, SetSampleRate and SetLatencyProfile */
+    bool CreateRxChannel();
+    void DeleteRxChannel();
+    i2s_std_clk_config_t RxClockConfig() const;
+
+    bool AllocateCaptureBuffer();
+    void FreeCaptureBuffer();
 
     // GPIO pins for microphone
     gpio_num_t mic_sck_;
@@ -43,17 +88,70 @@ private:
     uint32_t sample_rate_;
     size_t input_channels_ = 1;
 
-    /* rate = 16000, dma buffer = 6 * 240 = 1440, frame_size = 32bit
-       per dma filling time = 240 / 16000 = 15ms
-       total dma filling time = 15 * 6 = 90ms */
-    uint32_t audio_read_duration_ms_ = 30;
+    /* the profile sizes the dma buffers in ms, e.g. 15ms is 240 frames at 16kHz or 720 at 48kHz
+       (2880 bytes of 32-bit frames, under the 4092 byte descriptor limit), and the read period */
+    static_assert(IsLatencyProfile(AUDIO_LATENCY_PROFILE_MS), "AUDIO_LATENCY_PROFILE_MS is not a profile");
+    LatencyProfile latency_profile_ = *FindLatencyProfile(AUDIO_LATENCY_PROFILE_MS);
+    uint32_t dma_desc_num_ = latency_profile_.dma_desc_num;
+    uint32_t dma_frame_num_ = 0;
+    uint32_t channel_sample_rate_ = 0;   /* the rate dma_frame_num_ was sized for */
+    uint32_t audio_read_duration_ms_ = latency_profile_.frame_ms;
 
-    /* periodically read audio data from dma buffer every 30ms, convert it, 
+#ifdef AUDIO_CAPTURE_EVENT_DRIVEN
+    CaptureMode capture_mode_ = CaptureMode::DMA_EVENT;
+#else
+    CaptureMode capture_mode_ = CaptureMode::TIMER;
+#endif
+
+    /* long-lived capture buffer in dma-capable internal ram, sized for one read period of 32-bit
+       i2s words. the 16-bit samples are narrowed in place into the front of the same block. a
+       shorter read period (a lower rate or a shorter frame) reuses it */
+    static constexpr size_t CAPTURE_BUFFER_ALIGNMENT = 64;   /* cache line */
+    int32_t* capture_buffer_ = nullptr;
+    size_t capture_buffer_samples_ = 0;   /* allocated */
+    size_t read_period_samples_ = 0;
+
+    /* guarded by callback_mutex_ like the buffer it works on, reconfigured on rate changes */
+    CaptureConditioner conditioner_;
+#ifdef AUDIO_CAPTURE_DC_BLOCK
+    bool dc_block_ = true;
+#else
+    bool dc_block_ = false;
+#endif
+#ifdef AUDIO_CAPTURE_AGC
+    bool agc_ = true;
+#else
+    bool agc_ = false;
+#endif
+    AgcConfig agc_config_ = {
+        .target_dbfs = AUDIO_AGC_TARGET_DBFS,
+        .max_gain_db = AUDIO_AGC_MAX_GAIN_DB,
+        .min_gain_db = AUDIO_AGC_MIN_GAIN_DB,
+        .gate_dbfs = AUDIO_AGC_GATE_DBFS,
+        .limiter_dbfs = AUDIO_AGC_LIMITER_DBFS,
+        .attack_ms = AUDIO_AGC_ATTACK_MS,
+        .release_ms = AUDIO_AGC_RELEASE_MS,
+    };
+    std::atomic<float> agc_gain_db_{0.0f};
+    void ConfigureConditioner();
+
+    /* periodically read audio data from dma buffer every read period, convert it, 
        write to the audio_processor's ring buffer, and send it to the server via udp */
     esp_timer_handle_t timer_handle_ = nullptr;
+#ifdef AUDIO_LATENCY_TRACE
+    int64_t timer_due_us_ = 0;
+    /* low 32 bits of esp_timer_get_time() at the last on_recv, the newest filled dma buffer */
+    std::atomic<uint32_t> last_dma_event_us_{0};
+#endif
+
+    /* event driven capture: the dma isr notifies this task for every filled dma buffer */
+    std::atomic<TaskHandle_t> capture_task_{nullptr};
+    std::atomic<bool> capture_task_running_{false};
+    static constexpr uint32_t CAPTURE_TASK_IDLE_TIMEOUT_MS = 100;
 
     /* the audio callback_ is invoked by the audio_processor, via SetMicrophoneCallback,
        it writes the updated audio data to the ring buffer */
     std::mutex callback_mutex_;
     MicrophoneCallback audio_callback_;
+    MicrophoneSpanCallback audio_span_callback_;
 }; 
\ No newline at end of file
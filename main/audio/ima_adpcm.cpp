@@ -0,0 +1,105 @@
+#include "ima_adpcm.h"
+#include <cstring>
+
+static const int16_t STEP_TABLE[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t INDEX_TABLE[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+static inline int32_t Clamp(int32_t value, int32_t min_value, int32_t max_value) {
+    return value < min_value ? min_value : (value > max_value ? max_value : value);
+}
+
+/* applies one code to the state, shared by the encoder (to track the decoder) and the decoder */
+static inline void Step(ImaAdpcmState& state, uint8_t code) {
+    int32_t step = STEP_TABLE[state.step_index];
+    int32_t diff = step >> 3;
+    if (code & 4) diff += step;
+    if (code & 2) diff += step >> 1;
+    if (code & 1) diff += step >> 2;
+    state.predictor = Clamp((code & 8) ? state.predictor - diff : state.predictor + diff, INT16_MIN, INT16_MAX);
+    state.step_index = Clamp(state.step_index + INDEX_TABLE[code], 0, 88);
+}
+
+static inline uint8_t Quantize(const ImaAdpcmState& state, int32_t sample) {
+    int32_t step = STEP_TABLE[state.step_index];
+    int32_t diff = sample - state.predictor;
+    uint8_t code = 0;
+    if (diff < 0) {
+        code = 8;
+        diff = -diff;
+    }
+    if (diff >= step) { code |= 4; diff -= step; }
+    step >>= 1;
+    if (diff >= step) { code |= 2; diff -= step; }
+    step >>= 1;
+    if (diff >= step) { code |= 1; }
+    return code;
+}
+
+void ImaAdpcmEncoder::BeginBlock(uint8_t* out) {
+    int16_t predictor = static_cast<int16_t>(state_.predictor);
+    memcpy(out, &predictor, sizeof(predictor));
+    out[2] = static_cast<uint8_t>(state_.step_index);
+    out[3] = 0;
+
+    block_ = out;
+    write_ = out + IMA_ADPCM_BLOCK_HEADER_SIZE;
+    high_nibble_ = false;
+}
+
+void ImaAdpcmEncoder::Encode(std::span<const int16_t> samples) {
+    for (int16_t sample : samples) {
+        uint8_t code = Quantize(state_, sample);
+        Step(state_, code);
+
+        if (high_nibble_) {
+            *write_++ |= code << 4;
+        } else {
+            *write_ = code;
+        }
+        high_nibble_ = !high_nibble_;
+    }
+}
+
+size_t ImaAdpcmEncoder::EndBlock() {
+    if (high_nibble_) {
+        block_[3] |= IMA_ADPCM_FLAG_ODD;
+        write_++;
+    }
+    size_t size = write_ - block_;
+    block_ = write_ = nullptr;
+    return size;
+}
+
+size_t ImaAdpcmDecodeBlock(const uint8_t* block, size_t bytes, int16_t* out) {
+    if (bytes < IMA_ADPCM_BLOCK_HEADER_SIZE) {
+        return 0;
+    }
+
+    int16_t predictor;
+    memcpy(&predictor, block, sizeof(predictor));
+    ImaAdpcmState state = {predictor, Clamp(block[2], 0, 88)};
+
+    const uint8_t* data = block + IMA_ADPCM_BLOCK_HEADER_SIZE;
+    size_t data_bytes = bytes - IMA_ADPCM_BLOCK_HEADER_SIZE;
+    size_t samples = data_bytes * 2;
+    if (data_bytes > 0 && (block[3] & IMA_ADPCM_FLAG_ODD)) {
+        samples--;
+    }
+
+    for (size_t i = 0; i < samples; i++) {
+        uint8_t code = (i & 1) ? (data[i / 2] >> 4) : (data[i / 2] & 0x0F);
+        Step(state, code);
+        out[i] = static_cast<int16_t>(state.predictor);
+    }
+    return samples;
+}
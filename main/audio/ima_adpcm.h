@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+/* ima adpcm (4 bits per sample) in self-contained blocks.
+
+   block layout: int16 predictor, uint8 step index, uint8 flags, then two samples per byte,
+   low nibble first. every block starts with the encoder state it was coded from, so a block
+   decodes on its own and a lost packet never desynchronizes the next one. */
+
+static constexpr size_t IMA_ADPCM_BLOCK_HEADER_SIZE = 4;
+static constexpr uint8_t IMA_ADPCM_FLAG_ODD = 0x01;   /* the high nibble of the last byte is padding */
+
+static constexpr size_t ImaAdpcmBlockSize(size_t samples) {
+    return IMA_ADPCM_BLOCK_HEADER_SIZE + (samples + 1) / 2;
+}
+
+struct ImaAdpcmState {
+    int32_t predictor = 0;
+    int32_t step_index = 0;
+};
+
+/* the encoder state carries over from block to block, a block may be fed from several spans
+   (e.g. both halves of a wrapped ring buffer region) */
+class ImaAdpcmEncoder {
+public:
+    void Reset() { state_ = {}; }
+    /* the state the next block starts from. the same state and samples encode to the same bytes,
+       which is how a retransmission rebuilds a block */
+    const ImaAdpcmState& state() const { return state_; }
+    void SetState(const ImaAdpcmState& state) { state_ = state; }
+
+    /* starts a block at out, which must hold ImaAdpcmBlockSize(samples) bytes */
+    void BeginBlock(uint8_t* out);
+    void Encode(std::span<const int16_t> samples);
+    /* returns the size of the finished block in bytes */
+    size_t EndBlock();
+
+private:
+    ImaAdpcmState state_;
+    uint8_t* block_ = nullptr;
+    uint8_t* write_ = nullptr;
+    bool high_nibble_ = false;
+};
+
+/* decodes one block, returns the number of samples written to out (at most 2 * payload bytes) */
+size_t ImaAdpcmDecodeBlock(const uint8_t* block, size_t bytes, int16_t* out);
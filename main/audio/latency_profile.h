@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/* the fixed delays of the stream, all derived from one frame length (AUDIO_LATENCY_PROFILE_MS,
+   I2SCodec::SetLatencyProfile, AudioProcessor::SetLatencyProfile):
+
+     frame_ms               read period, send cadence and packet length. a sample waits up to one
+                            frame for its packet, this is the bulk of the device's share
+     dma_buffer_ms          one dma descriptor. the capture task only sees audio once a descriptor
+                            is full, so it divides the frame and stays short
+     dma_desc_num           descriptors in the dma ring. only slack for a late capture task or
+                            timer, they do not delay a sample that is read on time
+     client_buffer_packets  the jitter buffer floor udp_client picks when it sees packets of this
+                            length, short packets need more of them to ride out wifi jitter
+
+   host_pipeline --profile, 16 kHz PCM16, event driven capture, loopback. the mic latency runs
+   from a packet's oldest sample to its arrival; the wifi hop and the client's buffer come on top,
+   and the cpu figures are the host's, only their ratios carry over to the esp32s3:
+
+     profile  dma          packets/s  datagram  headers  mic to receive p50 / p99  cpu per period
+     5 ms     8 x 5 ms     200        172 B     20.0%    5.1 / 5.3 ms             39 us
+     10 ms    8 x 5 ms     100        332 B     11.1%    10.2 / 10.5 ms           65 us
+     20 ms    6 x 10 ms    50         652 B     5.9%     20.2 / 20.6 ms           76 us
+     30 ms    6 x 15 ms    33         972 B     4.0%     30.3 / 30.6 ms           96 us
+
+   headers are the 12 protocol bytes plus 28 of udp/ipv4 per datagram, as a share of the bytes
+   on air. adpcm quarters the payload and so roughly triples that share */
+struct LatencyProfile {
+    uint32_t frame_ms;
+    uint32_t dma_buffer_ms;
+    uint32_t dma_desc_num;
+    uint8_t client_buffer_packets;
+};
+
+inline constexpr LatencyProfile LATENCY_PROFILES[] = {
+    {5, 5, 8, 3},
+    {10, 5, 8, 2},
+    {20, 10, 6, 2},
+    {30, 15, 6, 2},
+};
+
+/* the profile for a frame length, nullptr if there is none */
+constexpr const LatencyProfile* FindLatencyProfile(uint32_t frame_ms) {
+    for (const LatencyProfile& profile : LATENCY_PROFILES) {
+        if (profile.frame_ms == frame_ms) {
+            return &profile;
+        }
+    }
+    return nullptr;
+}
+
+/* not FindLatencyProfile() != nullptr: gcc's -fsanitize=undefined makes that pointer comparison
+   non-constant, and static_asserts use this */
+constexpr bool IsLatencyProfile(uint32_t frame_ms) {
+    for (const LatencyProfile& profile : LATENCY_PROFILES) {
+        if (profile.frame_ms == frame_ms) {
+            return true;
+        }
+    }
+    return false;
+}
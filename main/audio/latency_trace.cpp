@@ -0,0 +1,84 @@
+#include "latency_trace.h"
+#include <esp_log.h>
+#include <inttypes.h>
+
+static const char* TAG = "LatencyTrace";
+
+LatencyTrace LatencyTrace::instance_;
+
+uint32_t LatencyHistogram::BucketUpperEdgeUs(size_t bucket) {
+    return bucket + 1 >= BUCKETS ? UINT32_MAX : FIRST_BUCKET_US << bucket;
+}
+
+uint32_t LatencyHistogram::Snapshot::Percentile(float fraction) const {
+    if (count == 0) {
+        return 0;
+    }
+    uint32_t rank = static_cast<uint32_t>(fraction * count);
+    uint32_t cumulative = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        cumulative += buckets[i];
+        if (cumulative > rank) {
+            uint32_t edge = BucketUpperEdgeUs(i);
+            return edge < max_us ? edge : max_us;
+        }
+    }
+    return max_us;
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::Read() const {
+    Snapshot snapshot;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        snapshot.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+    }
+    snapshot.count = count_.load(std::memory_order_relaxed);
+    snapshot.max_us = max_us_.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+void LatencyHistogram::Reset() {
+    for (auto& bucket : buckets_) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    max_us_.store(0, std::memory_order_relaxed);
+}
+
+void LatencyTrace::RecordTimerLateness(LatencyStage stage, int64_t now_us, int64_t& due_us, uint32_t period_us) {
+    int64_t late_us = now_us - due_us;
+    Record(stage, late_us);
+    due_us += period_us;
+    if (late_us >= static_cast<int64_t>(period_us)) {
+        due_us += (late_us / period_us) * period_us;   /* skip_unhandled_events drops the missed ones */
+    }
+}
+
+void LatencyTrace::Reset() {
+    for (auto& histogram : histograms_) {
+        histogram.Reset();
+    }
+}
+
+void LatencyTrace::Log() const {
+    for (size_t i = 0; i < static_cast<size_t>(LatencyStage::COUNT); i++) {
+        LatencyHistogram::Snapshot snapshot = histograms_[i].Read();
+        if (snapshot.count == 0) {
+            continue;
+        }
+        ESP_LOGI(TAG, "%-13s n=%" PRIu32 " p50<=%" PRIu32 "us p90<=%" PRIu32 "us p99<=%" PRIu32 "us max=%" PRIu32 "us",
+                 StageName(static_cast<LatencyStage>(i)), snapshot.count, snapshot.Percentile(0.5f),
+                 snapshot.Percentile(0.9f), snapshot.Percentile(0.99f), snapshot.max_us);
+    }
+}
+
+const char* LatencyTrace::StageName(LatencyStage stage) {
+    switch (stage) {
+        case LatencyStage::DMA: return "dma";
+        case LatencyStage::CONVERT: return "convert";
+        case LatencyStage::RING: return "ring";
+        case LatencyStage::SEND: return "send";
+        case LatencyStage::CAPTURE_TIMER: return "capture timer";
+        case LatencyStage::SEND_TIMER: return "send timer";
+        default: return "?";
+    }
+}
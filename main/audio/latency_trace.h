@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <esp_timer.h>
+#include "audio_config.h"
+
+/* per-stage latency of the capture -> send path, in fixed-bucket histograms.
+
+   stages, measured for the newest sample of every block:
+     DMA        on_recv of the newest filled dma buffer -> i2s_channel_read has returned it
+     CONVERT    conversion, conditioning and the ring buffer write (the rest of ReadAudioData)
+     RING       ring buffer write -> the send tick that picks the block up
+     SEND       SendToAllClients for one data packet, i.e. every client's sendto
+   and how late the two esp_timer callbacks run against their period (timer capture mode only).
+
+   bucket 0 counts everything under 16 us, bucket i [2^(i+3), 2^(i+4)) us and the last one
+   everything from ~262 ms up. a histogram has a single writer, the task running that stage, and
+   is read without locking, so a snapshot taken mid-update may be a count off.
+
+   compiled in with AUDIO_LATENCY_TRACE (audio_config.h). without it the LATENCY_TRACE_* macros
+   expand to nothing and no timestamps are taken; with nothing left reading them, the linker
+   drops the histograms too */
+
+enum class LatencyStage : uint8_t {
+    DMA,
+    CONVERT,
+    RING,
+    SEND,
+    CAPTURE_TIMER,   /* I2SCodec read timer lateness */
+    SEND_TIMER,      /* AudioProcessor send timer lateness */
+    COUNT,
+};
+
+class LatencyHistogram {
+public:
+    static constexpr size_t BUCKETS = 16;
+    static constexpr uint32_t FIRST_BUCKET_US = 16;
+
+    struct Snapshot {
+        uint32_t buckets[BUCKETS];
+        uint32_t count;
+        uint32_t max_us;
+
+        /* upper edge of the bucket holding the percentile, capped at max_us */
+        uint32_t Percentile(float fraction) const;
+    };
+
+    void Record(uint32_t us) {
+        size_t bucket = BucketOf(us);
+        buckets_[bucket].store(buckets_[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        count_.store(count_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (us > max_us_.load(std::memory_order_relaxed)) {
+            max_us_.store(us, std::memory_order_relaxed);
+        }
+    }
+    Snapshot Read() const;
+    void Reset();
+
+    /* exclusive upper edge, UINT32_MAX for the last bucket */
+    static uint32_t BucketUpperEdgeUs(size_t bucket);
+
+private:
+    static size_t BucketOf(uint32_t us) {
+        if (us < FIRST_BUCKET_US) {
+            return 0;
+        }
+        size_t bucket = static_cast<size_t>(31 - __builtin_clz(us)) - 3;
+        return bucket < BUCKETS ? bucket : BUCKETS - 1;
+    }
+
+    std::atomic<uint32_t> buckets_[BUCKETS] = {};
+    std::atomic<uint32_t> count_{0};
+    std::atomic<uint32_t> max_us_{0};
+};
+
+class LatencyTrace {
+public:
+    static LatencyTrace& GetInstance() { return instance_; }
+
+    void Record(LatencyStage stage, int64_t us) {
+        histograms_[static_cast<size_t>(stage)].Record(
+            us <= 0 ? 0 : (us >= UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(us)));
+    }
+    /* lateness of a periodic callback against its schedule. due_us moves on to the next period,
+       past any the timer skipped */
+    void RecordTimerLateness(LatencyStage stage, int64_t now_us, int64_t& due_us, uint32_t period_us);
+
+    LatencyHistogram::Snapshot Read(LatencyStage stage) const {
+        return histograms_[static_cast<size_t>(stage)].Read();
+    }
+    void Reset();
+    /* one line per stage that has samples */
+    void Log() const;
+
+    static const char* StageName(LatencyStage stage);
+
+private:
+    LatencyTrace() = default;
+
+    LatencyHistogram histograms_[static_cast<size_t>(LatencyStage::COUNT)];
+    static LatencyTrace instance_;
+};
+
+#ifdef AUDIO_LATENCY_TRACE
+#define LATENCY_TRACE_NOW(var) const int64_t var = esp_timer_get_time()
+#define LATENCY_TRACE_RECORD(stage, us) LatencyTrace::GetInstance().Record(LatencyStage::stage, (us))
+#define LATENCY_TRACE_TIMER(stage, due_us, period_us) \
+    LatencyTrace::GetInstance().RecordTimerLateness(LatencyStage::stage, esp_timer_get_time(), (due_us), (period_us))
+#else
+#define LATENCY_TRACE_NOW(var)
+#define LATENCY_TRACE_RECORD(stage, us) do {} while (0)
+#define LATENCY_TRACE_TIMER(stage, due_us, period_us) do {} while (0)
+#endif
@@ -0,0 +1,90 @@
+#include "pcm_convert.h"
+#include <algorithm>
+#include <cstring>
+
+#ifdef ESP_PLATFORM
+#include <sdkconfig.h>
+#endif
+
+#if defined(CONFIG_IDF_TARGET_ESP32S3)
+#define PCM_CONVERT_HAS_PIE 1
+/* pcm_convert_esp32s3.S, converts blocks * 8 samples, in and out must be 16-byte aligned.
+   limits points at {max, min} */
+extern "C" void pcm_convert_s32_s16_pie(const int32_t* in, int16_t* out, size_t blocks,
+                                        uint32_t shift, const int32_t* limits);
+#else
+#define PCM_CONVERT_HAS_PIE 0
+#endif
+
+static inline int32_t SaturationMin(PcmSaturation saturation) {
+    return (saturation == PcmSaturation::FULL) ? INT16_MIN : -INT16_MAX;
+}
+
+void PcmConvertS32ToS16Scalar(const int32_t* in, int16_t* out, size_t samples,
+                              uint32_t shift, PcmSaturation saturation) {
+    const int32_t min_value = SaturationMin(saturation);
+    for (size_t i = 0; i < samples; i++) {
+        int32_t value = in[i] >> shift;
+        out[i] = (value > INT16_MAX) ? INT16_MAX :
+                 (value < min_value) ? static_cast<int16_t>(min_value) :
+                 static_cast<int16_t>(value);
+    }
+}
+
+/* no aliasing inside a block, so the compiler is free to vectorize the loop */
+static inline void ConvertBlock(const int32_t* __restrict in, int16_t* __restrict out, size_t samples,
+                                uint32_t shift, int32_t min_value) {
+    for (size_t i = 0; i < samples; i++) {
+        int32_t value = in[i] >> shift;
+        value = std::max(value, min_value);
+        value = std::min(value, static_cast<int32_t>(INT16_MAX));
+        out[i] = static_cast<int16_t>(value);
+    }
+}
+
+void PcmConvertS32ToS16Portable(const int32_t* in, int16_t* out, size_t samples,
+                                uint32_t shift, PcmSaturation saturation) {
+    /* narrow into a small stack block and copy it out: block k writes bytes that precede
+       the words of block k + 1, so this stays correct when out == in */
+    constexpr size_t BLOCK_SAMPLES = 64;
+    const int32_t min_value = SaturationMin(saturation);
+    int16_t block[BLOCK_SAMPLES];
+
+    while (samples > 0) {
+        size_t count = std::min(samples, BLOCK_SAMPLES);
+        if (count == BLOCK_SAMPLES) {
+            // a constant trip count: gcc only vectorizes at -O2 (its very cheap cost model) when
+            // it needs no scalar epilogue
+            ConvertBlock(in, block, BLOCK_SAMPLES, shift, min_value);
+        } else {
+            ConvertBlock(in, block, count, shift, min_value);
+        }
+        memcpy(out, block, count * sizeof(int16_t));
+        in += count;
+        out += count;
+        samples -= count;
+    }
+}
+
+void PcmConvertS32ToS16(const int32_t* in, int16_t* out, size_t samples,
+                        uint32_t shift, PcmSaturation saturation) {
+#if PCM_CONVERT_HAS_PIE
+    constexpr size_t PIE_BLOCK_SAMPLES = 8;
+    const bool aligned = ((reinterpret_cast<uintptr_t>(in) | reinterpret_cast<uintptr_t>(out)) & 15) == 0;
+    if (aligned && samples >= PIE_BLOCK_SAMPLES) {
+        const int32_t limits[2] = {INT16_MAX, SaturationMin(saturation)};
+        size_t blocks = samples / PIE_BLOCK_SAMPLES;
+        pcm_convert_s32_s16_pie(in, out, blocks, shift, limits);
+
+        size_t done = blocks * PIE_BLOCK_SAMPLES;
+        in += done;
+        out += done;
+        samples -= done;
+    }
+#endif
+    PcmConvertS32ToS16Portable(in, out, samples, shift, saturation);
+}
+
+bool PcmConvertHasSimd() {
+    return PCM_CONVERT_HAS_PIE != 0;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/* 32-bit i2s word -> 16-bit pcm narrowing kernels.
+
+   every variant computes out[i] = clamp(in[i] >> shift) with an arithmetic shift, and all of them
+   are bit-exact with PcmConvertS32ToS16Scalar. out may alias in (in-place narrowing into the
+   front of the same buffer), any other overlap is not supported. */
+
+enum class PcmSaturation : uint8_t {
+    SYMMETRIC = 0,   /* clamp to [-INT16_MAX, INT16_MAX], what the capture path has always done */
+    FULL = 1,        /* clamp to [INT16_MIN, INT16_MAX] */
+};
+
+/* reference implementation, one sample at a time */
+void PcmConvertS32ToS16Scalar(const int32_t* in, int16_t* out, size_t samples,
+                              uint32_t shift, PcmSaturation saturation);
+
+/* branch-free blocked loop written for the compiler's auto-vectorizer (sse/avx/neon on hosts) */
+void PcmConvertS32ToS16Portable(const int32_t* in, int16_t* out, size_t samples,
+                                uint32_t shift, PcmSaturation saturation);
+
+/* best kernel for the build target: the esp32-s3 pie simd path when the buffers are 16-byte
+   aligned, the portable loop otherwise */
+void PcmConvertS32ToS16(const int32_t* in, int16_t* out, size_t samples,
+                        uint32_t shift, PcmSaturation saturation);
+
+/* true when PcmConvertS32ToS16 can use a simd instruction set extension on this target */
+bool PcmConvertHasSimd();
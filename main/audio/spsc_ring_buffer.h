@@ -0,0 +1,198 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <span>
+#include <type_traits>
+
+/* single-producer / single-consumer lock-free ring buffer.
+
+   head_ is only advanced by the producer and tail_ only by the consumer. both are free-running
+   counters: the fill level is head_ - tail_ and a slot index is counter & mask_, so the capacity
+   must be a power of two. the producer publishes samples with a release store on head_ which the
+   consumer pairs with an acquire load, and the consumer hands space back the same way on tail_.
+
+   a retention keeps the newest consumed elements out of the producer's reach, the consumer can
+   still look back at them with RetainedSpanAt (e.g. to send a packet again).
+
+   the storage is owned by the caller (e.g. a PSRAM block from heap_caps_malloc), so the same
+   template works on the target and in host tests. Attach/Detach/Reset must not race with either
+   side. */
+template <typename T>
+class SpscRingBuffer {
+    static_assert(std::is_trivially_copyable_v<T>, "ring buffer elements are moved with memcpy");
+
+public:
+    SpscRingBuffer() = default;
+
+    SpscRingBuffer(const SpscRingBuffer&) = delete;
+    SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+    static constexpr bool IsPowerOfTwo(size_t n) { return n != 0 && (n & (n - 1)) == 0; }
+
+    bool Attach(T* storage, size_t capacity) {
+        if (!storage || !IsPowerOfTwo(capacity)) {
+            return false;
+        }
+        storage_ = storage;
+        capacity_ = capacity;
+        mask_ = capacity - 1;
+        retention_ = 0;
+        Reset();
+        return true;
+    }
+
+    void Detach() {
+        storage_ = nullptr;
+        capacity_ = 0;
+        mask_ = 0;
+        retention_ = 0;
+        Reset();
+    }
+
+    /* the producer treats this many elements behind the read position as occupied. set it while
+       neither side runs, like Attach */
+    void SetRetention(size_t count) { retention_ = count < capacity_ ? count : capacity_; }
+    size_t Retention() const { return retention_; }
+
+    void Reset() {
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
+    }
+
+    bool IsAttached() const { return storage_ != nullptr; }
+    size_t Capacity() const { return capacity_; }
+
+    /* exact when called from either side, a snapshot otherwise */
+    size_t Size() const {
+        /* tail first: head can only have moved further ahead by the time it is loaded */
+        const size_t tail = tail_.load(std::memory_order_acquire);
+        return head_.load(std::memory_order_acquire) - tail;
+    }
+    size_t Free() const { return capacity_ - retention_ - Size(); }
+
+    /* ---- producer side ---- */
+
+    /* largest contiguous writable region, fill it then CommitWrite() what was written */
+    std::span<T> WriteSpan() {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        const size_t tail = tail_.load(std::memory_order_acquire);
+        const size_t free = capacity_ - retention_ - (head - tail);
+        const size_t index = head & mask_;
+        const size_t contiguous = capacity_ - index;
+        return {storage_ + index, free < contiguous ? free : contiguous};
+    }
+
+    void CommitWrite(size_t count) {
+        head_.store(head_.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+
+    /* total elements written since the last Reset, i.e. the stream position of WriteSpan()[0] */
+    size_t WritePosition() const { return head_.load(std::memory_order_relaxed); }
+
+    /* copy up to count elements in, returns how many fitted */
+    size_t Write(const T* data, size_t count) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        const size_t tail = tail_.load(std::memory_order_acquire);
+        const size_t free = capacity_ - retention_ - (head - tail);
+        if (count > free) {
+            count = free;
+        }
+        CopyIn(head & mask_, data, count);
+        head_.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    /* ---- consumer side ---- */
+
+    /* largest contiguous readable region, consume it then CommitRead() what was used */
+    std::span<const T> ReadSpan() const {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        const size_t head = head_.load(std::memory_order_acquire);
+        const size_t used = head - tail;
+        const size_t index = tail & mask_;
+        const size_t contiguous = capacity_ - index;
+        return {storage_ + index, used < contiguous ? used : contiguous};
+    }
+
+    /* contiguous readable region starting offset elements past ReadSpan()[0], for looking ahead
+       across the wrap without consuming (empty once offset reaches the fill level) */
+    std::span<const T> ReadSpanAt(size_t offset) const {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        const size_t head = head_.load(std::memory_order_acquire);
+        const size_t used = head - tail;
+        if (offset >= used) {
+            return {};
+        }
+        const size_t index = (tail + offset) & mask_;
+        const size_t contiguous = capacity_ - index;
+        return {storage_ + index, used - offset < contiguous ? used - offset : contiguous};
+    }
+
+    /* contiguous region of consumed elements starting at stream position position, up to the read
+       position. empty unless position lies within the retention behind ReadPosition() */
+    std::span<const T> RetainedSpanAt(size_t position) const {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (position >= tail || tail - position > retention_) {
+            return {};
+        }
+        const size_t index = position & mask_;
+        const size_t contiguous = capacity_ - index;
+        return {storage_ + index, tail - position < contiguous ? tail - position : contiguous};
+    }
+
+    /* total elements consumed since the last Reset, i.e. the stream position of ReadSpan()[0] */
+    size_t ReadPosition() const { return tail_.load(std::memory_order_relaxed); }
+
+    void CommitRead(size_t count) {
+        tail_.store(tail_.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+
+    /* copy up to count elements out without consuming them, returns how many were copied */
+    size_t Peek(T* out, size_t count) const {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        const size_t head = head_.load(std::memory_order_acquire);
+        const size_t used = head - tail;
+        if (count > used) {
+            count = used;
+        }
+        CopyOut(tail & mask_, out, count);
+        return count;
+    }
+
+    /* copy up to count elements out and consume them, returns how many were read */
+    size_t Read(T* out, size_t count) {
+        count = Peek(out, count);
+        CommitRead(count);
+        return count;
+    }
+
+private:
+    void CopyIn(size_t index, const T* data, size_t count) {
+        const size_t first = (index + count <= capacity_) ? count : capacity_ - index;
+        memcpy(storage_ + index, data, first * sizeof(T));
+        if (count > first) {
+            memcpy(storage_, data + first, (count - first) * sizeof(T));
+        }
+    }
+
+    void CopyOut(size_t index, T* out, size_t count) const {
+        const size_t first = (index + count <= capacity_) ? count : capacity_ - index;
+        memcpy(out, storage_ + index, first * sizeof(T));
+        if (count > first) {
+            memcpy(out + first, storage_, (count - first) * sizeof(T));
+        }
+    }
+
+    /* keep the two indices on separate cache lines so producer and consumer don't false-share */
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    T* storage_ = nullptr;
+    size_t capacity_ = 0;
+    size_t mask_ = 0;
+    size_t retention_ = 0;
+
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> head_{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail_{0};
+};
@@ -0,0 +1,96 @@
+#include "vad.h"
+#include <algorithm>
+#include <cmath>
+
+void VoiceActivityDetector::Configure(const VadConfig& config, uint32_t sample_rate) {
+    config_ = config;
+    sample_rate_ = sample_rate > 0 ? sample_rate : 16000;
+    hangover_samples_ = static_cast<uint32_t>(static_cast<uint64_t>(sample_rate_) * config_.hangover_ms / 1000);
+    Reset();
+}
+
+void VoiceActivityDetector::Reset() {
+    noise_floor_dbfs_ = SILENCE_DBFS;
+    hangover_left_ = 0;
+    frame_energy_dbfs_ = SILENCE_DBFS;
+    frame_rms_ = 0;
+    BeginFrame();
+}
+
+void VoiceActivityDetector::BeginFrame() {
+    sum_squares_ = 0;
+    frame_samples_ = 0;
+    zero_crossings_ = 0;
+}
+
+void VoiceActivityDetector::Accumulate(std::span<const int16_t> samples) {
+    if (samples.empty()) {
+        return;
+    }
+
+    // the first sample of a frame continues from the previous frame's sign
+    bool negative = frame_samples_ == 0 ? samples[0] < 0 : last_negative_;
+    uint64_t sum = 0;
+    uint32_t crossings = 0;
+    for (int16_t sample : samples) {
+        int32_t value = sample;
+        sum += static_cast<uint32_t>(value * value);
+        bool sample_negative = value < 0;
+        crossings += sample_negative != negative;
+        negative = sample_negative;
+    }
+
+    sum_squares_ += sum;
+    zero_crossings_ += crossings;
+    frame_samples_ += samples.size();
+    last_negative_ = negative;
+}
+
+bool VoiceActivityDetector::EndFrame() {
+    if (frame_samples_ == 0) {
+        return hangover_left_ > 0;
+    }
+
+    double mean_square = static_cast<double>(sum_squares_) / frame_samples_;
+    frame_rms_ = static_cast<uint16_t>(std::sqrt(mean_square));
+    frame_energy_dbfs_ = mean_square > 0.0
+        ? static_cast<float>(10.0 * std::log10(mean_square / (32768.0 * 32768.0))) - input_gain_db_
+        : SILENCE_DBFS;
+    uint32_t zcr_hz = static_cast<uint32_t>(static_cast<uint64_t>(zero_crossings_) * sample_rate_ / frame_samples_);
+
+    if (noise_floor_dbfs_ <= SILENCE_DBFS) {
+        // first frame, capped in case the stream starts mid-word
+        noise_floor_dbfs_ = std::min(frame_energy_dbfs_, config_.energy_threshold_dbfs);
+    }
+
+    float threshold = config_.energy_threshold_dbfs;
+    if (noise_floor_dbfs_ + config_.noise_margin_db > threshold) {
+        threshold = noise_floor_dbfs_ + config_.noise_margin_db;
+    }
+
+    bool active = frame_energy_dbfs_ >= threshold ||
+                  (frame_energy_dbfs_ >= threshold - config_.weak_speech_margin_db &&
+                   zcr_hz >= config_.zcr_threshold_hz);
+
+    // follow the background on every frame (minimum statistics): quickly down into each pause,
+    // slowly up so a steady noise source is learned but speech doesn't drag the floor along
+    uint32_t frame_samples = frame_samples_;
+    if (frame_energy_dbfs_ < noise_floor_dbfs_) {
+        noise_floor_dbfs_ += (frame_energy_dbfs_ - noise_floor_dbfs_) * NOISE_FLOOR_FALL;
+    } else {
+        float rise = NOISE_FLOOR_RISE_DB_PER_S * frame_samples / sample_rate_;
+        noise_floor_dbfs_ += std::min(frame_energy_dbfs_ - noise_floor_dbfs_, rise);
+    }
+
+    BeginFrame();
+
+    if (active) {
+        hangover_left_ = hangover_samples_;
+        return true;
+    }
+    if (hangover_left_ > 0) {
+        hangover_left_ = hangover_left_ > frame_samples ? hangover_left_ - frame_samples : 0;
+        return true;
+    }
+    return false;
+}
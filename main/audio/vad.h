@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+/* energy and zero-crossing voice activity detector, one decision per packet sized frame.
+
+   a frame is active when its energy clears the threshold, or when it is only a little below it
+   but crosses zero often (unvoiced consonants like "s" and "f" carry little energy but a lot of
+   high frequency content). the threshold follows the background: it is the configured floor or
+   the tracked noise level plus a margin, whichever is higher, so a fan or hum that would clear
+   the fixed threshold on its own is still suppressed. after the last active frame the
+   detector stays active for the hangover time so word endings and short pauses are kept.
+
+   the levels are those at the microphone: a gain applied ahead of the detector (the capture agc,
+   up to +30 dB into a quiet room) is taken back out of the frame energy, otherwise the agc lifts
+   the background over the threshold and nothing is ever classified as silence.
+
+   plain c++ without esp-idf dependencies, scripts/vad_report.cpp runs the same code on the host */
+
+struct VadConfig {
+    float energy_threshold_dbfs = -50.0f;   /* frames quieter than this are never active */
+    float noise_margin_db = 9.0f;           /* required level above the tracked noise floor */
+    float weak_speech_margin_db = 6.0f;     /* how far below the threshold a high zcr frame may be */
+    uint32_t zcr_threshold_hz = 3000;       /* zero crossings per second that mark unvoiced speech */
+    uint32_t hangover_ms = 300;
+};
+
+class VoiceActivityDetector {
+public:
+    void Configure(const VadConfig& config, uint32_t sample_rate);
+    void Reset();
+
+    /* a frame may be fed in several spans (e.g. both halves of a wrapped ring buffer region) */
+    void BeginFrame();
+    void Accumulate(std::span<const int16_t> samples);
+    /* returns true when the frame should be sent */
+    bool EndFrame();
+    /* gain the accumulated samples carry, applies from the next EndFrame */
+    void SetInputGainDb(float gain_db) { input_gain_db_ = gain_db; }
+
+    /* measurements of the last finished frame: the energy net of the input gain, the rms of the
+       samples as they are sent */
+    float frame_energy_dbfs() const { return frame_energy_dbfs_; }
+    uint16_t frame_rms() const { return frame_rms_; }
+    float noise_floor_dbfs() const { return noise_floor_dbfs_; }
+
+private:
+    static constexpr float SILENCE_DBFS = -120.0f;
+    static constexpr float NOISE_FLOOR_RISE_DB_PER_S = 3.0f;
+    static constexpr float NOISE_FLOOR_FALL = 0.5f;   /* fraction of the distance per frame */
+
+    VadConfig config_;
+    uint32_t sample_rate_ = 16000;
+    uint32_t hangover_samples_ = 0;
+    float input_gain_db_ = 0.0f;
+
+    /* frame accumulators */
+    uint64_t sum_squares_ = 0;
+    uint32_t frame_samples_ = 0;
+    uint32_t zero_crossings_ = 0;
+    bool last_negative_ = false;
+
+    /* detector state */
+    float noise_floor_dbfs_ = SILENCE_DBFS;
+    uint32_t hangover_left_ = 0;
+    float frame_energy_dbfs_ = SILENCE_DBFS;
+    uint16_t frame_rms_ = 0;
+};
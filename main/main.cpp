@@ -1,4 +1,5 @@
 #include <esp_log.h>
+#include <esp_heap_caps.h>
 #include <nvs_flash.h>
 #include "board/esp32s3_board.h"
 #include "audio/audio_processor.h"
@@ -12,6 +13,8 @@ static const char* TAG = "main";
 static const char* WIFI_AP_SSID = "ESP32_TEST_SERVER";
 static const char* WIFI_AP_PASSWORD = "12345678";
 static const uint16_t UDP_PORT = 5001;
+/* MULTICAST / BROADCAST send every packet once for all listeners (clients: --multicast / --broadcast) */
+static const UDPServer::DeliveryMode UDP_DELIVERY_MODE = UDPServer::DeliveryMode::UNICAST;
 
 /* udp data callback */
 void HandleUDPData(const uint8_t* data, size_t len, const sockaddr_in& client_addr) {
@@ -20,6 +23,25 @@ void HandleUDPData(const uint8_t* data, size_t len, const sockaddr_in& client_ad
     ESP_LOGI(TAG, "Received %d bytes from %s:%d", len, addr_str, ntohs(client_addr.sin_port));
 }
 
+/* udp stats callback, the device side of a STATS reply */
+void FillStatsSnapshot(StatsSnapshot& snapshot) {
+    snapshot.free_heap = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    snapshot.min_free_heap = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+    snapshot.free_psram = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    snapshot.min_free_psram = heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM);
+    AudioProcessor::GetInstance().FillStatsSnapshot(snapshot);
+}
+
+/* udp report callback, client loss feeds the congestion controller */
+void HandleReceiverReport(const ReceiverReport& report, const sockaddr_in& client_addr) {
+    AudioProcessor::GetInstance().OnReceiverReport(report);
+}
+
+/* udp nack callback, the send path re-sends what it still holds to the client that asked */
+void HandleNack(const NackRange* ranges, size_t count, const sockaddr_in& client_addr) {
+    AudioProcessor::GetInstance().OnNack(ranges, count, client_addr);
+}
+
 extern "C" void app_main(void)
 {
     /* initialize nvs */
@@ -65,6 +87,13 @@ extern "C" void app_main(void)
 
     /* initialize udp server */
     auto& udp_server = UDPServer::GetInstance();
+    if (!udp_server.SetDeliveryMode(UDP_DELIVERY_MODE)) {
+        ESP_LOGE(TAG, "Failed to set UDP delivery mode");
+        return;
+    }
+    udp_server.SetStatsCallback(FillStatsSnapshot);
+    udp_server.SetReportCallback(HandleReceiverReport);
+    udp_server.SetNackCallback(HandleNack);
     if (!udp_server.Initialize(UDP_PORT)) {
         ESP_LOGE(TAG, "Failed to initialize UDP server");
         return;
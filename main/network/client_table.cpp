@@ -0,0 +1,160 @@
+#include "client_table.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+ClientTable::ClientTable() {
+    RebuildIndex();
+}
+
+size_t ClientTable::Hash(const sockaddr_in& addr) {
+    uint32_t key = addr.sin_addr.s_addr ^ (static_cast<uint32_t>(addr.sin_port) << 16);
+    key *= 0x9E3779B1u;   /* fibonacci hashing, the top bits are the best mixed */
+    return key >> (32 - INDEX_BITS);
+}
+
+int ClientTable::Find(const sockaddr_in& addr) const {
+    size_t pos = Hash(addr);
+    for (size_t probe = 0; probe < INDEX_SIZE; probe++, pos = (pos + 1) & (INDEX_SIZE - 1)) {
+        uint8_t slot = index_[pos];
+        if (slot == EMPTY) {
+            return -1;
+        }
+        if (SameAddress(slots_[slot].addr, addr)) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+ClientTable::TouchResult ClientTable::Touch(const sockaddr_in& addr, int64_t now_us) {
+    int found = Find(addr);
+    if (found >= 0) {
+        slots_[found].last_seen_us = now_us;
+        return TouchResult::REFRESHED;
+    }
+
+    if (used_count_ == MAX_CLIENTS) {
+        return TouchResult::FULL;
+    }
+
+    size_t slot = 0;
+    while (slots_[slot].used) {
+        slot++;
+    }
+    slots_[slot] = {.addr = addr, .last_seen_us = now_us, .used = true};
+    send_failures_[slot].store(0, std::memory_order_relaxed);
+    used_count_++;
+
+    size_t pos = Hash(addr);
+    while (index_[pos] != EMPTY) {
+        pos = (pos + 1) & (INDEX_SIZE - 1);
+    }
+    index_[pos] = static_cast<uint8_t>(slot);
+
+    Publish();
+    return TouchResult::ADDED;
+}
+
+bool ClientTable::Remove(const sockaddr_in& addr) {
+    int found = Find(addr);
+    if (found < 0) {
+        return false;
+    }
+    FreeSlot(found);
+    RebuildIndex();
+    Publish();
+    return true;
+}
+
+size_t ClientTable::Expire(int64_t cutoff_us, uint8_t max_send_failures) {
+    size_t expired = 0;
+    for (size_t slot = 0; slot < MAX_CLIENTS; slot++) {
+        if (!slots_[slot].used) {
+            continue;
+        }
+        if (slots_[slot].last_seen_us < cutoff_us ||
+            send_failures_[slot].load(std::memory_order_relaxed) >= max_send_failures) {
+            FreeSlot(slot);
+            expired++;
+        }
+    }
+
+    if (expired > 0) {
+        RebuildIndex();
+        Publish();
+    }
+    return expired;
+}
+
+void ClientTable::Clear() {
+    for (size_t slot = 0; slot < MAX_CLIENTS; slot++) {
+        slots_[slot].used = false;
+    }
+    used_count_ = 0;
+    RebuildIndex();
+    Publish();
+}
+
+void ClientTable::FreeSlot(size_t slot) {
+    slots_[slot].used = false;
+    used_count_--;
+}
+
+/* linear probing can't just blank an entry, with at most 8 clients rebuilding is cheaper than
+   tombstones */
+void ClientTable::RebuildIndex() {
+    for (size_t pos = 0; pos < INDEX_SIZE; pos++) {
+        index_[pos] = EMPTY;
+    }
+    for (size_t slot = 0; slot < MAX_CLIENTS; slot++) {
+        if (!slots_[slot].used) {
+            continue;
+        }
+        size_t pos = Hash(slots_[slot].addr);
+        while (index_[pos] != EMPTY) {
+            pos = (pos + 1) & (INDEX_SIZE - 1);
+        }
+        index_[pos] = static_cast<uint8_t>(slot);
+    }
+}
+
+void ClientTable::Publish() {
+    uint32_t next = current_.load(std::memory_order_relaxed) ^ 1;
+
+    // grace period: wait out readers still pinning the previous snapshot
+    while (readers_[next].load(std::memory_order_acquire) != 0) {
+        vTaskDelay(1);
+    }
+
+    Snapshot& snapshot = snapshots_[next];
+    snapshot.count = 0;
+    for (size_t slot = 0; slot < MAX_CLIENTS; slot++) {
+        if (slots_[slot].used) {
+            snapshot.clients[snapshot.count++] = {.addr = slots_[slot].addr, .slot = static_cast<uint8_t>(slot)};
+        }
+    }
+    current_.store(next, std::memory_order_seq_cst);
+}
+
+ClientTable::ReadGuard ClientTable::Read() const {
+    for (;;) {
+        uint32_t index = current_.load(std::memory_order_seq_cst);
+        readers_[index].fetch_add(1, std::memory_order_seq_cst);
+        // if the writer flipped in between it may already be rewriting this buffer, pin the new one
+        if (current_.load(std::memory_order_seq_cst) == index) {
+            return ReadGuard(snapshots_[index], readers_[index]);
+        }
+        readers_[index].fetch_sub(1, std::memory_order_release);
+    }
+}
+
+void ClientTable::ReportSendResult(uint8_t slot, bool sent) {
+    if (slot >= MAX_CLIENTS) {
+        return;
+    }
+    if (sent) {
+        send_failures_[slot].store(0, std::memory_order_relaxed);
+    } else {
+        send_failures_[slot].fetch_add(1, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <lwip/sockets.h>
+
+/* a registered listener as seen by the send path */
+struct ClientInfo {
+    sockaddr_in addr;
+    uint8_t slot;   /* table slot, for ReportSendResult */
+};
+
+/* fixed capacity client registry.
+
+   one writer task (the udp receive task) adds, refreshes, expires and removes clients. the
+   clients live in fixed slots found through a small open addressing hash index, so a lookup per
+   received datagram is a bounded probe instead of a scan.
+
+   readers (the send path, on another task) never see the slots. every membership change publishes
+   a copy of the client list into one of two snapshot buffers and flips current_ (rcu style). a
+   reader pins the current buffer with a per-buffer reader count and the writer waits for that
+   count to drain before it reuses the buffer, so the send path never waits on the writer */
+class ClientTable {
+public:
+    static constexpr size_t MAX_CLIENTS = 8;
+
+    struct Snapshot {
+        size_t count = 0;
+        ClientInfo clients[MAX_CLIENTS];
+    };
+
+    /* keeps a snapshot pinned for as long as it lives */
+    class ReadGuard {
+    public:
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+        ~ReadGuard() { readers_.fetch_sub(1, std::memory_order_release); }
+
+        const Snapshot& operator*() const { return snapshot_; }
+        const Snapshot* operator->() const { return &snapshot_; }
+
+    private:
+        friend class ClientTable;
+        ReadGuard(const Snapshot& snapshot, std::atomic<uint32_t>& readers)
+            : snapshot_(snapshot), readers_(readers) {}
+
+        const Snapshot& snapshot_;
+        std::atomic<uint32_t>& readers_;
+    };
+
+    enum class TouchResult : uint8_t {
+        REFRESHED,   /* known client, heartbeat updated */
+        ADDED,
+        FULL,        /* new client but every slot is taken */
+    };
+
+    ClientTable();
+    ClientTable(const ClientTable&) = delete;
+    ClientTable& operator=(const ClientTable&) = delete;
+
+    /* ---- writer side, one task only ---- */
+
+    /* records a datagram from addr at now_us, registering the client if it is new */
+    TouchResult Touch(const sockaddr_in& addr, int64_t now_us);
+    bool Remove(const sockaddr_in& addr);
+    /* drops clients not heard from since cutoff_us and clients whose sends kept failing,
+       returns how many were dropped */
+    size_t Expire(int64_t cutoff_us, uint8_t max_send_failures);
+    void Clear();
+    size_t size() const { return used_count_; }
+
+    /* ---- reader side, any task ---- */
+
+    ReadGuard Read() const;
+    /* consecutive send failures per client, the writer evicts on its next Expire */
+    void ReportSendResult(uint8_t slot, bool sent);
+
+private:
+    /* at most half full so probes stay short */
+    static constexpr size_t INDEX_BITS = 4;
+    static constexpr size_t INDEX_SIZE = size_t{1} << INDEX_BITS;
+    static constexpr uint8_t EMPTY = 0xFF;
+    static_assert(INDEX_SIZE >= 2 * MAX_CLIENTS);
+
+    struct Slot {
+        sockaddr_in addr;
+        int64_t last_seen_us;
+        bool used;
+    };
+
+    static size_t Hash(const sockaddr_in& addr);
+    static bool SameAddress(const sockaddr_in& a, const sockaddr_in& b) {
+        return a.sin_addr.s_addr == b.sin_addr.s_addr && a.sin_port == b.sin_port;
+    }
+
+    int Find(const sockaddr_in& addr) const;
+    void FreeSlot(size_t slot);
+    void RebuildIndex();
+    void Publish();
+
+    Slot slots_[MAX_CLIENTS] = {};
+    uint8_t index_[INDEX_SIZE];   /* slot numbers, EMPTY ends a probe */
+    size_t used_count_ = 0;
+
+    /* written by readers, cleared by the writer when a slot changes hands */
+    std::atomic<uint8_t> send_failures_[MAX_CLIENTS] = {};
+
+    Snapshot snapshots_[2];
+    mutable std::atomic<uint32_t> readers_[2] = {};
+    std::atomic<uint32_t> current_{0};
+};
@@ -0,0 +1,129 @@
+#include "congestion_controller.h"
+#include <algorithm>
+
+void CongestionController::Reset(uint32_t now_ms) {
+    level_ = 0;
+    send_retries_ = config_.max_send_retries;
+    up_hold_ms_ = config_.up_hold_ms;
+    clean_ms_ = 0;
+    probing_ = false;
+    last_window_ = {};
+    StartWindow(now_ms);
+}
+
+void CongestionController::SetMaxLevel(uint8_t level) {
+    max_level_ = std::min<uint8_t>(level, LEVEL_COUNT - 1);
+    level_ = std::min(level_, max_level_);
+}
+
+void CongestionController::OnSendAttempt(bool sent) {
+    attempts_++;
+    if (!sent) {
+        failures_++;
+    }
+}
+
+void CongestionController::OnBacklog(uint32_t backlog_ms) {
+    if (!have_backlog_) {
+        backlog_first_ms_ = backlog_ms;
+        have_backlog_ = true;
+    }
+    backlog_last_ms_ = backlog_ms;
+    backlog_max_ms_ = std::max(backlog_max_ms_, backlog_ms);
+}
+
+void CongestionController::OnReceiverReport(uint32_t expected, uint32_t lost) {
+    expected_ += expected;
+    lost_ += std::min(lost, expected);
+}
+
+CongestionController::Verdict CongestionController::Judge() const {
+    if (attempts_ == 0 && expected_ == 0) {
+        return Verdict::IDLE;
+    }
+    float failure_ratio = attempts_ > 0 ? static_cast<float>(failures_) / attempts_ : 0.0f;
+    float loss_ratio = expected_ > 0 ? static_cast<float>(lost_) / expected_ : 0.0f;
+    int32_t growth_ms = have_backlog_ ? static_cast<int32_t>(backlog_last_ms_ - backlog_first_ms_) : 0;
+
+    if (failure_ratio >= config_.down_failure_ratio || loss_ratio >= config_.down_loss_ratio ||
+        backlog_max_ms_ >= config_.backlog_high_ms ||
+        growth_ms >= static_cast<int32_t>(config_.backlog_growth_ms)) {
+        return Verdict::CONGESTED;
+    }
+    if (failure_ratio <= config_.up_failure_ratio && loss_ratio <= config_.up_loss_ratio &&
+        backlog_max_ms_ <= config_.backlog_low_ms) {
+        return Verdict::CLEAN;
+    }
+    return Verdict::MARGINAL;
+}
+
+bool CongestionController::Update(uint32_t now_ms) {
+    uint32_t elapsed_ms = now_ms - window_start_ms_;
+    if (elapsed_ms < config_.window_ms) {
+        return false;
+    }
+
+    Verdict verdict = Judge();
+    last_window_ = Window{
+        .attempts = attempts_,
+        .failures = failures_,
+        .expected = expected_,
+        .lost = lost_,
+        .backlog_max_ms = backlog_max_ms_,
+        .backlog_growth_ms = have_backlog_ ? static_cast<int32_t>(backlog_last_ms_ - backlog_first_ms_) : 0,
+        .verdict = verdict,
+    };
+    send_retries_ = verdict == Verdict::CONGESTED  ? 0
+                    : verdict == Verdict::MARGINAL ? std::min<uint8_t>(config_.max_send_retries, 1)
+                                                   : config_.max_send_retries;
+
+    // a step up that lasted its probe period was right, the next one may come sooner
+    if (probing_ && verdict != Verdict::CONGESTED && now_ms - stepped_up_ms_ >= config_.probe_ms) {
+        probing_ = false;
+        up_hold_ms_ = std::max(config_.up_hold_ms, up_hold_ms_ / 2);
+    }
+
+    uint8_t previous = level_;
+    switch (verdict) {
+        case Verdict::CONGESTED:
+            clean_ms_ = 0;
+            if (probing_) {
+                // the level above was too much after all, wait longer before trying it again
+                probing_ = false;
+                up_hold_ms_ = std::min(config_.max_up_hold_ms, up_hold_ms_ * 2);
+            }
+            if (level_ < max_level_) {
+                level_++;
+            }
+            break;
+        case Verdict::CLEAN:
+            clean_ms_ += elapsed_ms;
+            if (level_ > 0 && clean_ms_ >= up_hold_ms_) {
+                level_--;
+                clean_ms_ = 0;
+                probing_ = true;
+                stepped_up_ms_ = now_ms;
+            }
+            break;
+        case Verdict::MARGINAL:
+            clean_ms_ = 0;
+            break;
+        case Verdict::IDLE:
+            break;
+    }
+
+    StartWindow(now_ms);
+    return level_ != previous;
+}
+
+void CongestionController::StartWindow(uint32_t now_ms) {
+    window_start_ms_ = now_ms;
+    attempts_ = 0;
+    failures_ = 0;
+    expected_ = 0;
+    lost_ = 0;
+    have_backlog_ = false;
+    backlog_first_ms_ = 0;
+    backlog_last_ms_ = 0;
+    backlog_max_ms_ = 0;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/* adapts the stream to what the link sustains. the send path reports every sendto attempt and
+   the ring buffer backlog it leaves behind, the udp task forwards the loss clients see
+   (ReceiverReport). once per window the controller decides whether the link is congested, clean
+   or in between, and moves along a ladder of stream settings that cost less and less airtime:
+
+     level 0   the configured stream
+     level 1   ima adpcm, a quarter of the bits per sample
+     level 2   adpcm and packets twice as long, half the datagrams and pbufs
+     level 3   adpcm, long packets and half the sample rate
+
+   a congested window steps down one level at once. stepping up needs up_hold_ms of clean windows
+   in a row, and a step up that is followed by congestion within probe_ms doubles that hold (up to
+   max_up_hold_ms), so a link at the edge does not flap between two levels. the hold halves again
+   for every step up that survives its probe. the retry budget of the send path follows the last
+   window: retrying into a congested link only burns pbufs.
+
+   no clock or rtos calls: the caller passes the time, so scripted traces replay it on the host
+   (host/congestion_replay.cpp) */
+class CongestionController {
+public:
+    struct Config {
+        uint32_t window_ms = 1000;
+        /* failed sendto attempts per attempt, and loss reported by clients */
+        float down_failure_ratio = 0.05f;
+        float up_failure_ratio = 0.01f;
+        float down_loss_ratio = 0.05f;
+        float up_loss_ratio = 0.01f;
+        /* audio left in the ring buffer after a send, and its growth over one window */
+        uint32_t backlog_high_ms = 300;
+        uint32_t backlog_low_ms = 100;
+        uint32_t backlog_growth_ms = 150;
+        uint32_t up_hold_ms = 5000;
+        uint32_t max_up_hold_ms = 80000;
+        uint32_t probe_ms = 10000;
+        /* immediate retries of a failed packet on a clean link, none once the link is congested */
+        uint8_t max_send_retries = 2;
+    };
+
+    /* what a level changes in the stream */
+    struct Rung {
+        bool compress;          /* adpcm whatever codec is configured */
+        uint8_t packet_scale;   /* multiple of the configured packet length */
+        uint8_t rate_divider;   /* of the configured sample rate */
+    };
+    static constexpr uint8_t LEVEL_COUNT = 4;
+    static constexpr Rung LADDER[LEVEL_COUNT] = {
+        {false, 1, 1},
+        {true, 1, 1},
+        {true, 2, 1},
+        {true, 2, 2},
+    };
+
+    enum class Verdict : uint8_t {
+        IDLE,        /* nothing sent or reported, the window says nothing */
+        CLEAN,
+        MARGINAL,    /* neither, holds the level and restarts the clean run */
+        CONGESTED,
+    };
+
+    /* one closed window, for logs and the replay tool */
+    struct Window {
+        uint32_t attempts;
+        uint32_t failures;
+        uint32_t expected;   /* reported by clients */
+        uint32_t lost;
+        uint32_t backlog_max_ms;
+        int32_t backlog_growth_ms;
+        Verdict verdict;
+    };
+
+    CongestionController() { Reset(0); }
+    explicit CongestionController(const Config& config) : config_(config) { Reset(0); }
+
+    /* back to level 0 with a fresh hold, the window starts at now_ms */
+    void Reset(uint32_t now_ms);
+    /* the deepest level the stream can take, e.g. 2 when half the rate is not supported */
+    void SetMaxLevel(uint8_t level);
+    uint8_t max_level() const { return max_level_; }
+
+    /* ---- inputs ---- */
+
+    /* the outcome of one sendto attempt, retries included */
+    void OnSendAttempt(bool sent);
+    /* audio still buffered after a send tick */
+    void OnBacklog(uint32_t backlog_ms);
+    /* packets a client expected over its last report interval and how many it lost */
+    void OnReceiverReport(uint32_t expected, uint32_t lost);
+
+    /* closes the window once window_ms have passed, returns true if the level changed */
+    bool Update(uint32_t now_ms);
+
+    /* ---- outputs ---- */
+
+    uint8_t level() const { return level_; }
+    const Rung& rung() const { return LADDER[level_]; }
+    /* how often the send path should retry a packet that failed, right now */
+    uint8_t send_retries() const { return send_retries_; }
+    uint32_t up_hold_ms() const { return up_hold_ms_; }
+    const Window& last_window() const { return last_window_; }
+    const Config& config() const { return config_; }
+
+private:
+    Verdict Judge() const;
+    void StartWindow(uint32_t now_ms);
+
+    Config config_;
+    uint8_t level_ = 0;
+    uint8_t max_level_ = LEVEL_COUNT - 1;
+    uint8_t send_retries_ = 0;
+
+    uint32_t up_hold_ms_ = 0;
+    uint32_t clean_ms_ = 0;           /* clean windows in a row */
+    bool probing_ = false;            /* stepped up less than probe_ms ago */
+    uint32_t stepped_up_ms_ = 0;
+
+    /* the window in progress */
+    uint32_t window_start_ms_ = 0;
+    uint32_t attempts_ = 0;
+    uint32_t failures_ = 0;
+    uint32_t expected_ = 0;
+    uint32_t lost_ = 0;
+    bool have_backlog_ = false;
+    uint32_t backlog_first_ms_ = 0;
+    uint32_t backlog_last_ms_ = 0;
+    uint32_t backlog_max_ms_ = 0;
+
+    Window last_window_ = {};
+};
@@ -0,0 +1,56 @@
+#include "fec_encoder.h"
+#include <cstring>
+
+static inline void XorInto(uint8_t* dst, const uint8_t* src, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        dst[i] ^= src[i];
+    }
+}
+
+void FecEncoder::Configure(uint8_t group_size) {
+    group_size_ = group_size > MAX_GROUP_SIZE ? MAX_GROUP_SIZE : group_size;
+    count_ = 0;
+}
+
+bool FecEncoder::Protect(PacketBuffer& data, PacketBuffer& parity) {
+    if (group_size_ == 0 || data.payload_len > MAX_PARITY_PROTECTED_PAYLOAD) {
+        return false;
+    }
+
+    if (count_ == 0) {
+        MessageHeader* header = parity.header();
+        header->type = MessageType::PARITY;
+        header->version = PROTOCOL_VERSION;
+        header->codec = AudioCodec::PCM16;
+        header->sample_rate_khz = data.header()->sample_rate_khz;
+
+        ParityHeader* parity_header = reinterpret_cast<ParityHeader*>(parity.frame + sizeof(MessageHeader));
+        memset(parity_header, 0, sizeof(ParityHeader));
+        parity_header->first_sequence = data.data_header()->sequence;
+        parity_header->group_size = group_size_;
+        parity.payload_len = 0;
+    }
+
+    ParityBlockHeader block = {
+        .sample_index = data.data_header()->sample_index,
+        .payload_len = static_cast<uint16_t>(data.payload_len),
+        .codec = data.header()->codec,
+        .reserved = 0,
+    };
+
+    // grow the parity with zeros up to the longest block seen in this group
+    size_t block_len = sizeof(block) + data.payload_len;
+    if (block_len > parity.payload_len) {
+        memset(parity.payload() + parity.payload_len, 0, block_len - parity.payload_len);
+        parity.payload_len = block_len;
+    }
+
+    XorInto(parity.payload(), reinterpret_cast<const uint8_t*>(&block), sizeof(block));
+    XorInto(parity.payload() + sizeof(block), data.payload(), data.payload_len);
+
+    if (++count_ < group_size_) {
+        return false;
+    }
+    count_ = 0;
+    return true;
+}
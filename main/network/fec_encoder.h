@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "udp_protocol.h"
+#include "packet_pool.h"
+
+/* xor parity forward error correction: every group_size DATA packets are followed by one
+   PARITY packet (see ParityHeader), which lets a client rebuild a single lost packet per group
+   without a retransmission round trip. the parity is accumulated in place in a pool packet */
+class FecEncoder {
+public:
+    static constexpr uint8_t MAX_GROUP_SIZE = 16;
+
+    /* 0 disables fec, a change restarts the current group */
+    void Configure(uint8_t group_size);
+    uint8_t group_size() const { return group_size_; }
+
+    /* drops the group in progress, e.g. when its parity buffer could not be allocated */
+    void Reset() { count_ = 0; }
+    bool InGroup() const { return count_ > 0; }
+
+    /* folds a built DATA packet into parity, returns true once parity holds a complete
+       PARITY packet that should be sent now */
+    bool Protect(PacketBuffer& data, PacketBuffer& parity);
+
+private:
+    uint8_t group_size_ = 0;
+    uint8_t count_ = 0;
+};
@@ -0,0 +1,96 @@
+#include "packet_pool.h"
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <new>
+
+static const char* TAG = "PacketPool";
+
+static constexpr uint32_t ALL_FREE_MASK =
+    (PacketPool::POOL_SIZE == 32) ? 0xFFFFFFFFu : ((1u << PacketPool::POOL_SIZE) - 1);
+
+PacketPool::~PacketPool() {
+    Deinitialize();
+}
+
+bool PacketPool::Initialize() {
+    if (buffers_) {
+        return true;
+    }
+
+    // internal ram, lwip copies out of it on every sendto
+    void* memory = heap_caps_calloc(POOL_SIZE, sizeof(PacketBuffer), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!memory) {
+        ESP_LOGE(TAG, "Failed to allocate %zu packet buffers", POOL_SIZE);
+        return false;
+    }
+    heap_allocations_++;
+
+    buffers_ = static_cast<PacketBuffer*>(memory);
+    for (size_t i = 0; i < POOL_SIZE; i++) {
+        new (&buffers_[i]) PacketBuffer();
+        buffers_[i].header()->type = MessageType::DATA;
+        buffers_[i].header()->version = PROTOCOL_VERSION;
+    }
+    free_mask_.store(ALL_FREE_MASK, std::memory_order_release);
+
+    ESP_LOGI(TAG, "Packet pool initialized: %zu x %zu bytes", POOL_SIZE, sizeof(PacketBuffer));
+    return true;
+}
+
+void PacketPool::Deinitialize() {
+    if (!buffers_) {
+        return;
+    }
+
+    if (free_mask_.load(std::memory_order_acquire) != ALL_FREE_MASK) {
+        ESP_LOGW(TAG, "Releasing pool with packets still in flight");
+    }
+    free_mask_.store(0, std::memory_order_release);
+    heap_caps_free(buffers_);
+    buffers_ = nullptr;
+}
+
+PacketBuffer* PacketPool::Acquire() {
+    uint32_t mask = free_mask_.load(std::memory_order_acquire);
+    while (mask != 0) {
+        uint32_t slot = __builtin_ctz(mask);
+        if (free_mask_.compare_exchange_weak(mask, mask & ~(1u << slot),
+                                             std::memory_order_acq_rel, std::memory_order_acquire)) {
+            acquired_++;
+
+            uint32_t in_use = POOL_SIZE - __builtin_popcount(mask & ~(1u << slot));
+            uint32_t peak = peak_in_use_.load(std::memory_order_relaxed);
+            while (in_use > peak && !peak_in_use_.compare_exchange_weak(peak, in_use)) {
+            }
+
+            PacketBuffer* packet = &buffers_[slot];
+            packet->payload_len = 0;
+            return packet;
+        }
+    }
+
+    exhausted_++;
+    return nullptr;
+}
+
+void PacketPool::Release(PacketBuffer* packet) {
+    if (!packet || !buffers_) {
+        return;
+    }
+
+    size_t slot = packet - buffers_;
+    if (slot >= POOL_SIZE) {
+        ESP_LOGE(TAG, "Releasing a buffer that does not belong to the pool");
+        return;
+    }
+    free_mask_.fetch_or(1u << slot, std::memory_order_release);
+}
+
+PacketPool::Stats PacketPool::GetStats() const {
+    return Stats{
+        .heap_allocations = heap_allocations_.load(std::memory_order_relaxed),
+        .acquired = acquired_.load(std::memory_order_relaxed),
+        .exhausted = exhausted_.load(std::memory_order_relaxed),
+        .peak_in_use = peak_in_use_.load(std::memory_order_relaxed),
+    };
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "udp_protocol.h"
+
+/* a preformatted datagram: the header lives in the headroom in front of the payload,
+   so producers write samples straight into payload() and the whole frame goes to sendto
+   without another copy */
+struct PacketBuffer {
+    static constexpr size_t HEADROOM = DATA_HEADERS_SIZE;
+
+    size_t payload_len = 0;
+    alignas(4) uint8_t frame[MAX_DATAGRAM_SIZE];
+
+    MessageHeader* header() { return reinterpret_cast<MessageHeader*>(frame); }
+    DataHeader* data_header() { return reinterpret_cast<DataHeader*>(frame + sizeof(MessageHeader)); }
+    uint8_t* payload() { return frame + HEADROOM; }
+    const uint8_t* data() const { return frame; }
+    size_t size() const { return HEADROOM + payload_len; }
+};
+
+static_assert(PacketBuffer::HEADROOM % sizeof(int32_t) == 0, "payload must stay 32-bit aligned");
+
+/* fixed pool of packet buffers allocated once at startup, acquire/release never touch the heap */
+class PacketPool {
+public:
+    static constexpr size_t POOL_SIZE = 4;
+
+    struct Stats {
+        uint32_t heap_allocations;   /* only ever bumped by Initialize */
+        uint32_t acquired;
+        uint32_t exhausted;          /* Acquire() calls that found no free buffer */
+        uint32_t peak_in_use;
+    };
+
+    PacketPool() = default;
+    ~PacketPool();
+
+    PacketPool(const PacketPool&) = delete;
+    PacketPool& operator=(const PacketPool&) = delete;
+
+    bool Initialize();
+    void Deinitialize();
+
+    /* returns nullptr when every buffer is in flight */
+    PacketBuffer* Acquire();
+    void Release(PacketBuffer* packet);
+
+    Stats GetStats() const;
+
+private:
+    static_assert(POOL_SIZE <= 32, "free slots are tracked in a 32-bit mask");
+
+    PacketBuffer* buffers_ = nullptr;
+    std::atomic<uint32_t> free_mask_{0};
+
+    std::atomic<uint32_t> heap_allocations_{0};
+    std::atomic<uint32_t> acquired_{0};
+    std::atomic<uint32_t> exhausted_{0};
+    std::atomic<uint32_t> peak_in_use_{0};
+};
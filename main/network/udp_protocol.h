@@ -0,0 +1,180 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/* wire format shared by the udp server and the host clients in scripts/ (udp_client.cpp keeps
+   a copy of these definitions). multi-byte fields are little endian */
+
+/* version 0: MessageHeader followed directly by pcm samples
+   version 1: DATA datagrams carry a DataHeader between MessageHeader and the samples, and
+              MessageHeader.sample_rate_khz (0 in older version 1 streams, meaning 16 kHz) */
+static constexpr uint8_t PROTOCOL_VERSION = 1;
+
+enum class MessageType : uint8_t {
+    DATA = 0,
+    DISCONNECT = 1,
+    PARITY = 2,      /* server -> client, forward error correction over a group of DATA packets */
+    KEEPALIVE = 3,   /* client -> server, header only, every KEEPALIVE_INTERVAL_MS */
+    STATS = 4,       /* client -> server header only, server -> client MessageHeader + StatsSnapshot */
+    RECEIVER_REPORT = 5,   /* client -> server, MessageHeader + ReceiverReport every RECEIVER_REPORT_INTERVAL_MS */
+    NACK = 6,        /* client -> server, MessageHeader + up to MAX_NACK_RANGES NackRange */
+};
+
+/* the server drops clients it has not heard from (any datagram but STATS counts) for CLIENT_TIMEOUT_MS */
+static constexpr uint32_t KEEPALIVE_INTERVAL_MS = 2000;
+static constexpr uint32_t CLIENT_TIMEOUT_MS = 5 * KEEPALIVE_INTERVAL_MS;
+
+/* payload encoding of DATA datagrams */
+enum class AudioCodec : uint8_t {
+    PCM16 = 0,       /* little endian int16 samples */
+    IMA_ADPCM = 1,   /* one ima adpcm block, see main/audio/ima_adpcm.h */
+    SILENCE = 2,     /* a SilenceDescriptor standing in for frames the vad suppressed */
+    GAP = 3,         /* a GapDescriptor for captured audio the server dropped */
+};
+
+struct MessageHeader {
+    MessageType type;
+    uint8_t version;
+    AudioCodec codec;           /* DATA only, zero (pcm) in every other message */
+    uint8_t sample_rate_khz;    /* DATA and PARITY, capture rate in kHz (8, 16, 24, 32 or 48) */
+};
+
+struct DataHeader {
+    uint32_t sequence;       /* per stream packet counter, wraps */
+    uint32_t sample_index;   /* stream position of the first sample in the payload, wraps */
+};
+
+/* follows MessageHeader in PARITY datagrams. the parity covers the DATA packets with sequence
+   numbers first_sequence .. first_sequence + group_size - 1 */
+struct ParityHeader {
+    uint32_t first_sequence;
+    uint8_t group_size;
+    uint8_t reserved[3];
+};
+
+/* the PARITY payload is the xor over the group of one ParityBlockHeader followed by the DATA
+   payload (zero padded to the longest in the group), so any single missing packet can be rebuilt
+   from the parity and the packets that did arrive */
+struct ParityBlockHeader {
+    uint32_t sample_index;
+    uint16_t payload_len;
+    AudioCodec codec;
+    uint8_t reserved;
+};
+
+/* SILENCE payload: DataHeader.sample_index is the start of the run, the client plays out this many
+   samples of silence (or comfort noise at noise_rms) so the timeline stays continuous. a run is
+   sent when it reaches its maximum length or just before the next voiced packet, and takes a
+   sequence number like any other DATA packet */
+struct SilenceDescriptor {
+    uint32_t samples;
+    uint16_t noise_rms;   /* background level of the suppressed frames, linear int16 */
+    uint16_t reserved;
+};
+
+/* RECEIVER_REPORT payload: what the client saw of the stream since its previous report, after
+   fec recovery. the server's congestion controller (congestion_controller.h) steps the stream
+   down when clients keep losing packets the send path handed to lwip without an error */
+static constexpr uint32_t RECEIVER_REPORT_INTERVAL_MS = 1000;
+
+struct ReceiverReport {
+    uint32_t interval_ms;
+    uint32_t expected_packets;   /* received + lost DATA packets */
+    uint32_t lost_packets;
+};
+
+/* NACK payload: DATA packets the client is missing and can still play out. the server re-sends
+   those it still has to the address the NACK came from, also in group delivery, with their
+   original sequence number and sample index and without parity. packets it no longer has are
+   not answered, the client conceals them at its jitter buffer deadline as before */
+static constexpr size_t MAX_NACK_RANGES = 16;
+static constexpr uint16_t MAX_NACK_RANGE_PACKETS = 64;
+
+struct NackRange {
+    uint32_t first_sequence;
+    uint16_t count;
+    uint16_t reserved;
+};
+
+/* GAP payload: the server dropped this many samples starting at DataHeader.sample_index because
+   its ring buffer overran (the send path fell behind the capture), so no DATA packet will ever
+   cover them. a client fills a short gap to keep its timeline and starts a new timeline after a
+   long one instead of waiting for or concealing audio that does not exist. like SILENCE it takes
+   a sequence number */
+enum class GapReason : uint8_t {
+    RING_FULL = 0,   /* the capture side found no room, the newest audio was lost */
+    SHED = 1,        /* the send path dropped the oldest audio to bound its backlog */
+};
+
+struct GapDescriptor {
+    uint32_t samples;
+    GapReason reason;   /* of the first drop the gap covers, adjacent drops are merged */
+    uint8_t reserved[3];
+};
+
+/* STATS reply payload. the server answers a STATS request to the address it came from, and a
+   request does not register the sender as a client, so a monitor can poll a device without
+   receiving its stream. fields are only ever appended: snapshot_size is the server's
+   sizeof(StatsSnapshot), a client reads the prefix it knows and zero fills the rest */
+static constexpr size_t STATS_STAGE_COUNT = 6;   /* LatencyStage::COUNT, in that order */
+static constexpr uint8_t STATS_FLAG_LATENCY_TRACE = 1 << 0;   /* stages[] is filled in */
+
+struct StatsStageLatency {
+    uint32_t count;
+    uint32_t p50_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+};
+
+struct StatsSnapshot {
+    uint16_t snapshot_size;
+    uint8_t client_count;
+    uint8_t flags;                       /* STATS_FLAG_* */
+    uint32_t uptime_ms;
+    uint32_t sample_rate;
+    uint32_t packets_sent;               /* datagrams, one per client in unicast mode */
+    uint64_t bytes_sent;
+    uint32_t send_failures;
+    uint32_t parity_packets;
+    uint32_t vad_suppressed_packets;
+    uint32_t ring_fill_samples;
+    uint32_t ring_capacity_samples;
+    uint32_t ring_dropped_samples;       /* overruns since the stream (re)started: new samples that did not fit */
+    uint32_t free_heap;                  /* internal ram */
+    uint32_t min_free_heap;              /* low watermark since boot */
+    uint32_t free_psram;
+    uint32_t min_free_psram;
+    StatsStageLatency stages[STATS_STAGE_COUNT];
+    uint32_t ring_shed_samples;          /* oldest audio dropped by the send path's overrun policy */
+    uint32_t ring_idle_samples;          /* discarded while no client listened, not an overrun */
+    uint32_t gap_markers;
+    uint8_t overrun_policy;              /* AudioProcessor::OverrunPolicy */
+    uint8_t reserved[3];
+    uint32_t retransmitted_packets;      /* DATA packets sent again in answer to a NACK */
+    uint32_t nack_expired_packets;       /* NACKed after they had left the ring's retention */
+};
+
+static_assert(sizeof(MessageHeader) == 4 && sizeof(DataHeader) == 8, "wire structs must not be padded");
+static_assert(sizeof(SilenceDescriptor) == 8, "wire structs must not be padded");
+static_assert(sizeof(GapDescriptor) == 8, "wire structs must not be padded");
+static_assert(sizeof(ParityHeader) == sizeof(DataHeader), "parity and data packets share the headroom");
+static_assert(sizeof(ParityBlockHeader) == 8, "wire structs must not be padded");
+static_assert(sizeof(ReceiverReport) == 12, "wire structs must not be padded");
+static_assert(sizeof(NackRange) == 8, "wire structs must not be padded");
+static_assert(sizeof(StatsSnapshot) == 88 + STATS_STAGE_COUNT * sizeof(StatsStageLatency), "wire structs must not be padded");
+
+/* group fan-out (UDPServer::DeliveryMode::MULTICAST / BROADCAST): DATA and PARITY datagrams go
+   to this port on the group or broadcast address instead of to each client's own port.
+   239.0.0.0/8 is the administratively scoped block, local to the device's network */
+static constexpr const char* DEFAULT_MULTICAST_GROUP = "239.255.42.1";
+static constexpr uint16_t GROUP_DELIVERY_PORT = 5002;
+
+/* largest datagram that fits a 1500 byte ethernet/wifi mtu without ip fragmentation
+   (1500 - 20 bytes ipv4 header - 8 bytes udp header) */
+static constexpr size_t UDP_IPV4_HEADERS_SIZE = 28;
+static constexpr size_t MAX_DATAGRAM_SIZE = 1500 - UDP_IPV4_HEADERS_SIZE;
+static constexpr size_t DATA_HEADERS_SIZE = sizeof(MessageHeader) + sizeof(DataHeader);
+static constexpr size_t MAX_PAYLOAD_SIZE = MAX_DATAGRAM_SIZE - DATA_HEADERS_SIZE;
+/* largest DATA payload a PARITY datagram can still protect */
+static constexpr size_t MAX_PARITY_PROTECTED_PAYLOAD = MAX_PAYLOAD_SIZE - sizeof(ParityBlockHeader);
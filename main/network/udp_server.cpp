@@ -22,6 +22,10 @@ UDPServer::~UDPServer() {
 bool UDPServer::Initialize(uint16_t port) {
     port_ = port;
 
+    if (!packet_pool_.Initialize()) {
+        return false;
+    }
+
     socket_fd_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
     if (socket_fd_ < 0) {
         ESP_LOGE(TAG, "Failed to create socket: errno %d", errno);
@@ -40,6 +44,20 @@ bool UDPServer::Initialize(uint16_t port) {
         return false;
     }
 
+    if (!ApplyDeliveryMode()) {
+        close(socket_fd_);
+        socket_fd_ = -1;
+        return false;
+    }
+
+    // wake the receive task regularly so silent clients expire even when nothing arrives
+    timeval timeout = {
+        .tv_sec = RECEIVE_TIMEOUT_MS / 1000,
+        .tv_usec = (RECEIVE_TIMEOUT_MS % 1000) * 1000,
+    };
+    setsockopt(socket_fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    last_expiry_us_ = esp_timer_get_time();
+
     // create receive task
     should_stop_ = false;
     if (xTaskCreate(HandleUDPTask, "udp_task", 4096, this, 5, &udp_task_) != pdPASS) {
@@ -62,42 +80,127 @@ void UDPServer::Deinitialize() {
         }
         close(socket_fd_);
         socket_fd_ = -1;
-        clients_.clear();
+        clients_.Clear();
     }
+    packet_pool_.Deinitialize();
+}
+
+bool UDPServer::SetDeliveryMode(DeliveryMode mode, const char* group_ip) {
+    sockaddr_in group_addr = {};
+    group_addr.sin_family = AF_INET;
+    group_addr.sin_port = htons(GROUP_DELIVERY_PORT);
+
+    if (mode == DeliveryMode::MULTICAST) {
+        if (!group_ip) {
+            group_ip = DEFAULT_MULTICAST_GROUP;
+        }
+        if (!inet_aton(group_ip, &group_addr.sin_addr) || !IN_MULTICAST(ntohl(group_addr.sin_addr.s_addr))) {
+            ESP_LOGE(TAG, "Invalid multicast group %s", group_ip);
+            return false;
+        }
+    } else if (mode == DeliveryMode::BROADCAST) {
+        if (!group_ip) {
+            group_addr.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+        } else if (!inet_aton(group_ip, &group_addr.sin_addr)) {
+            ESP_LOGE(TAG, "Invalid broadcast address %s", group_ip);
+            return false;
+        }
+    }
+
+    delivery_mode_ = mode;
+    group_addr_ = group_addr;
+    return socket_fd_ < 0 || ApplyDeliveryMode();
 }
 
-bool UDPServer::SendToAllClients(const uint8_t* data, size_t len) {
-    if (!data || len == 0) {
+bool UDPServer::ApplyDeliveryMode() {
+    if (delivery_mode_ == DeliveryMode::MULTICAST) {
+        // keep the stream on the local network and don't loop it back to the device itself
+        uint8_t ttl = 1;
+        uint8_t loop = 0;
+        if (setsockopt(socket_fd_, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0 ||
+            setsockopt(socket_fd_, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0) {
+            ESP_LOGE(TAG, "Failed to set multicast options: errno %d", errno);
+            return false;
+        }
+    } else if (delivery_mode_ == DeliveryMode::BROADCAST) {
+        int enable = 1;
+        if (setsockopt(socket_fd_, SOL_SOCKET, SO_BROADCAST, &enable, sizeof(enable)) < 0) {
+            ESP_LOGE(TAG, "Failed to enable broadcast: errno %d", errno);
+            return false;
+        }
+    }
+
+    if (delivery_mode_ == DeliveryMode::UNICAST) {
+        ESP_LOGI(TAG, "Delivery: unicast to each client");
+    } else {
+        ESP_LOGI(TAG, "Delivery: %s to %s:%d", delivery_mode_ == DeliveryMode::MULTICAST ? "multicast" : "broadcast",
+                 inet_ntoa(group_addr_.sin_addr), GROUP_DELIVERY_PORT);
+    }
+    return true;
+}
+
+bool UDPServer::SendToAllClients(PacketBuffer* packet) {
+    if (!packet || packet->payload_len == 0) {
         return false;
     }
 
-    // each packet has 4 bytes header
-    size_t total_len = sizeof(MessageHeader) + len;
-    std::vector<uint8_t> buffer(total_len);
-    MessageHeader* header = reinterpret_cast<MessageHeader*>(buffer.data());
-    header->type = MessageType::DATA;
-    memcpy(buffer.data() + sizeof(MessageHeader), data, len);
+    // one datagram serves every subscriber, a failure says nothing about any single client
+    if (delivery_mode_ != DeliveryMode::UNICAST) {
+        if (!SendTo(packet->data(), packet->size(), group_addr_)) {
+            CountSendFailure();
+            return false;
+        }
+        CountSent(packet->size());
+        return true;
+    }
 
+    // the headers were preformatted by the pool and stamped by the caller. the snapshot stays
+    // valid while the receive task registers or drops clients, failing ones are evicted there
     bool success = true;
-    std::vector<sockaddr_in> failed_clients;
-
-    for (const auto& client : clients_) {
-        if (!SendTo(buffer.data(), total_len, client.addr)) {
-            failed_clients.push_back(client.addr);
-            success = false;
-            ESP_LOGW(TAG, "Failed to send data to client %s:%d",
-                     inet_ntoa(client.addr.sin_addr), ntohs(client.addr.sin_port));
+    ClientTable::ReadGuard clients = clients_.Read();
+    for (size_t i = 0; i < clients->count; i++) {
+        const ClientInfo& client = clients->clients[i];
+        bool sent = SendTo(packet->data(), packet->size(), client.addr);
+        clients_.ReportSendResult(client.slot, sent);
+        if (sent) {
+            CountSent(packet->size());
+            continue;
         }
-    }
 
-    // remove failed clients
-    for (const auto& addr : failed_clients) {
-        RemoveClient(addr);
+        CountSendFailure();
+        success = false;
+        ESP_LOGW(TAG, "Failed to send data to client %s:%d",
+                 inet_ntoa(client.addr.sin_addr), ntohs(client.addr.sin_port));
     }
 
     return success;
 }
 
+bool UDPServer::SendToClient(PacketBuffer* packet, const sockaddr_in& client_addr) {
+    if (!packet || packet->payload_len == 0) {
+        return false;
+    }
+    if (!SendTo(packet->data(), packet->size(), client_addr)) {
+        CountSendFailure();
+        return false;
+    }
+    CountSent(packet->size());
+    return true;
+}
+
+void UDPServer::CountSent(size_t bytes) {
+    packets_sent_.fetch_add(1, std::memory_order_relaxed);
+    bytes_sent_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+UDPServer::Stats UDPServer::GetStats() const {
+    return Stats{
+        .packets_sent = packets_sent_.load(std::memory_order_relaxed),
+        .send_failures = send_failures_.load(std::memory_order_relaxed),
+        .bytes_sent = bytes_sent_.load(std::memory_order_relaxed),
+    };
+}
+
 bool UDPServer::SendTo(const uint8_t* data, size_t len, const sockaddr_in& dest_addr) {
     if (socket_fd_ < 0 || !data || len == 0) {
         return false;
@@ -112,17 +215,44 @@ bool UDPServer::SendTo(const uint8_t* data, size_t len, const sockaddr_in& dest_
     return true;
 }
 
+void UDPServer::SendStats(const sockaddr_in& dest_addr) {
+    StatsSnapshot snapshot = {};
+    if (stats_callback_) {
+        stats_callback_(snapshot);
+    }
+    Stats stats = GetStats();
+    snapshot.snapshot_size = sizeof(StatsSnapshot);
+    snapshot.client_count = static_cast<uint8_t>(clients_.size());
+    snapshot.uptime_ms = static_cast<uint32_t>(esp_timer_get_time() / 1000);
+    snapshot.packets_sent = stats.packets_sent;
+    snapshot.bytes_sent = stats.bytes_sent;
+    snapshot.send_failures = stats.send_failures;
+
+    // the snapshot is 8 byte aligned, the header in front of it only 4 bytes long
+    MessageHeader header = {
+        .type = MessageType::STATS,
+        .version = PROTOCOL_VERSION,
+        .codec = AudioCodec::PCM16,
+        .sample_rate_khz = 0,
+    };
+    uint8_t reply[sizeof(MessageHeader) + sizeof(StatsSnapshot)];
+    memcpy(reply, &header, sizeof(header));
+    memcpy(reply + sizeof(header), &snapshot, sizeof(snapshot));
+    SendTo(reply, sizeof(reply), dest_addr);
+}
+
 void UDPServer::RemoveClient(const sockaddr_in& addr) {
-    auto it = clients_.begin();
-    while (it != clients_.end()) {
-        if (it->addr.sin_addr.s_addr == addr.sin_addr.s_addr &&
-            it->addr.sin_port == addr.sin_port) {
-            ESP_LOGI(TAG, "Client %s:%d disconnected",
-                     inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
-            it = clients_.erase(it);
-            return;
-        }
-        ++it;
+    if (clients_.Remove(addr)) {
+        ESP_LOGI(TAG, "Client %s:%d disconnected",
+                 inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+    }
+}
+
+void UDPServer::ExpireClients(int64_t now_us) {
+    size_t expired = clients_.Expire(now_us - static_cast<int64_t>(CLIENT_TIMEOUT_MS) * 1000,
+                                     MAX_CLIENT_SEND_FAILURES);
+    if (expired > 0) {
+        ESP_LOGI(TAG, "Dropped %zu silent or unreachable client(s), %zu left", expired, clients_.size());
     }
 }
 
@@ -142,11 +272,37 @@ void UDPServer::HandleMessage(const uint8_t* data, size_t len, const sockaddr_in
             RemoveClient(client_addr);
             break;
 
+        case MessageType::KEEPALIVE:
+            break;   /* the heartbeat was already recorded */
+
+        case MessageType::RECEIVER_REPORT:
+            if (payload_len >= sizeof(ReceiverReport) && report_callback_) {
+                ReceiverReport report;
+                memcpy(&report, payload, sizeof(report));
+                report_callback_(report, client_addr);
+            }
+            break;
+
+        case MessageType::NACK:
+            if (payload_len >= sizeof(NackRange) && nack_callback_) {
+                NackRange ranges[MAX_NACK_RANGES];
+                size_t count = payload_len / sizeof(NackRange);
+                if (count > MAX_NACK_RANGES) {
+                    count = MAX_NACK_RANGES;
+                }
+                memcpy(ranges, payload, count * sizeof(NackRange));
+                nack_callback_(ranges, count, client_addr);
+            }
+            break;
+
         case MessageType::DATA:
             if (payload_len > 0 && data_callback_) {
                 data_callback_(payload, payload_len, client_addr);
             }
             break;
+
+        default:
+            break;
     }
 }
 
@@ -163,29 +319,39 @@ void UDPServer::HandleUDPTask(void* arg) {
         ssize_t len = recvfrom(server->socket_fd_, rx_buffer, sizeof(rx_buffer), 0,
                               (struct sockaddr*)&client_addr, &addr_len);
                               
+        int64_t now_us = esp_timer_get_time();
+        if (now_us - server->last_expiry_us_ >= static_cast<int64_t>(RECEIVE_TIMEOUT_MS) * 1000) {
+            server->ExpireClients(now_us);
+            server->last_expiry_us_ = now_us;
+        }
+
         if (len < 0) {
             if (errno != EAGAIN && errno != EWOULDBLOCK) {
                 ESP_LOGE(TAG, "recvfrom failed: errno %d", errno);
+                vTaskDelay(pdMS_TO_TICKS(10));
             }
-            vTaskDelay(pdMS_TO_TICKS(10));
             continue;
         }
 
-        // update or add client
-        bool is_new_client = true;
-        for (const auto& client : server->clients_) {
-            if (client.addr.sin_addr.s_addr == client_addr.sin_addr.s_addr &&
-                client.addr.sin_port == client_addr.sin_port) {
-                is_new_client = false;
-                break;
-            }
+        // a monitor polling stats is not a listener, answer it without registering it
+        if (len >= static_cast<ssize_t>(sizeof(MessageHeader)) &&
+            reinterpret_cast<const MessageHeader*>(rx_buffer)->type == MessageType::STATS) {
+            server->SendStats(client_addr);
+            continue;
         }
 
-        if (is_new_client) {
-            ESP_LOGI(TAG, "New client connected from %s:%d",
-                     inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
-            ClientInfo new_client(client_addr);
-            server->clients_.push_back(new_client);
+        // any other datagram is a heartbeat, new senders are registered
+        switch (server->clients_.Touch(client_addr, now_us)) {
+            case ClientTable::TouchResult::ADDED:
+                ESP_LOGI(TAG, "New client connected from %s:%d",
+                         inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+                break;
+            case ClientTable::TouchResult::FULL:
+                ESP_LOGW(TAG, "Client table full, ignoring %s:%d",
+                         inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+                continue;
+            case ClientTable::TouchResult::REFRESHED:
+                break;
         }
 
         server->HandleMessage(rx_buffer, len, client_addr);
@@ -1,33 +1,41 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <functional>
 #include <lwip/sockets.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
-#include <vector>
 #include <esp_timer.h>
-
-
-enum class MessageType : uint8_t {
-    DATA = 0,
-    DISCONNECT = 1
-};
-
-struct MessageHeader {
-    MessageType type;
-    uint8_t reserved[3];
-};
-
-struct ClientInfo {
-    sockaddr_in addr;
-    
-    ClientInfo(const sockaddr_in& a) : addr(a) {}
-};
+#include "udp_protocol.h"
+#include "packet_pool.h"
+#include "client_table.h"
 
 class UDPServer {
 public:
     using DataCallback = std::function<void(const uint8_t* data, size_t len, const sockaddr_in& client_addr)>;
+    /* fills the parts of a STATS reply the server does not know itself, runs on the udp task */
+    using StatsCallback = std::function<void(StatsSnapshot& snapshot)>;
+    /* a client's RECEIVER_REPORT, runs on the udp task */
+    using ReportCallback = std::function<void(const ReceiverReport& report, const sockaddr_in& client_addr)>;
+    /* a client's NACK, at most MAX_NACK_RANGES ranges, runs on the udp task */
+    using NackCallback = std::function<void(const NackRange* ranges, size_t count, const sockaddr_in& client_addr)>;
+
+    struct Stats {
+        uint32_t packets_sent;      /* datagrams handed to lwip, one per client in unicast mode */
+        uint32_t send_failures;
+        uint64_t bytes_sent;
+    };
+
+    /* UNICAST sends one datagram per registered client. MULTICAST and BROADCAST send each packet
+       once to a group address on GROUP_DELIVERY_PORT, so airtime and cpu no longer grow with the
+       number of listeners; clients still say hello so HasClients() gates streaming. note that an
+       access point sends group frames at a basic rate and without link layer retries */
+    enum class DeliveryMode : uint8_t {
+        UNICAST,
+        MULTICAST,
+        BROADCAST,
+    };
 
     static UDPServer& GetInstance();
 
@@ -38,13 +46,33 @@ public:
     bool Initialize(uint16_t port);
     void Deinitialize();
 
-    bool HasClients() const { return !clients_.empty(); }
+    bool HasClients() const { return clients_.Read()->count > 0; }
+
+    /* group_ip is a multicast group (MULTICAST, default DEFAULT_MULTICAST_GROUP) or a broadcast
+       address (BROADCAST, default 255.255.255.255). may be called before or after Initialize */
+    bool SetDeliveryMode(DeliveryMode mode, const char* group_ip = nullptr);
+    DeliveryMode delivery_mode() const { return delivery_mode_; }
 
-    bool SendToAllClients(const uint8_t* data, size_t len);
+    /* packets come from a fixed pool with the header preformatted in their headroom,
+       the caller fills payload() and hands the same buffer to every client */
+    PacketBuffer* AcquirePacket() { return packet_pool_.Acquire(); }
+    void ReleasePacket(PacketBuffer* packet) { packet_pool_.Release(packet); }
+    bool SendToAllClients(PacketBuffer* packet);
+    /* one client only, whatever the delivery mode. for retransmissions answering a NACK */
+    bool SendToClient(PacketBuffer* packet, const sockaddr_in& client_addr);
+
+    /* safe from any task, each counter is read on its own */
+    Stats GetStats() const;
+    PacketPool::Stats GetPacketPoolStats() const { return packet_pool_.GetStats(); }
 
     bool SendTo(const uint8_t* data, size_t len, const sockaddr_in& dest_addr);
     
     void SetReceiveCallback(DataCallback callback) { data_callback_ = callback; }
+    /* set before Initialize, the udp task reads it without locking */
+    void SetStatsCallback(StatsCallback callback) { stats_callback_ = callback; }
+    /* set before Initialize as well */
+    void SetReportCallback(ReportCallback callback) { report_callback_ = callback; }
+    void SetNackCallback(NackCallback callback) { nack_callback_ = callback; }
 
 private:
     UDPServer() = default;
@@ -54,15 +82,41 @@ private:
     
     void HandleMessage(const uint8_t* data, size_t len, const sockaddr_in& client_addr);
     
+    /* answers a STATS request, the transport fields come from here and the rest from stats_callback_ */
+    void SendStats(const sockaddr_in& dest_addr);
+
     void RemoveClient(const sockaddr_in& addr);
+    void ExpireClients(int64_t now_us);
+
+    /* socket options for the current delivery mode */
+    bool ApplyDeliveryMode();
+
+    void CountSent(size_t bytes);
+    void CountSendFailure() { send_failures_.fetch_add(1, std::memory_order_relaxed); }
 
     int socket_fd_ = -1;
     uint16_t port_ = 0;
     bool should_stop_ = false;
     TaskHandle_t udp_task_ = nullptr;
 
-    std::vector<ClientInfo> clients_;
+    /* registry owned by the udp task, the send path only reads its snapshots */
+    ClientTable clients_;
+    int64_t last_expiry_us_ = 0;
+    static constexpr uint32_t RECEIVE_TIMEOUT_MS = 1000;   /* also the expiry check period */
+    static constexpr uint8_t MAX_CLIENT_SEND_FAILURES = 3;   /* consecutive */
+
+    DeliveryMode delivery_mode_ = DeliveryMode::UNICAST;
+    sockaddr_in group_addr_ = {};
+
+    PacketPool packet_pool_;
+    /* bumped by the send path, read by the udp task for STATS replies and by GetStats */
+    std::atomic<uint32_t> packets_sent_{0};
+    std::atomic<uint32_t> send_failures_{0};
+    std::atomic<uint64_t> bytes_sent_{0};
     
     static UDPServer* instance_;
     DataCallback data_callback_;
+    StatsCallback stats_callback_;
+    ReportCallback report_callback_;
+    NackCallback nack_callback_;
 }; 
\ No newline at end of file
@@ -0,0 +1,307 @@
+// Host check and benchmark for the capture conditioning in
+// main/audio/capture_conditioner.cpp (DC blocker + AGC fused into the 32 -> 16
+// bit conversion). It first feeds synthetic signals through the conditioner,
+// shaped like what the I2S DMA delivers (24-bit samples in the top of 32-bit
+// words), and prints what it did to them: an offset microphone, quiet and
+// loud talkers, a noise-only pause, and a burst into the limiter. Then it
+// times one 30 ms read period per call against the plain narrowing kernels
+// from pcm_convert.cpp, in ns and (on x86) TSC cycles per sample. On the
+// device, the capture log prints the conditioner state for comparison.
+//
+// Build: g++ -std=gnu++20 -O2 -I../main/audio -o capture_dsp_benchmark capture_dsp_benchmark.cpp ../main/audio/capture_conditioner.cpp ../main/audio/pcm_convert.cpp
+// Run:   ./capture_dsp_benchmark [iterations]
+#include "capture_conditioner.h"
+#include "pcm_convert.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#else
+#define HAVE_TSC 0
+#endif
+
+namespace {
+
+// mirrors audio_config.h
+const uint32_t SHIFT = 12;
+const uint32_t SAMPLE_RATE = 16000;
+const size_t PERIOD_SAMPLES = SAMPLE_RATE / 1000 * 30;
+
+// an I2S word carrying a sample of the given level, relative to the plain
+// >> SHIFT scaling (0 dBFS = INT16_MAX after the shift)
+int32_t to_word(double value_dbfs_scale) {
+  double word = value_dbfs_scale * INT16_MAX * (1 << SHIFT);
+  word = std::max(std::min(word, 2147483647.0), -2147483648.0);
+  // 24-bit microphone data, the low byte is always zero
+  return static_cast<int32_t>(word) & ~0xFF;
+}
+
+double db_to_linear(double db) { return std::pow(10.0, db / 20.0); }
+
+double linear_to_dbfs(double value) {
+  return value > 0 ? 20.0 * std::log10(value / INT16_MAX) : -120.0;
+}
+
+struct Measure {
+  double mean = 0;
+  double peak = 0;
+  size_t clipped = 0;
+};
+
+// statistics over the output from start (in seconds) on
+Measure measure(const std::vector<int16_t> &out, double start) {
+  Measure m;
+  size_t first = static_cast<size_t>(start * SAMPLE_RATE);
+  double sum = 0;
+  for (size_t i = first; i < out.size(); i++) {
+    sum += out[i];
+    m.peak = std::max(m.peak, std::abs(static_cast<double>(out[i])));
+    m.clipped += std::abs(out[i]) >= INT16_MAX;
+  }
+  m.mean = out.size() > first ? sum / (out.size() - first) : 0;
+  return m;
+}
+
+// runs the words through the conditioner a read period at a time, in place
+// like I2SCodec::ReadAudioData
+std::vector<int16_t> condition(CaptureConditioner &conditioner,
+                               std::vector<int32_t> words) {
+  size_t samples = words.size();
+  std::vector<int16_t> out(samples);
+  for (size_t offset = 0; offset < samples; offset += PERIOD_SAMPLES) {
+    size_t count = std::min(PERIOD_SAMPLES, samples - offset);
+    int16_t *narrowed = reinterpret_cast<int16_t *>(words.data() + offset);
+    conditioner.Process(words.data() + offset, narrowed, count);
+    std::memcpy(out.data() + offset, narrowed, count * sizeof(int16_t));
+  }
+  return out;
+}
+
+std::vector<int16_t> plain(const std::vector<int32_t> &words) {
+  std::vector<int16_t> out(words.size());
+  PcmConvertS32ToS16Scalar(words.data(), out.data(), words.size(), SHIFT,
+                           PcmSaturation::SYMMETRIC);
+  return out;
+}
+
+std::vector<int32_t> tone(double seconds, double level_db, double dc = 0,
+                          double freq = 440.0) {
+  std::vector<int32_t> words(static_cast<size_t>(seconds * SAMPLE_RATE));
+  double amplitude = db_to_linear(level_db);
+  for (size_t i = 0; i < words.size(); i++) {
+    double t = static_cast<double>(i) / SAMPLE_RATE;
+    words[i] = to_word(dc + amplitude * std::sin(2 * M_PI * freq * t));
+  }
+  return words;
+}
+
+std::vector<int32_t> noise(double seconds, double level_db) {
+  std::mt19937 rng(1);
+  std::normal_distribution<double> dist(0.0, db_to_linear(level_db));
+  std::vector<int32_t> words(static_cast<size_t>(seconds * SAMPLE_RATE));
+  for (int32_t &word : words) {
+    word = to_word(dist(rng));
+  }
+  return words;
+}
+
+int failures = 0;
+
+void report(const std::string &name, bool ok, const std::string &detail) {
+  std::cout << (ok ? "  ok    " : "  FAIL  ") << std::left << std::setw(30)
+            << name << detail << std::endl;
+  failures += !ok;
+}
+
+std::string describe(const Measure &m) {
+  std::ostringstream text;
+  text << std::fixed << std::setprecision(1) << "mean " << m.mean << ", peak "
+       << linear_to_dbfs(m.peak) << " dBFS, " << m.clipped << " clipped";
+  return text.str();
+}
+
+void check_signals() {
+  AgcConfig agc;
+  std::cout << "Synthetic signals (AGC target " << agc.target_dbfs
+            << " dBFS, max gain " << agc.max_gain_db << " dB, gate "
+            << agc.gate_dbfs << " dBFS):" << std::endl;
+
+  CaptureConditioner dc_only;
+  dc_only.Configure(SAMPLE_RATE, SHIFT, true, false);
+  CaptureConditioner full;
+
+  // a mems microphone with a 5% offset, 1 s to settle
+  std::vector<int32_t> offset = tone(3.0, -30.0, 0.05);
+  Measure raw = measure(plain(offset), 1.0);
+  Measure blocked = measure(condition(dc_only, offset), 1.0);
+  report("dc offset, plain", std::abs(raw.mean) > 1000, describe(raw));
+  report("dc offset, dc blocker", std::abs(blocked.mean) < 2.0,
+         describe(blocked));
+
+  // the same tone at a few levels, the output should land near the target
+  for (double level : {-45.0, -30.0, -18.0, -6.0, +6.0}) {
+    full.Configure(SAMPLE_RATE, SHIFT, true, true);
+    std::vector<int32_t> words = tone(4.0, level, 0.02);
+    Measure before = measure(plain(words), 2.0);
+    Measure after = measure(condition(full, words), 2.0);
+    // past the gain range the level is only brought as close as it allows
+    bool at_limit = full.gain_db() <= agc.min_gain_db + 0.1 ||
+                    full.gain_db() >= agc.max_gain_db - 0.1;
+    bool ok = (std::abs(linear_to_dbfs(after.peak) - agc.target_dbfs) < 2.0 ||
+               at_limit) &&
+              after.clipped == 0;
+    std::ostringstream name;
+    name << "agc, tone at " << std::showpos << level << " dB";
+    std::ostringstream detail;
+    detail << std::fixed << std::setprecision(1) << "plain peak "
+           << linear_to_dbfs(before.peak) << " dBFS (" << before.clipped
+           << " clipped) -> " << describe(after) << ", gain "
+           << full.gain_db() << " dB";
+    report(name.str(), ok, detail.str());
+  }
+
+  // a pause must not be pumped up to the target
+  full.Configure(SAMPLE_RATE, SHIFT, true, true);
+  std::vector<int32_t> pause = noise(3.0, -65.0);
+  Measure quiet = measure(condition(full, pause), 1.0);
+  std::ostringstream gate_detail;
+  gate_detail << std::fixed << std::setprecision(1) << describe(quiet)
+              << ", gain " << full.gain_db() << " dB";
+  report("agc gate, -65 dB noise", std::abs(full.gain_db()) < 0.5,
+         gate_detail.str());
+
+  // a quiet talker turns the gain up, then a shout hits before it can react
+  full.Configure(SAMPLE_RATE, SHIFT, true, true);
+  std::vector<int32_t> burst = tone(2.0, -40.0);
+  std::vector<int32_t> shout = tone(0.05, 0.0);
+  burst.insert(burst.end(), shout.begin(), shout.end());
+  std::vector<int16_t> limited = condition(full, burst);
+  Measure attack = measure(limited, 2.0);
+  // only the first milliseconds, until the envelope catches up, may clip
+  report("limiter, -40 dB then 0 dB",
+         attack.clipped < SAMPLE_RATE / 1000 * 5, describe(attack));
+
+  // in place and out of place must agree
+  full.Configure(SAMPLE_RATE, SHIFT, true, true);
+  CaptureConditioner copy;
+  copy.Configure(SAMPLE_RATE, SHIFT, true, true);
+  std::vector<int32_t> words = tone(1.0, -20.0, 0.01);
+  std::vector<int16_t> in_place = condition(full, words);
+  std::vector<int16_t> separate(words.size());
+  copy.Process(words.data(), separate.data(), words.size());
+  report("in place == out of place", in_place == separate, "");
+
+  // with both stages off the conditioner is the plain narrowing
+  CaptureConditioner off;
+  off.Configure(SAMPLE_RATE, SHIFT, false, false);
+  std::vector<int32_t> full_scale = noise(1.0, 0.0);
+  report("disabled == pcm_convert",
+         condition(off, full_scale) == plain(full_scale), "");
+}
+
+double tsc_per_ns() {
+#if HAVE_TSC
+  auto start = std::chrono::steady_clock::now();
+  uint64_t tsc_start = __rdtsc();
+  while (std::chrono::steady_clock::now() - start <
+         std::chrono::milliseconds(100)) {
+  }
+  uint64_t tsc = __rdtsc() - tsc_start;
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start)
+                .count();
+  return static_cast<double>(tsc) / ns;
+#else
+  return 0;
+#endif
+}
+
+void benchmark(size_t iterations) {
+  std::vector<int32_t> source = tone(1.0, -20.0, 0.02);
+  source.resize(PERIOD_SAMPLES);
+  std::vector<int32_t> words(PERIOD_SAMPLES);
+  std::vector<int16_t> out(PERIOD_SAMPLES);
+
+  CaptureConditioner dc_only, agc_only, both;
+  dc_only.Configure(SAMPLE_RATE, SHIFT, true, false);
+  agc_only.Configure(SAMPLE_RATE, SHIFT, false, true);
+  both.Configure(SAMPLE_RATE, SHIFT, true, true);
+
+  struct Kernel {
+    const char *name;
+    std::function<void()> run;
+  };
+  std::vector<Kernel> kernels = {
+      {"pcm_convert scalar",
+       [&] {
+         PcmConvertS32ToS16Scalar(words.data(), out.data(), PERIOD_SAMPLES,
+                                  SHIFT, PcmSaturation::SYMMETRIC);
+       }},
+      {"pcm_convert portable",
+       [&] {
+         PcmConvertS32ToS16Portable(words.data(), out.data(), PERIOD_SAMPLES,
+                                    SHIFT, PcmSaturation::SYMMETRIC);
+       }},
+      {"conditioner dc",
+       [&] { dc_only.Process(words.data(), out.data(), PERIOD_SAMPLES); }},
+      {"conditioner agc",
+       [&] { agc_only.Process(words.data(), out.data(), PERIOD_SAMPLES); }},
+      {"conditioner dc + agc",
+       [&] { both.Process(words.data(), out.data(), PERIOD_SAMPLES); }},
+  };
+
+  double ticks_per_ns = tsc_per_ns();
+  std::cout << "\n" << iterations << " read periods of " << PERIOD_SAMPLES
+            << " samples per kernel\n";
+  std::cout << std::left << std::setw(24) << "kernel" << std::right
+            << std::setw(12) << "ns/sample" << std::setw(16)
+            << (HAVE_TSC ? "cycles/sample" : "") << std::endl;
+
+  int64_t checksum = 0;
+  for (const Kernel &kernel : kernels) {
+    std::chrono::nanoseconds elapsed(0);
+    for (size_t i = 0; i < iterations; i++) {
+      // fresh words every period, like the dma buffer
+      std::memcpy(words.data(), source.data(), PERIOD_SAMPLES * sizeof(int32_t));
+      auto start = std::chrono::steady_clock::now();
+      kernel.run();
+      elapsed += std::chrono::steady_clock::now() - start;
+      checksum += out[i % PERIOD_SAMPLES];
+    }
+    double ns = static_cast<double>(elapsed.count()) /
+                (static_cast<double>(iterations) * PERIOD_SAMPLES);
+    std::cout << std::left << std::setw(24) << kernel.name << std::right
+              << std::fixed << std::setprecision(2) << std::setw(12) << ns;
+    if (HAVE_TSC) {
+      std::cout << std::setw(16) << ns * ticks_per_ns;
+    }
+    std::cout << std::endl;
+  }
+  std::cout << "(checksum " << checksum << ")" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+  if (iterations == 0) {
+    iterations = 20000;
+  }
+
+  check_signals();
+  benchmark(iterations);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,153 @@
+// Wire format of the device's UDP stream for the host clients in scripts/.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Wire format, mirrors main/network/udp_protocol.h (little endian)
+const uint8_t PROTOCOL_VERSION = 1;
+
+// Group fan-out: the server sends each packet once to this port on a
+// multicast group or the broadcast address (UDPServer::DeliveryMode)
+const char *const DEFAULT_MULTICAST_GROUP = "239.255.42.1";
+const uint16_t GROUP_DELIVERY_PORT = 5002;
+
+enum class MessageType : uint8_t {
+  DATA = 0,
+  DISCONNECT = 1,
+  PARITY = 2,
+  KEEPALIVE = 3, // client -> server, header only
+  STATS = 4,     // request: header only, reply: header + StatsSnapshot
+  RECEIVER_REPORT = 5, // client -> server, header + ReceiverReport
+  NACK = 6             // client -> server, header + NackRange[]
+};
+
+// The server forgets clients it has not heard from for 5 intervals
+const int KEEPALIVE_INTERVAL_MS = 2000;
+const int RECEIVER_REPORT_INTERVAL_MS = 1000;
+
+enum class AudioCodec : uint8_t {
+  PCM16 = 0,
+  IMA_ADPCM = 1,
+  SILENCE = 2,
+  GAP = 3
+};
+
+#pragma pack(push, 1)
+struct MessageHeader {
+  uint8_t type;
+  uint8_t version; // 0 = legacy stream without DataHeader
+  uint8_t codec;           // AudioCodec of DATA payloads
+  uint8_t sample_rate_khz; // DATA and PARITY, 0 in older streams (16 kHz)
+};
+
+struct DataHeader {
+  uint32_t sequence;     // per stream packet counter, wraps
+  uint32_t sample_index; // stream position of the first payload sample, wraps
+};
+
+// PARITY datagrams: MessageHeader, ParityHeader, then the xor over the group
+// of a ParityBlockHeader followed by the DATA payload (zero padded)
+struct ParityHeader {
+  uint32_t first_sequence; // first DATA sequence number of the group
+  uint8_t group_size;
+  uint8_t reserved[3];
+};
+
+struct ParityBlockHeader {
+  uint32_t sample_index;
+  uint16_t payload_len;
+  uint8_t codec;
+  uint8_t reserved;
+};
+
+// SILENCE payloads: the server's VAD suppressed this many samples starting at
+// DataHeader.sample_index, they are played out as silence or comfort noise
+struct SilenceDescriptor {
+  uint32_t samples;
+  uint16_t noise_rms; // background level of the suppressed audio
+  uint16_t reserved;
+};
+
+// GAP payloads: the server's ring buffer overran and it dropped this many
+// samples starting at DataHeader.sample_index, no packet will ever carry them
+const uint8_t GAP_REASON_RING_FULL = 0; // the newest capture found no room
+const uint8_t GAP_REASON_SHED = 1;      // the oldest backlog was dropped
+struct GapDescriptor {
+  uint32_t samples;
+  uint8_t reason;
+  uint8_t reserved[3];
+};
+
+// RECEIVER_REPORT payload: the stream since the previous report, after FEC
+// recovery. The device's congestion control steps the stream down (ADPCM,
+// longer packets, half the rate) while clients keep losing packets
+struct ReceiverReport {
+  uint32_t interval_ms;
+  uint32_t expected_packets; // received + lost
+  uint32_t lost_packets;
+};
+
+// NACK payload: up to MAX_NACK_RANGES ranges of DATA sequence numbers to send
+// again. The device answers from its ring buffer to the sender alone (also in
+// group mode), as long as it still holds the audio, about a second back
+const size_t MAX_NACK_RANGES = 16;
+const uint16_t MAX_NACK_RANGE_PACKETS = 64;
+struct NackRange {
+  uint32_t first_sequence;
+  uint16_t count;
+  uint16_t reserved;
+};
+
+// Latency profiles of the device (main/audio/latency_profile.h). The packet
+// length tells which one is streaming, the jitter buffer then keeps at least
+// buffer_packets packets: short packets need more of them to ride out jitter.
+struct LatencyProfile {
+  uint32_t frame_ms;
+  size_t buffer_packets;
+};
+const LatencyProfile LATENCY_PROFILES[] = {{5, 3}, {10, 2}, {20, 2}, {30, 2}};
+
+// STATS reply payload. Fields are only ever appended, snapshot_size says how
+// many bytes the server filled; a STATS request does not register the sender
+// as a client, so polling does not start the stream.
+const size_t STATS_STAGE_COUNT = 6; // LatencyStage order on the device
+const char *const STATS_STAGE_NAMES[STATS_STAGE_COUNT] = {
+    "dma", "convert", "ring", "send", "capture_timer", "send_timer"};
+const uint8_t STATS_FLAG_LATENCY_TRACE = 1 << 0;
+
+struct StatsStageLatency {
+  uint32_t count;
+  uint32_t p50_us;
+  uint32_t p99_us;
+  uint32_t max_us;
+};
+
+struct StatsSnapshot {
+  uint16_t snapshot_size;
+  uint8_t client_count;
+  uint8_t flags;
+  uint32_t uptime_ms;
+  uint32_t sample_rate;
+  uint32_t packets_sent;
+  uint64_t bytes_sent;
+  uint32_t send_failures;
+  uint32_t parity_packets;
+  uint32_t vad_suppressed_packets;
+  uint32_t ring_fill_samples;
+  uint32_t ring_capacity_samples;
+  uint32_t ring_dropped_samples; // overruns since the stream (re)started
+  uint32_t free_heap;
+  uint32_t min_free_heap;
+  uint32_t free_psram;
+  uint32_t min_free_psram;
+  StatsStageLatency stages[STATS_STAGE_COUNT];
+  uint32_t ring_shed_samples; // dropped by the overrun policy
+  uint32_t ring_idle_samples; // discarded while no client listened
+  uint32_t gap_markers;
+  uint8_t overrun_policy; // 0 drop newest, 1 drop oldest, 2 catch up
+  uint8_t reserved[3];
+  uint32_t retransmitted_packets; // sent again in answer to a NACK
+  uint32_t nack_expired_packets;  // NACKed after the device let them go
+};
+#pragma pack(pop)
@@ -0,0 +1,117 @@
+// Sockets for the host clients in scripts/: the Winsock and POSIX
+// differences, receive buffer sizing and the Linux recvmmsg fast path.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef int socklen_t;
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define SOCKET int
+#define INVALID_SOCKET -1
+#define SOCKET_ERROR -1
+// Don't redefine closesocket as close - we'll handle it differently
+#endif
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+// Asks for a socket receive buffer of this many bytes (0 keeps the system
+// default, which is clamped by net.core.rmem_max unless the client may force
+// it) and turns on the kernel's drop counter where there is one. Returns the
+// size the socket ended up with.
+inline int configure_receive_socket(SOCKET sock, int requested_bytes) {
+  if (requested_bytes > 0) {
+    int size = requested_bytes;
+    bool forced = false;
+#ifdef SO_RCVBUFFORCE
+    forced = setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, (const char *)&size,
+                        sizeof(size)) == 0;
+#endif
+    if (!forced) {
+      setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (const char *)&size,
+                 sizeof(size));
+    }
+  }
+  int actual = 0;
+  socklen_t length = sizeof(actual);
+  getsockopt(sock, SOL_SOCKET, SO_RCVBUF, (char *)&actual, &length);
+#ifdef __linux__
+  actual /= 2; // Linux reports the doubled size it accounts overhead in
+#endif
+
+#ifdef SO_RXQ_OVFL
+  int enable = 1;
+  setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+#endif
+  return actual;
+}
+
+#ifdef __linux__
+// Linux fast path: up to CAPACITY datagrams per recvmmsg call into a
+// preallocated slab. The socket's SO_RXQ_OVFL drop counter is picked out of
+// the control messages on the way.
+class ReceiveBatch {
+public:
+  static constexpr size_t CAPACITY = 64;
+  static constexpr size_t SLOT_SIZE = 2048;
+
+  ReceiveBatch()
+      : slab(CAPACITY * SLOT_SIZE), control(CAPACITY * CONTROL_SIZE),
+        messages(CAPACITY), iovecs(CAPACITY) {
+    for (size_t i = 0; i < CAPACITY; i++) {
+      iovecs[i] = {slab.data() + i * SLOT_SIZE, SLOT_SIZE};
+    }
+  }
+
+  // flags as for recvmmsg. Returns the number of datagrams (<= 0 on timeout
+  // or error); kernel_drops is updated if the socket reported its counter.
+  int receive(SOCKET sock, int flags, uint64_t &kernel_drops) {
+    // the kernel shrinks msg_controllen to what it wrote, reset every call
+    for (size_t i = 0; i < CAPACITY; i++) {
+      messages[i].msg_hdr = {};
+      messages[i].msg_hdr.msg_iov = &iovecs[i];
+      messages[i].msg_hdr.msg_iovlen = 1;
+      messages[i].msg_hdr.msg_control = control.data() + i * CONTROL_SIZE;
+      messages[i].msg_hdr.msg_controllen = CONTROL_SIZE;
+    }
+
+    int count = recvmmsg(sock, messages.data(), CAPACITY, flags, nullptr);
+    for (int i = 0; i < count; i++) {
+      msghdr &header = messages[i].msg_hdr;
+      for (cmsghdr *cmsg = CMSG_FIRSTHDR(&header); cmsg;
+           cmsg = CMSG_NXTHDR(&header, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+          // datagrams the socket dropped so far, the newest value wins
+          uint32_t drops;
+          std::memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+          kernel_drops = drops;
+        }
+      }
+    }
+    return count;
+  }
+
+  const char *data(int i) const { return slab.data() + i * SLOT_SIZE; }
+  size_t size(int i) const { return messages[i].msg_len; }
+
+private:
+  static constexpr size_t CONTROL_SIZE = CMSG_SPACE(sizeof(uint32_t));
+
+  std::vector<char> slab;
+  std::vector<char> control;
+  std::vector<mmsghdr> messages;
+  std::vector<iovec> iovecs;
+};
+#endif
@@ -0,0 +1,353 @@
+// udp_client.cpp's writer thread: chunked, segmented recording to disk off
+// the receive thread.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "encoder_pool.h"
+#include "recording_segment.h"
+#include "spsc_queue.h"
+
+// Moves the recording to disk off the receive thread. Samples are appended to
+// pooled chunks; a full chunk (or one held for FLUSH_INTERVAL) goes through a
+// SpscQueue to the writer thread, which writes it with a single call and
+// hands it back through a second queue. The pool grows when the disk falls
+// behind, so the receive thread only waits once MAX_CHUNKS (16 MiB) are in
+// flight.
+//
+// The writer owns the files: the recording is split into segments named
+// <base>.wav, <base>_001.wav, ... (or .flac), a new one starting when the
+// sample rate changes or the current one reaches the rotation limit. Segments
+// are synced to disk every SYNC_INTERVAL. With several channels the appended
+// samples are interleaved frames, and segments are cut between frames.
+class DiskWriter {
+public:
+  static constexpr size_t CHUNK_BYTES = 64 * 1024;
+  static constexpr size_t INITIAL_CHUNKS = 4;
+  static constexpr size_t MAX_CHUNKS = 256;
+  static constexpr auto FLUSH_INTERVAL = std::chrono::seconds(1);
+  static constexpr auto SYNC_INTERVAL = std::chrono::seconds(5);
+
+  struct Stats {
+    uint64_t chunks_written = 0;
+    uint64_t bytes_written = 0; // PCM
+    uint64_t bytes_stored = 0;  // in the files, less than written with FLAC
+    uint64_t bytes_dropped = 0; // no file to write them to
+    size_t pool_chunks = 0;     // allocated so far
+    uint64_t stalls = 0;        // appends that had to wait for the disk
+    uint32_t segments = 0;
+  };
+
+  ~DiskWriter() { stop(); }
+
+  // Rotate after this much audio or this many bytes per file, 0 for no
+  // limit; segments are cut at the exact sample. A FLAC segment is cut once
+  // it has passed the size, a few blocks later. Call before start().
+  void set_rotation(uint32_t seconds, uint64_t bytes) {
+    rotate_seconds = seconds;
+    rotate_bytes = bytes;
+  }
+
+  // FLAC is encoded on encoder_threads threads, 0 for one per core. Call
+  // before start().
+  void set_format(RecordingFormat recording_format,
+                  unsigned encoder_threads = 0) {
+    format = recording_format;
+    encoder_thread_count = encoder_threads;
+  }
+
+  RecordingFormat get_format() const { return format; }
+
+  void start(const std::string &base_name, uint32_t rate,
+             uint16_t channel_count = 1) {
+    base = base_name;
+    channels = channel_count;
+    producer_rate = rate;
+    if (format == RecordingFormat::FLAC && channels > flac::MAX_CHANNELS) {
+      std::cerr << "FLAC holds at most " << flac::MAX_CHANNELS
+                << " channels, recording WAV" << std::endl;
+      format = RecordingFormat::WAV;
+    }
+    if (format == RecordingFormat::FLAC) {
+      encoders = std::make_unique<EncoderPool>(encoder_thread_count);
+      segment = std::make_unique<FlacSegment>(*encoders);
+    } else {
+      segment = std::make_unique<WavSegment>();
+    }
+    for (size_t i = pool.size(); i < INITIAL_CHUNKS; i++) {
+      pool.push_back(std::make_unique<Chunk>());
+      free_chunks.push(pool.back().get());
+    }
+    pool_size = pool.size();
+    stopping = false;
+    thread = std::thread(&DiskWriter::writer_loop, this);
+  }
+
+  // Writes out everything appended so far and closes the last segment
+  void stop() {
+    if (!thread.joinable()) {
+      return;
+    }
+    drain();
+    stopping = true;
+    submitted.fetch_add(1, std::memory_order_release);
+    submitted.notify_one();
+    thread.join();
+    close_segment();
+    segment.reset();
+    encoders.reset();
+  }
+
+  // Producer side, the receive thread
+  void append(const void *data, size_t bytes) {
+    const char *source = static_cast<const char *>(data);
+    while (bytes > 0) {
+      if (!current) {
+        current = acquire();
+        current->sample_rate = producer_rate;
+        current->started = std::chrono::steady_clock::now();
+      }
+      size_t count = std::min(bytes, CHUNK_BYTES - current->used);
+      std::memcpy(current->data + current->used, source, count);
+      current->used += count;
+      source += count;
+      bytes -= count;
+      if (current->used == CHUNK_BYTES) {
+        submit();
+      }
+    }
+    flush_if_stale();
+  }
+
+  // Producer side: samples appended from now on belong to a new segment at
+  // this rate
+  void set_sample_rate(uint32_t rate) {
+    if (current) {
+      submit();
+    }
+    producer_rate = rate;
+  }
+
+  // Producer side: hands over a partial chunk that has waited long enough,
+  // so a quiet stream still reaches the disk. Call now and then.
+  void flush_if_stale() {
+    if (current &&
+        std::chrono::steady_clock::now() - current->started >= FLUSH_INTERVAL) {
+      submit();
+    }
+  }
+
+  // Producer side: hands over the partial chunk and waits until everything
+  // appended so far is written
+  void drain() {
+    if (current) {
+      submit();
+    }
+    uint64_t target = submitted_chunks;
+    uint64_t done;
+    while ((done = completed.load(std::memory_order_acquire)) < target) {
+      completed.wait(done);
+    }
+  }
+
+  Stats get_stats() const {
+    Stats result;
+    result.chunks_written = completed.load(std::memory_order_relaxed);
+    result.bytes_written = bytes_written.load(std::memory_order_relaxed);
+    result.bytes_stored = bytes_stored.load(std::memory_order_relaxed);
+    result.bytes_dropped = bytes_dropped.load(std::memory_order_relaxed);
+    result.pool_chunks = pool_size.load(std::memory_order_relaxed);
+    result.stalls = stalls.load(std::memory_order_relaxed);
+    result.segments = segment_count.load(std::memory_order_relaxed);
+    return result;
+  }
+
+private:
+  struct Chunk {
+    size_t used = 0;
+    uint32_t sample_rate = 0;
+    std::chrono::steady_clock::time_point started;
+    char data[CHUNK_BYTES];
+  };
+
+  Chunk *acquire() {
+    Chunk *chunk = nullptr;
+    if (free_chunks.pop(chunk)) {
+      return chunk;
+    }
+    if (pool.size() < MAX_CHUNKS) {
+      pool.push_back(std::make_unique<Chunk>());
+      pool_size = pool.size();
+      return pool.back().get();
+    }
+    stalls++;
+    while (!free_chunks.pop(chunk)) {
+      uint64_t done = completed.load(std::memory_order_acquire);
+      if (free_chunks.pop(chunk)) {
+        break;
+      }
+      completed.wait(done);
+    }
+    return chunk;
+  }
+
+  void submit() {
+    // cannot fail: the queue holds more slots than there are chunks
+    filled_chunks.push(current);
+    current = nullptr;
+    submitted_chunks++;
+    submitted.fetch_add(1, std::memory_order_release);
+    submitted.notify_one();
+  }
+
+  void writer_loop() {
+    while (true) {
+      uint64_t seen = submitted.load(std::memory_order_acquire);
+      Chunk *chunk;
+      if (!filled_chunks.pop(chunk)) {
+        if (stopping) {
+          return;
+        }
+        submitted.wait(seen);
+        continue;
+      }
+      write_chunk(*chunk);
+      chunk->used = 0;
+      free_chunks.push(chunk);
+      completed.fetch_add(1, std::memory_order_release);
+      completed.notify_all();
+
+      auto now = std::chrono::steady_clock::now();
+      if (segment->is_open() && now - last_sync >= SYNC_INTERVAL) {
+        segment->sync();
+        last_sync = now;
+      }
+    }
+  }
+
+  // Writer side: splits the chunk across segments as the limits require
+  void write_chunk(const Chunk &chunk) {
+    const char *data = chunk.data;
+    size_t bytes = chunk.used;
+    while (bytes > 0) {
+      if (!segment->is_open() || segment->sample_rate() != chunk.sample_rate ||
+          segment->data_bytes() >= segment_limit ||
+          (rotate_bytes > 0 && segment->file_bytes() >= rotate_bytes)) {
+        open_segment(chunk.sample_rate);
+      }
+      size_t count = static_cast<size_t>(
+          std::min<uint64_t>(bytes, segment_limit - segment->data_bytes()));
+      if (!segment->is_open() || !segment->write(data, count)) {
+        bytes_dropped.fetch_add(bytes, std::memory_order_relaxed);
+        return;
+      }
+      bytes_written.fetch_add(count, std::memory_order_relaxed);
+      bytes_stored.store(closed_bytes + segment->file_bytes(),
+                         std::memory_order_relaxed);
+      data += count;
+      bytes -= count;
+    }
+  }
+
+  void open_segment(uint32_t rate) {
+    close_segment();
+
+    // whole frames per segment, whichever limit comes first
+    uint64_t frame_bytes = channels * sizeof(int16_t);
+    uint64_t limit = UINT64_MAX;
+    if (rotate_seconds > 0) {
+      limit = static_cast<uint64_t>(rotate_seconds) * rate * frame_bytes;
+    }
+    bool flac = format == RecordingFormat::FLAC;
+    if (!flac && rotate_bytes > sizeof(WavHeader)) {
+      limit = std::min(limit, rotate_bytes - sizeof(WavHeader));
+    }
+    segment_limit = limit == UINT64_MAX ? limit : limit - limit % frame_bytes;
+
+    uint32_t index = segment_count;
+    char suffix[16] = "";
+    if (index > 0) {
+      std::snprintf(suffix, sizeof(suffix), "_%03u", index);
+    }
+    const char *kind = flac ? "FLAC" : "WAV";
+    std::string path = base + suffix + (flac ? ".flac" : ".wav");
+    uint64_t size_hint = segment_limit == UINT64_MAX ? 0 : segment_limit;
+    if (!segment->open(path, rate, channels, size_hint)) {
+      std::cerr << "\nFailed to create " << kind << " file: " << path
+                << std::endl;
+      return;
+    }
+    segment_count++;
+    last_sync = std::chrono::steady_clock::now();
+    std::cout << "\nCreated new " << kind << " file: " << path << " (" << rate
+              << " Hz";
+    if (channels > 1) {
+      std::cout << ", " << channels << " channels";
+    }
+    std::cout << ")" << std::endl;
+  }
+
+  void close_segment() {
+    if (segment && segment->is_open()) {
+      segment->close();
+      closed_bytes += segment->file_bytes();
+      bytes_stored.store(closed_bytes, std::memory_order_relaxed);
+      std::cout << "\nSaved audio file: " << segment->path() << std::endl;
+    }
+  }
+
+  std::thread thread;
+  std::atomic<bool> stopping{false};
+
+  // owned by the producer, the writer only sees chunks through the queues
+  std::vector<std::unique_ptr<Chunk>> pool;
+  Chunk *current = nullptr;
+  uint64_t submitted_chunks = 0;
+  uint32_t producer_rate = 16000;
+
+  // owned by the writer thread (and by stop() once it has joined)
+  std::string base;
+  uint16_t channels = 1;
+  uint32_t rotate_seconds = 0;
+  uint64_t rotate_bytes = 0;
+  RecordingFormat format = RecordingFormat::WAV;
+  unsigned encoder_thread_count = 0;
+  std::unique_ptr<EncoderPool> encoders; // FLAC only, outlives the segment
+  std::unique_ptr<RecordingSegment> segment;
+  uint64_t segment_limit = UINT64_MAX; // data bytes in the current segment
+  uint64_t closed_bytes = 0;           // file bytes of the closed segments
+  std::chrono::steady_clock::time_point last_sync;
+
+  SpscQueue<Chunk *, MAX_CHUNKS * 2> filled_chunks; // receive -> writer
+  SpscQueue<Chunk *, MAX_CHUNKS * 2> free_chunks;   // writer -> receive
+  std::atomic<uint64_t> submitted{0};  // wakes the writer
+  std::atomic<uint64_t> completed{0};  // chunks written, wakes drain()
+  std::atomic<uint64_t> bytes_written{0};
+  std::atomic<uint64_t> bytes_stored{0};
+  std::atomic<uint64_t> bytes_dropped{0};
+  std::atomic<size_t> pool_size{0};
+  std::atomic<uint64_t> stalls{0};
+  std::atomic<uint32_t> segment_count{0};
+};
+
+// audio_<date>_<time>, the prefix of a recording's file names
+inline std::string make_recording_name() {
+  auto now = std::chrono::system_clock::now();
+  std::time_t now_time = std::chrono::system_clock::to_time_t(now);
+  std::tm *now_tm = std::localtime(&now_time);
+
+  char timestamp[20];
+  std::strftime(timestamp, sizeof(timestamp), "%Y%m%d_%H%M%S", now_tm);
+  return "audio_" + std::string(timestamp);
+}
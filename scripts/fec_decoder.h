@@ -0,0 +1,153 @@
+// Parity recovery for udp_client.cpp, the counterpart of the device's
+// FecEncoder.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <vector>
+
+#include "client_protocol.h"
+
+// Rebuilds a single lost DATA packet per parity group, mirrors
+// main/network/fec_encoder.cpp. The protected blocks of recent packets and
+// the parity of recent groups are both kept, so a group can be completed by
+// whichever of them arrives last.
+class FecDecoder {
+public:
+  struct Packet {
+    uint32_t sequence;
+    uint32_t sample_index;
+    uint8_t codec;
+    std::vector<uint8_t> payload;
+  };
+
+  // Records a DATA packet, returns false if its sequence number is already
+  // known (a duplicate, or a packet that was rebuilt before it turned up).
+  bool add_data(uint32_t sequence, uint32_t sample_index, uint8_t codec,
+                const uint8_t *payload, size_t size,
+                std::vector<Packet> &recovered) {
+    if (blocks.count(sequence)) {
+      return false;
+    }
+    ParityBlockHeader block_header = {sample_index,
+                                      static_cast<uint16_t>(size), codec, 0};
+    std::vector<uint8_t> block(sizeof(block_header) + size);
+    std::memcpy(block.data(), &block_header, sizeof(block_header));
+    std::memcpy(block.data() + sizeof(block_header), payload, size);
+    store_block(sequence, std::move(block));
+
+    for (auto &entry : groups) {
+      if (sequence - entry.first < entry.second.size) {
+        try_recover(entry.first, entry.second, recovered);
+        break;
+      }
+    }
+    return true;
+  }
+
+  // Records a PARITY packet (everything after the MessageHeader), returns the
+  // group size or 0 if the packet is malformed.
+  uint8_t add_parity(const uint8_t *data, size_t size,
+                     std::vector<Packet> &recovered) {
+    if (size < sizeof(ParityHeader) + sizeof(ParityBlockHeader)) {
+      return 0;
+    }
+    ParityHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (header.group_size == 0 || groups.count(header.first_sequence)) {
+      return header.group_size;
+    }
+
+    Group &group = groups[header.first_sequence];
+    group.size = header.group_size;
+    group.parity.assign(data + sizeof(header), data + size);
+    group_order.push_back(header.first_sequence);
+    if (group_order.size() > MAX_GROUPS) {
+      groups.erase(group_order.front());
+      group_order.pop_front();
+    }
+
+    try_recover(header.first_sequence, group, recovered);
+    return header.group_size;
+  }
+
+  uint64_t recovered_packets() const { return recovered_count; }
+
+private:
+  struct Group {
+    uint8_t size = 0;
+    bool done = false;
+    std::vector<uint8_t> parity;
+  };
+
+  static constexpr size_t MAX_BLOCKS = 256;
+  static constexpr size_t MAX_GROUPS = 32;
+
+  void store_block(uint32_t sequence, std::vector<uint8_t> block) {
+    blocks.emplace(sequence, std::move(block));
+    block_order.push_back(sequence);
+    if (block_order.size() > MAX_BLOCKS) {
+      blocks.erase(block_order.front());
+      block_order.pop_front();
+    }
+  }
+
+  void try_recover(uint32_t first_sequence, Group &group,
+                   std::vector<Packet> &recovered) {
+    if (group.done) {
+      return;
+    }
+    size_t missing = 0;
+    uint32_t missing_sequence = 0;
+    for (uint32_t i = 0; i < group.size; i++) {
+      if (!blocks.count(first_sequence + i)) {
+        missing++;
+        missing_sequence = first_sequence + i;
+      }
+    }
+    if (missing != 1) {
+      group.done = (missing == 0);
+      return; // nothing lost, or more than the parity can rebuild
+    }
+    group.done = true;
+
+    std::vector<uint8_t> block = group.parity;
+    for (uint32_t i = 0; i < group.size; i++) {
+      auto it = blocks.find(first_sequence + i);
+      if (it == blocks.end()) {
+        continue;
+      }
+      if (it->second.size() > block.size()) {
+        return; // parity shorter than a block it should cover
+      }
+      for (size_t j = 0; j < it->second.size(); j++) {
+        block[j] ^= it->second[j];
+      }
+    }
+
+    ParityBlockHeader block_header;
+    std::memcpy(&block_header, block.data(), sizeof(block_header));
+    if (block_header.payload_len > block.size() - sizeof(block_header)) {
+      return;
+    }
+    block.resize(sizeof(block_header) + block_header.payload_len);
+
+    Packet packet;
+    packet.sequence = missing_sequence;
+    packet.sample_index = block_header.sample_index;
+    packet.codec = block_header.codec;
+    packet.payload.assign(block.begin() + sizeof(block_header), block.end());
+    store_block(missing_sequence, std::move(block));
+    recovered.push_back(std::move(packet));
+    recovered_count++;
+  }
+
+  std::map<uint32_t, std::vector<uint8_t>> blocks;
+  std::deque<uint32_t> block_order;
+  std::map<uint32_t, Group> groups;
+  std::deque<uint32_t> group_order;
+  uint64_t recovered_count = 0;
+};
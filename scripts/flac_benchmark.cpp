@@ -0,0 +1,602 @@
+// Host benchmark and round-trip check for the FLAC recordings of
+// udp_client.cpp (flac_encoder.h).
+//
+// Without arguments it encodes synthetic test signals (speech-like, silence,
+// full scale noise, clipped square waves, 1-8 channels, blocks of every
+// short length) into in-memory FLAC streams, decodes them with the
+// independent decoder in flac_decoder.h (which checks the CRCs, STREAMINFO
+// totals and the MD5) and requires the samples back bit-exact. Then it times the encoder
+// on 16 kHz speech-like audio: the real-time mono streams one core keeps up
+// with, and the same over --threads threads encoding separate streams.
+//
+// WAV files given as arguments (e.g. recordings of the client) go through the
+// same round trip and are reported with their compression ratio; FLAC files
+// are decoded and checked like `flac -t` would.
+//
+// With --client it checks the whole path instead: it plays the device on
+// 127.0.0.1:5001 like receive_benchmark.cpp, records the same deterministic
+// stream once as WAV and once with --flac (rotating every 2 s, so the short
+// last frames and segment cuts are covered), decodes the FLAC segments and
+// requires them identical to the WAV segments and to the samples sent. The
+// client's CPU time per second of audio is reported for both formats.
+//
+// Build: g++ -std=gnu++20 -O2 -pthread -o flac_benchmark flac_benchmark.cpp
+// Run:   ./flac_benchmark [--seconds s] [--threads n] [file.wav|.flac...]
+//        ./flac_benchmark --client ./udp_client [--seconds s]
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "flac_decoder.h"
+#include "flac_encoder.h"
+
+namespace {
+
+const uint32_t SAMPLE_RATE = 16000;
+const uint32_t BLOCK_FRAMES = 4096; // as FlacSegment
+
+using flac_decoder::decode;
+using flac_decoder::Decoded;
+
+// --- encoding, the way FlacSegment lays out a file ---
+
+std::vector<uint8_t> encode(const std::vector<int16_t> &samples,
+                            uint16_t channels, uint32_t rate,
+                            uint32_t block_frames = BLOCK_FRAMES) {
+  flac::StreamInfo info;
+  info.block_frames = block_frames;
+  info.sample_rate = rate;
+  info.channels = channels;
+  std::vector<uint8_t> frames;
+  size_t total = samples.size() / channels;
+  uint32_t number = 0;
+  for (size_t first = 0; first < total; first += block_frames, number++) {
+    size_t count = std::min<size_t>(block_frames, total - first);
+    size_t start = frames.size();
+    flac::encode_frame(samples.data() + first * channels, count, channels,
+                       rate, number, block_frames, frames);
+    uint32_t size = static_cast<uint32_t>(frames.size() - start);
+    info.min_frame_bytes =
+        info.min_frame_bytes == 0 ? size : std::min(info.min_frame_bytes, size);
+    info.max_frame_bytes = std::max(info.max_frame_bytes, size);
+  }
+  info.total_frames = total;
+  flac::Md5 md5;
+  md5.update(samples.data(), samples.size() * sizeof(int16_t));
+  info.md5 = md5.finish();
+
+  std::vector<uint8_t> stream = flac::stream_header(info);
+  stream.insert(stream.end(), frames.begin(), frames.end());
+  return stream;
+}
+
+// --- test signals ---
+
+struct Random {
+  uint32_t state;
+  explicit Random(uint32_t seed) : state(seed) {}
+  uint32_t next() {
+    state = state * 1664525u + 1013904223u;
+    return state;
+  }
+  double uniform() { return (next() >> 8) / 16777216.0; } // [0, 1)
+};
+
+int16_t clip(double value) {
+  return static_cast<int16_t>(std::clamp(std::lround(value), -32768L, 32767L));
+}
+
+// voiced syllables at 4 Hz on a wandering pitch, with pauses and a little
+// background noise, roughly what the microphones pick up
+std::vector<int16_t> speech_like(size_t frames, uint16_t channels,
+                                 uint32_t seed, uint32_t rate = SAMPLE_RATE) {
+  std::vector<int16_t> out(frames * channels);
+  for (uint16_t c = 0; c < channels; c++) {
+    Random random(seed + c * 7919);
+    double phase = 0;
+    for (size_t i = 0; i < frames; i++) {
+      double t = static_cast<double>(i) / rate;
+      double pitch = 120 + 40 * std::sin(2 * M_PI * 0.3 * t + c);
+      phase += 2 * M_PI * pitch / rate;
+      double syllable = std::sin(2 * M_PI * 4 * t);
+      bool pause = std::fmod(t + 0.5 * c, 3.0) > 2.2;
+      double envelope = pause ? 0 : syllable * syllable;
+      double voice = 0;
+      for (int h = 1; h <= 12; h++) {
+        double formant = std::exp(-std::pow((h * pitch - 700) / 600, 2)) +
+                         0.5 * std::exp(-std::pow((h * pitch - 1800) / 500, 2));
+        voice += formant * std::sin(h * phase) / h;
+      }
+      double noise = (random.uniform() - 0.5) * 60;
+      out[i * channels + c] = clip(6000 * envelope * voice + noise);
+    }
+  }
+  return out;
+}
+
+struct Case {
+  std::string name;
+  std::vector<int16_t> samples;
+  uint16_t channels;
+  uint32_t block_frames = BLOCK_FRAMES;
+};
+
+std::vector<Case> test_cases() {
+  std::vector<Case> cases;
+  cases.push_back({"speech", speech_like(10 * SAMPLE_RATE + 1234, 1, 1), 1});
+  cases.push_back({"silence", std::vector<int16_t>(3 * SAMPLE_RATE, 0), 1});
+
+  Random random(2);
+  std::vector<int16_t> noise(2 * SAMPLE_RATE);
+  for (int16_t &sample : noise) {
+    sample = static_cast<int16_t>(random.next() >> 16);
+  }
+  cases.push_back({"full scale noise", noise, 1});
+
+  std::vector<int16_t> square(2 * SAMPLE_RATE);
+  for (size_t i = 0; i < square.size(); i++) {
+    square[i] = (i / 40) % 2 ? 32767 : -32768;
+  }
+  cases.push_back({"clipped square", square, 1});
+
+  // alternating extremes: the largest order-4 residuals 16-bit input gives
+  std::vector<int16_t> extremes(BLOCK_FRAMES * 2);
+  for (size_t i = 0; i < extremes.size(); i++) {
+    extremes[i] = i % 2 ? 32767 : -32768;
+  }
+  cases.push_back({"alternating extremes", extremes, 1});
+
+  for (uint16_t channels = 2; channels <= flac::MAX_CHANNELS; channels++) {
+    cases.push_back({std::to_string(channels) + " channels",
+                     speech_like(2 * SAMPLE_RATE + 77, channels, channels),
+                     channels});
+  }
+
+  // every block length up to 40 frames, and the 8/16-bit size codes
+  std::vector<int16_t> tail = speech_like(BLOCK_FRAMES * 2, 1, 9);
+  for (size_t frames = 1; frames <= 40; frames++) {
+    cases.push_back({"length " + std::to_string(frames),
+                     std::vector<int16_t>(tail.begin(), tail.begin() + frames),
+                     1});
+  }
+  for (size_t frames : {255, 256, 257, 4095, 4097, 8191}) {
+    cases.push_back({"length " + std::to_string(frames),
+                     std::vector<int16_t>(tail.begin(), tail.begin() + frames),
+                     1});
+  }
+  cases.push_back({"block 1152", speech_like(SAMPLE_RATE, 2, 4), 2, 1152});
+  return cases;
+}
+
+// --- round trips ---
+
+bool round_trip(const std::string &name, const std::vector<int16_t> &samples,
+                uint16_t channels, uint32_t rate, uint32_t block_frames,
+                bool report) {
+  std::vector<uint8_t> stream = encode(samples, channels, rate, block_frames);
+  Decoded decoded = decode(stream);
+  bool ok = decoded.error.empty() && decoded.samples == samples &&
+            decoded.channels == channels && decoded.md5_set;
+  if (!ok || report) {
+    std::cout << "  " << std::left << std::setw(28) << name << std::right;
+    if (!ok) {
+      std::cout << "FAILED "
+                << (decoded.error.empty() ? "samples differ" : decoded.error)
+                << std::endl;
+      return false;
+    }
+    std::cout << std::fixed << std::setprecision(1) << std::setw(6)
+              << 100.0 * stream.size() / (samples.size() * 2 + 44)
+              << "% of the WAV size" << std::endl;
+  }
+  return true;
+}
+
+// Samples of a WAV or RF64 file as the client writes them
+bool read_wav(const std::string &path, std::vector<int16_t> &samples,
+              uint16_t &channels, uint32_t &rate) {
+  std::ifstream file(path, std::ios::binary);
+  std::vector<char> data((std::istreambuf_iterator<char>(file)),
+                         std::istreambuf_iterator<char>());
+  if (data.size() < 12 || (std::memcmp(data.data(), "RIFF", 4) != 0 &&
+                           std::memcmp(data.data(), "RF64", 4) != 0)) {
+    return false;
+  }
+  channels = 0;
+  size_t offset = 12;
+  while (offset + 8 <= data.size()) {
+    uint32_t size;
+    std::memcpy(&size, &data[offset + 4], 4);
+    const char *id = &data[offset];
+    if (std::memcmp(id, "fmt ", 4) == 0 && offset + 24 <= data.size()) {
+      uint16_t bits;
+      std::memcpy(&channels, &data[offset + 10], 2);
+      std::memcpy(&rate, &data[offset + 12], 4);
+      std::memcpy(&bits, &data[offset + 22], 2);
+      if (bits != 16) {
+        return false;
+      }
+    } else if (std::memcmp(id, "data", 4) == 0) {
+      // 0 or 0xFFFFFFFF while recording or past 4 GiB: up to the end
+      size_t available = data.size() - offset - 8;
+      size_t bytes = size == 0 || size == UINT32_MAX
+                         ? available
+                         : std::min<size_t>(size, available);
+      if (channels == 0) {
+        return false;
+      }
+      bytes -= bytes % (channels * 2);
+      samples.resize(bytes / 2);
+      std::memcpy(samples.data(), &data[offset + 8], bytes);
+      return true;
+    }
+    offset += 8 + size + (size & 1);
+  }
+  return false;
+}
+
+double thread_cpu_seconds() {
+  timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// The frames of a mono signal, block by block as FlacSegment does
+void encode_frames(const std::vector<int16_t> &signal,
+                   std::vector<uint8_t> &out) {
+  out.clear();
+  uint32_t number = 0;
+  for (size_t first = 0; first < signal.size();
+       first += BLOCK_FRAMES, number++) {
+    size_t count = std::min<size_t>(BLOCK_FRAMES, signal.size() - first);
+    flac::encode_frame(signal.data() + first, count, 1, SAMPLE_RATE, number,
+                       BLOCK_FRAMES, out);
+  }
+}
+
+// --- end to end through the client ---
+
+// mirrors main/network/udp_protocol.h, as in receive_benchmark.cpp
+const uint16_t SERVER_PORT = 5001;
+const uint8_t PROTOCOL_VERSION = 1;
+const uint8_t MESSAGE_DATA = 0;
+const size_t SAMPLES_PER_PACKET = 480;
+const size_t HEADERS_SIZE = 12;
+
+std::vector<std::string> split_command(const std::string &command) {
+  std::istringstream words(command);
+  std::vector<std::string> args;
+  std::string word;
+  while (words >> word) {
+    args.push_back(word);
+  }
+  return args;
+}
+
+struct Recording {
+  bool ok = false;
+  std::vector<int16_t> samples; // all segments in order
+  size_t files = 0;
+  uint64_t file_bytes = 0;
+  double cpu_seconds = 0;
+  std::string error;
+};
+
+// Streams signal to the client at `speed` times real time and collects what
+// it wrote
+Recording record(const std::string &client, const std::vector<int16_t> &signal,
+                 double speed) {
+  Recording result;
+  std::filesystem::path dir =
+      std::filesystem::temp_directory_path() /
+      ("flac_benchmark_" + std::to_string(getpid()));
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+
+  int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  int enable = 1;
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(SERVER_PORT);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+    result.error = "failed to bind port " + std::to_string(SERVER_PORT);
+    close(sock);
+    return result;
+  }
+  timeval timeout = {2, 0};
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  std::string output = (dir / "client.txt").string();
+  pid_t pid = fork();
+  if (pid == 0) {
+    if (chdir(dir.c_str()) != 0) {
+      _exit(127);
+    }
+    int fd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    dup2(fd, STDOUT_FILENO);
+    dup2(fd, STDERR_FILENO);
+    std::vector<std::string> args = split_command(client);
+    args.push_back("127.0.0.1");
+    std::vector<char *> argv;
+    for (std::string &arg : args) {
+      argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+    execv(argv[0], argv.data());
+    _exit(127);
+  }
+
+  char buffer[64];
+  sockaddr_in client_addr = {};
+  socklen_t addr_len = sizeof(client_addr);
+  if (recvfrom(sock, buffer, sizeof(buffer), 0,
+               reinterpret_cast<sockaddr *>(&client_addr), &addr_len) < 0) {
+    result.error = client + " did not say hello";
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    close(sock);
+    std::filesystem::remove_all(dir);
+    return result;
+  }
+
+  std::vector<uint8_t> packet(HEADERS_SIZE + SAMPLES_PER_PACKET * 2);
+  packet[0] = MESSAGE_DATA;
+  packet[1] = PROTOCOL_VERSION;
+  packet[2] = 0; // PCM16
+  packet[3] = 16;
+  uint32_t packets = static_cast<uint32_t>(signal.size() / SAMPLES_PER_PACKET);
+  double rate = speed * SAMPLE_RATE / SAMPLES_PER_PACKET;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t sequence = 0; sequence < packets; sequence++) {
+    uint32_t sample_index = sequence * SAMPLES_PER_PACKET;
+    std::memcpy(&packet[4], &sequence, sizeof(sequence));
+    std::memcpy(&packet[8], &sample_index, sizeof(sample_index));
+    std::memcpy(&packet[HEADERS_SIZE], &signal[sample_index],
+                SAMPLES_PER_PACKET * 2);
+    std::this_thread::sleep_until(
+        start + std::chrono::duration<double>(sequence / rate));
+    sendto(sock, packet.data(), packet.size(), 0,
+           reinterpret_cast<sockaddr *>(&client_addr), sizeof(client_addr));
+  }
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  kill(pid, SIGINT);
+  int status = 0;
+  rusage usage = {};
+  pid_t exited = 0;
+  for (int i = 0; i < 100 && (exited = wait4(pid, &status, WNOHANG, &usage)) == 0; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  if (exited == 0) {
+    kill(pid, SIGKILL);
+    wait4(pid, &status, 0, &usage);
+  }
+  close(sock);
+  result.cpu_seconds = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+                       (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+
+  // <base>.ext sorts before <base>_001.ext
+  std::vector<std::filesystem::path> files;
+  for (const auto &entry : std::filesystem::directory_iterator(dir)) {
+    std::string extension = entry.path().extension().string();
+    if (extension == ".wav" || extension == ".flac") {
+      files.push_back(entry.path());
+    }
+  }
+  std::sort(files.begin(), files.end());
+  result.ok = !files.empty();
+  for (const auto &path : files) {
+    result.files++;
+    result.file_bytes += std::filesystem::file_size(path);
+    if (path.extension() == ".wav") {
+      std::vector<int16_t> samples;
+      uint16_t channels;
+      uint32_t rate;
+      if (!read_wav(path.string(), samples, channels, rate)) {
+        result.ok = false;
+        result.error = "unreadable " + path.filename().string();
+        break;
+      }
+      result.samples.insert(result.samples.end(), samples.begin(),
+                            samples.end());
+    } else {
+      std::ifstream file(path, std::ios::binary);
+      std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                                std::istreambuf_iterator<char>());
+      Decoded decoded = decode(data);
+      if (!decoded.error.empty() || !decoded.md5_set) {
+        result.ok = false;
+        result.error = path.filename().string() + ": " +
+                       (decoded.error.empty() ? "no MD5" : decoded.error);
+        break;
+      }
+      result.samples.insert(result.samples.end(), decoded.samples.begin(),
+                            decoded.samples.end());
+    }
+  }
+  if (files.empty()) {
+    result.error = "no recording, see the client output";
+  }
+  std::filesystem::remove_all(dir);
+  return result;
+}
+
+int run_client_check(const std::string &client, double seconds) {
+  std::vector<int16_t> signal =
+      speech_like(static_cast<size_t>(seconds * SAMPLE_RATE), 1, 5);
+  signal.resize(signal.size() / SAMPLES_PER_PACKET * SAMPLES_PER_PACKET);
+  double audio_seconds = static_cast<double>(signal.size()) / SAMPLE_RATE;
+  std::cout << "streaming " << audio_seconds
+            << " s of speech-like audio to the client twice, 2 s segments\n";
+
+  const double speed = 4; // faster than real time, still without loss
+  Recording wav = record(client + " --segment-seconds 2", signal, speed);
+  Recording flac = record(client + " --flac --segment-seconds 2", signal, speed);
+  for (const Recording *recording : {&wav, &flac}) {
+    if (!recording->ok) {
+      std::cout << (recording == &wav ? "WAV" : "FLAC")
+                << " recording failed: " << recording->error << std::endl;
+      return 1;
+    }
+  }
+
+  std::cout << std::fixed << std::setprecision(1);
+  std::cout << "  WAV   " << wav.files << " files, " << wav.file_bytes
+            << " bytes, client cpu " << wav.cpu_seconds * 1e3 / audio_seconds
+            << " ms per s of audio\n";
+  std::cout << "  FLAC  " << flac.files << " files, " << flac.file_bytes
+            << " bytes (" << 100.0 * flac.file_bytes / wav.file_bytes
+            << "%), client cpu " << flac.cpu_seconds * 1e3 / audio_seconds
+            << " ms per s of audio\n";
+
+  bool exact = flac.samples == wav.samples;
+  bool complete = wav.samples == signal;
+  std::cout << "decoded FLAC " << (exact ? "==" : "!=") << " WAV, WAV "
+            << (complete ? "==" : "!=") << " samples sent ("
+            << flac.samples.size() << " / " << wav.samples.size() << " / "
+            << signal.size() << " samples)" << std::endl;
+  return exact && complete ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  double seconds = 3.0;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  std::string client;
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--seconds" && i + 1 < argc) {
+      seconds = std::strtod(argv[++i], nullptr);
+    } else if (arg == "--threads" && i + 1 < argc) {
+      threads = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+    } else if (arg == "--client" && i + 1 < argc) {
+      // the client may come with options, only the path is made absolute
+      std::string command = argv[++i];
+      size_t end = command.find(' ');
+      client = std::filesystem::absolute(command.substr(0, end)).string() +
+               (end == std::string::npos ? "" : command.substr(end));
+    } else if (!arg.empty() && arg[0] != '-') {
+      files.push_back(arg);
+    } else {
+      std::cerr << "usage: " << argv[0]
+                << " [--seconds s] [--threads n] [file.wav|.flac...]\n"
+                << "       " << argv[0] << " --client ./udp_client [--seconds s]"
+                << std::endl;
+      return 1;
+    }
+  }
+  if (!client.empty()) {
+    return run_client_check(client, std::max(seconds, 10.0));
+  }
+
+  // round trips
+  bool ok = true;
+  if (files.empty()) {
+    std::vector<Case> cases = test_cases();
+    std::cout << "round trip of " << cases.size() << " test signals:\n";
+    for (const Case &test : cases) {
+      bool report = test.name.rfind("length ", 0) != 0;
+      ok &= round_trip(test.name, test.samples, test.channels, SAMPLE_RATE,
+                       test.block_frames, report);
+    }
+    std::cout << "  " << (ok ? "all bit-exact" : "FAILED") << "\n\n";
+  } else {
+    std::cout << "round trip of the WAV files, check of the FLAC files:\n";
+    for (const std::string &path : files) {
+      if (std::filesystem::path(path).extension() == ".flac") {
+        std::ifstream file(path, std::ios::binary);
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                                  std::istreambuf_iterator<char>());
+        Decoded decoded = decode(data);
+        std::cout << "  " << path << ": ";
+        if (!decoded.error.empty()) {
+          std::cout << "FAILED " << decoded.error << "\n";
+          ok = false;
+        } else {
+          std::cout << decoded.samples.size() / decoded.channels << " frames x "
+                    << decoded.channels << " at " << decoded.sample_rate
+                    << " Hz, " << (decoded.md5_set ? "MD5 ok" : "no MD5 yet")
+                    << "\n";
+        }
+        continue;
+      }
+      std::vector<int16_t> samples;
+      uint16_t channels;
+      uint32_t rate;
+      if (!read_wav(path, samples, channels, rate) ||
+          channels > flac::MAX_CHANNELS) {
+        std::cout << "  " << path << ": not a 16-bit WAV of 1-8 channels\n";
+        ok = false;
+        continue;
+      }
+      ok &= round_trip(path, samples, channels, rate, BLOCK_FRAMES, true);
+    }
+    std::cout << std::endl;
+  }
+
+  // throughput, one thread by its cpu time
+  std::vector<int16_t> signal = speech_like(60 * SAMPLE_RATE, 1, 3);
+  std::vector<uint8_t> out;
+  double cpu_start = thread_cpu_seconds(), cpu = 0;
+  size_t passes = 0;
+  for (; cpu < seconds; passes++) {
+    encode_frames(signal, out);
+    cpu = thread_cpu_seconds() - cpu_start;
+  }
+  double per_core = passes * signal.size() / cpu / SAMPLE_RATE;
+  std::cout << std::fixed << std::setprecision(1)
+            << "encoding 16 kHz mono speech-like audio in " << BLOCK_FRAMES
+            << " frame blocks, " << 100.0 * out.size() / (signal.size() * 2)
+            << "% of the PCM size:\n"
+            << "  1 thread:   " << std::setprecision(0) << per_core
+            << " real-time streams per core\n";
+
+  // the same work per thread on separate streams, by the wall clock
+  std::vector<std::thread> workers;
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned t = 0; t < threads; t++) {
+    workers.emplace_back([&, t] {
+      std::vector<int16_t> stream = speech_like(60 * SAMPLE_RATE, 1, 10 + t);
+      std::vector<uint8_t> frames;
+      for (size_t pass = 0; pass < passes; pass++) {
+        encode_frames(stream, frames);
+      }
+    });
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  double wall = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start).count();
+  std::cout << "  " << threads << " thread(s): "
+            << threads * passes * signal.size() / wall / SAMPLE_RATE
+            << " real-time streams on " << std::thread::hardware_concurrency()
+            << " core(s), signal generation included" << std::endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,386 @@
+// FLAC decoder for checking the recordings of udp_client.cpp, written from
+// RFC 9639 apart from flac_encoder.h so that a shared misreading of the spec
+// does not cancel out. It reads what the encoder writes (16-bit samples,
+// fixed block size, CONSTANT, VERBATIM and FIXED subframes) and rejects the
+// rest, and checks the frame CRCs, the frame numbers, the STREAMINFO totals
+// and the MD5 like `flac -t`.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "flac_encoder.h"
+
+namespace flac_decoder {
+
+class BitReader {
+public:
+  BitReader(const uint8_t *data, size_t size) : data(data), size(size) {}
+
+  uint32_t read(unsigned bits) {
+    uint32_t value = 0;
+    for (unsigned i = 0; i < bits; i++) {
+      if (position >= size * 8) {
+        overrun = true;
+        return 0;
+      }
+      value = (value << 1) | ((data[position / 8] >> (7 - position % 8)) & 1);
+      position++;
+    }
+    return value;
+  }
+
+  int32_t read_signed(unsigned bits) {
+    if (bits == 0) {
+      return 0;
+    }
+    uint32_t value = read(bits);
+    if (bits < 32 && (value >> (bits - 1)) & 1) {
+      value |= ~0u << bits;
+    }
+    return static_cast<int32_t>(value);
+  }
+
+  uint32_t read_unary() {
+    uint32_t zeros = 0;
+    while (read(1) == 0 && !overrun) {
+      zeros++;
+    }
+    return zeros;
+  }
+
+  int32_t read_rice(unsigned k) {
+    uint32_t folded = (read_unary() << k) | read(k);
+    return (folded & 1) ? -static_cast<int32_t>(folded >> 1) - 1
+                        : static_cast<int32_t>(folded >> 1);
+  }
+
+  void align() { position = (position + 7) / 8 * 8; }
+  size_t byte() const { return position / 8; }
+  bool failed() const { return overrun; }
+
+private:
+  const uint8_t *data;
+  size_t size;
+  size_t position = 0; // in bits
+  bool overrun = false;
+};
+
+struct Decoded {
+  uint32_t sample_rate = 0;
+  uint16_t channels = 0;
+  uint64_t declared_frames = 0;
+  bool md5_set = false;
+  std::vector<int16_t> samples; // interleaved
+  std::string error;
+};
+
+inline bool decode_residual(BitReader &bits, size_t n, unsigned order,
+                     int32_t *residual, std::string &error) {
+  uint32_t method = bits.read(2);
+  if (method > 1) {
+    error = "reserved residual coding method";
+    return false;
+  }
+  unsigned parameter_bits = method == 0 ? 4 : 5;
+  uint32_t escape = (1u << parameter_bits) - 1;
+  unsigned partition_order = bits.read(4);
+  size_t partition = n >> partition_order;
+  if ((partition << partition_order) != n || partition < order) {
+    error = "bad partition order";
+    return false;
+  }
+  size_t i = order;
+  for (size_t p = 0; p < (size_t{1} << partition_order); p++) {
+    uint32_t k = bits.read(parameter_bits);
+    size_t end = (p + 1) * partition;
+    if (k == escape) {
+      unsigned raw = bits.read(5);
+      for (; i < end; i++) {
+        residual[i] = bits.read_signed(raw);
+      }
+    } else {
+      for (; i < end; i++) {
+        residual[i] = bits.read_rice(k);
+      }
+    }
+  }
+  return !bits.failed();
+}
+
+inline bool decode_subframe(BitReader &bits, size_t n, std::vector<int32_t> &out,
+                     std::string &error) {
+  const unsigned sample_bits = 16;
+  out.assign(n, 0);
+  if (bits.read(1) != 0) {
+    error = "subframe padding bit set";
+    return false;
+  }
+  uint32_t type = bits.read(6);
+  unsigned wasted = 0;
+  if (bits.read(1)) {
+    wasted = bits.read_unary() + 1;
+  }
+  unsigned sbits = sample_bits - wasted;
+
+  if (type == 0) {
+    int32_t value = bits.read_signed(sbits);
+    std::fill(out.begin(), out.end(), value);
+  } else if (type == 1) {
+    for (size_t i = 0; i < n; i++) {
+      out[i] = bits.read_signed(sbits);
+    }
+  } else if ((type & 0x38) == 0x08 && (type & 7) <= 4) {
+    unsigned order = type & 7;
+    if (order > n) {
+      error = "fixed order above the block size";
+      return false;
+    }
+    for (unsigned i = 0; i < order; i++) {
+      out[i] = bits.read_signed(sbits);
+    }
+    if (!decode_residual(bits, n, order, out.data(), error)) {
+      return false;
+    }
+    static const int64_t COEFFICIENTS[5][4] = {
+        {0, 0, 0, 0}, {1, 0, 0, 0}, {2, -1, 0, 0}, {3, -3, 1, 0},
+        {4, -6, 4, -1}};
+    for (size_t i = order; i < n; i++) {
+      int64_t prediction = 0;
+      for (unsigned j = 0; j < order; j++) {
+        prediction += COEFFICIENTS[order][j] * out[i - 1 - j];
+      }
+      out[i] = static_cast<int32_t>(out[i] + prediction);
+    }
+  } else if (type & 0x20) {
+    unsigned order = (type & 0x1F) + 1;
+    if (order > n) {
+      error = "LPC order above the block size";
+      return false;
+    }
+    for (unsigned i = 0; i < order; i++) {
+      out[i] = bits.read_signed(sbits);
+    }
+    unsigned precision = bits.read(4) + 1;
+    int shift = bits.read_signed(5);
+    if (precision == 16 || shift < 0) {
+      error = "bad LPC precision or shift";
+      return false;
+    }
+    std::vector<int64_t> coefficients(order);
+    for (unsigned j = 0; j < order; j++) {
+      coefficients[j] = bits.read_signed(precision);
+    }
+    if (!decode_residual(bits, n, order, out.data(), error)) {
+      return false;
+    }
+    for (size_t i = order; i < n; i++) {
+      int64_t sum = 0;
+      for (unsigned j = 0; j < order; j++) {
+        sum += coefficients[j] * out[i - 1 - j];
+      }
+      out[i] = static_cast<int32_t>(out[i] + (sum >> shift));
+    }
+  } else {
+    error = "reserved subframe type";
+    return false;
+  }
+  for (int32_t &sample : out) {
+    sample = static_cast<int32_t>(static_cast<uint32_t>(sample) << wasted);
+  }
+  return !bits.failed();
+}
+
+// One frame at data[offset], its samples appended to result. Returns the
+// frame size, 0 on error.
+inline size_t decode_frame(const std::vector<uint8_t> &data, size_t offset,
+                    uint64_t expected_number, Decoded &result) {
+  BitReader bits(data.data() + offset, data.size() - offset);
+  if (bits.read(14) != 0x3FFE || bits.read(1) != 0) {
+    result.error = "no frame sync";
+    return 0;
+  }
+  if (bits.read(1) != 0) {
+    result.error = "variable block size stream";
+    return 0;
+  }
+  uint32_t size_code = bits.read(4);
+  uint32_t rate_code = bits.read(4);
+  uint32_t assignment = bits.read(4);
+  uint32_t size_bits = bits.read(3);
+  if (bits.read(1) != 0 || size_code == 0 || rate_code == 15 ||
+      assignment > 7 || (size_bits != 4 && size_bits != 0)) {
+    result.error = "unsupported or invalid frame header";
+    return 0;
+  }
+  if (assignment + 1u != result.channels) {
+    result.error = "channel count differs from STREAMINFO";
+    return 0;
+  }
+
+  // frame number, UTF-8 style
+  uint32_t first = bits.read(8);
+  unsigned extra = 0;
+  while (extra < 7 && (first & (0x80 >> extra))) {
+    extra++;
+  }
+  if (extra == 1 || extra > 6) {
+    result.error = "bad frame number coding";
+    return 0;
+  }
+  uint64_t number = extra == 0 ? first : first & (0x7F >> extra);
+  for (unsigned i = 1; i < extra; i++) {
+    uint32_t next = bits.read(8);
+    if ((next & 0xC0) != 0x80) {
+      result.error = "bad frame number coding";
+      return 0;
+    }
+    number = (number << 6) | (next & 0x3F);
+  }
+  if (number != expected_number) {
+    result.error = "frame " + std::to_string(number) + " where " +
+                   std::to_string(expected_number) + " was due";
+    return 0;
+  }
+
+  size_t n;
+  if (size_code == 1) {
+    n = 192;
+  } else if (size_code <= 5) {
+    n = 576u << (size_code - 2);
+  } else if (size_code == 6) {
+    n = bits.read(8) + 1;
+  } else if (size_code == 7) {
+    n = bits.read(16) + 1;
+  } else {
+    n = 256u << (size_code - 8);
+  }
+  static const uint32_t RATES[12] = {0,     88200, 176400, 192000,
+                                     8000,  16000, 22050,  24000,
+                                     32000, 44100, 48000,  96000};
+  uint32_t rate = rate_code < 12    ? RATES[rate_code]
+                  : rate_code == 12 ? bits.read(8) * 1000
+                  : rate_code == 13 ? bits.read(16)
+                                    : bits.read(16) * 10;
+  if (rate != 0 && rate != result.sample_rate) {
+    result.error = "sample rate differs from STREAMINFO";
+    return 0;
+  }
+  size_t header_bytes = bits.byte();
+  if (bits.read(8) != flac::crc8(data.data() + offset, header_bytes)) {
+    result.error = "frame header CRC mismatch";
+    return 0;
+  }
+
+  std::vector<std::vector<int32_t>> channels(result.channels);
+  for (auto &channel : channels) {
+    if (!decode_subframe(bits, n, channel, result.error)) {
+      return 0;
+    }
+  }
+  bits.align();
+  size_t body_bytes = bits.byte();
+  if (bits.read(16) != flac::crc16(data.data() + offset, body_bytes) ||
+      bits.failed()) {
+    result.error = "frame CRC mismatch";
+    return 0;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    for (auto &channel : channels) {
+      if (channel[i] < INT16_MIN || channel[i] > INT16_MAX) {
+        result.error = "sample out of range";
+        return 0;
+      }
+      result.samples.push_back(static_cast<int16_t>(channel[i]));
+    }
+  }
+  return body_bytes + 2;
+}
+
+inline Decoded decode(const std::vector<uint8_t> &data) {
+  Decoded result;
+  if (data.size() < flac::STREAM_HEADER_SIZE ||
+      std::memcmp(data.data(), "fLaC", 4) != 0) {
+    result.error = "not a FLAC stream";
+    return result;
+  }
+  std::array<uint8_t, 16> md5{};
+  size_t offset = 4;
+  bool last = false, have_info = false;
+  while (!last) {
+    if (offset + 4 > data.size()) {
+      result.error = "truncated metadata";
+      return result;
+    }
+    BitReader header(data.data() + offset, 4);
+    last = header.read(1);
+    uint32_t type = header.read(7);
+    uint32_t length = header.read(24);
+    if (offset + 4 + length > data.size()) {
+      result.error = "truncated metadata";
+      return result;
+    }
+    if (type == 0) {
+      BitReader info(data.data() + offset + 4, length);
+      info.read(16); // block sizes
+      info.read(16);
+      info.read(24); // frame sizes
+      info.read(24);
+      result.sample_rate = info.read(20);
+      result.channels = static_cast<uint16_t>(info.read(3) + 1);
+      if (info.read(5) + 1 != 16) {
+        result.error = "not 16 bits per sample";
+        return result;
+      }
+      result.declared_frames = static_cast<uint64_t>(info.read(4)) << 32;
+      result.declared_frames |= info.read(32);
+      for (uint8_t &byte : md5) {
+        byte = static_cast<uint8_t>(info.read(8));
+      }
+      have_info = true;
+    }
+    offset += 4 + length;
+  }
+  if (!have_info) {
+    result.error = "no STREAMINFO";
+    return result;
+  }
+
+  for (uint64_t number = 0; offset < data.size(); number++) {
+    size_t frame = decode_frame(data, offset, number, result);
+    if (frame == 0) {
+      result.error += " at byte " + std::to_string(offset);
+      return result;
+    }
+    offset += frame;
+  }
+
+  uint64_t frames = result.samples.size() / result.channels;
+  if (result.declared_frames != 0 && result.declared_frames != frames) {
+    result.error = "STREAMINFO counts " +
+                   std::to_string(result.declared_frames) + " frames, found " +
+                   std::to_string(frames);
+    return result;
+  }
+  result.md5_set = md5 != std::array<uint8_t, 16>{};
+  if (result.md5_set) {
+    flac::Md5 check;
+    for (int16_t sample : result.samples) {
+      uint8_t bytes[2] = {static_cast<uint8_t>(sample),
+                          static_cast<uint8_t>(static_cast<uint16_t>(sample) >> 8)};
+      check.update(bytes, 2);
+    }
+    if (check.finish() != md5) {
+      result.error = "MD5 mismatch";
+    }
+  }
+  return result;
+}
+
+} // namespace flac_decoder
@@ -0,0 +1,517 @@
+// FLAC encoder for the compressed recordings of udp_client.cpp (RFC 9639).
+//
+// A streamable subset that any FLAC decoder reads: 16-bit samples, up to 8
+// independently coded channels, fixed-blocksize frames. Each subframe is the
+// cheapest of CONSTANT (VAD silence), VERBATIM and FIXED: the polynomial
+// predictors of order 0-4, with the residual Rice coded in up to 2^8
+// partitions that each get their own parameter. No LPC search and no stereo
+// decorrelation (the channels are separate devices), so the ratio is about
+// that of `flac -1`, at a small fraction of the CPU of the higher levels.
+//
+// encode_frame() has no state beyond its arguments, so the blocks of a stream
+// can be encoded on any number of threads and written in frame order.
+// flac_benchmark.cpp decodes the output independently to check it.
+//
+// Header only so the client keeps its one-line build.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace flac {
+
+const size_t STREAM_HEADER_SIZE = 42; // "fLaC" + STREAMINFO block
+const uint16_t MAX_CHANNELS = 8;
+const size_t MAX_BLOCK_FRAMES = 65535;
+
+// --- checksums ---
+
+inline const std::array<uint8_t, 256> &crc8_table() {
+  static const std::array<uint8_t, 256> table = [] {
+    std::array<uint8_t, 256> t{};
+    for (int i = 0; i < 256; i++) {
+      uint8_t crc = static_cast<uint8_t>(i);
+      for (int bit = 0; bit < 8; bit++) {
+        crc = static_cast<uint8_t>((crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1);
+      }
+      t[i] = crc;
+    }
+    return t;
+  }();
+  return table;
+}
+
+inline const std::array<uint16_t, 256> &crc16_table() {
+  static const std::array<uint16_t, 256> table = [] {
+    std::array<uint16_t, 256> t{};
+    for (int i = 0; i < 256; i++) {
+      uint16_t crc = static_cast<uint16_t>(i << 8);
+      for (int bit = 0; bit < 8; bit++) {
+        crc = static_cast<uint16_t>((crc & 0x8000) ? (crc << 1) ^ 0x8005
+                                                   : crc << 1);
+      }
+      t[i] = crc;
+    }
+    return t;
+  }();
+  return table;
+}
+
+// frame header check, x^8 + x^2 + x + 1
+inline uint8_t crc8(const uint8_t *data, size_t size) {
+  uint8_t crc = 0;
+  for (size_t i = 0; i < size; i++) {
+    crc = crc8_table()[crc ^ data[i]];
+  }
+  return crc;
+}
+
+// whole frame check, x^16 + x^15 + x^2 + 1
+inline uint16_t crc16(const uint8_t *data, size_t size) {
+  uint16_t crc = 0;
+  for (size_t i = 0; i < size; i++) {
+    crc = static_cast<uint16_t>((crc << 8) ^ crc16_table()[(crc >> 8) ^ data[i]]);
+  }
+  return crc;
+}
+
+// RFC 1321, for the STREAMINFO signature of the decoded audio
+class Md5 {
+public:
+  void update(const void *data, size_t size) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    length += size;
+    while (size > 0) {
+      size_t count = std::min(size, sizeof(block) - used);
+      std::memcpy(block + used, bytes, count);
+      used += count;
+      bytes += count;
+      size -= count;
+      if (used == sizeof(block)) {
+        transform(block);
+        used = 0;
+      }
+    }
+  }
+
+  std::array<uint8_t, 16> finish() {
+    uint64_t bits = length * 8;
+    uint8_t pad = 0x80;
+    update(&pad, 1);
+    pad = 0;
+    while (used != 56) {
+      update(&pad, 1);
+    }
+    uint8_t size_bytes[8];
+    for (int i = 0; i < 8; i++) {
+      size_bytes[i] = static_cast<uint8_t>(bits >> (8 * i));
+    }
+    update(size_bytes, 8);
+
+    std::array<uint8_t, 16> digest;
+    for (int i = 0; i < 4; i++) {
+      for (int b = 0; b < 4; b++) {
+        digest[i * 4 + b] = static_cast<uint8_t>(state[i] >> (8 * b));
+      }
+    }
+    return digest;
+  }
+
+private:
+  static uint32_t rotate(uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+
+  void transform(const uint8_t *chunk) {
+    static const uint32_t K[64] = {
+        0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a,
+        0xa8304613, 0xfd469501, 0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+        0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821, 0xf61e2562, 0xc040b340,
+        0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+        0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8,
+        0x676f02d9, 0x8d2a4c8a, 0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+        0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70, 0x289b7ec6, 0xeaa127fa,
+        0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+        0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92,
+        0xffeff47d, 0x85845dd1, 0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+        0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391};
+    static const int SHIFT[64] = {7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+                                  7, 12, 17, 22, 5, 9,  14, 20, 5, 9,  14, 20,
+                                  5, 9,  14, 20, 5, 9,  14, 20, 4, 11, 16, 23,
+                                  4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+                                  6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21,
+                                  6, 10, 15, 21};
+    uint32_t m[16];
+    for (int i = 0; i < 16; i++) {
+      m[i] = static_cast<uint32_t>(chunk[i * 4]) |
+             static_cast<uint32_t>(chunk[i * 4 + 1]) << 8 |
+             static_cast<uint32_t>(chunk[i * 4 + 2]) << 16 |
+             static_cast<uint32_t>(chunk[i * 4 + 3]) << 24;
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    for (int i = 0; i < 64; i++) {
+      uint32_t f;
+      int g;
+      if (i < 16) {
+        f = (b & c) | (~b & d);
+        g = i;
+      } else if (i < 32) {
+        f = (d & b) | (~d & c);
+        g = (5 * i + 1) % 16;
+      } else if (i < 48) {
+        f = b ^ c ^ d;
+        g = (3 * i + 5) % 16;
+      } else {
+        f = c ^ (b | ~d);
+        g = (7 * i) % 16;
+      }
+      uint32_t next = d;
+      d = c;
+      c = b;
+      b = b + rotate(a + f + K[i] + m[g], SHIFT[i]);
+      a = next;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+  }
+
+  uint32_t state[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+  uint8_t block[64];
+  size_t used = 0;
+  uint64_t length = 0;
+};
+
+// --- bitstream ---
+
+// MSB first into a byte vector
+class BitWriter {
+public:
+  explicit BitWriter(std::vector<uint8_t> &out) : out(out) {}
+
+  // bits <= 32, the value's higher bits are ignored
+  void write(uint32_t value, unsigned bits) {
+    if (bits == 0) {
+      return;
+    }
+    uint64_t mask = (1ull << bits) - 1;
+    accumulator = (accumulator << bits) | (value & mask);
+    pending += bits;
+    while (pending >= 8) {
+      pending -= 8;
+      out.push_back(static_cast<uint8_t>(accumulator >> pending));
+    }
+  }
+
+  void write_signed(int32_t value, unsigned bits) {
+    write(static_cast<uint32_t>(value), bits);
+  }
+
+  // q zero bits, a one, then the k low bits of u
+  void write_rice(uint32_t u, unsigned k) {
+    uint32_t q = u >> k;
+    if (q + 1 + k <= 32) {
+      write((1u << k) | (u & ((1u << k) - 1)), q + 1 + k);
+      return;
+    }
+    for (; q >= 32; q -= 32) {
+      write(0, 32);
+    }
+    write(1, q + 1);
+    write(u, k);
+  }
+
+  // the UTF-8 like coding of frame numbers, up to 31 bits
+  void write_coded_number(uint32_t value) {
+    if (value < 0x80) {
+      write(value, 8);
+      return;
+    }
+    int extra = value < 0x800 ? 1 : value < 0x10000 ? 2 : value < 0x200000 ? 3
+                : value < 0x4000000 ? 4 : 5;
+    uint32_t lead = (0xFF00u >> (extra + 1)) & 0xFF;
+    write(lead | (value >> (6 * extra)), 8);
+    for (int i = extra - 1; i >= 0; i--) {
+      write(0x80 | ((value >> (6 * i)) & 0x3F), 8);
+    }
+  }
+
+  void align() {
+    if (pending > 0) {
+      write(0, 8 - pending);
+    }
+  }
+
+private:
+  std::vector<uint8_t> &out;
+  uint64_t accumulator = 0;
+  unsigned pending = 0; // bits in the accumulator not yet in out
+};
+
+// --- stream header ---
+
+struct StreamInfo {
+  uint32_t block_frames = 4096;
+  uint32_t min_frame_bytes = 0; // 0: unknown
+  uint32_t max_frame_bytes = 0;
+  uint32_t sample_rate = 16000;
+  uint16_t channels = 1;
+  uint64_t total_frames = 0;    // 0: unknown
+  std::array<uint8_t, 16> md5{}; // all zero: not computed
+};
+
+// "fLaC" and the STREAMINFO block, STREAM_HEADER_SIZE bytes. Rewriting it in
+// place keeps the file's totals current.
+inline std::vector<uint8_t> stream_header(const StreamInfo &info) {
+  std::vector<uint8_t> out = {'f', 'L', 'a', 'C'};
+  BitWriter bits(out);
+  bits.write(1, 1);  // last metadata block
+  bits.write(0, 7);  // STREAMINFO
+  bits.write(34, 24);
+  bits.write(info.block_frames, 16);
+  bits.write(info.block_frames, 16);
+  bits.write(info.min_frame_bytes, 24);
+  bits.write(info.max_frame_bytes, 24);
+  bits.write(info.sample_rate, 20);
+  bits.write(info.channels - 1u, 3);
+  bits.write(16 - 1, 5);
+  bits.write(static_cast<uint32_t>(info.total_frames >> 32), 4);
+  bits.write(static_cast<uint32_t>(info.total_frames), 32);
+  for (uint8_t byte : info.md5) {
+    bits.write(byte, 8);
+  }
+  return out;
+}
+
+// --- frames ---
+
+namespace detail {
+
+const unsigned MAX_FIXED_ORDER = 4;
+const unsigned MAX_PARTITION_ORDER = 8;
+const unsigned MAX_RICE_PARAMETER = 14; // 15 is the escape code
+
+inline uint32_t fold(int32_t residual) {
+  return (static_cast<uint32_t>(residual) << 1) ^
+         static_cast<uint32_t>(residual >> 31);
+}
+
+// the parameter for a partition of n folded residuals summing to sum, and
+// the bits it would take (close to exact)
+inline unsigned rice_parameter(uint64_t sum, size_t n, uint64_t &bits) {
+  unsigned k = 0;
+  while (k < MAX_RICE_PARAMETER && (static_cast<uint64_t>(n) << (k + 1)) < sum) {
+    k++;
+  }
+  bits = 4 + n * (k + 1) + (sum >> k);
+  return k;
+}
+
+// order-n differences of samples[i], i >= n
+inline int32_t fixed_residual(const int32_t *s, size_t i, unsigned order) {
+  switch (order) {
+  case 0:
+    return s[i];
+  case 1:
+    return s[i] - s[i - 1];
+  case 2:
+    return s[i] - 2 * s[i - 1] + s[i - 2];
+  case 3:
+    return s[i] - 3 * s[i - 1] + 3 * s[i - 2] - s[i - 3];
+  default:
+    return s[i] - 4 * s[i - 1] + 6 * s[i - 2] - 4 * s[i - 3] + s[i - 4];
+  }
+}
+
+// one channel of a block as a CONSTANT, VERBATIM or FIXED subframe
+inline void encode_subframe(const int32_t *s, size_t n, BitWriter &bits,
+                            std::vector<uint32_t> &folded) {
+  bool constant = true;
+  for (size_t i = 1; i < n && constant; i++) {
+    constant = s[i] == s[0];
+  }
+  if (constant) {
+    bits.write(0x00, 8); // padding bit, CONSTANT, no wasted bits
+    bits.write_signed(s[0], 16);
+    return;
+  }
+  auto verbatim = [&] {
+    bits.write(0x02, 8);
+    for (size_t i = 0; i < n; i++) {
+      bits.write_signed(s[i], 16);
+    }
+  };
+  if (n <= MAX_FIXED_ORDER) {
+    verbatim(); // too short to predict anything
+    return;
+  }
+
+  // the order with the smallest residual magnitude, from one pass over all;
+  // e<k> is the order-k difference
+  uint64_t totals[MAX_FIXED_ORDER + 1] = {};
+  for (size_t i = MAX_FIXED_ORDER; i < n; i++) {
+    int32_t d1 = s[i - 1] - s[i - 2], d2 = s[i - 2] - s[i - 3];
+    int32_t d3 = s[i - 3] - s[i - 4];
+    int32_t e0 = s[i];
+    int32_t e1 = e0 - s[i - 1];
+    int32_t e2 = e1 - d1;
+    int32_t e3 = e2 - (d1 - d2);
+    int32_t e4 = e3 - ((d1 - d2) - (d2 - d3));
+    totals[0] += static_cast<uint32_t>(e0 < 0 ? -e0 : e0);
+    totals[1] += static_cast<uint32_t>(e1 < 0 ? -e1 : e1);
+    totals[2] += static_cast<uint32_t>(e2 < 0 ? -e2 : e2);
+    totals[3] += static_cast<uint32_t>(e3 < 0 ? -e3 : e3);
+    totals[4] += static_cast<uint32_t>(e4 < 0 ? -e4 : e4);
+  }
+  unsigned order = 0;
+  for (unsigned o = 1; o <= MAX_FIXED_ORDER; o++) {
+    if (totals[o] < totals[order]) {
+      order = o;
+    }
+  }
+
+  folded.resize(n);
+  for (size_t i = order; i < n; i++) {
+    folded[i] = fold(fixed_residual(s, i, order));
+  }
+
+  // sums per partition at the finest order, merged pairwise for the coarser
+  unsigned max_order = 0;
+  while (max_order < MAX_PARTITION_ORDER && n % (2u << max_order) == 0 &&
+         (n >> (max_order + 1)) > order) {
+    max_order++;
+  }
+  std::vector<uint64_t> sums(1u << max_order, 0);
+  size_t part = n >> max_order;
+  for (size_t p = 0; p < sums.size(); p++) {
+    for (size_t i = std::max(p * part, static_cast<size_t>(order));
+         i < (p + 1) * part; i++) {
+      sums[p] += folded[i];
+    }
+  }
+
+  uint64_t best_bits = UINT64_MAX;
+  unsigned best_order = 0;
+  std::vector<uint8_t> best_parameters, parameters;
+  for (int porder = static_cast<int>(max_order); porder >= 0; porder--) {
+    size_t partitions = 1u << porder;
+    size_t samples = n >> porder;
+    uint64_t total = 0;
+    parameters.resize(partitions);
+    for (size_t p = 0; p < partitions; p++) {
+      size_t count = samples - (p == 0 ? order : 0);
+      uint64_t partition_bits;
+      parameters[p] = static_cast<uint8_t>(rice_parameter(sums[p], count,
+                                                          partition_bits));
+      total += partition_bits;
+    }
+    if (total < best_bits) {
+      best_bits = total;
+      best_order = static_cast<unsigned>(porder);
+      best_parameters = parameters;
+    }
+    // the next coarser order
+    for (size_t p = 0; p < partitions / 2; p++) {
+      sums[p] = sums[2 * p] + sums[2 * p + 1];
+    }
+  }
+
+  if (order * 16 + 6 + best_bits >= n * 16) {
+    verbatim(); // noise, prediction does not pay
+    return;
+  }
+
+  bits.write(0x10 | (order << 1), 8); // FIXED of this order
+  for (size_t i = 0; i < order; i++) {
+    bits.write_signed(s[i], 16); // warm-up
+  }
+  bits.write(0, 2); // Rice coding with 4-bit parameters
+  bits.write(best_order, 4);
+  size_t samples = n >> best_order;
+  for (size_t p = 0; p < best_parameters.size(); p++) {
+    unsigned k = best_parameters[p];
+    bits.write(k, 4);
+    for (size_t i = std::max(p * samples, static_cast<size_t>(order));
+         i < (p + 1) * samples; i++) {
+      bits.write_rice(folded[i], k);
+    }
+  }
+}
+
+inline uint32_t sample_rate_code(uint32_t rate) {
+  switch (rate) {
+  case 8000:
+    return 0x4;
+  case 16000:
+    return 0x5;
+  case 22050:
+    return 0x6;
+  case 24000:
+    return 0x7;
+  case 32000:
+    return 0x8;
+  case 44100:
+    return 0x9;
+  case 48000:
+    return 0xA;
+  case 96000:
+    return 0xB;
+  default:
+    return 0x0; // from STREAMINFO
+  }
+}
+
+} // namespace detail
+
+// Appends one frame holding `frames` interleaved frames (1..MAX_BLOCK_FRAMES)
+// to out. Every frame but the stream's last must have the block size from
+// the StreamInfo, and frame_number counts from 0.
+inline void encode_frame(const int16_t *interleaved, size_t frames,
+                         uint16_t channels, uint32_t sample_rate,
+                         uint32_t frame_number, uint32_t block_frames,
+                         std::vector<uint8_t> &out) {
+  size_t start = out.size();
+  BitWriter bits(out);
+
+  uint32_t size_code;
+  if (frames == block_frames && block_frames == 4096) {
+    size_code = 0xC;
+  } else if (frames <= 256) {
+    size_code = 0x6; // 8-bit size - 1 after the header
+  } else {
+    size_code = 0x7; // 16-bit size - 1 after the header
+  }
+  bits.write(0x3FFE, 14); // sync
+  bits.write(0, 1);
+  bits.write(0, 1); // fixed block size, frame numbers
+  bits.write(size_code, 4);
+  bits.write(detail::sample_rate_code(sample_rate), 4);
+  bits.write(channels - 1u, 4); // independent channels
+  bits.write(0x4, 3);           // 16 bits per sample
+  bits.write(0, 1);
+  bits.write_coded_number(frame_number);
+  if (size_code == 0x6) {
+    bits.write(static_cast<uint32_t>(frames - 1), 8);
+  } else if (size_code == 0x7) {
+    bits.write(static_cast<uint32_t>(frames - 1), 16);
+  }
+  bits.write(crc8(out.data() + start, out.size() - start), 8);
+
+  std::vector<int32_t> channel(frames);
+  std::vector<uint32_t> folded;
+  for (uint16_t c = 0; c < channels; c++) {
+    for (size_t i = 0; i < frames; i++) {
+      channel[i] = interleaved[i * channels + c];
+    }
+    detail::encode_subframe(channel.data(), frames, bits, folded);
+  }
+
+  bits.align();
+  uint16_t crc = crc16(out.data() + start, out.size() - start);
+  bits.write(crc, 16);
+}
+
+} // namespace flac
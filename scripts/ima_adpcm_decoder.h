@@ -0,0 +1,62 @@
+// IMA-ADPCM decoding for udp_client.cpp, the client side of the device's
+// compressed stream.
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// IMA-ADPCM block decoder, mirrors main/audio/ima_adpcm.cpp. A block is an
+// int16 predictor, a uint8 step index, a uint8 flags byte (bit 0: the last
+// high nibble is padding) and two 4-bit codes per byte, low nibble first.
+namespace ima_adpcm {
+const int16_t STEP_TABLE[89] = {
+    7,     8,     9,     10,    11,    12,    13,    14,    16,    17,
+    19,    21,    23,    25,    28,    31,    34,    37,    41,    45,
+    50,    55,    60,    66,    73,    80,    88,    97,    107,   118,
+    130,   143,   157,   173,   190,   209,   230,   253,   279,   307,
+    337,   371,   408,   449,   494,   544,   598,   658,   724,   796,
+    876,   963,   1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+    2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,
+    5894,  6484,  7132,  7845,  8630,  9493,  10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+const int8_t INDEX_TABLE[16] = {-1, -1, -1, -1, 2, 4, 6, 8,
+                                -1, -1, -1, -1, 2, 4, 6, 8};
+const size_t BLOCK_HEADER_SIZE = 4;
+
+// Returns the number of samples written to out (at most 2 per payload byte)
+inline size_t decode_block(const uint8_t *block, size_t bytes, int16_t *out) {
+  if (bytes < BLOCK_HEADER_SIZE) {
+    return 0;
+  }
+  int16_t header_predictor;
+  std::memcpy(&header_predictor, block, sizeof(header_predictor));
+  int32_t predictor = header_predictor;
+  int32_t step_index = std::min<int32_t>(block[2], 88);
+
+  size_t data_bytes = bytes - BLOCK_HEADER_SIZE;
+  size_t samples = data_bytes * 2;
+  if (data_bytes > 0 && (block[3] & 0x01)) {
+    samples--;
+  }
+
+  const uint8_t *data = block + BLOCK_HEADER_SIZE;
+  for (size_t i = 0; i < samples; i++) {
+    uint8_t code = (i & 1) ? (data[i / 2] >> 4) : (data[i / 2] & 0x0F);
+    int32_t step = STEP_TABLE[step_index];
+    int32_t diff = step >> 3;
+    if (code & 4)
+      diff += step;
+    if (code & 2)
+      diff += step >> 1;
+    if (code & 1)
+      diff += step >> 2;
+    predictor = (code & 8) ? predictor - diff : predictor + diff;
+    predictor = std::max<int32_t>(-32768, std::min<int32_t>(32767, predictor));
+    step_index = std::max(0, std::min(88, step_index + INDEX_TABLE[code]));
+    out[i] = static_cast<int16_t>(predictor);
+  }
+  return samples;
+}
+} // namespace ima_adpcm
@@ -0,0 +1,274 @@
+// Receive side reordering and loss concealment of udp_client.cpp, and the
+// receiver reports the device's congestion control is fed from.
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "client_protocol.h"
+
+// Reorders packets by their sample index and hands a gapless timeline to the
+// sink. Missing packets are waited for while the buffered audio beyond the gap
+// is shorter than the (adaptive) target depth, then concealed.
+class JitterBuffer {
+public:
+  using Sink = std::function<void(const int16_t *, size_t)>;
+
+  struct Stats {
+    uint64_t received_packets = 0;
+    uint64_t lost_packets = 0;      // sequence numbers never seen
+    uint64_t reordered_packets = 0; // arrived after a later sequence number
+    uint64_t late_packets = 0;      // arrived after their slot was played out
+    uint64_t concealed_samples = 0;
+    size_t target_depth_samples = 0;
+    size_t packet_samples = 0; // the longest packet, the depth's unit
+  };
+
+  explicit JitterBuffer(Sink sink) : sink(std::move(sink)) {}
+
+  // Never shrink the window below this many packets, e.g. to give a parity
+  // packet time to arrive before its group is concealed.
+  void set_min_depth(size_t packets) {
+    std::lock_guard<std::mutex> lock(mutex);
+    min_depth_packets = std::min(std::max(packets, MIN_DEPTH_PACKETS),
+                                 MAX_DEPTH_PACKETS);
+    target_depth = std::max(target_depth, min_depth_packets * packet_samples);
+  }
+
+  // silence: expanded from a SILENCE descriptor, a run of many packets that
+  // must not count towards the packet size the window is measured in
+  void push(uint32_t sequence, uint32_t sample_index, const int16_t *samples,
+            size_t count, bool silence = false) {
+    if (count == 0) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (!started) {
+      started = true;
+      next_index = sample_index;
+      highest_sequence = static_cast<int64_t>(sequence) - 1;
+      first_sequence = sequence;
+      newest_end = next_index;
+      packet_samples = 0;
+      target_depth = 0;
+    }
+    if (!silence && count > packet_samples) {
+      if (packet_samples == 0) {
+        target_depth = std::max(target_depth, min_depth_packets * count);
+      }
+      packet_samples = count;
+    }
+
+    // unwrap the 32-bit counters relative to what we have already seen
+    int64_t index = next_index + static_cast<int32_t>(
+                                     sample_index - static_cast<uint32_t>(next_index));
+    int64_t seq = highest_sequence + static_cast<int32_t>(
+                                         sequence - static_cast<uint32_t>(highest_sequence));
+
+    stats.received_packets++;
+    first_sequence = std::min(first_sequence, seq);
+    if (seq > highest_sequence) {
+      highest_sequence = seq;
+      in_order_run++;
+    } else {
+      stats.reordered_packets++;
+      in_order_run = 0;
+    }
+
+    if ((playing && index + static_cast<int64_t>(count) <= next_index) ||
+        pending.count(index)) {
+      // already played out (or concealed) or a duplicate, widen the window
+      stats.late_packets++;
+      target_depth = std::min(target_depth + packet_samples,
+                              MAX_DEPTH_PACKETS * packet_samples);
+      return;
+    }
+
+    pending.emplace(index, std::vector<int16_t>(samples, samples + count));
+
+    // a reordered packet filled a hole: make sure the window covers the distance
+    if (index < newest_end) {
+      size_t distance = static_cast<size_t>(newest_end - index);
+      target_depth = std::min(std::max(target_depth, distance + packet_samples),
+                              MAX_DEPTH_PACKETS * packet_samples);
+    }
+    newest_end = std::max(newest_end, index + static_cast<int64_t>(count));
+
+    // shrink slowly again after a long clean run
+    if (in_order_run >= DECAY_PACKETS &&
+        target_depth > min_depth_packets * packet_samples) {
+      target_depth -= packet_samples;
+      in_order_run = 0;
+    }
+
+    drain(false);
+  }
+
+  // Emit everything still buffered, concealing the remaining gaps.
+  void flush() {
+    std::lock_guard<std::mutex> lock(mutex);
+    drain(true);
+  }
+
+  // Start over on a new timeline (e.g. after a sample rate change), keeping
+  // the statistics. Call flush() first to play out what is buffered.
+  void reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    carried_lost_packets = segment_lost_packets();
+    segment_received = stats.received_packets;
+    segment_late = stats.late_packets;
+    started = false;
+    playing = false;
+    pending.clear();
+    history.clear();
+    in_order_run = 0;
+  }
+
+  Stats get_stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats result = stats;
+    result.lost_packets = segment_lost_packets();
+    result.target_depth_samples = target_depth;
+    result.packet_samples = packet_samples;
+    return result;
+  }
+
+private:
+  static constexpr size_t MIN_DEPTH_PACKETS = 2;
+  static constexpr size_t MAX_DEPTH_PACKETS = 16;
+  static constexpr size_t DECAY_PACKETS = 500;
+
+  uint64_t segment_lost_packets() const {
+    if (!started) {
+      return carried_lost_packets;
+    }
+    uint64_t expected = static_cast<uint64_t>(highest_sequence - first_sequence + 1);
+    uint64_t unique = (stats.received_packets - segment_received) -
+                      (stats.late_packets - segment_late);
+    return carried_lost_packets + (expected > unique ? expected - unique : 0);
+  }
+
+  void drain(bool force) {
+    if (!playing) {
+      // hold the first window back too, the stream may start out of order
+      if (pending.empty() ||
+          (!force && newest_end - pending.begin()->first <
+                         static_cast<int64_t>(target_depth))) {
+        return;
+      }
+      next_index = pending.begin()->first;
+      playing = true;
+    }
+
+    while (!pending.empty()) {
+      auto it = pending.begin();
+      int64_t index = it->first;
+      std::vector<int16_t> &block = it->second;
+
+      if (index > next_index) {
+        int64_t buffered = newest_end - next_index;
+        if (!force && buffered < static_cast<int64_t>(target_depth)) {
+          return; // still worth waiting for the missing packet
+        }
+        conceal(static_cast<size_t>(index - next_index));
+        continue;
+      }
+
+      // drop whatever overlaps audio that was already emitted
+      size_t skip = static_cast<size_t>(next_index - index);
+      if (skip < block.size()) {
+        emit(block.data() + skip, block.size() - skip);
+      }
+      pending.erase(it);
+    }
+  }
+
+  void emit(const int16_t *samples, size_t count) {
+    sink(samples, count);
+    next_index += count;
+    size_t keep = std::min(count, MAX_HISTORY);
+    history.assign(samples + count - keep, samples + count);
+  }
+
+  // Packet loss concealment: repeat the last emitted audio with a linear fade
+  // to silence over one history length, then fill with silence.
+  void conceal(size_t count) {
+    std::vector<int16_t> fill(count, 0);
+    size_t fade = history.size();
+    for (size_t i = 0; i < count && i < fade; i++) {
+      double gain = 1.0 - static_cast<double>(i + 1) / fade;
+      fill[i] = static_cast<int16_t>(history[i % fade] * gain);
+    }
+    sink(fill.data(), count);
+    next_index += count;
+    stats.concealed_samples += count;
+    history.clear();
+  }
+
+  static constexpr size_t MAX_HISTORY = 480;
+
+  Sink sink;
+  std::mutex mutex;
+  bool started = false;
+  bool playing = false;
+  int64_t next_index = 0;
+  int64_t newest_end = 0;
+  int64_t first_sequence = 0;
+  int64_t highest_sequence = 0;
+  size_t packet_samples = 0;
+  size_t min_depth_packets = MIN_DEPTH_PACKETS;
+  size_t target_depth = 0;
+  size_t in_order_run = 0;
+  std::map<int64_t, std::vector<int16_t>> pending;
+  std::vector<int16_t> history;
+  Stats stats;
+  // counters at the last reset(), the lost count is per timeline
+  uint64_t carried_lost_packets = 0;
+  uint64_t segment_received = 0;
+  uint64_t segment_late = 0;
+};
+
+// Turns the jitter buffer's running totals into the receiver report for the
+// interval since the previous one. Late arrivals can lower the loss count
+// again, so both deltas stop at zero.
+class ReceiverReporter {
+public:
+  static constexpr size_t DATAGRAM_SIZE =
+      sizeof(MessageHeader) + sizeof(ReceiverReport);
+
+  // Returns the datagram size, 0 while no packet arrived (the device cannot
+  // be told about a stream that is lost entirely, its keepalive timeout is)
+  size_t build(const JitterBuffer::Stats &stats, uint32_t interval_ms,
+               char *datagram) {
+    uint64_t received = stats.received_packets - stats.late_packets;
+    uint64_t received_delta =
+        received > last_received ? received - last_received : 0;
+    uint64_t lost_delta =
+        stats.lost_packets > last_lost ? stats.lost_packets - last_lost : 0;
+    last_received = received;
+    last_lost = stats.lost_packets;
+    if (received_delta == 0) {
+      return 0;
+    }
+
+    MessageHeader header = {static_cast<uint8_t>(MessageType::RECEIVER_REPORT),
+                            PROTOCOL_VERSION, 0, 0};
+    ReceiverReport report = {
+        interval_ms, static_cast<uint32_t>(received_delta + lost_delta),
+        static_cast<uint32_t>(lost_delta)};
+    memcpy(datagram, &header, sizeof(header));
+    memcpy(datagram + sizeof(header), &report, sizeof(report));
+    return DATAGRAM_SIZE;
+  }
+
+private:
+  uint64_t last_received = 0;
+  uint64_t last_lost = 0;
+};
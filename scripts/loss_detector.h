@@ -0,0 +1,161 @@
+// NACK generation for udp_client.cpp: which DATA packets to ask the device
+// for again, and when.
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+
+#include "client_protocol.h"
+
+// Finds DATA sequence numbers that did not arrive and asks the device to send
+// them again while the jitter buffer still waits for them. A hole is NACKed as
+// soon as a later packet shows it and again after every retry interval, until
+// as many packets are in behind it as the jitter buffer is deep: from there on
+// its audio is concealed, and it is given up. The device answers at its next
+// send tick, ahead of new audio, so the buffer needs a packet more than the
+// hole takes to show (StreamDecoder::update_min_depth). A retransmission that
+// still comes too late counts as late and widens the jitter buffer.
+class LossDetector {
+public:
+  using Clock = std::chrono::steady_clock;
+  static constexpr size_t DATAGRAM_CAPACITY =
+      sizeof(MessageHeader) + MAX_NACK_RANGES * sizeof(NackRange);
+
+  struct Stats {
+    uint64_t requested = 0; // sequence numbers NACKed, retries not counted
+    uint64_t nacks = 0;     // NACK datagrams
+    uint64_t recovered = 0; // NACKed and then arrived
+    uint64_t expired = 0;   // still missing at the deadline
+    uint64_t rtt_samples = 0;
+    double rtt_ms = 0;      // smoothed NACK to retransmission round trip
+  };
+
+  // A DATA sequence number that arrived or was rebuilt from parity
+  void on_packet(uint32_t sequence, Clock::time_point now) {
+    if (!started) {
+      started = true;
+      highest = sequence;
+      return;
+    }
+    int64_t seq = highest + static_cast<int32_t>(
+                                sequence - static_cast<uint32_t>(highest));
+    if (seq <= highest) {
+      auto it = missing.find(seq);
+      if (it != missing.end()) {
+        stats.recovered += it->second.attempts > 0;
+        // asked for once only, so it answers that request (Karn)
+        if (it->second.attempts == 1) {
+          add_rtt_sample(now - it->second.requested);
+        }
+        missing.erase(it);
+      }
+      return;
+    }
+
+    // a longer jump is a restarted stream rather than loss worth asking for
+    if (seq - highest - 1 <= static_cast<int64_t>(MAX_MISSING)) {
+      for (int64_t hole = highest + 1; hole < seq; hole++) {
+        missing.emplace(hole, Hole{now, now, 0});
+      }
+    }
+    highest = seq;
+    while (missing.size() > MAX_MISSING) {
+      missing.erase(missing.begin());
+      stats.expired++;
+    }
+  }
+
+  // The NACK due at now, for the holes with fewer than deadline_packets
+  // packets in behind them. A hole is asked for again once the retransmission
+  // is overdue: the measured round trip plus four deviations, as a TCP
+  // retransmission timer, and never sooner than min_retry. Until the first
+  // round trip is measured, twice min_retry. Returns its size, 0 if nothing
+  // is due
+  size_t build(Clock::time_point now, size_t deadline_packets,
+               Clock::duration min_retry, char *datagram) {
+    Clock::duration retry = 2 * min_retry;
+    if (stats.rtt_samples > 0) {
+      retry = std::max(min_retry, srtt + 4 * rttvar);
+    }
+    NackRange ranges[MAX_NACK_RANGES];
+    size_t count = 0;
+    for (auto it = missing.begin(); it != missing.end();) {
+      Hole &hole = it->second;
+      if (highest - it->first + 1 >= static_cast<int64_t>(deadline_packets)) {
+        stats.expired++;
+        it = missing.erase(it);
+        continue;
+      }
+      if (hole.attempts < MAX_ATTEMPTS && now >= hole.next_request) {
+        uint32_t sequence = static_cast<uint32_t>(it->first);
+        NackRange *last = count > 0 ? &ranges[count - 1] : nullptr;
+        if (last && last->first_sequence + last->count == sequence &&
+            last->count < MAX_NACK_RANGE_PACKETS) {
+          last->count++;
+        } else if (count < MAX_NACK_RANGES) {
+          ranges[count++] = {sequence, 1, 0};
+        } else {
+          break; // the rest goes out with the next datagram
+        }
+        stats.requested += hole.attempts == 0;
+        hole.attempts++;
+        hole.requested = now;
+        hole.next_request = now + retry;
+      }
+      ++it;
+    }
+    if (count == 0) {
+      return 0;
+    }
+
+    MessageHeader header = {static_cast<uint8_t>(MessageType::NACK),
+                            PROTOCOL_VERSION, 0, 0};
+    memcpy(datagram, &header, sizeof(header));
+    memcpy(datagram + sizeof(header), ranges, count * sizeof(NackRange));
+    stats.nacks++;
+    return sizeof(header) + count * sizeof(NackRange);
+  }
+
+  // A new timeline, the holes in the old one are of no use any more. The
+  // round trip estimate belongs to the link and is kept
+  void reset() {
+    started = false;
+    missing.clear();
+  }
+
+  Stats get_stats() const { return stats; }
+
+private:
+  static constexpr size_t MAX_MISSING = 256;
+  static constexpr uint32_t MAX_ATTEMPTS = 3;
+
+  struct Hole {
+    Clock::time_point requested;
+    Clock::time_point next_request;
+    uint32_t attempts;
+  };
+
+  // RFC 6298 smoothing, gains 1/8 and 1/4
+  void add_rtt_sample(Clock::duration rtt) {
+    if (stats.rtt_samples++ == 0) {
+      srtt = rtt;
+      rttvar = rtt / 2;
+    } else {
+      Clock::duration error = rtt > srtt ? rtt - srtt : srtt - rtt;
+      rttvar += (error - rttvar) / 4;
+      srtt += (rtt - srtt) / 8;
+    }
+    stats.rtt_ms = std::chrono::duration<double, std::milli>(srtt).count();
+  }
+
+  bool started = false;
+  int64_t highest = 0;
+  std::map<int64_t, Hole> missing;
+  Clock::duration srtt{};
+  Clock::duration rttvar{};
+  Stats stats;
+};
@@ -0,0 +1,473 @@
+// Host benchmark for the multi-device ingest of udp_client.cpp (several
+// devices, one epoll loop, one interleaved WAV). Two parts:
+//
+// 1. The interleave kernel from pcm_interleave.h against its scalar reference
+//    for each device count, checked bit-exact, in frames per second and in
+//    the share of one core that N real-time 16 kHz channels cost.
+// 2. End to end on loopback: it plays N devices on 127.0.0.1:6001..., starts
+//    the client with --devices (in a scratch directory, console output to a
+//    file), waits for the hellos and streams PCM16 packets from each device.
+//    The devices start up to 100 ms apart with unrelated sample and sequence
+//    counters, like boards booted at different times, but all of them carry
+//    a click at the same moment of every second. The click's spread across
+//    the channels of the recording shows how well the client aligned them;
+//    loss comes from the client's summary and its CPU time from wait4.
+//
+// --speed streams faster than real time to load the client; the arrival
+// anchors then no longer match the sample clocks, so the alignment is only
+// checked at speed 1.
+//
+// Build: g++ -std=gnu++20 -O2 -o multi_device_benchmark multi_device_benchmark.cpp
+// Run:   ./multi_device_benchmark [--seconds s] [--devices n1,n2,...]
+//                                 [--speed x] client
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pcm_interleave.h"
+
+namespace {
+
+// mirrors main/network/udp_protocol.h: 30 ms of 16 kHz PCM16 per packet
+const uint16_t BASE_PORT = 6001;
+const uint8_t PROTOCOL_VERSION = 1;
+const uint8_t MESSAGE_DATA = 0;
+const uint32_t SAMPLE_RATE = 16000;
+const size_t SAMPLES_PER_PACKET = 480;
+const size_t HEADERS_SIZE = 12;
+const int16_t CLICK_LEVEL = 20000;
+const size_t CLICK_SAMPLES = 16;
+
+// --- interleave kernel ---
+
+void bench_kernel(const std::vector<size_t> &counts) {
+  const size_t frames = SAMPLE_RATE * 10;
+  std::cout << "interleave kernel, " << frames / SAMPLE_RATE
+            << " s of 16 kHz per channel"
+            << (PCM_INTERLEAVE_SSE2 ? " (sse2)" : " (scalar only)") << "\n\n";
+  std::cout << std::left << std::setw(10) << "channels" << std::setw(22)
+            << "scalar Mframes/s" << std::setw(22) << "kernel Mframes/s"
+            << std::setw(10) << "speedup"
+            << "core % for real time\n";
+
+  for (size_t channels : counts) {
+    std::vector<std::vector<int16_t>> planar(channels,
+                                             std::vector<int16_t>(frames));
+    std::vector<const int16_t *> in(channels);
+    uint32_t state = 12345;
+    for (size_t c = 0; c < channels; c++) {
+      for (int16_t &sample : planar[c]) {
+        state = state * 1664525u + 1013904223u;
+        sample = static_cast<int16_t>(state >> 16);
+      }
+      in[c] = planar[c].data();
+    }
+    std::vector<int16_t> reference(frames * channels), out(frames * channels);
+
+    auto time = [&](auto kernel, std::vector<int16_t> &result) {
+      double best = 1e9;
+      for (int round = 0; round < 5; round++) {
+        auto start = std::chrono::steady_clock::now();
+        kernel(in.data(), channels, frames, result.data());
+        best = std::min(best, std::chrono::duration<double>(
+                                  std::chrono::steady_clock::now() - start)
+                                  .count());
+      }
+      return frames / best;
+    };
+    double scalar = time(interleave_s16_scalar, reference);
+    double kernel = time(interleave_s16, out);
+    if (out != reference) {
+      std::cout << channels << " channels: kernel differs from the scalar "
+                << "reference" << std::endl;
+      std::exit(1);
+    }
+    std::cout << std::left << std::setw(10) << channels << std::fixed
+              << std::setprecision(1) << std::setw(22) << scalar / 1e6
+              << std::setw(22) << kernel / 1e6 << std::setw(10)
+              << std::setprecision(2) << kernel / scalar << std::setprecision(4)
+              << 100.0 * SAMPLE_RATE / kernel << "\n";
+  }
+  std::cout << std::endl;
+}
+
+// --- end to end ---
+
+struct SimulatedDevice {
+  int sock = -1;
+  sockaddr_in client = {};
+  double start_ms = 0;     // after the hello
+  uint32_t sample_base = 0;
+  uint32_t sequence_base = 0;
+  uint64_t sent = 0;
+};
+
+struct Result {
+  bool ok = false;
+  uint64_t sent = 0;
+  uint64_t received = 0;
+  uint64_t lost = 0;
+  double cpu_us_per_packet = 0;
+  double cpu_share = 0;        // of one core over the run
+  double calls_per_packet = 0; // recvmmsg calls
+  double spread_ms = -1;       // click misalignment across channels
+  size_t channels = 0;
+};
+
+// "Packets: N received, M lost, ..." and "Receive: N datagrams in M ..."
+bool parse_summary(const std::string &path, Result &result) {
+  std::ifstream file(path);
+  std::string line;
+  bool found = false;
+  while (std::getline(file, line)) {
+    size_t pos = line.find("Packets: ");
+    if (pos != std::string::npos) {
+      std::istringstream fields(line.substr(pos + 9));
+      std::string word;
+      fields >> result.received >> word >> result.lost;
+      found = !fields.fail();
+    }
+    uint64_t datagrams = 0, calls = 0;
+    if (std::sscanf(line.c_str(), "Receive: %" SCNu64 " datagrams in %" SCNu64,
+                    &datagrams, &calls) == 2 && datagrams > 0) {
+      result.calls_per_packet = static_cast<double>(calls) / datagrams;
+    }
+  }
+  return found;
+}
+
+// The recording's clicks: per second of the stream, the largest distance
+// between the channels' click onsets
+bool measure_alignment(const std::filesystem::path &dir, Result &result) {
+  std::filesystem::path wav;
+  for (const auto &entry : std::filesystem::directory_iterator(dir)) {
+    if (entry.path().extension() == ".wav") {
+      wav = entry.path();
+    }
+  }
+  std::ifstream file(wav, std::ios::binary);
+  std::vector<char> data((std::istreambuf_iterator<char>(file)),
+                         std::istreambuf_iterator<char>());
+  if (data.size() < 12) {
+    return false;
+  }
+
+  uint16_t channels = 0;
+  size_t pos = 12;
+  while (pos + 8 <= data.size()) {
+    uint32_t size;
+    std::memcpy(&size, &data[pos + 4], sizeof(size));
+    size_t body = pos + 8;
+    if (std::memcmp(&data[pos], "fmt ", 4) == 0) {
+      std::memcpy(&channels, &data[body + 2], sizeof(channels));
+    } else if (std::memcmp(&data[pos], "data", 4) == 0 && channels > 0) {
+      size_t frames = (data.size() - body) / (2 * channels);
+      const char *samples = &data[body];
+      result.channels = channels;
+
+      // onsets[c][second], -1 if that click is missing
+      std::vector<std::vector<int64_t>> onsets(channels);
+      for (uint16_t c = 0; c < channels; c++) {
+        int64_t last = -static_cast<int64_t>(SAMPLE_RATE);
+        for (size_t f = 0; f < frames; f++) {
+          int16_t sample;
+          std::memcpy(&sample, samples + (f * channels + c) * 2, 2);
+          if (sample > CLICK_LEVEL / 2 &&
+              static_cast<int64_t>(f) - last > SAMPLE_RATE / 2) {
+            last = static_cast<int64_t>(f);
+            size_t second = (f + SAMPLE_RATE / 2) / SAMPLE_RATE;
+            onsets[c].resize(std::max(onsets[c].size(), second + 1), -1);
+            onsets[c][second] = last;
+          }
+        }
+      }
+
+      int64_t spread = -1;
+      for (size_t second = 0;; second++) {
+        int64_t low = INT64_MAX, high = INT64_MIN;
+        bool complete = true;
+        for (uint16_t c = 0; c < channels && complete; c++) {
+          complete = second < onsets[c].size() && onsets[c][second] >= 0;
+          if (complete) {
+            low = std::min(low, onsets[c][second]);
+            high = std::max(high, onsets[c][second]);
+          }
+        }
+        bool beyond = true;
+        for (uint16_t c = 0; c < channels; c++) {
+          beyond = beyond && second >= onsets[c].size();
+        }
+        if (beyond) {
+          break;
+        }
+        if (complete) {
+          spread = std::max(spread, high - low);
+        }
+      }
+      result.spread_ms = spread < 0 ? -1 : spread * 1000.0 / SAMPLE_RATE;
+      return spread >= 0;
+    }
+    pos = body + size + (size & 1);
+  }
+  return false;
+}
+
+// "path arg..." to an argv for execv
+std::vector<std::string> split_command(const std::string &command) {
+  std::istringstream words(command);
+  std::vector<std::string> args;
+  std::string word;
+  while (words >> word) {
+    args.push_back(word);
+  }
+  return args;
+}
+
+// the stream as every device hears it: quiet noise and a click each second,
+// t counted in samples from the first hello
+int16_t true_sample(uint64_t t) {
+  if (t % SAMPLE_RATE < CLICK_SAMPLES) {
+    return CLICK_LEVEL;
+  }
+  uint32_t hash = static_cast<uint32_t>(t) * 2654435761u;
+  return static_cast<int16_t>(static_cast<int32_t>(hash >> 25) - 64);
+}
+
+Result run(const std::string &client, size_t count, double seconds,
+           double speed) {
+  Result result;
+  std::filesystem::path dir = std::filesystem::temp_directory_path() /
+                              ("multi_device_benchmark_" + std::to_string(getpid()));
+  std::filesystem::create_directories(dir);
+
+  std::vector<SimulatedDevice> devices(count);
+  std::string list;
+  for (size_t i = 0; i < count; i++) {
+    SimulatedDevice &device = devices[i];
+    device.sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    int enable = 1;
+    setsockopt(device.sock, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(BASE_PORT + i);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(device.sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+      std::cerr << "Failed to bind port " << BASE_PORT + i << std::endl;
+      return result;
+    }
+    timeval timeout = {2, 0};
+    setsockopt(device.sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    // unrelated counters and start times, like boards booted at random
+    device.start_ms = (i * 7919) % 97;
+    device.sample_base = static_cast<uint32_t>(i * 1000003u);
+    device.sequence_base = static_cast<uint32_t>(i * 101u);
+    list += (i > 0 ? "," : "") + std::string("127.0.0.1:") +
+            std::to_string(BASE_PORT + i);
+  }
+
+  std::string output = (dir / "client.txt").string();
+  pid_t pid = fork();
+  if (pid == 0) {
+    if (chdir(dir.c_str()) != 0) {
+      _exit(127);
+    }
+    int fd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    dup2(fd, STDOUT_FILENO);
+    dup2(fd, STDERR_FILENO);
+    std::vector<std::string> args = split_command(client);
+    args.push_back("--devices");
+    args.push_back(list);
+    std::vector<char *> argv;
+    for (std::string &arg : args) {
+      argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+    execv(argv[0], argv.data());
+    _exit(127);
+  }
+
+  auto cleanup = [&] {
+    for (SimulatedDevice &device : devices) {
+      close(device.sock);
+    }
+    std::filesystem::remove_all(dir);
+  };
+
+  // every device waits for its hello
+  for (SimulatedDevice &device : devices) {
+    char buffer[64];
+    socklen_t length = sizeof(device.client);
+    if (recvfrom(device.sock, buffer, sizeof(buffer), 0,
+                 reinterpret_cast<sockaddr *>(&device.client), &length) < 0) {
+      std::cerr << client << " did not say hello to every device" << std::endl;
+      kill(pid, SIGKILL);
+      waitpid(pid, nullptr, 0);
+      cleanup();
+      return result;
+    }
+  }
+
+  std::vector<uint8_t> packet(HEADERS_SIZE + SAMPLES_PER_PACKET * 2);
+  packet[0] = MESSAGE_DATA;
+  packet[1] = PROTOCOL_VERSION;
+  packet[2] = 0; // PCM16
+  packet[3] = SAMPLE_RATE / 1000;
+
+  // paced in 1 ms slices, device i's packet k is due at its start + 30 ms * k
+  const double packet_ms = SAMPLES_PER_PACKET * 1000.0 / SAMPLE_RATE;
+  const uint64_t packets = static_cast<uint64_t>(seconds * 1000.0 / packet_ms);
+  auto start = std::chrono::steady_clock::now();
+  bool pending = true;
+  while (pending) {
+    auto now = std::chrono::steady_clock::now();
+    double elapsed_ms =
+        std::chrono::duration<double, std::milli>(now - start).count() * speed;
+    pending = false;
+    for (SimulatedDevice &device : devices) {
+      while (device.sent < packets &&
+             device.start_ms + device.sent * packet_ms <= elapsed_ms) {
+        uint64_t first = static_cast<uint64_t>(device.start_ms * SAMPLE_RATE / 1000) +
+                         device.sent * SAMPLES_PER_PACKET;
+        uint32_t sequence = device.sequence_base + static_cast<uint32_t>(device.sent);
+        uint32_t sample_index = device.sample_base +
+                                static_cast<uint32_t>(device.sent * SAMPLES_PER_PACKET);
+        std::memcpy(&packet[4], &sequence, sizeof(sequence));
+        std::memcpy(&packet[8], &sample_index, sizeof(sample_index));
+        for (size_t j = 0; j < SAMPLES_PER_PACKET; j++) {
+          int16_t sample = true_sample(first + j);
+          std::memcpy(&packet[HEADERS_SIZE + j * 2], &sample, sizeof(sample));
+        }
+        sendto(device.sock, packet.data(), packet.size(), 0,
+               reinterpret_cast<sockaddr *>(&device.client), sizeof(device.client));
+        device.sent++;
+        result.sent++;
+      }
+      pending = pending || device.sent < packets;
+    }
+    std::this_thread::sleep_until(now + std::chrono::milliseconds(1));
+  }
+  double run_seconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start).count();
+
+  // let the client drain, then stop it like Ctrl+C does
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  kill(pid, SIGINT);
+  int status = 0;
+  rusage usage = {};
+  pid_t exited = 0;
+  for (int i = 0; i < 200 && (exited = wait4(pid, &status, WNOHANG, &usage)) == 0; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  if (exited == 0) {
+    kill(pid, SIGKILL);
+    wait4(pid, &status, 0, &usage);
+  }
+
+  result.ok = parse_summary(output, result);
+  result.lost = std::max(result.lost, result.sent > result.received
+                                          ? result.sent - result.received
+                                          : 0);
+  double cpu_us = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e6 +
+                  usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+  result.cpu_us_per_packet = result.received > 0 ? cpu_us / result.received : 0;
+  result.cpu_share = cpu_us / 1e6 / (run_seconds + 0.5);
+  if (result.ok && speed == 1.0) {
+    measure_alignment(dir, result);
+  }
+  cleanup();
+  return result;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  double seconds = 5.0;
+  double speed = 1.0;
+  std::vector<size_t> counts = {1, 2, 4, 8, 16, 32};
+  std::string client;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--seconds" && i + 1 < argc) {
+      seconds = std::strtod(argv[++i], nullptr);
+    } else if (arg == "--speed" && i + 1 < argc) {
+      speed = std::strtod(argv[++i], nullptr);
+    } else if (arg == "--devices" && i + 1 < argc) {
+      counts.clear();
+      std::istringstream list(argv[++i]);
+      std::string count;
+      while (std::getline(list, count, ',')) {
+        counts.push_back(std::strtoul(count.c_str(), nullptr, 10));
+      }
+    } else {
+      // the client may come with options, only the path is made absolute
+      size_t end = arg.find(' ');
+      client = std::filesystem::absolute(arg.substr(0, end)).string() +
+               (end == std::string::npos ? "" : arg.substr(end));
+    }
+  }
+  if (client.empty() || seconds <= 0 || speed <= 0) {
+    std::cerr << "usage: " << argv[0]
+              << " [--seconds s] [--devices n1,n2,...] [--speed x] client"
+              << std::endl;
+    return 1;
+  }
+
+  bench_kernel(counts);
+
+  std::cout << std::defaultfloat << "ingest, " << seconds << " s of 33 packets/s per device at "
+            << speed << "x, loopback\n\n";
+  std::cout << std::left << std::setw(10) << "devices" << std::setw(12)
+            << "packets/s" << std::setw(16) << "loss" << std::setw(14)
+            << "cpu us/pkt" << std::setw(12) << "core %" << std::setw(12)
+            << "calls/pkt"
+            << "click spread ms\n";
+  for (size_t count : counts) {
+    Result result = run(client, count, seconds, speed);
+    std::cout << std::left << std::setw(10) << count;
+    if (!result.ok) {
+      std::cout << "n/a" << std::endl;
+      continue;
+    }
+    double loss = result.sent > 0
+                      ? static_cast<double>(result.lost) / result.sent
+                      : 0.0;
+    std::ostringstream lost;
+    lost << std::fixed << std::setprecision(2) << loss * 100.0 << "% ("
+         << result.lost << ")";
+    std::cout << std::fixed << std::setprecision(0) << std::setw(12)
+              << result.sent / seconds * speed << std::setw(16) << lost.str()
+              << std::setprecision(1) << std::setw(14)
+              << result.cpu_us_per_packet << std::setw(12)
+              << result.cpu_share * 100.0 << std::setprecision(2)
+              << std::setw(12) << result.calls_per_packet;
+    if (result.spread_ms >= 0 && result.channels == count) {
+      std::cout << std::setprecision(2) << result.spread_ms;
+    } else {
+      std::cout << "-";
+    }
+    std::cout << std::endl;
+  }
+  return 0;
+}
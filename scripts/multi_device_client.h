@@ -0,0 +1,632 @@
+// Several devices recorded into one multichannel file by udp_client.cpp
+// (--devices). The client itself needs Linux, the device addresses do not.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+#include "client_protocol.h"
+#include "client_socket.h"
+#include "disk_writer.h"
+#include "jitter_buffer.h"
+#include "loss_detector.h"
+#include "pcm_interleave.h"
+#include "rate_upsampler.h"
+#include "stream_decoder.h"
+
+// A device to record from, "ip[:port]" on the command line
+struct DeviceAddress {
+  std::string ip;
+  int port = 5001;
+};
+
+inline DeviceAddress parse_device_address(const std::string &text) {
+  DeviceAddress address;
+  size_t colon = text.find(':');
+  address.ip = text.substr(0, colon);
+  if (colon != std::string::npos) {
+    address.port = std::stoi(text.substr(colon + 1));
+  }
+  return address;
+}
+
+#ifdef __linux__
+// Records several devices into one WAV file, channel i for device i. A single
+// thread waits on an epoll set holding one connected socket per device, so the
+// kernel demultiplexes the streams by source address and the event's tag names
+// the device. Every device has its own StreamDecoder.
+//
+// The devices' sample counters are unrelated, so each stream is anchored on
+// the output timeline at the arrival time of its first packet. In SEQUENCE
+// mode it then advances by its own sample index (gaps are concealed by its
+// jitter buffer) and network jitter never moves the audio. ARRIVAL mode also
+// follows the arrival clock: the offset between arrival time and sample index
+// is tracked (its minimum over ARRIVAL_WINDOW rejects the network jitter) and
+// the stream is shifted by padding or dropping samples once it is more than
+// ARRIVAL_TOLERANCE_MS off, which absorbs the clock drift between boards.
+//
+// Frames are written once every device has samples for them. A device more
+// than MAX_WAIT_MS behind the others (or not streaming at all) is padded with
+// silence, and the samples it delivers late are dropped so it stays aligned.
+class MultiDeviceClient {
+public:
+  enum class AlignMode { SEQUENCE, ARRIVAL };
+
+  explicit MultiDeviceClient(const std::vector<DeviceAddress> &addresses)
+      : recording_name(make_recording_name()) {
+    for (const DeviceAddress &address : addresses) {
+      devices.push_back(std::make_unique<Device>());
+      Device *device = devices.back().get();
+      device->address = address;
+      device->decoder = std::make_unique<StreamDecoder>(
+          [this, device](const int16_t *samples, size_t count) {
+            accept_samples(*device, samples, count);
+          },
+          [this, device](uint32_t rate) { change_sample_rate(*device, rate); });
+    }
+    channel_pointers.resize(devices.size());
+    frame_buffer.resize(MIX_BLOCK_FRAMES * devices.size());
+  }
+
+  ~MultiDeviceClient() { close(); }
+
+  bool start_receiving() {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+      std::cerr << "Failed to create the epoll instance" << std::endl;
+      return false;
+    }
+
+    int buffer_size = 0;
+    for (size_t i = 0; i < devices.size(); i++) {
+      Device &device = *devices[i];
+      sockaddr_in addr = {};
+      addr.sin_family = AF_INET;
+      addr.sin_port = htons(device.address.port);
+      if (inet_pton(AF_INET, device.address.ip.c_str(), &addr.sin_addr) != 1) {
+        std::cerr << "Invalid device address: " << device.address.ip
+                  << std::endl;
+        return false;
+      }
+
+      // connected: the kernel only queues this device's datagrams here
+      device.sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, IPPROTO_UDP);
+      if (device.sock == INVALID_SOCKET ||
+          ::connect(device.sock, (struct sockaddr *)&addr, sizeof(addr)) ==
+              SOCKET_ERROR) {
+        std::cerr << "Failed to open a socket for " << device_name(device)
+                  << std::endl;
+        return false;
+      }
+      buffer_size = configure_receive_socket(device.sock, receive_buffer_bytes);
+
+      epoll_event event = {};
+      event.events = EPOLLIN;
+      event.data.u32 = static_cast<uint32_t>(i);
+      if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, device.sock, &event) != 0) {
+        std::cerr << "Failed to watch the socket for " << device_name(device)
+                  << std::endl;
+        return false;
+      }
+    }
+    std::cout << "Socket receive buffer: " << buffer_size / 1024
+              << " KB per device" << std::endl;
+
+    start_time = std::chrono::steady_clock::now();
+    for (auto &device : devices) {
+      std::cout << "Trying to connect to " << device_name(*device) << "..."
+                << std::endl;
+      const char *hello_msg = "hello";
+      send(device->sock, hello_msg, strlen(hello_msg), 0);
+    }
+
+    running = true;
+    disk_writer.start(recording_name, output_rate,
+                      static_cast<uint16_t>(devices.size()));
+    receive_thread = std::thread(&MultiDeviceClient::_receive_loop, this);
+    return true;
+  }
+
+  void close() {
+    if (closed) {
+      return;
+    }
+    closed = true;
+    running = false;
+    if (receive_thread.joinable()) {
+      receive_thread.join();
+    }
+
+    // play out the jitter buffers and pad everyone to the longest stream
+    for (auto &device : devices) {
+      device->decoder->flush();
+    }
+    mix(true);
+    disk_writer.stop();
+    print_summary();
+
+    for (auto &device : devices) {
+      if (device->sock != INVALID_SOCKET) {
+        ::close(device->sock);
+      }
+    }
+    if (epoll_fd >= 0) {
+      ::close(epoll_fd);
+    }
+  }
+
+  // Call before start_receiving()
+  void set_align_mode(AlignMode mode) { align_mode = mode; }
+
+  void set_comfort_noise(bool enabled) {
+    for (auto &device : devices) {
+      device->decoder->set_comfort_noise(enabled);
+    }
+  }
+
+  // Per device receiver reports for its congestion control (on by default)
+  void set_receiver_reports(bool enabled) { receiver_reports = enabled; }
+
+  // NACK each device's lost packets (on by default)
+  void set_nack(bool enabled) {
+    for (auto &device : devices) {
+      device->decoder->set_nack(enabled);
+    }
+  }
+
+  // Start a new file after this many seconds of audio or this many bytes,
+  // 0 for no limit. Call before start_receiving().
+  void set_rotation(uint32_t seconds, uint64_t bytes) {
+    disk_writer.set_rotation(seconds, bytes);
+  }
+
+  // WAV or FLAC files, FLAC encoded on this many threads (0: one per core).
+  // Call before start_receiving().
+  void set_format(RecordingFormat format, unsigned encoder_threads = 0) {
+    disk_writer.set_format(format, encoder_threads);
+  }
+
+  // SO_RCVBUF per device, 0 keeps the system default. Call before
+  // start_receiving().
+  void set_receive_buffer(int bytes) { receive_buffer_bytes = bytes; }
+
+  std::string get_recording_name() const { return recording_name; }
+
+private:
+  // a quarter of the single device default, 8 MiB for 32 devices
+  static constexpr int DEFAULT_RECEIVE_BUFFER_BYTES = 256 << 10;
+  static constexpr int POLL_TIMEOUT_MS = 100;
+  static constexpr uint32_t MAX_WAIT_MS = 1000;
+  static constexpr auto ARRIVAL_WINDOW = std::chrono::seconds(2);
+  static constexpr uint32_t ARRIVAL_TOLERANCE_MS = 10;
+  static constexpr auto STREAMING_TIMEOUT = std::chrono::seconds(2);
+  static constexpr size_t MIX_BLOCK_FRAMES = 1024;
+  static constexpr size_t COMPACT_SAMPLES = 16384;
+
+  struct Device {
+    DeviceAddress address;
+    SOCKET sock = INVALID_SOCKET;
+    std::unique_ptr<StreamDecoder> decoder;
+
+    // pending[pending_read + i] belongs to output frame written_frames + i;
+    // the next `skip` samples from the decoder are dropped (they belong to
+    // frames that are already out)
+    std::vector<int16_t> pending;
+    size_t pending_read = 0;
+    uint64_t skip = 0;
+
+    bool anchored = false; // first packet seen on the current timeline
+    bool placed = false;   // its first samples are in pending
+    bool muted = false;    // sample rate differs from the recording's
+    RateUpsampler upsampler; // or is a whole fraction of it
+    int64_t anchor_frame = 0;
+    int64_t offset = 0; // output frame - sample index
+    uint32_t last_index = 0;
+    int64_t unwrapped_index = 0;
+    int64_t window_offset = INT64_MAX;
+    std::chrono::steady_clock::time_point window_start;
+
+    std::chrono::steady_clock::time_point last_datagram;
+    uint64_t datagrams = 0;
+    uint64_t kernel_drops = 0;
+    uint64_t padded_samples = 0;  // silence filled in for it
+    uint64_t dropped_samples = 0; // late, shifted out or muted
+    uint64_t shifts = 0;          // ARRIVAL corrections
+    ReceiverReporter reporter;
+  };
+
+  static std::string device_name(const Device &device) {
+    return device.address.ip + ":" + std::to_string(device.address.port);
+  }
+
+  static size_t pending_size(const Device &device) {
+    return device.pending.size() - device.pending_read;
+  }
+
+  void _receive_loop() {
+    ReceiveBatch batch;
+    std::vector<epoll_event> events(devices.size());
+    auto last_keepalive = std::chrono::steady_clock::now();
+    auto last_status = last_keepalive;
+    auto last_report = last_keepalive;
+
+    while (running) {
+      int count = epoll_wait(epoll_fd, events.data(),
+                             static_cast<int>(events.size()), POLL_TIMEOUT_MS);
+      wakeups++;
+      auto now = std::chrono::steady_clock::now();
+      for (int e = 0; e < count; e++) {
+        Device &device = *devices[events[e].data.u32];
+        // one batch per device and wakeup keeps the devices fair; epoll is
+        // level-triggered and reports a socket with more queued again
+        int received = batch.receive(device.sock, MSG_DONTWAIT,
+                                     device.kernel_drops);
+        receive_calls++;
+        for (int i = 0; i < received; i++) {
+          handle_datagram(device, batch.data(i), batch.size(i), now);
+        }
+        char datagram[LossDetector::DATAGRAM_CAPACITY];
+        size_t size = device.decoder->build_nack(datagram);
+        if (size > 0) {
+          send(device.sock, datagram, size, 0);
+        }
+      }
+      mix(false);
+      disk_writer.flush_if_stale();
+
+      if (now - last_keepalive >=
+          std::chrono::milliseconds(KEEPALIVE_INTERVAL_MS)) {
+        MessageHeader header = {static_cast<uint8_t>(MessageType::KEEPALIVE),
+                                PROTOCOL_VERSION, 0, 0};
+        for (auto &device : devices) {
+          send(device->sock, &header, sizeof(header), 0);
+        }
+        last_keepalive = now;
+      }
+      auto report_interval =
+          std::chrono::duration_cast<std::chrono::milliseconds>(now -
+                                                                last_report);
+      if (receiver_reports &&
+          report_interval.count() >= RECEIVER_REPORT_INTERVAL_MS) {
+        char datagram[ReceiverReporter::DATAGRAM_SIZE];
+        for (auto &device : devices) {
+          size_t size = device->reporter.build(
+              device->decoder->get_stream_stats(),
+              static_cast<uint32_t>(report_interval.count()), datagram);
+          if (size > 0) {
+            send(device->sock, datagram, size, 0);
+          }
+        }
+        last_report = now;
+      }
+      if (now - last_status >= std::chrono::seconds(1)) {
+        print_status(now);
+        last_status = now;
+      }
+    }
+  }
+
+  void handle_datagram(Device &device, const char *buffer, size_t size,
+                       std::chrono::steady_clock::time_point now) {
+    datagrams_received++;
+    device.datagrams++;
+    device.last_datagram = now;
+    // a rate change inside restarts the device's timeline, so the arrival is
+    // looked at afterwards
+    device.decoder->handle_datagram(buffer, size);
+
+    MessageHeader header;
+    if (size < sizeof(header)) {
+      return;
+    }
+    std::memcpy(&header, buffer, sizeof(header));
+    if (header.type != static_cast<uint8_t>(MessageType::DATA)) {
+      return;
+    }
+    int64_t arrival_frame = static_cast<int64_t>(
+        std::chrono::duration<double>(now - start_time).count() * output_rate);
+
+    // legacy streams without a DataHeader are only anchored
+    bool indexed = header.version >= 1 &&
+                   size >= sizeof(MessageHeader) + sizeof(DataHeader);
+    DataHeader data_header = {};
+    if (indexed) {
+      std::memcpy(&data_header, buffer + sizeof(MessageHeader),
+                  sizeof(data_header));
+    }
+
+    // sample indexes count at the stream's rate, frames at the output's
+    int64_t factor = device.upsampler.get_factor();
+    if (!device.anchored) {
+      device.anchored = true;
+      device.anchor_frame = arrival_frame;
+      device.last_index = data_header.sample_index;
+      device.unwrapped_index = factor * data_header.sample_index;
+      device.offset = arrival_frame - device.unwrapped_index;
+      device.window_offset = device.offset;
+      device.window_start = now;
+      return;
+    }
+    if (!indexed) {
+      return;
+    }
+    device.unwrapped_index +=
+        factor * static_cast<int32_t>(data_header.sample_index - device.last_index);
+    device.last_index = data_header.sample_index;
+
+    if (align_mode != AlignMode::ARRIVAL) {
+      return;
+    }
+    device.window_offset = std::min(device.window_offset,
+                                    arrival_frame - device.unwrapped_index);
+    if (now - device.window_start < ARRIVAL_WINDOW) {
+      return;
+    }
+    int64_t drift = device.window_offset - device.offset;
+    int64_t tolerance = ARRIVAL_TOLERANCE_MS * output_rate / 1000;
+    if (device.placed && std::abs(drift) > tolerance) {
+      int64_t next = written_frames + static_cast<int64_t>(pending_size(device)) -
+                     static_cast<int64_t>(device.skip);
+      place(device, next + drift);
+      device.offset = device.window_offset;
+      device.shifts++;
+    }
+    device.window_offset = INT64_MAX;
+    device.window_start = now;
+  }
+
+  // Decoder sink: the device's gapless timeline
+  void accept_samples(Device &device, const int16_t *samples, size_t count) {
+    if (device.muted) {
+      device.dropped_samples += count;
+      return;
+    }
+    device.upsampler.process(samples, count,
+                             [&](const int16_t *out, size_t n) {
+                               queue_samples(device, out, n);
+                             });
+  }
+
+  // The device's samples at the output rate
+  void queue_samples(Device &device, const int16_t *samples, size_t count) {
+    if (!device.placed) {
+      place(device, device.anchor_frame);
+      device.placed = true;
+    }
+    size_t skip = static_cast<size_t>(std::min<uint64_t>(device.skip, count));
+    device.skip -= skip;
+    device.dropped_samples += skip;
+    device.pending.insert(device.pending.end(), samples + skip,
+                          samples + count);
+  }
+
+  // Makes the device's next sample land on this output frame, padding with
+  // silence or dropping what is queued (or yet to come) in between
+  void place(Device &device, int64_t frame) {
+    int64_t end = written_frames + static_cast<int64_t>(pending_size(device));
+    if (frame >= end) {
+      device.skip = 0;
+      device.pending.resize(device.pending.size() + (frame - end), 0);
+      device.padded_samples += frame - end;
+      return;
+    }
+    uint64_t excess = static_cast<uint64_t>(end - frame);
+    size_t drop = static_cast<size_t>(
+        std::min<uint64_t>(excess, pending_size(device)));
+    device.pending.resize(device.pending.size() - drop);
+    device.dropped_samples += drop;
+    device.skip = excess - drop;
+  }
+
+  // Decoder callback: one file has one rate, the first device decides it
+  // unless audio has already been queued at the default rate
+  void change_sample_rate(Device &device, uint32_t rate) {
+    bool idle = written_frames == 0;
+    for (auto &other : devices) {
+      idle = idle && pending_size(*other) == 0;
+    }
+    if (rate != output_rate && idle) {
+      output_rate = rate;
+      disk_writer.set_sample_rate(rate);
+      std::cout << "\nStream sample rate: " << rate << " Hz" << std::endl;
+    }
+    // a congestion step down is upsampled back to the recording's rate
+    bool fraction = rate < output_rate && output_rate % rate == 0;
+    device.upsampler.set_factor(fraction ? output_rate / rate : 1);
+    device.muted = rate != output_rate && !fraction;
+    if (device.muted) {
+      std::cerr << "\n" << device_name(device) << " streams at " << rate
+                << " Hz, the recording is at " << output_rate
+                << " Hz: its channel stays silent" << std::endl;
+    }
+    // its sample index starts over
+    device.anchored = false;
+    device.placed = false;
+  }
+
+  // Writes the frames all devices have samples for; with final (or once a
+  // device lags more than MAX_WAIT_MS) the shorter ones are padded
+  void mix(bool final) {
+    size_t ready = SIZE_MAX, most = 0;
+    for (auto &device : devices) {
+      ready = std::min(ready, pending_size(*device));
+      most = std::max(most, pending_size(*device));
+    }
+    size_t max_wait = static_cast<size_t>(MAX_WAIT_MS) * output_rate / 1000;
+    if (final) {
+      ready = most;
+    } else if (most - ready > max_wait) {
+      ready = most - max_wait;
+    }
+    if (ready == 0) {
+      return;
+    }
+
+    for (auto &device : devices) {
+      size_t have = pending_size(*device);
+      if (have < ready) {
+        device->pending.resize(device->pending.size() + ready - have, 0);
+        device->padded_samples += ready - have;
+        if (device->placed) {
+          device->skip += ready - have; // those frames are out by then
+        }
+      }
+    }
+
+    size_t channels = devices.size();
+    for (size_t done = 0; done < ready;) {
+      size_t frames = std::min(ready - done, MIX_BLOCK_FRAMES);
+      for (size_t c = 0; c < channels; c++) {
+        channel_pointers[c] =
+            devices[c]->pending.data() + devices[c]->pending_read + done;
+      }
+      interleave_s16(channel_pointers.data(), channels, frames,
+                     frame_buffer.data());
+      disk_writer.append(frame_buffer.data(),
+                         frames * channels * sizeof(int16_t));
+      done += frames;
+    }
+
+    for (auto &device : devices) {
+      device->pending_read += ready;
+      if (device->pending_read == device->pending.size()) {
+        device->pending.clear();
+        device->pending_read = 0;
+      } else if (device->pending_read >= COMPACT_SAMPLES) {
+        device->pending.erase(device->pending.begin(),
+                              device->pending.begin() + device->pending_read);
+        device->pending_read = 0;
+      }
+    }
+    written_frames += ready;
+  }
+
+  void print_status(std::chrono::steady_clock::time_point now) {
+    size_t streaming = 0;
+    uint64_t lost = 0, padded = 0, kernel_drops = 0;
+    for (auto &device : devices) {
+      if (device->datagrams > 0 &&
+          now - device->last_datagram < STREAMING_TIMEOUT) {
+        streaming++;
+      }
+      lost += device->decoder->get_stream_stats().lost_packets;
+      padded += device->padded_samples;
+      kernel_drops += device->kernel_drops;
+    }
+    std::cout << "\rDevices: " << streaming << "/" << devices.size()
+              << " streaming | Duration: " << std::fixed
+              << std::setprecision(1)
+              << written_frames / static_cast<double>(output_rate)
+              << "s | Lost: " << lost << " | Padded: "
+              << padded / static_cast<double>(output_rate) << "s";
+    if (kernel_drops > 0) {
+      std::cout << " | Kernel drops: " << kernel_drops;
+    }
+    std::cout << std::flush;
+  }
+
+  void print_summary() {
+    JitterBuffer::Stats total;
+    for (auto &device : devices) {
+      JitterBuffer::Stats stats = device->decoder->get_stream_stats();
+      total.received_packets += stats.received_packets;
+      total.lost_packets += stats.lost_packets;
+      total.reordered_packets += stats.reordered_packets;
+      total.late_packets += stats.late_packets;
+      total.concealed_samples += stats.concealed_samples;
+    }
+    std::cout << "\nPackets: " << total.received_packets << " received, "
+              << total.lost_packets << " lost, " << total.reordered_packets
+              << " reordered, " << total.late_packets << " late | concealed "
+              << total.concealed_samples << " samples" << std::endl;
+
+    double rate = output_rate;
+    for (size_t i = 0; i < devices.size(); i++) {
+      Device &device = *devices[i];
+      JitterBuffer::Stats stats = device.decoder->get_stream_stats();
+      std::cout << "Channel " << i + 1 << " " << device_name(device) << ": "
+                << stats.received_packets << " received, "
+                << stats.lost_packets << " lost | anchored at "
+                << std::fixed << std::setprecision(1)
+                << device.anchor_frame * 1000.0 / rate << " ms | padded "
+                << device.padded_samples / rate << "s, dropped "
+                << device.dropped_samples / rate << "s";
+      if (device.shifts > 0) {
+        std::cout << ", " << device.shifts << " arrival corrections";
+      }
+      LossDetector::Stats nack = device.decoder->get_nack_stats();
+      if (nack.requested > 0) {
+        std::cout << " | " << nack.requested << " NACKed, " << nack.recovered
+                  << " arrived";
+      }
+      if (device.kernel_drops > 0) {
+        std::cout << " | " << device.kernel_drops << " dropped by the kernel";
+      }
+      std::cout << std::endl;
+    }
+
+    uint64_t datagrams = datagrams_received, calls = receive_calls;
+    std::cout << "Receive: " << datagrams << " datagrams in " << calls
+              << " recvmmsg calls over " << wakeups << " epoll wakeups ("
+              << std::fixed << std::setprecision(1)
+              << (calls > 0 ? static_cast<double>(datagrams) / calls : 0.0)
+              << " per call)" << std::endl;
+    DiskWriter::Stats disk = disk_writer.get_stats();
+    std::cout << "Disk: " << disk.segments << " file(s), "
+              << disk.chunks_written << " writes of up to "
+              << DiskWriter::CHUNK_BYTES / 1024 << " KB, " << disk.pool_chunks
+              << " buffers pooled, " << disk.stalls << " stalls";
+    if (disk_writer.get_format() == RecordingFormat::FLAC &&
+        disk.bytes_written > 0) {
+      std::cout << ", FLAC " << std::fixed << std::setprecision(1)
+                << 100.0 * disk.bytes_stored / disk.bytes_written
+                << "% of the PCM";
+    }
+    if (disk.bytes_dropped > 0) {
+      std::cout << ", " << disk.bytes_dropped << " bytes not written";
+    }
+    std::cout << std::endl;
+    std::cout << "Output: " << written_frames << " frames x " << devices.size()
+              << " channels, " << std::setprecision(1)
+              << written_frames / rate << "s ("
+              << (align_mode == AlignMode::ARRIVAL ? "arrival" : "sequence")
+              << " alignment)" << std::endl;
+  }
+
+  std::vector<std::unique_ptr<Device>> devices;
+  AlignMode align_mode = AlignMode::SEQUENCE;
+  bool receiver_reports = true;
+  int receive_buffer_bytes = DEFAULT_RECEIVE_BUFFER_BYTES;
+  int epoll_fd = -1;
+  std::atomic<bool> running{false};
+  bool closed = false;
+  std::thread receive_thread;
+  std::chrono::steady_clock::time_point start_time;
+
+  // owned by the receive thread (and by close() once it has joined)
+  uint32_t output_rate = StreamDecoder::DEFAULT_SAMPLE_RATE;
+  int64_t written_frames = 0;
+  std::vector<const int16_t *> channel_pointers;
+  std::vector<int16_t> frame_buffer;
+  uint64_t datagrams_received = 0;
+  uint64_t receive_calls = 0;
+  uint64_t wakeups = 0;
+
+  std::string recording_name;
+  DiskWriter disk_writer;
+};
+#endif
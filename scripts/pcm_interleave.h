@@ -0,0 +1,138 @@
+// Planar to interleaved 16-bit PCM for the multichannel recordings of
+// udp_client.cpp: out[frame * channels + c] = in[c][frame].
+//
+// interleave_s16 is bit-exact with interleave_s16_scalar. On x86 it moves
+// whole vectors: SSE2 unpacks for 2 and 4 channels, and an 8x8 transpose for
+// every full group of 8 channels, so 32 channels take four transposes per 8
+// frames instead of 256 scalar stores. The channels beyond the last group of
+// 8, the last frames % 8 frames and other targets go through the scalar loop.
+//
+// Header only so the client keeps its one-line build;
+// multi_device_benchmark.cpp times both variants.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PCM_INTERLEAVE_SSE2 1
+#else
+#define PCM_INTERLEAVE_SSE2 0
+#endif
+
+namespace pcm_interleave_detail {
+
+// channels [first, last) of frames [begin, end)
+inline void scalar_range(const int16_t *const *in, size_t channels,
+                         size_t first, size_t last, size_t begin, size_t end,
+                         int16_t *out) {
+  for (size_t f = begin; f < end; f++) {
+    int16_t *frame = out + f * channels;
+    for (size_t c = first; c < last; c++) {
+      frame[c] = in[c][f];
+    }
+  }
+}
+
+#if PCM_INTERLEAVE_SSE2
+inline __m128i load8(const int16_t *p) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+
+inline void store8(int16_t *p, __m128i v) {
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v);
+}
+
+// frames f..f+7 of channels in[0..7]; row k of the result (frame f + k) goes
+// to out + k * stride
+inline void transpose8x8(const int16_t *const *in, size_t f, int16_t *out,
+                         size_t stride) {
+  // pairs of channels, 32-bit lane j = (c, c + 1) of frame j (or j + 4)
+  __m128i a0 = _mm_unpacklo_epi16(load8(in[0] + f), load8(in[1] + f));
+  __m128i a1 = _mm_unpackhi_epi16(load8(in[0] + f), load8(in[1] + f));
+  __m128i a2 = _mm_unpacklo_epi16(load8(in[2] + f), load8(in[3] + f));
+  __m128i a3 = _mm_unpackhi_epi16(load8(in[2] + f), load8(in[3] + f));
+  __m128i a4 = _mm_unpacklo_epi16(load8(in[4] + f), load8(in[5] + f));
+  __m128i a5 = _mm_unpackhi_epi16(load8(in[4] + f), load8(in[5] + f));
+  __m128i a6 = _mm_unpacklo_epi16(load8(in[6] + f), load8(in[7] + f));
+  __m128i a7 = _mm_unpackhi_epi16(load8(in[6] + f), load8(in[7] + f));
+
+  // quads of channels, 64-bit half = channels 0-3 or 4-7 of one frame
+  __m128i b0 = _mm_unpacklo_epi32(a0, a2); // frames 0, 1
+  __m128i b1 = _mm_unpackhi_epi32(a0, a2); // frames 2, 3
+  __m128i b2 = _mm_unpacklo_epi32(a1, a3); // frames 4, 5
+  __m128i b3 = _mm_unpackhi_epi32(a1, a3); // frames 6, 7
+  __m128i b4 = _mm_unpacklo_epi32(a4, a6);
+  __m128i b5 = _mm_unpackhi_epi32(a4, a6);
+  __m128i b6 = _mm_unpacklo_epi32(a5, a7);
+  __m128i b7 = _mm_unpackhi_epi32(a5, a7);
+
+  store8(out + 0 * stride, _mm_unpacklo_epi64(b0, b4));
+  store8(out + 1 * stride, _mm_unpackhi_epi64(b0, b4));
+  store8(out + 2 * stride, _mm_unpacklo_epi64(b1, b5));
+  store8(out + 3 * stride, _mm_unpackhi_epi64(b1, b5));
+  store8(out + 4 * stride, _mm_unpacklo_epi64(b2, b6));
+  store8(out + 5 * stride, _mm_unpackhi_epi64(b2, b6));
+  store8(out + 6 * stride, _mm_unpacklo_epi64(b3, b7));
+  store8(out + 7 * stride, _mm_unpackhi_epi64(b3, b7));
+}
+
+// the frames below frames & ~7, returns how many were done
+inline size_t interleave_sse2(const int16_t *const *in, size_t channels,
+                              size_t frames, int16_t *out) {
+  size_t vector_frames = frames & ~static_cast<size_t>(7);
+  if (channels == 2) {
+    for (size_t f = 0; f < vector_frames; f += 8) {
+      __m128i c0 = load8(in[0] + f), c1 = load8(in[1] + f);
+      store8(out + f * 2, _mm_unpacklo_epi16(c0, c1));
+      store8(out + f * 2 + 8, _mm_unpackhi_epi16(c0, c1));
+    }
+  } else if (channels == 4) {
+    for (size_t f = 0; f < vector_frames; f += 8) {
+      __m128i c0 = load8(in[0] + f), c1 = load8(in[1] + f);
+      __m128i c2 = load8(in[2] + f), c3 = load8(in[3] + f);
+      __m128i a0 = _mm_unpacklo_epi16(c0, c1), a1 = _mm_unpackhi_epi16(c0, c1);
+      __m128i a2 = _mm_unpacklo_epi16(c2, c3), a3 = _mm_unpackhi_epi16(c2, c3);
+      store8(out + f * 4, _mm_unpacklo_epi32(a0, a2));
+      store8(out + f * 4 + 8, _mm_unpackhi_epi32(a0, a2));
+      store8(out + f * 4 + 16, _mm_unpacklo_epi32(a1, a3));
+      store8(out + f * 4 + 24, _mm_unpackhi_epi32(a1, a3));
+    }
+  } else {
+    size_t grouped = channels & ~static_cast<size_t>(7);
+    for (size_t f = 0; f < vector_frames; f += 8) {
+      for (size_t c = 0; c < grouped; c += 8) {
+        transpose8x8(in + c, f, out + f * channels + c, channels);
+      }
+    }
+    scalar_range(in, channels, grouped, channels, 0, vector_frames, out);
+  }
+  return vector_frames;
+}
+#endif
+
+} // namespace pcm_interleave_detail
+
+// reference implementation, one sample at a time
+inline void interleave_s16_scalar(const int16_t *const *in, size_t channels,
+                                  size_t frames, int16_t *out) {
+  pcm_interleave_detail::scalar_range(in, channels, 0, channels, 0, frames,
+                                      out);
+}
+
+// best kernel for the build target, in and out must not overlap
+inline void interleave_s16(const int16_t *const *in, size_t channels,
+                           size_t frames, int16_t *out) {
+  if (channels == 1) {
+    std::memcpy(out, in[0], frames * sizeof(int16_t));
+    return;
+  }
+  size_t done = 0;
+#if PCM_INTERLEAVE_SSE2
+  done = pcm_interleave_detail::interleave_sse2(in, channels, frames, out);
+#endif
+  pcm_interleave_detail::scalar_range(in, channels, 0, channels, done, frames,
+                                      out);
+}
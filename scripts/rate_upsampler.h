@@ -0,0 +1,51 @@
+// Integer factor upsampling for udp_client.cpp's recordings.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Brings a stream that stepped down to a whole fraction of the recording's
+// rate (the device's congestion control halves it) back up to that rate, so
+// a congested stretch stays in the same file instead of starting a new one.
+// Linear interpolation from the previous input sample, factor 1 passes the
+// samples through.
+class RateUpsampler {
+public:
+  void set_factor(uint32_t value) {
+    factor = value > 0 ? value : 1;
+    previous = 0;
+  }
+  uint32_t get_factor() const { return factor; }
+
+  // Calls out(samples, count) with count * factor samples, in blocks
+  template <typename Out>
+  void process(const int16_t *samples, size_t count, Out &&out) {
+    if (factor == 1) {
+      out(samples, count);
+      return;
+    }
+    int16_t block[BLOCK_SAMPLES];
+    size_t used = 0;
+    for (size_t i = 0; i < count; i++) {
+      int32_t step = samples[i] - previous;
+      for (uint32_t k = 1; k <= factor; k++) {
+        block[used++] = static_cast<int16_t>(
+            previous + step * static_cast<int32_t>(k) /
+                           static_cast<int32_t>(factor));
+      }
+      previous = samples[i];
+      if (used + factor > BLOCK_SAMPLES) {
+        out(block, used);
+        used = 0;
+      }
+    }
+    if (used > 0) {
+      out(block, used);
+    }
+  }
+
+private:
+  static constexpr size_t BLOCK_SAMPLES = 1024;
+  uint32_t factor = 1;
+  int16_t previous = 0;
+};
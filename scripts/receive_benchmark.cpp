@@ -0,0 +1,300 @@
+// Host benchmark for the receive path of udp_client.cpp: finds the highest
+// DATA packet rate a client build keeps up with. It plays the device on
+// 127.0.0.1:5001, starts the client (in a scratch directory, console output
+// to a file), waits for its hello and streams PCM16 packets at a fixed rate
+// for a few seconds per step. The client's own summary line ("Packets: N
+// received, M lost") gives the loss; a rate counts as sustained while less
+// than 0.1% of the packets are lost. Anything the client cannot drain in time
+// overflows the kernel socket buffer, so this measures the per-packet cost of
+// the receive thread. On a loaded or single core host the loss mostly shows
+// scheduling delays, so the client's CPU time per packet (from wait4) is
+// reported too, with the rate one core could sustain at that cost, and the
+// receive syscalls per packet from the client's "Receive:" summary. Pass
+// several builds (e.g. one from an older commit), or one build with different
+// options in quotes ("./udp_client --no-batch"), to compare them. The stream
+// runs in real time at 33 packets/s, so the default rates are 30-3000x that.
+//
+// Build: g++ -std=gnu++20 -O2 -o receive_benchmark receive_benchmark.cpp
+// Run:   ./receive_benchmark [--seconds s] [--rates r1,r2,...] client...
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <chrono>
+#include <cmath>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// mirrors main/network/udp_protocol.h: 30 ms of 16 kHz PCM16 per packet
+const uint16_t SERVER_PORT = 5001;
+const uint8_t PROTOCOL_VERSION = 1;
+const uint8_t MESSAGE_DATA = 0;
+const size_t SAMPLES_PER_PACKET = 480;
+const size_t HEADERS_SIZE = 12;
+const double MAX_LOSS = 0.001;
+
+struct Result {
+  bool ok = false;
+  uint64_t sent = 0;
+  uint64_t received = 0;
+  uint64_t lost = 0;
+  double cpu_us_per_packet = 0;   // client user + system time per packet received
+  double calls_per_packet = 0;    // receive syscalls, 0 if not reported
+};
+
+// "Packets: N received, M lost, ..." from the client's summary
+bool parse_summary(const std::string &path, Result &result) {
+  std::ifstream file(path);
+  std::string line;
+  while (std::getline(file, line)) {
+    size_t pos = line.find("Packets: ");
+    if (pos == std::string::npos) {
+      continue;
+    }
+    std::istringstream fields(line.substr(pos + 9));
+    std::string word;
+    fields >> result.received >> word >> result.lost;
+    if (fields.fail()) {
+      return false;
+    }
+    // "Receive: N datagrams in M recvmmsg calls ..."
+    while (std::getline(file, line)) {
+      uint64_t datagrams = 0, calls = 0;
+      if (std::sscanf(line.c_str(), "Receive: %" SCNu64 " datagrams in %" SCNu64,
+                      &datagrams, &calls) == 2 && datagrams > 0) {
+        result.calls_per_packet = static_cast<double>(calls) / datagrams;
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+// "path arg..." to an argv for execv
+std::vector<std::string> split_command(const std::string &command) {
+  std::istringstream words(command);
+  std::vector<std::string> args;
+  std::string word;
+  while (words >> word) {
+    args.push_back(word);
+  }
+  return args;
+}
+
+Result run(const std::string &client, uint32_t rate, double seconds) {
+  Result result;
+  std::filesystem::path dir = std::filesystem::temp_directory_path() /
+                              ("receive_benchmark_" + std::to_string(getpid()));
+  std::filesystem::create_directories(dir);
+
+  int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  int enable = 1;
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(SERVER_PORT);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+    std::cerr << "Failed to bind port " << SERVER_PORT << std::endl;
+    close(sock);
+    return result;
+  }
+  timeval timeout = {2, 0};
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  std::string output = (dir / "client.txt").string();
+  pid_t pid = fork();
+  if (pid == 0) {
+    if (chdir(dir.c_str()) != 0) {
+      _exit(127);
+    }
+    int fd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    dup2(fd, STDOUT_FILENO);
+    dup2(fd, STDERR_FILENO);
+    std::vector<std::string> args = split_command(client);
+    args.push_back("127.0.0.1");
+    std::vector<char *> argv;
+    for (std::string &arg : args) {
+      argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+    execv(argv[0], argv.data());
+    _exit(127);
+  }
+
+  // the hello tells us where to stream to
+  char buffer[64];
+  sockaddr_in client_addr = {};
+  socklen_t addr_len = sizeof(client_addr);
+  if (recvfrom(sock, buffer, sizeof(buffer), 0,
+               reinterpret_cast<sockaddr *>(&client_addr), &addr_len) < 0) {
+    std::cerr << client << " did not say hello" << std::endl;
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    close(sock);
+    std::filesystem::remove_all(dir);
+    return result;
+  }
+
+  std::vector<uint8_t> packet(HEADERS_SIZE + SAMPLES_PER_PACKET * 2);
+  packet[0] = MESSAGE_DATA;
+  packet[1] = PROTOCOL_VERSION;
+  packet[2] = 0; // PCM16
+  packet[3] = 16;
+  for (size_t i = 0; i < SAMPLES_PER_PACKET; i++) {
+    int16_t sample = static_cast<int16_t>(8000 * std::sin(i * 0.1));
+    std::memcpy(&packet[HEADERS_SIZE + i * 2], &sample, sizeof(sample));
+  }
+
+  // paced in 1 ms slices
+  uint64_t total = static_cast<uint64_t>(rate * seconds);
+  auto start = std::chrono::steady_clock::now();
+  uint32_t sequence = 0;
+  while (sequence < total) {
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - start).count();
+    uint64_t due = std::min<uint64_t>(total, static_cast<uint64_t>(elapsed * rate) + 1);
+    for (; sequence < due; sequence++) {
+      uint32_t sample_index = sequence * SAMPLES_PER_PACKET;
+      std::memcpy(&packet[4], &sequence, sizeof(sequence));
+      std::memcpy(&packet[8], &sample_index, sizeof(sample_index));
+      sendto(sock, packet.data(), packet.size(), 0,
+             reinterpret_cast<sockaddr *>(&client_addr), sizeof(client_addr));
+    }
+    std::this_thread::sleep_until(now + std::chrono::milliseconds(1));
+  }
+  result.sent = sequence;
+
+  // let the client drain its socket, then stop it like Ctrl+C does
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  kill(pid, SIGINT);
+  int status = 0;
+  rusage usage = {};
+  pid_t exited = 0;
+  for (int i = 0; i < 100 && (exited = wait4(pid, &status, WNOHANG, &usage)) == 0; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  if (exited == 0) {
+    kill(pid, SIGKILL);
+    wait4(pid, &status, 0, &usage);
+  }
+  close(sock);
+  result.ok = parse_summary(output, result);
+  // packets lost at the end of the stream never show up as a gap
+  result.lost = std::max(result.lost, result.sent > result.received
+                                          ? result.sent - result.received
+                                          : 0);
+
+  // per packet the client actually got to process
+  double cpu_us = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e6 +
+                  usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+  uint64_t processed = result.sent - std::min(result.lost, result.sent);
+  result.cpu_us_per_packet = processed > 0 ? cpu_us / processed : 0;
+  std::filesystem::remove_all(dir);
+  return result;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  double seconds = 3.0;
+  std::vector<uint32_t> rates = {1000, 2000, 5000, 10000, 20000, 50000, 100000};
+  std::vector<std::string> clients;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--seconds" && i + 1 < argc) {
+      seconds = std::strtod(argv[++i], nullptr);
+    } else if (arg == "--rates" && i + 1 < argc) {
+      rates.clear();
+      std::istringstream list(argv[++i]);
+      std::string rate;
+      while (std::getline(list, rate, ',')) {
+        rates.push_back(std::strtoul(rate.c_str(), nullptr, 10));
+      }
+    } else {
+      // the client may come with options, only the path is made absolute
+      size_t end = arg.find(' ');
+      clients.push_back(std::filesystem::absolute(arg.substr(0, end)).string() +
+                        (end == std::string::npos ? "" : arg.substr(end)));
+    }
+  }
+  if (clients.empty() || seconds <= 0) {
+    std::cerr << "usage: " << argv[0]
+              << " [--seconds s] [--rates r1,r2,...] client..." << std::endl;
+    return 1;
+  }
+
+  std::cout << HEADERS_SIZE + SAMPLES_PER_PACKET * 2 << " byte packets for "
+            << seconds << " s per rate, loopback\n\n";
+  std::cout << std::left << std::setw(12) << "packets/s";
+  for (size_t i = 0; i < clients.size(); i++) {
+    std::cout << std::setw(40) << ("client " + std::to_string(i + 1) +
+                                   " loss, cpu us/pkt, calls/pkt");
+  }
+  std::cout << std::endl;
+
+  std::vector<uint32_t> sustained(clients.size(), 0);
+  std::vector<double> cpu_us(clients.size(), 0); // at the highest rate run
+  std::vector<bool> failed(clients.size(), false);
+  for (uint32_t rate : rates) {
+    std::cout << std::left << std::setw(12) << rate;
+    for (size_t i = 0; i < clients.size(); i++) {
+      if (failed[i]) {
+        std::cout << std::setw(40) << "-"; // already gave up at a lower rate
+        continue;
+      }
+      Result result = run(clients[i], rate, seconds);
+      std::ostringstream cell;
+      if (!result.ok) {
+        cell << "n/a";
+      } else {
+        double loss = result.sent > 0
+                          ? static_cast<double>(result.lost) / result.sent
+                          : 0.0;
+        cell << std::fixed << std::setprecision(2) << loss * 100.0 << "% ("
+             << result.lost << "), " << std::setprecision(1)
+             << result.cpu_us_per_packet;
+        if (result.calls_per_packet > 0) {
+          cell << ", " << std::setprecision(2) << result.calls_per_packet;
+        }
+        cpu_us[i] = result.cpu_us_per_packet;
+        if (loss <= MAX_LOSS) {
+          sustained[i] = rate;
+        } else if (loss > 0.1) {
+          failed[i] = true;
+        }
+      }
+      std::cout << std::setw(40) << cell.str() << std::flush;
+    }
+    std::cout << std::endl;
+  }
+
+  std::cout << "\nhighest rate with at most " << MAX_LOSS * 100.0
+            << "% loss, and one core's worth at the last cpu cost:\n";
+  for (size_t i = 0; i < clients.size(); i++) {
+    std::cout << "  client " << i + 1 << " " << std::setw(8) << sustained[i]
+              << " packets/s  " << std::setw(8)
+              << (cpu_us[i] > 0 ? static_cast<uint32_t>(1e6 / cpu_us[i]) : 0)
+              << " packets/s  " << clients[i] << "\n";
+  }
+  return 0;
+}
@@ -0,0 +1,395 @@
+// The files udp_client.cpp records into: RF64-ready WAV and FLAC segments
+// behind one interface, so the DiskWriter rotates either the same way.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "encoder_pool.h"
+#include "flac_encoder.h"
+
+#pragma pack(push, 1)
+// WAV header with room for RF64 (EBU Tech 3306): the JUNK chunk after WAVE
+// becomes the ds64 chunk with 64-bit sizes once a file outgrows 4 GiB, so the
+// samples never have to move. The audio data starts at byte 80.
+struct WavHeader {
+  // RIFF chunk, "RF64" with wav_size 0xFFFFFFFF past 4 GiB
+  char riff_header[4] = {'R', 'I', 'F', 'F'};
+  uint32_t wav_size = 0;
+  char wave_header[4] = {'W', 'A', 'V', 'E'};
+
+  // JUNK placeholder, or the ds64 chunk
+  char ds64_header[4] = {'J', 'U', 'N', 'K'};
+  uint32_t ds64_chunk_size = 28;
+  uint64_t riff_size_64 = 0;
+  uint64_t data_size_64 = 0;
+  uint64_t sample_count_64 = 0;
+  uint32_t table_length = 0;
+
+  // fmt chunk
+  char fmt_header[4] = {'f', 'm', 't', ' '};
+  uint32_t fmt_chunk_size = 16;
+  uint16_t audio_format = 1; // PCM
+  uint16_t num_channels = 1; // interleaved frames when more than one
+  uint32_t sample_rate = 16000;
+  uint32_t byte_rate = 32000; // sample_rate * num_channels * bytes_per_sample
+  uint16_t block_align = 2;   // num_channels * bytes_per_sample
+  uint16_t bits_per_sample = 16;
+
+  // data chunk, 0xFFFFFFFF in RF64
+  char data_header[4] = {'d', 'a', 't', 'a'};
+  uint32_t data_chunk_size = 0;
+
+  WavHeader(uint32_t rate, uint16_t channels = 1)
+      : num_channels(channels), sample_rate(rate) {
+    block_align = channels * sizeof(int16_t);
+    byte_rate = rate * block_align;
+  }
+
+  // Sizes for this much audio data, switching to RF64 when they stop fitting
+  void set_data_size(uint64_t data_bytes) {
+    uint64_t riff_size = sizeof(WavHeader) - 8 + data_bytes;
+    if (riff_size <= UINT32_MAX) {
+      wav_size = static_cast<uint32_t>(riff_size);
+      data_chunk_size = static_cast<uint32_t>(data_bytes);
+      return;
+    }
+    std::memcpy(riff_header, "RF64", 4);
+    std::memcpy(ds64_header, "ds64", 4);
+    wav_size = UINT32_MAX;
+    data_chunk_size = UINT32_MAX;
+    riff_size_64 = riff_size;
+    data_size_64 = data_bytes;
+    sample_count_64 = data_bytes / block_align;
+  }
+};
+#pragma pack(pop)
+static_assert(sizeof(WavHeader) == 80, "WAV header must not be padded");
+
+enum class RecordingFormat { WAV, FLAC };
+
+// Absolute fseek past 2 GiB
+inline bool seek_file(FILE *file, uint64_t offset) {
+#ifdef _WIN32
+  return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+  return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+// One file of a segmented recording, used by the DiskWriter's thread only.
+// The file is valid at any moment, also after a crash or kill -9; sync()
+// makes that durable against power loss.
+class RecordingSegment {
+public:
+  virtual ~RecordingSegment() = default;
+
+  // size_hint: the largest the audio data will get, 0 if unknown
+  virtual bool open(const std::string &path, uint32_t rate, uint16_t channels,
+                    uint64_t size_hint) = 0;
+  virtual bool write(const char *data, size_t bytes) = 0;
+  virtual void sync() = 0;
+  virtual void close() = 0;
+
+  virtual bool is_open() const = 0;
+  virtual uint32_t sample_rate() const = 0;
+  virtual uint64_t data_bytes() const = 0; // PCM taken in
+  virtual uint64_t file_bytes() const = 0; // on disk so far
+  virtual const std::string &path() const = 0;
+};
+
+// Raw PCM. The header is rewritten after every write with the size of the
+// data already in the file. On Linux the space is reserved in large steps
+// ahead of the writes so a long capture does not fragment, and the unused
+// reservation is released on close.
+class WavSegment : public RecordingSegment {
+public:
+  static constexpr uint64_t PREALLOCATE_STEP = 64ull << 20;
+
+  ~WavSegment() override { close(); }
+
+  bool open(const std::string &path, uint32_t rate, uint16_t channels,
+            uint64_t size_hint) override {
+    if (size_hint > 0) {
+      size_hint += sizeof(WavHeader);
+    }
+    close();
+    file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+      return false;
+    }
+    // whole chunks only, no stdio buffer between them and the kernel
+    std::setvbuf(file, nullptr, _IONBF, 0);
+    file_path = path;
+    header = WavHeader(rate, channels);
+    data_size = 0;
+    preallocated = 0;
+    preallocate_step = size_hint > 0 ? std::min(size_hint, PREALLOCATE_STEP)
+                                     : PREALLOCATE_STEP;
+    if (!write_header()) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  bool write(const char *data, size_t bytes) override {
+    preallocate(sizeof(WavHeader) + data_size + bytes);
+    if (!seek_file(file, sizeof(WavHeader) + data_size) ||
+        std::fwrite(data, 1, bytes, file) != bytes) {
+      return false;
+    }
+    // the data is in the file before the header counts it
+    data_size += bytes;
+    return write_header();
+  }
+
+  void sync() override {
+#ifndef _WIN32
+    if (file) {
+      fdatasync(fileno(file));
+    }
+#endif
+  }
+
+  void close() override {
+    if (!file) {
+      return;
+    }
+    write_header();
+#ifdef __linux__
+    // gives back the reserved blocks beyond the end of the data
+    if (ftruncate(fileno(file), sizeof(WavHeader) + data_size) != 0) {
+      std::cerr << "\nFailed to trim " << file_path << std::endl;
+    }
+#endif
+    sync();
+    std::fclose(file);
+    file = nullptr;
+  }
+
+  bool is_open() const override { return file != nullptr; }
+  uint32_t sample_rate() const override { return header.sample_rate; }
+  uint64_t data_bytes() const override { return data_size; }
+  uint64_t file_bytes() const override {
+    return sizeof(WavHeader) + data_size;
+  }
+  const std::string &path() const override { return file_path; }
+
+private:
+  bool write_header() {
+    header.set_data_size(data_size);
+    return seek_file(file, 0) &&
+           std::fwrite(&header, sizeof(header), 1, file) == 1;
+  }
+
+  void preallocate(uint64_t end) {
+#ifdef __linux__
+    if (end <= preallocated) {
+      return;
+    }
+    // KEEP_SIZE: the file size still only covers what was written
+    uint64_t length = std::max(preallocate_step, end - preallocated);
+    if (fallocate(fileno(file), FALLOC_FL_KEEP_SIZE,
+                  static_cast<off_t>(preallocated),
+                  static_cast<off_t>(length)) == 0) {
+      preallocated += length;
+    } else {
+      preallocated = UINT64_MAX; // not supported here, stop trying
+    }
+#else
+    (void)end;
+#endif
+  }
+
+  FILE *file = nullptr;
+  std::string file_path;
+  WavHeader header{16000};
+  uint64_t data_size = 0;
+  uint64_t preallocated = 0; // file offset up to which space is reserved
+  uint64_t preallocate_step = PREALLOCATE_STEP;
+};
+
+// Lossless FLAC (flac_encoder.h), about half the size of the WAV for speech.
+// The PCM is cut into BLOCK_FRAMES blocks that are encoded on the pool and
+// written in order as they complete, so the writer thread only copies and
+// writes while the pool does the compression of every stream in the
+// process. Up to MAX_IN_FLIGHT blocks are outstanding before write() waits
+// for the oldest.
+//
+// STREAMINFO is rewritten after every frame with the totals of the frames
+// already in the file; the MD5 of the audio goes in on close. A crash loses
+// the blocks still being encoded and the partial one, at most a few seconds.
+class FlacSegment : public RecordingSegment {
+public:
+  static constexpr size_t BLOCK_FRAMES = 4096;
+  static constexpr size_t MAX_IN_FLIGHT = 32;
+
+  explicit FlacSegment(EncoderPool &pool) : pool(pool) {}
+  ~FlacSegment() override { close(); }
+
+  bool open(const std::string &path, uint32_t rate, uint16_t channels,
+            uint64_t size_hint) override {
+    (void)size_hint; // the compressed size is not known ahead
+    close();
+    file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+      return false;
+    }
+    std::setvbuf(file, nullptr, _IONBF, 0);
+    file_path = path;
+    info = flac::StreamInfo();
+    info.block_frames = BLOCK_FRAMES;
+    info.sample_rate = rate;
+    info.channels = channels;
+    md5 = flac::Md5();
+    pending.clear();
+    data_size = 0;
+    file_size = flac::STREAM_HEADER_SIZE;
+    frame_number = 0;
+    failed = false;
+    if (!write_header()) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  bool write(const char *data, size_t bytes) override {
+    md5.update(data, bytes);
+    data_size += bytes;
+    size_t block_bytes = BLOCK_FRAMES * info.channels * sizeof(int16_t);
+    while (bytes > 0) {
+      size_t count = std::min(bytes, block_bytes - pending.size());
+      pending.insert(pending.end(), data, data + count);
+      data += count;
+      bytes -= count;
+      if (pending.size() == block_bytes) {
+        submit_block();
+      }
+    }
+    return write_encoded(false);
+  }
+
+  void sync() override {
+#ifndef _WIN32
+    if (file) {
+      fdatasync(fileno(file));
+    }
+#endif
+  }
+
+  // Encodes the partial block as the short last frame
+  void close() override {
+    if (!file) {
+      return;
+    }
+    if (!pending.empty()) {
+      submit_block();
+    }
+    write_encoded(true);
+    if (!failed) {
+      info.md5 = md5.finish();
+      write_header();
+    }
+    sync();
+    std::fclose(file);
+    file = nullptr;
+  }
+
+  bool is_open() const override { return file != nullptr; }
+  uint32_t sample_rate() const override { return info.sample_rate; }
+  uint64_t data_bytes() const override { return data_size; }
+  uint64_t file_bytes() const override { return file_size; }
+  const std::string &path() const override { return file_path; }
+
+private:
+  struct Block {
+    std::vector<int16_t> samples; // interleaved
+    std::vector<uint8_t> frame;
+    std::atomic<bool> done{false};
+  };
+
+  void submit_block() {
+    auto block = std::make_unique<Block>();
+    block->samples.resize(pending.size() / sizeof(int16_t));
+    std::memcpy(block->samples.data(), pending.data(), pending.size());
+    pending.clear();
+
+    Block *job = block.get();
+    uint16_t channels = info.channels;
+    uint32_t rate = info.sample_rate;
+    uint32_t number = frame_number++;
+    blocks.push_back(std::move(block));
+    pool.submit([job, channels, rate, number] {
+      flac::encode_frame(job->samples.data(), job->samples.size() / channels,
+                         channels, rate, number, BLOCK_FRAMES, job->frame);
+      job->done.store(true, std::memory_order_release);
+      job->done.notify_one();
+    });
+  }
+
+  // Writes the encoded frames at the front of the queue, waiting for them
+  // if all is set or too many are outstanding
+  bool write_encoded(bool all) {
+    while (!blocks.empty()) {
+      Block &block = *blocks.front();
+      if (!block.done.load(std::memory_order_acquire)) {
+        if (!all && blocks.size() < MAX_IN_FLIGHT) {
+          break;
+        }
+        block.done.wait(false, std::memory_order_acquire);
+      }
+      if (!failed) {
+        // the frame is in the file before STREAMINFO counts it
+        uint32_t frame_bytes = static_cast<uint32_t>(block.frame.size());
+        failed = !seek_file(file, file_size) ||
+                 std::fwrite(block.frame.data(), 1, frame_bytes, file) !=
+                     frame_bytes;
+        if (!failed) {
+          file_size += frame_bytes;
+          info.total_frames += block.samples.size() / info.channels;
+          info.min_frame_bytes = info.min_frame_bytes == 0
+                                     ? frame_bytes
+                                     : std::min(info.min_frame_bytes,
+                                                frame_bytes);
+          info.max_frame_bytes = std::max(info.max_frame_bytes, frame_bytes);
+          failed = !write_header();
+        }
+      }
+      blocks.pop_front();
+    }
+    return !failed;
+  }
+
+  bool write_header() {
+    std::vector<uint8_t> header = flac::stream_header(info);
+    return seek_file(file, 0) &&
+           std::fwrite(header.data(), 1, header.size(), file) == header.size();
+  }
+
+  EncoderPool &pool;
+  FILE *file = nullptr;
+  std::string file_path;
+  flac::StreamInfo info;
+  flac::Md5 md5;
+  std::vector<char> pending; // PCM of the block being filled
+  std::deque<std::unique_ptr<Block>> blocks; // submitted, in frame order
+  uint64_t data_size = 0;
+  uint64_t file_size = 0;
+  uint32_t frame_number = 0;
+  bool failed = false; // the file stops growing after a failed write
+};
@@ -0,0 +1,202 @@
+// Host benchmark for UDPServer::DeliveryMode: per-packet send cost with 1-8
+// listeners, unicast (one sendto per listener, like SendToAllClients) versus
+// multicast (one sendto to the group). Everything runs over the loopback
+// interface, so this measures sender CPU per audio packet. The airtime saved
+// on the access point, the larger win on the device, does not show up here.
+//
+// Build: g++ -std=gnu++17 -O2 -o send_benchmark send_benchmark.cpp
+// Run:   ./send_benchmark [packets per run]
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+// one 30 ms PCM16 packet at 16 kHz plus MessageHeader and DataHeader
+const size_t DATAGRAM_SIZE = 960 + 12;
+const size_t MAX_LISTENERS = 8;
+const size_t DRAIN_INTERVAL = 32; // packets between draining the listeners
+const char *GROUP = "239.255.42.1";
+const uint16_t GROUP_PORT = 5002;
+
+struct Result {
+  double ns_per_packet = 0;
+  size_t datagrams_sent = 0;
+  size_t min_received = 0; // per listener, should equal the packet count
+  bool ok = false;
+};
+
+void drain(const std::vector<int> &listeners, std::vector<size_t> &received) {
+  char buffer[2048];
+  for (size_t i = 0; i < listeners.size(); i++) {
+    while (recv(listeners[i], buffer, sizeof(buffer), MSG_DONTWAIT) > 0) {
+      received[i]++;
+    }
+  }
+}
+
+void close_all(const std::vector<int> &sockets) {
+  for (int fd : sockets) {
+    close(fd);
+  }
+}
+
+Result run(size_t listener_count, bool multicast, size_t packets) {
+  Result result;
+  std::vector<int> listeners;
+  std::vector<sockaddr_in> destinations;
+
+  int sender = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (sender < 0) {
+    return result;
+  }
+
+  in_addr loopback = {};
+  loopback.s_addr = htonl(INADDR_LOOPBACK);
+
+  for (size_t i = 0; i < listener_count; i++) {
+    int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    int rcvbuf = 4 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    if (multicast) {
+      // every member binds the group port, the kernel hands each a copy
+      int enable = 1;
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+      addr.sin_port = htons(GROUP_PORT);
+      addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    } else {
+      addr.sin_port = 0;
+      addr.sin_addr = loopback;
+    }
+    if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+      std::cerr << "bind failed: " << strerror(errno) << std::endl;
+      close(fd);
+      close_all(listeners);
+      close(sender);
+      return result;
+    }
+
+    if (multicast) {
+      ip_mreq membership = {};
+      inet_pton(AF_INET, GROUP, &membership.imr_multiaddr);
+      membership.imr_interface = loopback;
+      if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership,
+                     sizeof(membership)) < 0) {
+        std::cerr << "IP_ADD_MEMBERSHIP failed: " << strerror(errno)
+                  << std::endl;
+        close(fd);
+        close_all(listeners);
+        close(sender);
+        return result;
+      }
+    } else {
+      socklen_t len = sizeof(addr);
+      getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &len);
+      destinations.push_back(addr);
+    }
+    listeners.push_back(fd);
+  }
+
+  if (multicast) {
+    // same options as UDPServer::ApplyDeliveryMode, except that the stream
+    // has to loop back to reach the listeners on this host
+    uint8_t ttl = 1;
+    uint8_t loop = 1;
+    setsockopt(sender, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    setsockopt(sender, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+    setsockopt(sender, IPPROTO_IP, IP_MULTICAST_IF, &loopback,
+               sizeof(loopback));
+    sockaddr_in group = {};
+    group.sin_family = AF_INET;
+    group.sin_port = htons(GROUP_PORT);
+    inet_pton(AF_INET, GROUP, &group.sin_addr);
+    destinations.push_back(group);
+  }
+
+  std::vector<uint8_t> datagram(DATAGRAM_SIZE, 0x5a);
+  std::vector<size_t> received(listener_count, 0);
+  std::chrono::nanoseconds elapsed(0);
+
+  for (size_t packet = 0; packet < packets; packet++) {
+    auto start = std::chrono::steady_clock::now();
+    for (const sockaddr_in &dest : destinations) {
+      if (sendto(sender, datagram.data(), datagram.size(), 0,
+                 reinterpret_cast<const sockaddr *>(&dest),
+                 sizeof(dest)) == static_cast<ssize_t>(datagram.size())) {
+        result.datagrams_sent++;
+      }
+    }
+    elapsed += std::chrono::steady_clock::now() - start;
+
+    if ((packet + 1) % DRAIN_INTERVAL == 0) {
+      drain(listeners, received);
+    }
+  }
+  usleep(10000);
+  drain(listeners, received);
+
+  result.ns_per_packet = static_cast<double>(elapsed.count()) / packets;
+  result.min_received = received.empty() ? 0 : received[0];
+  for (size_t count : received) {
+    result.min_received = std::min(result.min_received, count);
+  }
+  result.ok = true;
+
+  close_all(listeners);
+  close(sender);
+  return result;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  size_t packets = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 5000;
+  if (packets == 0) {
+    packets = 5000;
+  }
+
+  std::cout << packets << " packets of " << DATAGRAM_SIZE
+            << " bytes per run, loopback\n\n";
+  std::cout << std::left << std::setw(11) << "listeners" << std::setw(26)
+            << "unicast ns/pkt (dgrams)" << std::setw(26)
+            << "multicast ns/pkt (dgrams)" << "speedup\n";
+
+  for (size_t listeners = 1; listeners <= MAX_LISTENERS; listeners++) {
+    Result unicast = run(listeners, false, packets);
+    Result multicast = run(listeners, true, packets);
+
+    std::cout << std::left << std::setw(11) << listeners;
+    for (const Result *r : {&unicast, &multicast}) {
+      if (!r->ok) {
+        std::cout << std::setw(26) << "n/a";
+        continue;
+      }
+      std::ostringstream cell;
+      cell << std::fixed << std::setprecision(0) << r->ns_per_packet << " ("
+           << r->datagrams_sent / packets << ")";
+      if (r->min_received < packets) {
+        cell << " lost " << packets - r->min_received;
+      }
+      std::cout << std::setw(26) << cell.str();
+    }
+    if (unicast.ok && multicast.ok && multicast.ns_per_packet > 0) {
+      std::cout << std::fixed << std::setprecision(2)
+                << unicast.ns_per_packet / multicast.ns_per_packet << "x";
+    }
+    std::cout << std::endl;
+  }
+  return 0;
+}
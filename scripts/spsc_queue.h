@@ -0,0 +1,43 @@
+// Single producer, single consumer queue between udp_client.cpp's receive
+// and disk writer threads.
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Bounded lock-free queue between exactly one producer and one consumer thread.
+// N is a power of two; one slot stays empty to tell full from empty.
+template <typename T, size_t N> class SpscQueue {
+  static_assert((N & (N - 1)) == 0, "N must be a power of two");
+
+public:
+  bool push(const T &item) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) == N - 1) {
+      return false;
+    }
+    items[head & (N - 1)] = item;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T &item) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = items[tail & (N - 1)];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t size() const {
+    return head_.load(std::memory_order_acquire) -
+           tail_.load(std::memory_order_acquire);
+  }
+
+private:
+  T items[N];
+  std::atomic<size_t> head_{0}; // written by the producer
+  std::atomic<size_t> tail_{0}; // written by the consumer
+};
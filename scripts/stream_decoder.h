@@ -0,0 +1,381 @@
+// One device's stream, datagrams in and a gapless sample timeline out: the
+// receive path udp_client.cpp runs per device.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include "client_protocol.h"
+#include "fec_decoder.h"
+#include "ima_adpcm_decoder.h"
+#include "jitter_buffer.h"
+#include "loss_detector.h"
+
+// Decodes one device's stream into a gapless sample timeline: FEC recovery,
+// jitter buffering, ADPCM decoding and VAD silence expansion. The samples go
+// to the sink on the thread that feeds the datagrams. On a sample rate change
+// the old timeline is played out first, then the rate callback runs before
+// any samples at the new rate.
+class StreamDecoder {
+public:
+  static constexpr uint32_t DEFAULT_SAMPLE_RATE = 16000;
+
+  using Sink = JitterBuffer::Sink;
+  using RateCallback = std::function<void(uint32_t)>;
+
+  struct Stats {
+    uint64_t fec_recovered = 0;
+    uint64_t data_bytes = 0;
+    uint64_t parity_bytes = 0;
+    uint64_t silence_descriptors = 0;
+    uint64_t silence_samples = 0;
+    uint64_t gap_markers = 0;
+    uint64_t gap_samples = 0;
+    uint64_t resyncs = 0; // gaps too long to fill, a new timeline followed
+  };
+
+  StreamDecoder(Sink sink, RateCallback on_rate_change)
+      : sink(sink), on_rate_change(std::move(on_rate_change)),
+        jitter_buffer(sink) {}
+
+  // Fill VAD silence runs with noise at the level the server measured
+  // instead of digital silence.
+  void set_comfort_noise(bool enabled) { comfort_noise = enabled; }
+  bool get_comfort_noise() const { return comfort_noise; }
+
+  // Print the first samples and the range of every nth packet, 0 for none.
+  void set_debug_interval(uint64_t packets) { debug_interval = packets; }
+
+  // Ask the device to send lost packets again, see build_nack
+  void set_nack(bool enabled) { nack_enabled = enabled; }
+  bool get_nack() const { return nack_enabled; }
+
+  // DATA and PARITY datagrams, anything else is ignored
+  void handle_datagram(const char *buffer, size_t received_bytes) {
+    if (received_bytes < sizeof(MessageHeader)) {
+      return;
+    }
+
+    const MessageHeader *header =
+        reinterpret_cast<const MessageHeader *>(buffer);
+    const uint8_t *body =
+        reinterpret_cast<const uint8_t *>(buffer + sizeof(MessageHeader));
+    size_t body_size = received_bytes - sizeof(MessageHeader);
+    recovered.clear();
+
+    if (header->type == static_cast<uint8_t>(MessageType::PARITY)) {
+      parity_bytes += received_bytes;
+      uint8_t group_size = fec_decoder.add_parity(body, body_size, recovered);
+      if (group_size > 0 && group_size != fec_group_size) {
+        fec_group_size = group_size;
+        update_min_depth();
+      }
+    } else if (header->type == static_cast<uint8_t>(MessageType::DATA)) {
+      data_bytes += received_bytes;
+      set_sample_rate(header->sample_rate_khz > 0 && header->version >= 1
+                          ? header->sample_rate_khz * 1000u
+                          : DEFAULT_SAMPLE_RATE);
+      if (header->version == 0) {
+        // legacy stream without DataHeader, straight to the sink
+        handle_data(header->codec, nullptr, body, body_size);
+        return;
+      }
+      if (body_size < sizeof(DataHeader)) {
+        return;
+      }
+      const DataHeader *data_header =
+          reinterpret_cast<const DataHeader *>(body);
+      const uint8_t *payload = body + sizeof(DataHeader);
+      size_t payload_size = body_size - sizeof(DataHeader);
+      if (!fec_decoder.add_data(data_header->sequence,
+                                data_header->sample_index, header->codec,
+                                payload, payload_size, recovered)) {
+        return; // duplicate or already rebuilt from parity
+      }
+      if (nack_enabled) {
+        loss_detector.on_packet(data_header->sequence,
+                                LossDetector::Clock::now());
+      }
+      handle_data(header->codec, data_header, payload, payload_size);
+    }
+
+    for (const FecDecoder::Packet &packet : recovered) {
+      if (nack_enabled) {
+        loss_detector.on_packet(packet.sequence, LossDetector::Clock::now());
+      }
+      DataHeader data_header = {packet.sequence, packet.sample_index};
+      handle_data(packet.codec, &data_header, packet.payload.data(),
+                  packet.payload.size());
+    }
+    fec_recovered = fec_decoder.recovered_packets();
+  }
+
+  // Plays out whatever the jitter buffer still holds
+  void flush() { jitter_buffer.flush(); }
+
+  // The NACK for the packets that are missing and can still make it into the
+  // jitter buffer, to send to the device on the thread that feeds the
+  // datagrams. A request is repeated once the measured round trip says the
+  // answer is overdue, and no sooner than a packet's time, the device's send
+  // period. Returns its size, 0 if nothing is due
+  size_t build_nack(char *datagram) {
+    if (!nack_enabled) {
+      return 0;
+    }
+    JitterBuffer::Stats stream = jitter_buffer.get_stats();
+    if (stream.packet_samples == 0) {
+      return 0;
+    }
+    auto packet_time = std::chrono::microseconds(
+        stream.packet_samples * 1000000ull / sample_rate);
+    return loss_detector.build(
+        LossDetector::Clock::now(),
+        stream.target_depth_samples / stream.packet_samples, packet_time,
+        datagram);
+  }
+
+  // Not synchronized, read it once the datagrams stopped
+  LossDetector::Stats get_nack_stats() const {
+    return loss_detector.get_stats();
+  }
+
+  uint32_t get_sample_rate() const { return sample_rate; }
+  uint8_t get_fec_group_size() const { return fec_group_size; }
+  JitterBuffer::Stats get_stream_stats() { return jitter_buffer.get_stats(); }
+
+  Stats get_stats() const {
+    Stats result;
+    result.fec_recovered = fec_recovered;
+    result.data_bytes = data_bytes;
+    result.parity_bytes = parity_bytes;
+    result.silence_descriptors = silence_descriptors;
+    result.silence_samples = silence_samples;
+    result.gap_markers = gap_markers;
+    result.gap_samples = gap_samples;
+    result.resyncs = resyncs;
+    return result;
+  }
+
+private:
+  static constexpr size_t MAX_DECODED_SAMPLES = 4096;
+  static constexpr uint32_t MAX_SILENCE_SECONDS = 2;
+  static constexpr uint32_t MAX_GAP_FILL_SECONDS = 5;
+
+  // A WAV file has a single rate: the audio at the old rate is played out
+  // before the sink hears of the new one
+  void set_sample_rate(uint32_t rate) {
+    if (rate == sample_rate) {
+      return;
+    }
+    jitter_buffer.flush();
+    jitter_buffer.reset();
+    fec_decoder = FecDecoder();
+    loss_detector.reset();
+    latency_profile_ms = 0;
+    sample_rate = rate;
+    on_rate_change(rate);
+  }
+
+  // Decodes one DATA payload and hands it to the jitter buffer (or straight
+  // to the sink for version 0 streams without a DataHeader)
+  void handle_data(uint8_t codec, const DataHeader *data_header,
+                   const uint8_t *payload, size_t payload_size) {
+    int16_t decoded[MAX_DECODED_SAMPLES];
+
+    // Process as int16 data (similar to numpy.frombuffer), decoding
+    // compressed payloads first
+    const int16_t *int16_data = reinterpret_cast<const int16_t *>(payload);
+    int sample_count = payload_size / 2;
+
+    if (codec == static_cast<uint8_t>(AudioCodec::IMA_ADPCM)) {
+      if (payload_size > MAX_DECODED_SAMPLES / 2) {
+        return;
+      }
+      sample_count = static_cast<int>(
+          ima_adpcm::decode_block(payload, payload_size, decoded));
+      int16_data = decoded;
+    } else if (codec == static_cast<uint8_t>(AudioCodec::SILENCE)) {
+      handle_silence(data_header, payload, payload_size);
+      return;
+    } else if (codec == static_cast<uint8_t>(AudioCodec::GAP)) {
+      handle_gap(data_header, payload, payload_size);
+      return;
+    } else if (codec != static_cast<uint8_t>(AudioCodec::PCM16)) {
+      return; // unknown codec
+    }
+
+    if (debug_interval > 0 && sample_count > 0 &&
+        debug_packets++ % debug_interval == 0) {
+      print_debug(int16_data, sample_count);
+    }
+
+    if (sample_count > 0) {
+      uint32_t packet_ms = static_cast<uint32_t>(
+          static_cast<uint64_t>(sample_count) * 1000 / sample_rate);
+      // the longest packet, like the jitter buffer's packet size: a short one
+      // is only the tail of a timer driven read
+      if (data_header && packet_ms > latency_profile_ms) {
+        latency_profile_ms = packet_ms;
+        update_min_depth();
+      }
+      if (data_header) {
+        jitter_buffer.push(data_header->sequence, data_header->sample_index,
+                           int16_data, sample_count);
+      } else {
+        sink(int16_data, sample_count);
+      }
+    }
+  }
+
+  // The jitter buffer floor: what the latency profile the packet length
+  // points to asks for, and at least an FEC group and its parity, since a lost
+  // packet can only be rebuilt once the rest of its group is in. NACKs need
+  // one packet more, the device's answer comes with its next send
+  void update_min_depth() {
+    const LatencyProfile *profile = &LATENCY_PROFILES[0];
+    while (profile->frame_ms < latency_profile_ms &&
+           profile + 1 < std::end(LATENCY_PROFILES)) {
+      profile++;
+    }
+    size_t packets = profile->buffer_packets;
+    if (fec_group_size > 0) {
+      packets = std::max(packets, static_cast<size_t>(fec_group_size) + 1);
+    }
+    if (nack_enabled) {
+      packets++;
+    }
+    jitter_buffer.set_min_depth(packets);
+  }
+
+  // Sampled packet dump for --debug, no flush so the console cannot stall
+  // the receive thread
+  void print_debug(const int16_t *samples, int count) {
+    std::cout << "\nFirst 8 samples: ";
+    for (int i = 0; i < std::min(8, count); i++) {
+      std::cout << samples[i] << " ";
+    }
+
+    int16_t min_val = 32767, max_val = -32768;
+    int64_t sum = 0;
+    for (int i = 0; i < count; i++) {
+      min_val = std::min(min_val, samples[i]);
+      max_val = std::max(max_val, samples[i]);
+      sum += samples[i];
+    }
+    std::cout << "| range: min=" << min_val << ", max=" << max_val
+              << ", mean=" << std::fixed << std::setprecision(2)
+              << static_cast<double>(sum) / count << '\n';
+  }
+
+  // Expands a SILENCE descriptor back into the samples the server's VAD left
+  // out, so the recording keeps its timeline
+  void handle_silence(const DataHeader *data_header, const uint8_t *payload,
+                      size_t payload_size) {
+    SilenceDescriptor descriptor;
+    if (payload_size < sizeof(descriptor)) {
+      return;
+    }
+    std::memcpy(&descriptor, payload, sizeof(descriptor));
+    // at most a second or so per descriptor, anything longer is corrupt
+    if (descriptor.samples == 0 ||
+        descriptor.samples > MAX_SILENCE_SECONDS * sample_rate) {
+      return;
+    }
+
+    silence_buffer.assign(descriptor.samples, 0);
+    if (comfort_noise && descriptor.noise_rms > 0) {
+      // uniform noise with the same rms as the suppressed background
+      double amplitude = descriptor.noise_rms * std::sqrt(3.0);
+      std::uniform_real_distribution<double> noise(-amplitude, amplitude);
+      for (int16_t &sample : silence_buffer) {
+        sample = static_cast<int16_t>(noise(noise_rng));
+      }
+    }
+    silence_descriptors++;
+    silence_samples += descriptor.samples;
+
+    if (data_header) {
+      jitter_buffer.push(data_header->sequence, data_header->sample_index,
+                         silence_buffer.data(), silence_buffer.size(), true);
+    } else {
+      sink(silence_buffer.data(), silence_buffer.size());
+    }
+  }
+
+  // A GAP marker: the audio is gone on the server, there is nothing to wait
+  // for or conceal. A short gap is filled with silence so the recording keeps
+  // its timeline, after a long one the recording starts a new timeline at the
+  // next packet instead of carrying seconds of nothing.
+  void handle_gap(const DataHeader *data_header, const uint8_t *payload,
+                  size_t payload_size) {
+    GapDescriptor descriptor;
+    if (!data_header || payload_size < sizeof(descriptor)) {
+      return;
+    }
+    std::memcpy(&descriptor, payload, sizeof(descriptor));
+    if (descriptor.samples == 0) {
+      return;
+    }
+    gap_markers++;
+    gap_samples += descriptor.samples;
+
+    if (descriptor.samples > MAX_GAP_FILL_SECONDS * sample_rate) {
+      std::cout << "\nServer dropped " << std::fixed << std::setprecision(1)
+                << descriptor.samples / static_cast<double>(sample_rate)
+                << "s of audio ("
+                << (descriptor.reason == GAP_REASON_SHED ? "backlog shed"
+                                                         : "ring buffer full")
+                << "), resynchronizing" << std::endl;
+      jitter_buffer.flush();
+      jitter_buffer.reset();
+      loss_detector.reset();
+      resyncs++;
+      return;
+    }
+
+    silence_buffer.assign(descriptor.samples, 0);
+    jitter_buffer.push(data_header->sequence, data_header->sample_index,
+                       silence_buffer.data(), silence_buffer.size(), true);
+  }
+
+  Sink sink;
+  RateCallback on_rate_change;
+  JitterBuffer jitter_buffer;
+  FecDecoder fec_decoder;
+  std::vector<FecDecoder::Packet> recovered;
+  bool nack_enabled = true;
+  LossDetector loss_detector;
+  uint8_t fec_group_size = 0;
+  uint32_t latency_profile_ms = 0; // longest packet at this rate
+
+  // written by the decoding thread only, read by the statistics
+  std::atomic<uint32_t> sample_rate{DEFAULT_SAMPLE_RATE};
+  std::atomic<uint64_t> fec_recovered{0};
+  std::atomic<uint64_t> data_bytes{0};
+  std::atomic<uint64_t> parity_bytes{0};
+
+  // VAD silence runs, expanded by handle_silence
+  std::vector<int16_t> silence_buffer;
+  bool comfort_noise = false;
+  std::mt19937 noise_rng{54321};
+  std::atomic<uint64_t> silence_descriptors{0};
+  std::atomic<uint64_t> silence_samples{0};
+
+  // server overruns, handled by handle_gap
+  std::atomic<uint64_t> gap_markers{0};
+  std::atomic<uint64_t> gap_samples{0};
+  std::atomic<uint64_t> resyncs{0};
+
+  uint64_t debug_interval = 0;
+  uint64_t debug_packets = 0;
+};
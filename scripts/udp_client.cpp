@@ -1,70 +1,47 @@
+// Records the device's UDP audio stream to WAV or FLAC files, or several
+// devices into one multichannel file (--devices), and polls the device's
+// STATS counters (--stats). The receive path lives in the headers next to
+// this file, header only so the client still builds with one line:
+//
+// Build: g++ -std=gnu++20 -O2 -Wall -pthread -o udp_client udp_client.cpp
 #include <atomic>
 #include <chrono>
 #include <csignal>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <ctime>
-#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <random>
+#include <sstream>
 #include <string>
 #include <thread>
 #include <vector>
 
-#ifdef _WIN32
-#include <winsock2.h>
-#include <ws2tcpip.h>
-#pragma comment(lib, "ws2_32.lib")
-typedef int socklen_t;
-#else
-#include <arpa/inet.h>
-#include <fcntl.h>
-#include <netinet/in.h>
-#include <sys/socket.h>
-#include <unistd.h>
-#define SOCKET int
-#define INVALID_SOCKET -1
-#define SOCKET_ERROR -1
-// Don't redefine closesocket as close - we'll handle it differently
-#endif
-
-// Wave file header structure
-struct WavHeader {
-  // RIFF chunk
-  char riff_header[4] = {'R', 'I', 'F', 'F'};
-  uint32_t wav_size = 0; // Will be filled in later
-  char wave_header[4] = {'W', 'A', 'V', 'E'};
-
-  // fmt chunk
-  char fmt_header[4] = {'f', 'm', 't', ' '};
-  uint32_t fmt_chunk_size = 16;
-  uint16_t audio_format = 1; // PCM
-  uint16_t num_channels = 1; // Mono
-  uint32_t sample_rate = 16000;
-  uint32_t byte_rate = 32000; // sample_rate * num_channels * bytes_per_sample
-  uint16_t block_align = 2;   // num_channels * bytes_per_sample
-  uint16_t bits_per_sample = 16;
-
-  // data chunk
-  char data_header[4] = {'d', 'a', 't', 'a'};
-  uint32_t data_chunk_size = 0; // Will be filled in later
-};
+#include "client_protocol.h"
+#include "client_socket.h"
+#include "disk_writer.h"
+#include "jitter_buffer.h"
+#include "loss_detector.h"
+#include "multi_device_client.h"
+#include "rate_upsampler.h"
+#include "recording_segment.h"
+#include "stream_decoder.h"
 
 class UDPClient {
 public:
   UDPClient(const std::string &server_ip = "192.168.4.1",
             int server_port = 5001)
-      : server_ip(server_ip), server_port(server_port), running(false),
-        connected(false), total_bytes(0), bytes_since_last_update(0),
-        sample_rate(16000) {
+      : server_ip(server_ip), server_port(server_port),
+        decoder(
+            [this](const int16_t *samples, size_t count) {
+              write_samples(samples, count);
+            },
+            [this](uint32_t rate) { change_sample_rate(rate); }) {
 
     // Create timestamped filename
-    auto now = std::chrono::system_clock::now();
-    std::time_t now_time = std::chrono::system_clock::to_time_t(now);
-    std::tm *now_tm = std::localtime(&now_time);
-
-    char timestamp[20];
-    std::strftime(timestamp, sizeof(timestamp), "%Y%m%d_%H%M%S", now_tm);
-    wav_filename = "audio_" + std::string(timestamp) + ".wav";
+    recording_name = make_recording_name();
 
 // Initialize socket
 #ifdef _WIN32
@@ -96,36 +73,15 @@ public:
     tv.tv_usec = 0;
     setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char *)&tv, sizeof(tv));
 #endif
-
-    init_wav_file();
   }
 
   ~UDPClient() { close(); }
 
-  void init_wav_file() {
-    if (wav_file.is_open()) {
-      wav_file.close();
-    }
-
-    wav_file.open(wav_filename, std::ios::binary);
-    if (!wav_file.is_open()) {
-      std::cerr << "Failed to create WAV file: " << wav_filename << std::endl;
-      exit(1);
-    }
-
-    // Write header (will update sizes later)
-    WavHeader header;
-    wav_file.write(reinterpret_cast<const char *>(&header), sizeof(header));
-    data_size = 0;
-
-    std::cout << "Created new WAV file: " << wav_filename << std::endl;
-  }
-
   bool connect() {
     std::cout << "Trying to connect to " << server_ip << ":" << server_port
               << "..." << std::endl;
 
-    struct sockaddr_in server_addr;
+    server_addr = {};
     server_addr.sin_family = AF_INET;
     server_addr.sin_port = htons(server_port);
 #ifdef _WIN32
@@ -150,7 +106,91 @@ public:
     }
   }
 
+  void send_keepalive() {
+    MessageHeader header = {static_cast<uint8_t>(MessageType::KEEPALIVE),
+                            PROTOCOL_VERSION, 0, 0};
+    sendto(sock, reinterpret_cast<const char *>(&header), sizeof(header), 0,
+           (struct sockaddr *)&server_addr, sizeof(server_addr));
+  }
+
+  void send_receiver_report(uint32_t interval_ms) {
+    char datagram[ReceiverReporter::DATAGRAM_SIZE];
+    size_t size =
+        reporter.build(decoder.get_stream_stats(), interval_ms, datagram);
+    if (size > 0) {
+      sendto(sock, datagram, static_cast<int>(size), 0,
+             (struct sockaddr *)&server_addr, sizeof(server_addr));
+    }
+  }
+
+  // From the receive thread, the hole was just found or a retry is due
+  void send_nack() {
+    char datagram[LossDetector::DATAGRAM_CAPACITY];
+    size_t size = decoder.build_nack(datagram);
+    if (size > 0) {
+      sendto(sock, datagram, static_cast<int>(size), 0,
+             (struct sockaddr *)&server_addr, sizeof(server_addr));
+    }
+  }
+
+  // Receive the stream on GROUP_DELIVERY_PORT instead of the hello socket's
+  // own port. An empty group means broadcast. Call before start_receiving().
+  void set_group(const std::string &group) {
+    group_mode = true;
+    group_ip = group;
+  }
+
+  bool join_group() {
+    // several clients on one host may share the port
+    int enable = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char *)&enable,
+               sizeof(enable));
+#ifdef SO_REUSEPORT
+    setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, (const char *)&enable,
+               sizeof(enable));
+#endif
+
+    struct sockaddr_in local_addr = {};
+    local_addr.sin_family = AF_INET;
+    local_addr.sin_port = htons(GROUP_DELIVERY_PORT);
+    local_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(sock, (struct sockaddr *)&local_addr, sizeof(local_addr)) ==
+        SOCKET_ERROR) {
+      std::cerr << "Failed to bind port " << GROUP_DELIVERY_PORT << std::endl;
+      return false;
+    }
+
+    if (group_ip.empty()) {
+      std::cout << "Listening for broadcast on port " << GROUP_DELIVERY_PORT
+                << std::endl;
+      return true;
+    }
+
+    struct ip_mreq membership = {};
+    if (inet_pton(AF_INET, group_ip.c_str(), &membership.imr_multiaddr) != 1) {
+      std::cerr << "Invalid multicast group: " << group_ip << std::endl;
+      return false;
+    }
+    membership.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+                   (const char *)&membership,
+                   sizeof(membership)) == SOCKET_ERROR) {
+      std::cerr << "Failed to join multicast group " << group_ip << std::endl;
+      return false;
+    }
+    std::cout << "Joined multicast group " << group_ip << ":"
+              << GROUP_DELIVERY_PORT << std::endl;
+    return true;
+  }
+
   bool start_receiving() {
+    if (group_mode && !join_group()) {
+      return false;
+    }
+    apply_socket_options();
+
+    // the hello registers this client even in group mode, the server only
+    // streams while someone is listening
     if (!connect()) {
       return false;
     }
@@ -158,7 +198,9 @@ public:
     running = true;
     connected = true;
 
-    // Start receive thread
+    // Start the disk writer and receive thread
+    recording_rate = decoder.get_sample_rate();
+    disk_writer.start(recording_name, recording_rate);
     receive_thread = std::thread(&UDPClient::_receive_loop, this);
     stats_thread = std::thread(&UDPClient::_stats_loop, this);
 
@@ -166,6 +208,10 @@ public:
   }
 
   void close() {
+    if (closed) {
+      return;
+    }
+    closed = true;
     running = false;
 
     if (receive_thread.joinable()) {
@@ -176,25 +222,11 @@ public:
       stats_thread.join();
     }
 
-    if (wav_file.is_open()) {
-      // Update WAV header with final sizes
-      wav_file.seekp(0, std::ios::end);
-      size_t file_size = wav_file.tellp();
-
-      // Update RIFF chunk size
-      wav_file.seekp(4, std::ios::beg);
-      uint32_t riff_size = file_size - 8;
-      wav_file.write(reinterpret_cast<const char *>(&riff_size),
-                     sizeof(riff_size));
-
-      // Update data chunk size
-      wav_file.seekp(40, std::ios::beg);
-      wav_file.write(reinterpret_cast<const char *>(&data_size),
-                     sizeof(data_size));
-
-      wav_file.close();
-      std::cout << "\nSaved audio file: " << wav_filename << std::endl;
-    }
+    // play out whatever the jitter buffer still holds
+    // then close the last segment so the disk figures are final
+    decoder.flush();
+    disk_writer.stop();
+    print_stream_stats();
 
 // Close socket with platform-specific method
 #ifdef _WIN32
@@ -205,21 +237,191 @@ public:
 #endif
   }
 
-  std::string get_wav_filename() const { return wav_filename; }
+  // Recording files are <name>.wav, <name>_001.wav, ...
+  std::string get_recording_name() const { return recording_name; }
 
   std::string get_server_ip() const { return server_ip; }
 
   int get_server_port() const { return server_port; }
 
+  // Drop this fraction of received datagrams to exercise loss recovery.
+  void set_simulated_loss(double fraction) { simulated_loss = fraction; }
+
+  // Tell the device every second how many packets were lost, so its
+  // congestion control can react to loss it cannot see (on by default)
+  void set_receiver_reports(bool enabled) { receiver_reports = enabled; }
+
+  // NACK lost packets so the device sends them again (on by default)
+  void set_nack(bool enabled) { decoder.set_nack(enabled); }
+
+  // Fill VAD silence runs with noise at the level the server measured
+  // instead of digital silence.
+  void set_comfort_noise(bool enabled) { decoder.set_comfort_noise(enabled); }
+
+  // Start a new file after this many seconds of audio or this many bytes,
+  // 0 for no limit. Call before start_receiving().
+  void set_rotation(uint32_t seconds, uint64_t bytes) {
+    disk_writer.set_rotation(seconds, bytes);
+  }
+
+  // WAV or FLAC files, FLAC encoded on this many threads (0: one per core).
+  // Call before start_receiving().
+  void set_format(RecordingFormat format, unsigned encoder_threads = 0) {
+    disk_writer.set_format(format, encoder_threads);
+  }
+
+  // Print the first samples and the range of every nth packet, 0 for none.
+  // The receive thread does no console I/O otherwise.
+  void set_debug_interval(uint64_t packets) {
+    decoder.set_debug_interval(packets);
+  }
+
+  // SO_RCVBUF to ask for, 0 keeps the system default. Call before
+  // start_receiving().
+  void set_receive_buffer(int bytes) { receive_buffer_bytes = bytes; }
+
+  // Linux reads up to 64 datagrams per recvmmsg call; off, one recvfrom each
+  void set_batch_receive(bool enabled) { batch_receive = enabled; }
+
 private:
+  // about 8 s of a 16 kHz PCM stream, clamped by net.core.rmem_max unless
+  // the client may force it
+  static constexpr int DEFAULT_RECEIVE_BUFFER_BYTES = 1 << 20;
+
+  void apply_socket_options() {
+    int actual = configure_receive_socket(sock, receive_buffer_bytes);
+    std::cout << "Socket receive buffer: " << actual / 1024 << " KB";
+    if (receive_buffer_bytes > 0 && actual < receive_buffer_bytes) {
+      std::cout << " (asked for " << receive_buffer_bytes / 1024
+                << " KB, raise net.core.rmem_max)";
+    }
+    std::cout << std::endl;
+  }
+
+  // Decoder callback, the audio at the old rate is out. A step down to a
+  // whole fraction of the recording's rate is upsampled into the same file,
+  // anything else starts a new one
+  void change_sample_rate(uint32_t rate) {
+    if (total_bytes > 0 && rate < recording_rate &&
+        recording_rate % rate == 0) {
+      std::cout << "\nStream sample rate: " << rate << " Hz, recorded at "
+                << recording_rate << " Hz" << std::endl;
+      upsampler.set_factor(recording_rate / rate);
+      return;
+    }
+    std::cout << "\nStream sample rate: " << rate << " Hz" << std::endl;
+    recording_rate = rate;
+    upsampler.set_factor(1);
+    disk_writer.set_sample_rate(rate);
+  }
+
+  void write_samples(const int16_t *samples, size_t count) {
+    size_t bytes = count * sizeof(int16_t);
+    upsampler.process(samples, count, [this](const int16_t *out, size_t n) {
+      disk_writer.append(out, n * sizeof(int16_t));
+    });
+
+    // Update statistics
+    total_bytes += bytes;
+    bytes_since_last_update += bytes;
+    audio_duration_us += count * 1000000ull / decoder.get_sample_rate();
+  }
+
+  void print_stream_stats() {
+    JitterBuffer::Stats stats = decoder.get_stream_stats();
+    StreamDecoder::Stats decoded = decoder.get_stats();
+    uint8_t fec_group_size = decoder.get_fec_group_size();
+    std::cout << "\nPackets: " << stats.received_packets
+              << " received, " << stats.lost_packets << " lost, "
+              << stats.reordered_packets << " reordered, "
+              << stats.late_packets << " late | concealed "
+              << stats.concealed_samples << " samples" << std::endl;
+    if (fec_group_size > 0 || simulated_loss > 0) {
+      uint64_t data = decoded.data_bytes, parity = decoded.parity_bytes;
+      std::cout << "FEC " << static_cast<int>(fec_group_size) << ":1 | "
+                << decoded.fec_recovered << " packets recovered, parity overhead "
+                << std::fixed << std::setprecision(1)
+                << (data > 0 ? 100.0 * parity / data : 0.0) << "%";
+      if (simulated_loss > 0) {
+        std::cout << " | " << simulated_drops << " datagrams dropped ("
+                  << simulated_loss * 100.0 << "% simulated loss)";
+      }
+      std::cout << std::endl;
+    }
+    uint64_t datagrams = datagrams_received, calls = receive_calls;
+    std::cout << "Receive: " << datagrams << " datagrams in " << calls
+              << (batch_receive ? " recvmmsg" : " recvfrom") << " calls ("
+              << std::fixed << std::setprecision(1)
+              << (calls > 0 ? static_cast<double>(datagrams) / calls : 0.0)
+              << " per call), " << kernel_drops << " dropped by the kernel"
+              << std::endl;
+    DiskWriter::Stats disk = disk_writer.get_stats();
+    std::cout << "Disk: " << disk.segments << " file(s), "
+              << disk.chunks_written << " writes of up to "
+              << DiskWriter::CHUNK_BYTES / 1024 << " KB, " << disk.pool_chunks
+              << " buffers pooled, " << disk.stalls << " stalls";
+    if (disk_writer.get_format() == RecordingFormat::FLAC &&
+        disk.bytes_written > 0) {
+      std::cout << ", FLAC " << std::fixed << std::setprecision(1)
+                << 100.0 * disk.bytes_stored / disk.bytes_written
+                << "% of the PCM";
+    }
+    if (disk.bytes_dropped > 0) {
+      std::cout << ", " << disk.bytes_dropped << " bytes not written";
+    }
+    std::cout << std::endl;
+    if (decoded.silence_descriptors > 0) {
+      std::cout << "VAD: " << decoded.silence_descriptors << " silence runs, "
+                << std::fixed << std::setprecision(1)
+                << decoded.silence_samples /
+                       static_cast<double>(decoder.get_sample_rate())
+                << "s of " << audio_duration_us / 1e6 << "s suppressed"
+                << (decoder.get_comfort_noise() ? " (comfort noise)" : "")
+                << std::endl;
+    }
+    LossDetector::Stats nack = decoder.get_nack_stats();
+    if (nack.requested > 0) {
+      std::cout << "NACK: " << nack.requested << " packets asked for in "
+                << nack.nacks << " requests, " << nack.recovered
+                << " arrived, " << nack.expired << " given up";
+      if (nack.rtt_samples > 0) {
+        std::cout << ", round trip " << nack.rtt_ms << "ms";
+      }
+      std::cout << std::endl;
+    }
+    if (decoded.gap_markers > 0) {
+      std::cout << "Server overruns: " << decoded.gap_markers << " gaps, "
+                << std::fixed << std::setprecision(1)
+                << decoded.gap_samples /
+                       static_cast<double>(decoder.get_sample_rate())
+                << "s of audio dropped, " << decoded.resyncs
+                << " resynchronized" << std::endl;
+    }
+  }
+
   void _stats_loop() {
     auto last_update_time = std::chrono::steady_clock::now();
+    auto last_keepalive_time = last_update_time;
+    auto last_report_time = last_update_time;
 
     while (running) {
       std::this_thread::sleep_for(
           std::chrono::milliseconds(200)); // Update every 0.2 seconds
 
       auto current_time = std::chrono::steady_clock::now();
+      if (current_time - last_keepalive_time >=
+          std::chrono::milliseconds(KEEPALIVE_INTERVAL_MS)) {
+        send_keepalive();
+        last_keepalive_time = current_time;
+      }
+      auto report_interval =
+          std::chrono::duration_cast<std::chrono::milliseconds>(
+              current_time - last_report_time);
+      if (receiver_reports &&
+          report_interval.count() >= RECEIVER_REPORT_INTERVAL_MS) {
+        send_receiver_report(static_cast<uint32_t>(report_interval.count()));
+        last_report_time = current_time;
+      }
       auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
                          current_time - last_update_time)
                          .count() /
@@ -229,15 +431,28 @@ private:
           (elapsed > 0) ? static_cast<double>(bytes_since_last_update) / elapsed
                         : 0;
 
-      // Calculate audio duration (seconds)
-      double audio_duration = static_cast<double>(total_bytes) /
-                              (sample_rate * 2); // 2 bytes/sample
+      // Calculate audio duration (seconds), the rate may have changed on the way
+      double audio_duration = audio_duration_us / 1e6;
+
+      JitterBuffer::Stats stream = decoder.get_stream_stats();
+      uint32_t sample_rate = decoder.get_sample_rate();
 
       // Show statistics (print without newline)
       std::cout << "\rReceived: " << std::fixed << std::setprecision(1)
                 << (total_bytes / 1024.0) << "KB ("
                 << (bytes_per_second / 1024.0) << " KB/s) | "
-                << "Duration: " << audio_duration << "s" << std::flush;
+                << "Duration: " << audio_duration << "s | "
+                << "Lost: " << stream.lost_packets
+                << " Reordered: " << stream.reordered_packets
+                << " Late: " << stream.late_packets
+                << " Recovered: " << decoder.get_stats().fec_recovered
+                << " | Jitter buffer: "
+                << (stream.target_depth_samples * 1000.0 / sample_rate)
+                << "ms @ " << sample_rate / 1000 << "kHz";
+      if (kernel_drops > 0) {
+        std::cout << " | Kernel drops: " << kernel_drops;
+      }
+      std::cout << std::flush;
 
       last_update_time = current_time;
       bytes_since_last_update = 0;
@@ -245,6 +460,12 @@ private:
   }
 
   void _receive_loop() {
+#ifdef __linux__
+    if (batch_receive) {
+      _receive_loop_batched();
+      return;
+    }
+#endif
     const size_t buffer_size = 2048;
     char buffer[buffer_size];
     struct sockaddr_in sender_addr;
@@ -255,56 +476,12 @@ private:
         int received_bytes =
             recvfrom(sock, buffer, buffer_size, 0,
                      (struct sockaddr *)&sender_addr, &sender_addr_size);
-
-        if (received_bytes > 0) {
-          // Process as int16 data (similar to numpy.frombuffer)
-          int16_t *int16_data = reinterpret_cast<int16_t *>(buffer);
-          int sample_count = received_bytes / 2; // Each sample is 2 bytes
-
-          // Check for leading zeros and skip if necessary
-          int start_idx = 0;
-          if (sample_count >= 482 && int16_data[0] == 0 && int16_data[1] == 0) {
-            start_idx = 2;
-            std::cout << "\nSkipped 2 leading zeros, remaining samples: "
-                      << (sample_count - 2) << std::endl;
-          }
-
-          // Print first 8 samples
-          if (sample_count > start_idx) {
-            std::cout << "First 8 samples: ";
-            for (int i = start_idx; i < std::min(start_idx + 8, sample_count);
-                 i++) {
-              std::cout << int16_data[i] << " ";
-            }
-            std::cout << std::endl;
-
-            // Calculate data range statistics
-            int16_t min_val = 32767, max_val = -32768;
-            double sum = 0;
-            for (int i = start_idx; i < sample_count; i++) {
-              min_val = std::min(min_val, int16_data[i]);
-              max_val = std::max(max_val, int16_data[i]);
-              sum += int16_data[i];
-            }
-            double mean = sum / (sample_count - start_idx);
-
-            std::cout << "Data range: min=" << min_val << ", max=" << max_val
-                      << ", mean=" << std::fixed << std::setprecision(2) << mean
-                      << std::endl;
-          }
-
-          // Only write valid audio data (skip the first two samples if needed)
-          int data_size_to_write = (sample_count - start_idx) * 2;
-          if (data_size_to_write > 0) {
-            wav_file.write(
-                reinterpret_cast<const char *>(&int16_data[start_idx]),
-                data_size_to_write);
-
-            // Update statistics
-            total_bytes += data_size_to_write;
-            bytes_since_last_update += data_size_to_write;
-            data_size += data_size_to_write;
-          }
+        receive_calls++;
+        if (received_bytes >= 0) {
+          handle_datagram(buffer, received_bytes);
+          send_nack();
+        } else {
+          disk_writer.flush_if_stale(); // timeout, the stream may have paused
         }
       } catch (const std::exception &e) {
         std::cerr << "\nError receiving data: " << e.what() << std::endl;
@@ -314,45 +491,427 @@ private:
     }
   }
 
+#ifdef __linux__
+  // MSG_WAITFORONE blocks (up to SO_RCVTIMEO) for the first datagram only and
+  // takes whatever else is already queued
+  void _receive_loop_batched() {
+    ReceiveBatch batch;
+    uint64_t drops = 0;
+    while (running) {
+      int count = batch.receive(sock, MSG_WAITFORONE, drops);
+      receive_calls++;
+      if (count <= 0) {
+        disk_writer.flush_if_stale(); // timeout, the stream may have paused
+        continue;
+      }
+      kernel_drops = drops;
+      for (int i = 0; i < count; i++) {
+        handle_datagram(batch.data(i), batch.size(i));
+      }
+      send_nack();
+    }
+  }
+#endif
+
+  void handle_datagram(const char *buffer, size_t received_bytes) {
+    datagrams_received++;
+    if (simulated_loss > 0 && loss_dist(loss_rng) < simulated_loss) {
+      simulated_drops++;
+      return;
+    }
+    decoder.handle_datagram(buffer, received_bytes);
+  }
+
   std::string server_ip;
   int server_port;
+  struct sockaddr_in server_addr = {};
   SOCKET sock;
-  std::atomic<bool> running;
-  std::atomic<bool> connected;
+  std::atomic<bool> running{false};
+  std::atomic<bool> connected{false};
   std::thread receive_thread;
   std::thread stats_thread;
 
-  int sample_rate;
-  std::string wav_filename;
-  std::ofstream wav_file;
-  uint32_t data_size;
+  // written by the receive thread only
+  std::atomic<uint64_t> audio_duration_us{0};
+  std::string recording_name;
+  DiskWriter disk_writer;
+  uint32_t recording_rate = 0;  // the files' rate, receive thread only
+  RateUpsampler upsampler;
+  bool closed = false;
+
+  std::atomic<size_t> total_bytes{0};
+  std::atomic<size_t> bytes_since_last_update{0};
+
+  StreamDecoder decoder;
+
+  bool group_mode = false;
+  std::string group_ip; // empty: broadcast
+
+  bool receiver_reports = true;
+  ReceiverReporter reporter; // stats thread only
+
+  // fraction of datagrams dropped on purpose before processing (testing)
+  double simulated_loss = 0.0;
+  uint64_t simulated_drops = 0;
+  std::mt19937 loss_rng{12345};
+  std::uniform_real_distribution<double> loss_dist{0.0, 1.0};
+
+  // receive path, written by the receive thread only
+  bool batch_receive = true;
+  int receive_buffer_bytes = DEFAULT_RECEIVE_BUFFER_BYTES;
+  std::atomic<uint64_t> receive_calls{0};
+  std::atomic<uint64_t> datagrams_received{0};
+  std::atomic<uint64_t> kernel_drops{0}; // SO_RXQ_OVFL, batched path only
+};
+// Polls a device with STATS requests and prints one CSV row per reply, a time
+// series for monitoring devices in the field without a serial console. Runs
+// on its own socket: it never says hello, so it does not receive the stream.
+class StatsMonitor {
+public:
+  StatsMonitor(const std::string &server_ip, int server_port,
+               double interval_s)
+      : interval_ms(std::max(50, static_cast<int>(interval_s * 1000))) {
+#ifdef _WIN32
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+      std::cerr << "Failed to initialize Winsock" << std::endl;
+      exit(1);
+    }
+#endif
+    sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock == INVALID_SOCKET) {
+      std::cerr << "Failed to create socket" << std::endl;
+      exit(1);
+    }
+#ifdef _WIN32
+    DWORD timeout = interval_ms;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char *)&timeout,
+               sizeof(timeout));
+#else
+    struct timeval tv;
+    tv.tv_sec = interval_ms / 1000;
+    tv.tv_usec = (interval_ms % 1000) * 1000;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char *)&tv, sizeof(tv));
+#endif
+
+    server_addr = {};
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(server_port);
+    inet_pton(AF_INET, server_ip.c_str(), &server_addr.sin_addr);
+  }
+
+  ~StatsMonitor() {
+#ifdef _WIN32
+    closesocket(sock);
+    WSACleanup();
+#else
+    ::close(sock);
+#endif
+  }
+
+  // Runs until stop() (or count replies, if count > 0)
+  void run(uint64_t count = 0) {
+    print_header();
+    uint64_t replies = 0;
+    auto next_poll = std::chrono::steady_clock::now();
+
+    while (running && (count == 0 || replies < count)) {
+      MessageHeader request = {static_cast<uint8_t>(MessageType::STATS),
+                               PROTOCOL_VERSION, 0, 0};
+      sendto(sock, reinterpret_cast<const char *>(&request), sizeof(request),
+             0, (struct sockaddr *)&server_addr, sizeof(server_addr));
+      next_poll += std::chrono::milliseconds(interval_ms);
+
+      // wait for the reply until the next poll is due, stray datagrams and
+      // replies to earlier polls that arrived late are skipped
+      StatsSnapshot snapshot;
+      bool answered = false;
+      while (running && !answered &&
+             std::chrono::steady_clock::now() < next_poll) {
+        answered = receive(snapshot);
+      }
+      if (answered) {
+        print_row(snapshot);
+        replies++;
+      } else if (running) {
+        std::cerr << timestamp() << " no reply" << std::endl;
+      }
+      std::this_thread::sleep_until(next_poll);
+    }
+  }
+
+  void stop() { running = false; }
+
+private:
+  bool receive(StatsSnapshot &snapshot) {
+    char buffer[512];
+    struct sockaddr_in sender_addr;
+    socklen_t sender_addr_size = sizeof(sender_addr);
+    int len = recvfrom(sock, buffer, sizeof(buffer), 0,
+                       (struct sockaddr *)&sender_addr, &sender_addr_size);
+    if (len < static_cast<int>(sizeof(MessageHeader) + sizeof(uint16_t))) {
+      return false;
+    }
+    const MessageHeader *header = reinterpret_cast<const MessageHeader *>(buffer);
+    if (header->type != static_cast<uint8_t>(MessageType::STATS)) {
+      return false;
+    }
+    // an older server sends a shorter snapshot, a newer one a longer one
+    snapshot = {};
+    size_t size = std::min(static_cast<size_t>(len) - sizeof(MessageHeader),
+                           sizeof(snapshot));
+    std::memcpy(&snapshot, buffer + sizeof(MessageHeader), size);
+    return true;
+  }
+
+  static std::string timestamp() {
+    auto now = std::chrono::system_clock::now();
+    std::time_t now_time = std::chrono::system_clock::to_time_t(now);
+    char text[32];
+    std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%S",
+                  std::localtime(&now_time));
+    return text;
+  }
+
+  void print_header() {
+    std::cout << "time,uptime_s,sample_rate,clients,packets_sent,"
+                 "send_failures,bytes_sent,kbps,parity_packets,"
+                 "vad_suppressed,ring_fill_pct,ring_dropped,free_heap,"
+                 "min_free_heap,free_psram,min_free_psram";
+    for (const char *stage : STATS_STAGE_NAMES) {
+      std::cout << "," << stage << "_p50_us," << stage << "_p99_us," << stage
+                << "_max_us";
+    }
+    std::cout << ",ring_shed,ring_idle,gap_markers,overrun_policy,"
+                 "retransmitted,nack_expired"
+              << std::endl;
+  }
+
+  void print_row(const StatsSnapshot &s) {
+    // rate over the poll interval, from the device's own clock
+    double kbps = 0;
+    if (have_previous && s.uptime_ms > previous.uptime_ms &&
+        s.bytes_sent >= previous.bytes_sent) {
+      kbps = (s.bytes_sent - previous.bytes_sent) * 8.0 /
+             (s.uptime_ms - previous.uptime_ms);
+    }
+    previous = s;
+    have_previous = true;
+
+    double fill = s.ring_capacity_samples > 0
+                      ? 100.0 * s.ring_fill_samples / s.ring_capacity_samples
+                      : 0;
+    std::cout << timestamp() << "," << std::fixed << std::setprecision(1)
+              << s.uptime_ms / 1000.0 << "," << s.sample_rate << ","
+              << static_cast<int>(s.client_count) << "," << s.packets_sent
+              << "," << s.send_failures << "," << s.bytes_sent << "," << kbps
+              << "," << s.parity_packets << "," << s.vad_suppressed_packets
+              << "," << fill << "," << s.ring_dropped_samples << ","
+              << s.free_heap << "," << s.min_free_heap << "," << s.free_psram
+              << "," << s.min_free_psram;
+    // empty columns when the firmware was built without the latency trace
+    bool traced = s.flags & STATS_FLAG_LATENCY_TRACE;
+    for (const StatsStageLatency &stage : s.stages) {
+      if (traced && stage.count > 0) {
+        std::cout << "," << stage.p50_us << "," << stage.p99_us << ","
+                  << stage.max_us;
+      } else {
+        std::cout << ",,,";
+      }
+    }
+    std::cout << "," << s.ring_shed_samples << "," << s.ring_idle_samples << ","
+              << s.gap_markers << "," << static_cast<int>(s.overrun_policy)
+              << "," << s.retransmitted_packets << "," << s.nack_expired_packets
+              << std::endl;
+  }
 
-  std::atomic<size_t> total_bytes;
-  std::atomic<size_t> bytes_since_last_update;
+  SOCKET sock;
+  struct sockaddr_in server_addr;
+  int interval_ms;
+  std::atomic<bool> running{true};
+  StatsSnapshot previous = {};
+  bool have_previous = false;
 };
 
-// Signal handler for Ctrl+C
-UDPClient *global_client = nullptr;
+// Ctrl+C, SIGTERM and SIGHUP only raise flags (lock-free atomics); main()
+// closes the recording outside signal context
+std::atomic<bool> stop_requested{false};
+StatsMonitor *global_monitor = nullptr;
+static_assert(std::atomic<bool>::is_always_lock_free);
+
 void signal_handler(int signal) {
-  std::cout << "\nStopping recording..." << std::endl;
-  if (global_client) {
-    global_client->close();
+  stop_requested = true;
+  if (global_monitor) {
+    global_monitor->stop();
   }
-  exit(0);
+}
+
+void install_signal_handlers() {
+  signal(SIGINT, signal_handler);
+  signal(SIGTERM, signal_handler);
+#ifdef SIGHUP
+  signal(SIGHUP, signal_handler);
+#endif
+}
+
+// Optional numeric flag arguments, without mistaking the server address for one
+bool is_positive_number(const char *text) {
+  char *end = nullptr;
+  double value = std::strtod(text, &end);
+  return end != text && *end == '\0' && value > 0;
 }
 
 int main(int argc, char *argv[]) {
-  std::string server_ip = "192.168.4.1";
+  std::vector<DeviceAddress> addresses;
+  bool multi_device = false;
+  bool arrival_alignment = false;
+
+  double simulated_loss = 0.0;
+  bool comfort_noise = false;
+  bool group_mode = false;
+  std::string group;
+  double stats_interval_s = 0;
+  uint64_t stats_count = 0;
+  uint64_t debug_interval = 0;
+  int receive_buffer = -1;
+  bool batch_receive = true;
+  uint32_t segment_seconds = 0;
+  uint64_t segment_bytes = 0;
+  RecordingFormat format = RecordingFormat::WAV;
+  unsigned encoder_threads = 0;
+  bool receiver_reports = true;
+  bool nack = true;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--simulate-loss" && i + 1 < argc) {
+      simulated_loss = std::stod(argv[++i]);
+    } else if (arg == "--comfort-noise") {
+      comfort_noise = true;
+    } else if (arg == "--multicast") {
+      // optional group address right after the flag
+      group = DEFAULT_MULTICAST_GROUP;
+      if (i + 1 < argc && IN_MULTICAST(ntohl(inet_addr(argv[i + 1])))) {
+        group = argv[++i];
+      }
+      group_mode = true;
+    } else if (arg == "--broadcast") {
+      group.clear();
+      group_mode = true;
+    } else if (arg == "--stats") {
+      // optional poll interval in seconds right after the flag
+      stats_interval_s = 1.0;
+      if (i + 1 < argc && is_positive_number(argv[i + 1])) {
+        stats_interval_s = std::stod(argv[++i]);
+      }
+    } else if (arg == "--debug") {
+      // optional packet interval right after the flag
+      debug_interval = 50;
+      if (i + 1 < argc && is_positive_number(argv[i + 1])) {
+        debug_interval = std::stoull(argv[++i]);
+      }
+    } else if (arg == "--rcvbuf" && i + 1 < argc) {
+      receive_buffer = std::stoi(argv[++i]);
+    } else if (arg == "--no-batch") {
+      batch_receive = false;
+    } else if (arg == "--no-reports") {
+      receiver_reports = false;
+    } else if (arg == "--no-nack") {
+      nack = false;
+    } else if (arg == "--segment-seconds" && i + 1 < argc) {
+      segment_seconds = std::stoul(argv[++i]);
+    } else if (arg == "--segment-mb" && i + 1 < argc) {
+      segment_bytes = std::stoull(argv[++i]) << 20;
+    } else if (arg == "--flac") {
+      format = RecordingFormat::FLAC;
+    } else if (arg == "--encoder-threads" && i + 1 < argc) {
+      encoder_threads = std::stoul(argv[++i]);
+    } else if (arg == "--stats-count" && i + 1 < argc) {
+      stats_count = std::stoull(argv[++i]);
+    } else if (arg == "--devices" && i + 1 < argc) {
+      // comma separated, one channel each even if there is just one
+      std::istringstream list(argv[++i]);
+      std::string address;
+      while (std::getline(list, address, ',')) {
+        addresses.push_back(parse_device_address(address));
+      }
+      multi_device = true;
+    } else if (arg == "--align" && i + 1 < argc) {
+      arrival_alignment = std::string(argv[++i]) == "arrival";
+    } else {
+      addresses.push_back(parse_device_address(arg));
+    }
+  }
+  if (addresses.empty()) {
+    addresses.push_back(parse_device_address("192.168.4.1"));
+  }
+  multi_device = multi_device || addresses.size() > 1;
+  const char *extension = format == RecordingFormat::FLAC ? "*.flac" : "*.wav";
+
+  // poll the device's counters instead of recording its stream
+  if (stats_interval_s > 0) {
+    StatsMonitor monitor(addresses[0].ip, addresses[0].port,
+                         stats_interval_s);
+    global_monitor = &monitor;
+    install_signal_handlers();
+    monitor.run(stats_count);
+    global_monitor = nullptr;
+    return 0;
+  }
 
-  if (argc > 1) {
-    server_ip = argv[1];
+  // several devices, one interleaved recording
+  if (multi_device) {
+#ifdef __linux__
+    MultiDeviceClient client(addresses);
+    client.set_align_mode(arrival_alignment
+                              ? MultiDeviceClient::AlignMode::ARRIVAL
+                              : MultiDeviceClient::AlignMode::SEQUENCE);
+    client.set_comfort_noise(comfort_noise);
+    client.set_receiver_reports(receiver_reports);
+    client.set_nack(nack);
+    client.set_rotation(segment_seconds, segment_bytes);
+    client.set_format(format, encoder_threads);
+    if (receive_buffer >= 0) {
+      client.set_receive_buffer(receive_buffer);
+    }
+    install_signal_handlers();
+    if (!client.start_receiving()) {
+      std::cout << "Failed to start client" << std::endl;
+      return 1;
+    }
+    std::cout << "Recording " << addresses.size()
+              << " devices, one channel each, to: "
+              << client.get_recording_name() << extension << std::endl;
+    std::cout << "Press Ctrl+C to stop recording..." << std::endl;
+    while (!stop_requested) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    std::cout << "\nStopping recording..." << std::endl;
+    client.close();
+    return 0;
+#else
+    std::cerr << "Recording several devices needs Linux (epoll)" << std::endl;
+    return 1;
+#endif
   }
 
-  UDPClient client(server_ip);
-  global_client = &client;
+  UDPClient client(addresses[0].ip, addresses[0].port);
+  client.set_simulated_loss(simulated_loss);
+  client.set_comfort_noise(comfort_noise);
+  client.set_receiver_reports(receiver_reports);
+  client.set_nack(nack);
+  client.set_debug_interval(debug_interval);
+  client.set_batch_receive(batch_receive);
+  if (receive_buffer >= 0) {
+    client.set_receive_buffer(receive_buffer);
+  }
+  if (group_mode) {
+    client.set_group(group);
+  }
+  client.set_rotation(segment_seconds, segment_bytes);
+  client.set_format(format, encoder_threads);
 
-  // Set up signal handler for clean termination
-  signal(SIGINT, signal_handler);
+  install_signal_handlers();
 
   try {
     if (!client.start_receiving()) {
@@ -362,14 +921,14 @@ int main(int argc, char *argv[]) {
 
     std::cout << "UDP Client started, connecting to " << client.get_server_ip()
               << ":" << client.get_server_port() << std::endl;
-    std::cout << "Audio will be saved to: " << client.get_wav_filename()
-              << std::endl;
+    std::cout << "Audio will be saved to: " << client.get_recording_name()
+              << extension << std::endl;
     std::cout << "Press Ctrl+C to stop recording..." << std::endl;
 
-    // Keep main thread alive
-    while (true) {
-      std::this_thread::sleep_for(std::chrono::seconds(1));
+    while (!stop_requested) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
     }
+    std::cout << "\nStopping recording..." << std::endl;
   } catch (const std::exception &e) {
     std::cerr << "Error: " << e.what() << std::endl;
   }
@@ -43,6 +43,18 @@ class UDPClient:
         self.wav_file.setframerate(self.sample_rate)
         print(f"Created new WAV file: {self.wav_filename}")
 
+    def set_sample_rate(self, rate):
+        print(f"\nStream sample rate: {rate} Hz")
+        written = self.wav_file.getnframes() > 0
+        self.wav_file.close()
+        if written:
+            print(f"Saved audio file: {self.wav_filename}")
+            timestamp = datetime.now().strftime("%Y%m%d_%H%M%S")
+            self.wav_filename = f'audio_{timestamp}_{rate // 1000}k.wav'
+        self.sample_rate = rate
+        self.wav_file = None
+        self.init_wav_file()
+
     def connect(self):
         print(f"Trying to connect to {self.server_ip}:{self.server_port}...")
         try:
@@ -70,9 +82,15 @@ class UDPClient:
         return True
 
     def _stats_loop(self):
+        last_keepalive_time = time.time()
         while self.running:
             time.sleep(0.2)  # update every 0.2 seconds
             current_time = time.time()
+
+            # the server drops listeners it has not heard from for 10 seconds
+            if current_time - last_keepalive_time >= 2.0:
+                self.sock.sendto(bytes([3, 1, 0, 0]), (self.server_ip, self.server_port))  # KEEPALIVE
+                last_keepalive_time = current_time
             
             elapsed = current_time - self.last_update_time
             bytes_per_second = self.bytes_since_last_update / elapsed if elapsed > 0 else 0
@@ -93,19 +111,39 @@ class UDPClient:
             try:
                 data, addr = self.sock.recvfrom(2048)  # increase the receive buffer to adapt to 480 sampling points
                 
-                # directly convert the received data to int16 array
-                int16_data = np.frombuffer(data, dtype='<i2')
-                
-                
-                if len(int16_data) >= 482 and int16_data[0] == 0 and int16_data[1] == 0:
-                    int16_data = int16_data[2:]
-                    print(f"\nSkipped 2 leading zeros, remaining samples: {len(int16_data)}")
+                # skip the message header (type, version, codec, reserved); protocol version 1+
+                # adds an 8-byte data header (sequence, sample index) in front of the samples
+                if len(data) < 4 or data[0] != 0:
+                    continue
+                if data[2] not in (0, 2):
+                    # compressed (e.g. IMA-ADPCM) streams are only decoded by udp_client.cpp
+                    continue
+                header_size = 4 + (8 if data[1] >= 1 else 0)
+
+                # version 1 carries the capture rate in kHz (0 in older firmware = 16 kHz),
+                # a wav file has a single rate so a change starts a new file
+                rate = data[3] * 1000 if data[1] >= 1 and data[3] else 16000
+                if rate != self.sample_rate:
+                    self.set_sample_rate(rate)
+
+                if data[2] == 2:
+                    # silence descriptor (samples u32, noise rms u16, reserved u16): the
+                    # server's vad left this many samples out, write them as silence
+                    if len(data) < header_size + 8:
+                        continue
+                    samples = int.from_bytes(data[header_size:header_size + 4], 'little')
+                    if samples > 2 * self.sample_rate:
+                        continue
+                    int16_data = np.zeros(samples, dtype='<i2')
+                else:
+                    # directly convert the received data to int16 array
+                    int16_data = np.frombuffer(data[header_size:], dtype='<i2')
                 
-                if len(int16_data) > 0:
+                if len(int16_data) > 0 and data[2] == 0:
                     print(f"First 8 samples: {int16_data[:8]}")
                     print(f"Data range: min={int16_data.min()}, max={int16_data.max()}, mean={int16_data.mean():.2f}")
                 
-                # only write the valid audio data (skip the first two samples)
+                # only write the audio data
                 self.wav_file.writeframes(int16_data.tobytes())
                 
                 # update the statistics (use the actual audio data size)
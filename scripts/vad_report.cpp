@@ -0,0 +1,249 @@
+// Host report for the firmware's voice activity detection: runs
+// main/audio/vad.cpp over recorded WAV files with the same packetization and
+// silence runs as AudioProcessor::SendData and prints how many datagram bytes
+// the stream needs with and without it. Recordings made by udp_client.cpp
+// (with VAD off on the device) are a good corpus; only 16-bit PCM is read and
+// the first channel of a multichannel file is used.
+//
+// Build: g++ -std=gnu++20 -O2 -I../main/audio -o vad_report vad_report.cpp ../main/audio/vad.cpp
+// Run:   ./vad_report [--threshold dbfs] [--margin db] [--zcr hz]
+//                     [--hangover ms] [--adpcm] [--dump] file.wav...
+#include "vad.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+
+// mirrors AudioProcessor::Start and udp_protocol.h
+const size_t READ_PERIOD_MS = 30;
+const size_t MAX_SAMPLES_PER_PACKET = 720;
+const size_t DATA_HEADERS_SIZE = 12;
+const size_t SILENCE_DESCRIPTOR_SIZE = 8;
+const uint32_t SILENCE_RUN_MS = 300;
+
+struct Recording {
+  uint32_t sample_rate = 0;
+  std::vector<int16_t> samples;
+};
+
+struct Result {
+  double seconds = 0;
+  size_t packets = 0;
+  size_t suppressed_packets = 0;
+  size_t descriptors = 0;
+  uint64_t bytes_without_vad = 0;
+  uint64_t bytes_with_vad = 0;
+};
+
+uint32_t read_u32(const char *p) {
+  uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+uint16_t read_u16(const char *p) {
+  uint16_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+bool load_wav(const std::string &path, Recording &recording) {
+  std::ifstream file(path, std::ios::binary);
+  std::vector<char> data((std::istreambuf_iterator<char>(file)),
+                         std::istreambuf_iterator<char>());
+  // udp_client.cpp switches to RF64 (ds64 chunk, 32-bit sizes 0xFFFFFFFF)
+  // past 4 GB
+  if (data.size() < 12 ||
+      (std::memcmp(data.data(), "RIFF", 4) != 0 &&
+       std::memcmp(data.data(), "RF64", 4) != 0) ||
+      std::memcmp(data.data() + 8, "WAVE", 4) != 0) {
+    std::cerr << path << ": not a WAV file" << std::endl;
+    return false;
+  }
+
+  uint16_t channels = 0, bits = 0, format = 0;
+  size_t pos = 12;
+  while (pos + 8 <= data.size()) {
+    const char *chunk = data.data() + pos;
+    size_t size = read_u32(chunk + 4);
+    size_t body = pos + 8;
+    // 0 (older clients killed mid-recording) or 0xFFFFFFFF (RF64): up to the
+    // end of the file
+    size_t available = std::min(size == 0 ? data.size() - body : size,
+                                data.size() - body);
+
+    if (std::memcmp(chunk, "fmt ", 4) == 0 && available >= 16) {
+      format = read_u16(data.data() + body);
+      channels = read_u16(data.data() + body + 2);
+      recording.sample_rate = read_u32(data.data() + body + 4);
+      bits = read_u16(data.data() + body + 14);
+    } else if (std::memcmp(chunk, "data", 4) == 0) {
+      if (format != 1 || bits != 16 || channels == 0) {
+        std::cerr << path << ": only 16-bit PCM is supported" << std::endl;
+        return false;
+      }
+      size_t frames = available / (2 * channels);
+      recording.samples.resize(frames);
+      for (size_t i = 0; i < frames; i++) {
+        std::memcpy(&recording.samples[i], data.data() + body + i * 2 * channels,
+                    sizeof(int16_t));
+      }
+      return recording.sample_rate > 0;
+    }
+    pos = body + size + (size & 1);
+  }
+  std::cerr << path << ": no data chunk" << std::endl;
+  return false;
+}
+
+size_t payload_bytes(size_t samples, bool adpcm) {
+  return adpcm ? 4 + (samples + 1) / 2 : samples * sizeof(int16_t);
+}
+
+Result run(const Recording &recording, const VadConfig &config, bool adpcm,
+           bool dump) {
+  Result result;
+  uint32_t rate = recording.sample_rate;
+  result.seconds = static_cast<double>(recording.samples.size()) / rate;
+
+  size_t period_samples = rate / 1000 * READ_PERIOD_MS;
+  size_t packets = (period_samples + MAX_SAMPLES_PER_PACKET - 1) /
+                   MAX_SAMPLES_PER_PACKET;
+  size_t samples_per_packet = (period_samples + packets - 1) / packets;
+  uint32_t silence_run_max = rate / 1000 * SILENCE_RUN_MS;
+
+  VoiceActivityDetector vad;
+  vad.Configure(config, rate);
+  uint32_t silence_run = 0;
+
+  for (size_t offset = 0; offset < recording.samples.size();
+       offset += samples_per_packet) {
+    size_t count =
+        std::min(samples_per_packet, recording.samples.size() - offset);
+    size_t datagram = DATA_HEADERS_SIZE + payload_bytes(count, adpcm);
+    result.packets++;
+    result.bytes_without_vad += datagram;
+
+    vad.BeginFrame();
+    vad.Accumulate({recording.samples.data() + offset, count});
+    bool voiced = vad.EndFrame();
+    if (dump) {
+      std::cout << std::fixed << std::setprecision(3)
+                << static_cast<double>(offset) / rate << "s "
+                << std::setprecision(1) << vad.frame_energy_dbfs()
+                << " dBFS floor " << vad.noise_floor_dbfs() << " "
+                << (voiced ? "voice" : "silence") << "\n";
+    }
+
+    if (!voiced) {
+      result.suppressed_packets++;
+      silence_run += count;
+      if (silence_run >= silence_run_max) {
+        result.descriptors++;
+        result.bytes_with_vad += DATA_HEADERS_SIZE + SILENCE_DESCRIPTOR_SIZE;
+        silence_run = 0;
+      }
+      continue;
+    }
+    if (silence_run > 0) {
+      result.descriptors++;
+      result.bytes_with_vad += DATA_HEADERS_SIZE + SILENCE_DESCRIPTOR_SIZE;
+      silence_run = 0;
+    }
+    result.bytes_with_vad += datagram;
+  }
+  if (silence_run > 0) {
+    result.descriptors++;
+    result.bytes_with_vad += DATA_HEADERS_SIZE + SILENCE_DESCRIPTOR_SIZE;
+  }
+  return result;
+}
+
+void print(const std::string &name, const Result &r) {
+  double reduction = r.bytes_without_vad > 0
+                         ? 100.0 * (1.0 - static_cast<double>(r.bytes_with_vad) /
+                                              r.bytes_without_vad)
+                         : 0.0;
+  std::cout << std::left << std::setw(32) << name << std::right << std::fixed
+            << std::setprecision(1) << std::setw(8) << r.seconds << "s"
+            << std::setw(9) << r.packets << std::setw(8)
+            << (r.packets > 0 ? 100.0 * r.suppressed_packets / r.packets : 0.0)
+            << "%" << std::setw(8) << r.descriptors << std::setw(12)
+            << r.bytes_without_vad << std::setw(12) << r.bytes_with_vad
+            << std::setw(9) << reduction << "%" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  VadConfig config;
+  bool adpcm = false;
+  bool dump = false;
+  std::vector<std::string> files;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--threshold" && i + 1 < argc) {
+      config.energy_threshold_dbfs = std::strtof(argv[++i], nullptr);
+    } else if (arg == "--margin" && i + 1 < argc) {
+      config.noise_margin_db = std::strtof(argv[++i], nullptr);
+    } else if (arg == "--zcr" && i + 1 < argc) {
+      config.zcr_threshold_hz = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--hangover" && i + 1 < argc) {
+      config.hangover_ms = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--adpcm") {
+      adpcm = true;
+    } else if (arg == "--dump") {
+      dump = true;
+    } else {
+      files.push_back(arg);
+    }
+  }
+  if (files.empty()) {
+    std::cerr << "usage: " << argv[0]
+              << " [--threshold dbfs] [--margin db] [--zcr hz] [--hangover ms]"
+                 " [--adpcm] [--dump] file.wav..."
+              << std::endl;
+    return 1;
+  }
+
+  std::cout << (adpcm ? "IMA-ADPCM" : "PCM16") << " datagram bytes, threshold "
+            << config.energy_threshold_dbfs << " dBFS, margin "
+            << config.noise_margin_db << " dB, zcr " << config.zcr_threshold_hz
+            << " Hz, hangover " << config.hangover_ms << " ms\n\n";
+  std::cout << std::left << std::setw(32) << "file" << std::right
+            << std::setw(9) << "length" << std::setw(9) << "packets"
+            << std::setw(9) << "silent" << std::setw(8) << "runs"
+            << std::setw(12) << "bytes" << std::setw(12) << "with vad"
+            << std::setw(10) << "saved" << std::endl;
+
+  Result total;
+  for (const std::string &path : files) {
+    Recording recording;
+    if (!load_wav(path, recording)) {
+      continue;
+    }
+    Result result = run(recording, config, adpcm, dump);
+    print(path.substr(path.find_last_of('/') + 1), result);
+
+    total.seconds += result.seconds;
+    total.packets += result.packets;
+    total.suppressed_packets += result.suppressed_packets;
+    total.descriptors += result.descriptors;
+    total.bytes_without_vad += result.bytes_without_vad;
+    total.bytes_with_vad += result.bytes_with_vad;
+  }
+  if (files.size() > 1) {
+    print("total", total);
+  }
+  return 0;
+}